@@ -0,0 +1,79 @@
+/*
+ * Benchmarks for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bench.h"
+
+/*
+ * Count heap allocations by wrapping the C allocator, so benchmarks report
+ * allocs/op. This only works with glibc, which exports its allocator under
+ * __libc_* names; elsewhere, allocations aren't counted.
+ */
+
+#if defined(__GLIBC__)
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t count, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static atomic_uint_fast64_t allocs;
+
+void *malloc (size_t size)
+{
+	atomic_fetch_add_explicit (&allocs, 1, memory_order_relaxed);
+	return __libc_malloc (size);
+}
+
+void *calloc (size_t count, size_t size)
+{
+	atomic_fetch_add_explicit (&allocs, 1, memory_order_relaxed);
+	return __libc_calloc (count, size);
+}
+
+void *realloc (void *ptr, size_t size)
+{
+	atomic_fetch_add_explicit (&allocs, 1, memory_order_relaxed);
+	return __libc_realloc (ptr, size);
+}
+
+static uint64_t alloc_count ()
+{
+	return atomic_load_explicit (&allocs, memory_order_relaxed);
+}
+
+void bench_count_allocs ()
+{
+	bench_set_alloc_counter (alloc_count);
+}
+
+#else
+
+void bench_count_allocs () {}
+
+#endif
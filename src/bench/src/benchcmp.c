@@ -0,0 +1,551 @@
+/*
+ * Benchmark comparison for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "log.h"
+#include "map.h"
+#include "strings.h"
+#include "vector.h"
+
+/**
+ * ptklbenchcmp compares two `ptklbench --json` result files and prints a
+ * before/after table. For each benchmark, the change in median ns/op is
+ * tested for significance with a Mann-Whitney U test over the raw samples;
+ * a benchmark that is significantly slower by more than the threshold is a
+ * regression, and the exit status is EXIT_FAILURE if there are any.
+ *
+ *     ptklbench --json before.json
+ *     # ... make changes, rebuild ...
+ *     ptklbench --json after.json
+ *     ptklbenchcmp before.json after.json
+ */
+
+#define DEFAULT_THRESHOLD 5.0 /* percent */
+#define DEFAULT_ALPHA 0.05
+#define EXIT_ERROR 2
+
+typedef struct bench_samples {
+	string suite;
+	string name;
+	string key; /* suite + "/" + name */
+	size_t count;
+	double *samples;
+	double allocs; /* per op, or -1 if not counted */
+} bench_samples;
+
+typedef struct bench_file {
+	const char *path;
+	vector runs; /* bench_samples*, in file order */
+	map index;   /* key -> bench_samples* */
+} bench_file;
+
+
+/*
+ * Minimal JSON reader: just enough to read the format written by
+ * run_benches (bench.c). Unknown keys are skipped.
+ */
+
+typedef struct parser {
+	const char *path;
+	const char *p;
+	bool ok;
+} parser;
+
+static void parse_error (parser *ps, const char *what)
+{
+	if (ps->ok) log_error ("%s: invalid JSON: %s", ps->path, what);
+	ps->ok = false;
+}
+
+static void skip_ws (parser *ps)
+{
+	while (isspace ((unsigned char)*ps->p)) ps->p++;
+}
+
+static bool consume (parser *ps, char c)
+{
+	skip_ws (ps);
+	if (*ps->p != c) return false;
+	ps->p++;
+	return true;
+}
+
+static void expect (parser *ps, char c)
+{
+	if (!consume (ps, c)) {
+		char what[] = "expected 'x'";
+		what[10] = c;
+		parse_error (ps, what);
+	}
+}
+
+static string parse_string (parser *ps)
+{
+	string s = string_new ("");
+	if (!consume (ps, '"')) {
+		parse_error (ps, "expected string");
+		return s;
+	}
+	char buf[2] = {};
+	while (ps->ok && *ps->p != '"') {
+		char c = *ps->p++;
+		if (c == '\0') {
+			parse_error (ps, "unterminated string");
+			break;
+		}
+		if (c == '\\') {
+			c = *ps->p++;
+			switch (c) {
+			case 'n':
+				c = '\n';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'u': {
+				/* only ASCII escapes are written by bench.c */
+				unsigned code = 0;
+				if (sscanf (ps->p, "%4x", &code) != 1) {
+					parse_error (ps, "invalid \\u escape");
+				}
+				ps->p += 4;
+				c = code < 0x80 ? (char)code : '?';
+				break;
+			}
+			case '\0':
+				parse_error (ps, "unterminated string");
+				break;
+			default: /* '"', '\\', '/' */
+				break;
+			}
+		}
+		buf[0] = c;
+		s = string_cat (s, buf);
+	}
+	if (ps->ok) ps->p++;
+	return s;
+}
+
+static double parse_number (parser *ps)
+{
+	skip_ws (ps);
+	char *end;
+	double d = strtod (ps->p, &end);
+	if (end == ps->p) parse_error (ps, "expected number");
+	ps->p = end;
+	return d;
+}
+
+static void skip_value (parser *ps);
+
+/* parse "{ key: value, ... }", calling fn for each key */
+static void parse_object (parser *ps, void *ctx,
+			  void (*fn) (parser *, void *, const char *key))
+{
+	expect (ps, '{');
+	if (consume (ps, '}')) return;
+	while (ps->ok) {
+		string key = parse_string (ps);
+		expect (ps, ':');
+		if (ps->ok) {
+			if (fn) fn (ps, ctx, key);
+			else skip_value (ps);
+		}
+		string_free (key);
+		if (consume (ps, '}')) return;
+		expect (ps, ',');
+	}
+}
+
+/* parse "[ value, ... ]", calling fn for each element */
+static void parse_array (parser *ps, void *ctx, void (*fn) (parser *, void *))
+{
+	expect (ps, '[');
+	if (consume (ps, ']')) return;
+	while (ps->ok) {
+		if (fn) fn (ps, ctx);
+		else skip_value (ps);
+		if (consume (ps, ']')) return;
+		expect (ps, ',');
+	}
+}
+
+static void skip_value (parser *ps)
+{
+	skip_ws (ps);
+	switch (*ps->p) {
+	case '{':
+		parse_object (ps, nullptr, nullptr);
+		break;
+	case '[':
+		parse_array (ps, nullptr, nullptr);
+		break;
+	case '"':
+		string_free (parse_string (ps));
+		break;
+	case 't':
+	case 'f':
+	case 'n':
+		while (isalpha ((unsigned char)*ps->p)) ps->p++;
+		break;
+	default:
+		parse_number (ps);
+		break;
+	}
+}
+
+static void parse_sample (parser *ps, void *ctx)
+{
+	bench_samples *b = ctx;
+	double d = parse_number (ps);
+	if (!ps->ok) return;
+	double *samples =
+		realloc (b->samples, sizeof (double) * (b->count + 1));
+	if (!samples) panic ("out of memory");
+	samples[b->count++] = d;
+	b->samples = samples;
+}
+
+static void parse_benchmark_key (parser *ps, void *ctx, const char *key)
+{
+	bench_samples *b = ctx;
+	if (strcmp (key, "suite") == 0) {
+		string_free (b->suite);
+		b->suite = parse_string (ps);
+	} else if (strcmp (key, "name") == 0) {
+		string_free (b->name);
+		b->name = parse_string (ps);
+	} else if (strcmp (key, "samples") == 0) {
+		parse_array (ps, b, parse_sample);
+	} else if (strcmp (key, "allocs") == 0) {
+		b->allocs = parse_number (ps);
+	} else {
+		skip_value (ps);
+	}
+}
+
+static void free_samples (bench_samples *b)
+{
+	string_free (b->suite);
+	string_free (b->name);
+	string_free (b->key);
+	free (b->samples);
+	free (b);
+}
+
+static void parse_benchmark (parser *ps, void *ctx)
+{
+	bench_file *file = ctx;
+	bench_samples *b = calloc (1, sizeof (bench_samples));
+	if (!b) panic ("out of memory");
+	b->suite = string_new ("");
+	b->name = string_new ("");
+	b->allocs = -1;
+	parse_object (ps, b, parse_benchmark_key);
+
+	if (!ps->ok || b->count == 0) {
+		if (ps->ok) {
+			log_error ("%s: %s has no samples", ps->path, b->name);
+		}
+		free_samples (b);
+		return;
+	}
+	b->key = string_format ("%s/%s", b->suite, b->name);
+	if (map_get (&file->index, b->key)) {
+		log_error ("%s: duplicate benchmark %s", ps->path, b->key);
+		free_samples (b);
+		return;
+	}
+	vector_add (&file->runs, b);
+	map_put (&file->index, b->key, b);
+}
+
+static void parse_top_key (parser *ps, void *ctx, const char *key)
+{
+	if (strcmp (key, "benchmarks") == 0) {
+		parse_array (ps, ctx, parse_benchmark);
+	} else {
+		skip_value (ps);
+	}
+}
+
+static char *read_file (const char *path)
+{
+	FILE *f = fopen (path, "rb");
+	if (!f) return nullptr;
+	string s = string_new ("");
+	char buf[4096];
+	size_t n;
+	while ((n = fread (buf, 1, sizeof (buf) - 1, f)) > 0) {
+		buf[n] = '\0';
+		s = string_cat (s, buf);
+	}
+	fclose (f);
+	return s;
+}
+
+static void free_file (bench_file *file)
+{
+	for (size_t i = 0; i < vector_size (&file->runs); i++) {
+		free_samples (vector_get (&file->runs, i));
+	}
+	vector_free (&file->runs);
+	map_free (&file->index);
+}
+
+static bool load_file (bench_file *file, const char *path)
+{
+	*file = (bench_file){.path = path};
+	vector_init (&file->runs);
+	map_init (&file->index);
+
+	string text = read_file (path);
+	if (!text) {
+		log_error ("unable to read %s", path);
+		return false;
+	}
+	parser ps = {.path = path, .p = text, .ok = true};
+	parse_object (&ps, file, parse_top_key);
+	string_free (text);
+
+	if (ps.ok && vector_size (&file->runs) == 0) {
+		log_error ("%s: no benchmarks", path);
+		ps.ok = false;
+	}
+	return ps.ok;
+}
+
+
+/*
+ * Comparison
+ */
+
+typedef enum verdict {
+	SAME,
+	FASTER,
+	SLOWER, /* significant, but within the threshold */
+	REGRESSION,
+	ADDED,
+	REMOVED,
+} verdict;
+
+static const char *verdict_label[] = {
+	[SAME] = "~",
+	[FASTER] = "faster",
+	[SLOWER] = "slower",
+	[REGRESSION] = "REGRESSION",
+	[ADDED] = "added",
+	[REMOVED] = "removed",
+};
+
+typedef struct options {
+	double threshold;
+	double alpha;
+	bool markdown;
+	const char *before;
+	const char *after;
+} options;
+
+static double median_of (const bench_samples *b)
+{
+	double *copy = malloc (sizeof (double) * b->count);
+	if (!copy) panic ("out of memory");
+	memcpy (copy, b->samples, sizeof (double) * b->count);
+	bench_stats stats = bench_compute_stats (copy, b->count);
+	free (copy);
+	return stats.median;
+}
+
+static void print_header (const options *opts, int width)
+{
+	if (opts->markdown) {
+		printf ("| benchmark | before (ns/op) | after (ns/op) | delta "
+			"| p | allocs/op | |\n");
+		printf ("|---|--:|--:|--:|--:|--:|---|\n");
+	} else {
+		printf ("%-*s %14s %14s %9s %8s %16s\n", width, "benchmark",
+			"before ns/op", "after ns/op", "delta", "p",
+			"allocs/op");
+	}
+}
+
+static void print_row (const options *opts, int width, const char *name,
+		       const bench_samples *before, const bench_samples *after,
+		       double delta, double p, verdict v)
+{
+	char b[32] = "-", a[32] = "-", d[32] = "-", pv[32] = "-";
+	char allocs[64] = "-";
+	if (before) snprintf (b, sizeof (b), "%.1f", median_of (before));
+	if (after) snprintf (a, sizeof (a), "%.1f", median_of (after));
+	if (before && after) {
+		snprintf (d, sizeof (d), "%+.1f%%", delta);
+		snprintf (pv, sizeof (pv), "%.3f", p);
+		if (before->allocs >= 0 && after->allocs >= 0) {
+			snprintf (allocs, sizeof (allocs), "%.1f -> %.1f",
+				  before->allocs, after->allocs);
+		}
+	}
+
+	if (opts->markdown) {
+		printf ("| %s | %s | %s | %s | %s | %s | %s |\n", name, b, a, d,
+			pv, allocs, v == SAME ? "" : verdict_label[v]);
+	} else {
+		printf ("%-*s %14s %14s %9s %8s %16s  %s\n", width, name, b,
+			a, d, pv, allocs, v == SAME ? "" : verdict_label[v]);
+	}
+}
+
+static verdict compare (const options *opts, const bench_samples *before,
+			const bench_samples *after, double *delta, double *p)
+{
+	const double m0 = median_of (before);
+	const double m1 = median_of (after);
+	*delta = m0 > 0 ? (m1 - m0) / m0 * 100.0 : 0;
+	*p = bench_mann_whitney (before->samples, before->count,
+				 after->samples, after->count);
+
+	if (*p >= opts->alpha) return SAME;
+	if (*delta > opts->threshold) return REGRESSION;
+	if (*delta > 0) return SLOWER;
+	return FASTER;
+}
+
+static int run (const options *opts, bench_file *before, bench_file *after)
+{
+	int counts[REMOVED + 1] = {};
+
+	/* rows are named suite/name: widen the column to the longest */
+	int width = 40;
+	for (size_t i = 0; i < vector_size (&before->runs); i++) {
+		const bench_samples *b = vector_get (&before->runs, i);
+		int len = (int)strlen (b->key);
+		if (len > width) width = len;
+	}
+	for (size_t i = 0; i < vector_size (&after->runs); i++) {
+		const bench_samples *a = vector_get (&after->runs, i);
+		int len = (int)strlen (a->key);
+		if (len > width) width = len;
+	}
+
+	print_header (opts, width);
+	for (size_t i = 0; i < vector_size (&before->runs); i++) {
+		const bench_samples *b = vector_get (&before->runs, i);
+		const bench_samples *a = map_get (&after->index, b->key);
+		double delta = 0, p = 1;
+		verdict v = a ? compare (opts, b, a, &delta, &p) : REMOVED;
+		counts[v]++;
+		print_row (opts, width, b->key, b, a, delta, p, v);
+	}
+	for (size_t i = 0; i < vector_size (&after->runs); i++) {
+		const bench_samples *a = vector_get (&after->runs, i);
+		if (map_get (&before->index, a->key)) continue;
+		counts[ADDED]++;
+		print_row (opts, width, a->key, nullptr, a, 0, 1, ADDED);
+	}
+
+	printf ("\n%d regressions, %d faster, %d slower within %.1f%%, "
+		"%d unchanged (alpha %.3f)\n",
+		counts[REGRESSION], counts[FASTER], counts[SLOWER],
+		opts->threshold, counts[SAME], opts->alpha);
+	if (counts[ADDED] || counts[REMOVED]) {
+		printf ("%d added, %d removed\n", counts[ADDED],
+			counts[REMOVED]);
+	}
+	return counts[REGRESSION] ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage (const char *prog)
+{
+	fprintf (stderr,
+		 "usage: %s [--threshold PCT] [--alpha P] [--markdown] "
+		 "BEFORE.json AFTER.json\n\n"
+		 "  --threshold PCT  slowdown that counts as a regression "
+		 "(default: %.1f)\n"
+		 "  --alpha P        significance level (default: %.2f)\n"
+		 "  --markdown       print the table as markdown\n\n"
+		 "Exits %d if there are regressions, %d on errors.\n",
+		 prog, DEFAULT_THRESHOLD, DEFAULT_ALPHA, EXIT_FAILURE,
+		 EXIT_ERROR);
+}
+
+static bool parse_options (int argc, char **argv, options *opts)
+{
+	*opts = (options){
+		.threshold = DEFAULT_THRESHOLD,
+		.alpha = DEFAULT_ALPHA,
+	};
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		char *end = nullptr;
+		if (strcmp (arg, "--threshold") == 0 && i + 1 < argc) {
+			opts->threshold = strtod (argv[++i], &end);
+			if (*end || opts->threshold < 0) return false;
+		} else if (strcmp (arg, "--alpha") == 0 && i + 1 < argc) {
+			opts->alpha = strtod (argv[++i], &end);
+			if (*end || opts->alpha <= 0 || opts->alpha >= 1) {
+				return false;
+			}
+		} else if (strcmp (arg, "--markdown") == 0) {
+			opts->markdown = true;
+		} else if (arg[0] == '-' && arg[1] != '\0') {
+			return false;
+		} else if (!opts->before) {
+			opts->before = arg;
+		} else if (!opts->after) {
+			opts->after = arg;
+		} else {
+			return false;
+		}
+	}
+	return opts->before && opts->after;
+}
+
+int main (int argc, char **argv)
+{
+	register_signal_panic_handlers ();
+
+	options opts;
+	if (!parse_options (argc, argv, &opts)) {
+		usage (argv[0]);
+		return EXIT_ERROR;
+	}
+
+	bench_file before, after;
+	bool ok = load_file (&before, opts.before);
+	ok = load_file (&after, opts.after) && ok;
+
+	int status = ok ? run (&opts, &before, &after) : EXIT_ERROR;
+
+	free_file (&before);
+	free_file (&after);
+	return status;
+}
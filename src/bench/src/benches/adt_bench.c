@@ -0,0 +1,149 @@
+/*
+ * Benchmarks for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "adt.h"
+#include "bench.h"
+
+#define KEY_COUNT 1024
+
+static char keys[KEY_COUNT][16];
+
+static void init_keys ()
+{
+	if (keys[0][0] != '\0') return;
+	for (int i = 0; i < KEY_COUNT; i++) {
+		snprintf (keys[i], sizeof (keys[i]), "key%d", i);
+	}
+}
+
+/* list_add walks to the tail, so build fixed-size lists to keep the cost per
+ * op independent of n */
+static void bench_list_add_64 (bench *b)
+{
+	for (uint64_t i = 0; i < b->n; i++) {
+		list l;
+		list_init (&l);
+		for (int j = 0; j < 64; j++) list_add (&l, &l);
+		list_free (&l);
+	}
+}
+
+static void bench_list_get (bench *b)
+{
+	bench_timer_stop (b);
+	list l;
+	list_init (&l);
+	for (int i = 0; i < 64; i++) list_add (&l, &l);
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) bench_keep (list_get (&l, i % 64));
+
+	bench_timer_stop (b);
+	list_free (&l);
+}
+
+static void bench_stack_push_pop (bench *b)
+{
+	stack s;
+	stack_init (&s);
+	for (uint64_t i = 0; i < b->n; i++) {
+		stack_push (&s, &s);
+		bench_keep (stack_pop (&s));
+	}
+	bench_timer_stop (b);
+	stack_free (&s);
+}
+
+static void bench_vector_add (bench *b)
+{
+	vector v;
+	vector_init (&v);
+	for (uint64_t i = 0; i < b->n; i++) vector_add (&v, &v);
+	bench_timer_stop (b);
+	vector_free (&v);
+}
+
+static void bench_vector_get (bench *b)
+{
+	bench_timer_stop (b);
+	vector v;
+	vector_init (&v);
+	for (int i = 0; i < 1024; i++) vector_add (&v, &v);
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (vector_get (&v, i % 1024));
+	}
+
+	bench_timer_stop (b);
+	vector_free (&v);
+}
+
+static void bench_map_put (bench *b)
+{
+	bench_timer_stop (b);
+	init_keys ();
+	map m;
+	map_init (&m);
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		map_put (&m, keys[i % KEY_COUNT], &m);
+	}
+
+	bench_timer_stop (b);
+	map_free (&m);
+}
+
+static void bench_map_get (bench *b)
+{
+	bench_timer_stop (b);
+	init_keys ();
+	map m;
+	map_init (&m);
+	for (int i = 0; i < KEY_COUNT; i++) map_put (&m, keys[i], &m);
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (map_get (&m, keys[i % KEY_COUNT]));
+	}
+
+	bench_timer_stop (b);
+	map_free (&m);
+}
+
+void adt_bench ()
+{
+	benchmark (bench_list_add_64);
+	benchmark (bench_list_get);
+	benchmark (bench_stack_push_pop);
+	benchmark (bench_vector_add);
+	benchmark (bench_vector_get);
+	benchmark (bench_map_put);
+	benchmark (bench_map_get);
+}
@@ -0,0 +1,154 @@
+/*
+ * Benchmarks for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "bench.h"
+
+/*
+ * A request's allocations, roughly as a JS heap sees them: mostly small
+ * objects and strings, some of them freed along the way, arrays that
+ * grow, and at the end everything that's left is freed (one at a time
+ * with malloc, in one reset with an arena).
+ */
+
+#define REQUEST_OPS 20000
+#define REQUEST_SLOTS 4096
+
+typedef struct allocator {
+	void *(*alloc) (void *state, size_t size);
+	void *(*resize) (void *state, void *p, size_t size);
+	void (*release) (void *state, void *p);
+	void (*end) (void *state, void **live, size_t count);
+	void *state;
+} allocator;
+
+static void *request (const allocator *a, void **live)
+{
+	uint32_t rng = 12345;
+	memset (live, 0, REQUEST_SLOTS * sizeof (void *));
+	for (int i = 0; i < REQUEST_OPS; i++) {
+		rng = rng * 1103515245 + 12345;
+		uint32_t r = rng >> 8;
+		size_t slot = r % REQUEST_SLOTS;
+		void *p = live[slot];
+		if (r % 10 < 7 || !p) {
+			/* mostly 16-96 bytes: objects, shapes, short strings */
+			size_t size = 16 + (r >> 4) % 80;
+			if (r % 32 == 0) size = 256 + (r >> 4) % 4096;
+			if (p) a->release (a->state, p);
+			p = a->alloc (a->state, size);
+			memset (p, 0, 16);
+		} else if (r % 10 < 9) {
+			a->release (a->state, p);
+			p = nullptr;
+		} else {
+			/* an array growing */
+			p = a->resize (a->state, p, 64 + (r >> 4) % 2048);
+		}
+		live[slot] = p;
+	}
+	a->end (a->state, live, REQUEST_SLOTS);
+	return live;
+}
+
+static void *malloc_alloc (void *state, size_t size)
+{
+	return malloc (size);
+}
+
+static void *malloc_resize (void *state, void *p, size_t size)
+{
+	return realloc (p, size);
+}
+
+static void malloc_release (void *state, void *p)
+{
+	free (p);
+}
+
+static void malloc_end (void *state, void **live, size_t count)
+{
+	for (size_t i = 0; i < count; i++) free (live[i]);
+}
+
+static void *arena_alloc_fn (void *state, size_t size)
+{
+	return arena_alloc (state, size);
+}
+
+static void *arena_resize_fn (void *state, void *p, size_t size)
+{
+	return arena_resize (state, p, size);
+}
+
+static void arena_release_fn (void *state, void *p)
+{
+	arena_release (state, p);
+}
+
+static void arena_end (void *state, void **live, size_t count)
+{
+	arena_reset (state);
+}
+
+static void bench_request_malloc (bench *b)
+{
+	void **live = malloc (REQUEST_SLOTS * sizeof (void *));
+	allocator a = {
+		.alloc = malloc_alloc,
+		.resize = malloc_resize,
+		.release = malloc_release,
+		.end = malloc_end,
+	};
+	for (uint64_t i = 0; i < b->n; i++) bench_keep (request (&a, live));
+	bench_timer_stop (b);
+	free (live);
+}
+
+static void bench_request_arena (bench *b)
+{
+	void **live = malloc (REQUEST_SLOTS * sizeof (void *));
+	allocator a = {
+		.alloc = arena_alloc_fn,
+		.resize = arena_resize_fn,
+		.release = arena_release_fn,
+		.end = arena_end,
+		.state = arena_new (0),
+	};
+	for (uint64_t i = 0; i < b->n; i++) bench_keep (request (&a, live));
+	bench_timer_stop (b);
+	arena_free (a.state);
+	free (live);
+}
+
+void arena_bench ()
+{
+	benchmark (bench_request_malloc);
+	benchmark (bench_request_arena);
+}
@@ -0,0 +1,192 @@
+/*
+ * Benchmarks for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "command.h"
+#include "completion.h"
+
+static command new_command_tree ()
+{
+	command root = command_new ("ptkl", "root command", nullptr);
+	command_flag (root, 'a', "alpha", NO_ARGUMENT, "alpha flag");
+	command_flag (root, 'b', "bravo", REQUIRED_ARGUMENT, "bravo flag");
+	command_flag (root, 'c', "charlie", NO_ARGUMENT, "charlie flag");
+
+	command sub = command_add (root, "run", "subcommand", nullptr);
+	command_flag (sub, 'd', "delta", NO_ARGUMENT, "delta flag");
+	command_flag (sub, 'e', "echo", REQUIRED_ARGUMENT, "echo flag");
+	return root;
+}
+
+/*
+ * A 4-level tree with 50 flags: 14 on the root and 12 on each of the
+ * nested subcommands (every 4th flag takes an argument).
+ */
+static void add_flags (command cmd, const char *prefix, char first, int count)
+{
+	for (int i = 0; i < count; i++) {
+		char name[16];
+		snprintf (name, sizeof (name), "%s%d", prefix, i);
+		command_flag (cmd, (char)(first + i), name,
+			      i % 4 == 1 ? REQUIRED_ARGUMENT : NO_ARGUMENT,
+			      "generated flag");
+	}
+}
+
+static command new_deep_command_tree ()
+{
+	command root = command_new ("ptkl", "root command", nullptr);
+	add_flags (root, "root", 'a', 14);
+	command one = command_add (root, "one", "level 1", nullptr);
+	add_flags (one, "one", 'o', 12);
+	command two = command_add (one, "two", "level 2", nullptr);
+	add_flags (two, "two", 'A', 12);
+	command three = command_add (two, "three", "level 3", nullptr);
+	add_flags (three, "three", 'M', 12);
+	command_expect_args (three, COMMAND_ARGS_ANY);
+	return root;
+}
+
+static void bench_command_new_free (bench *b)
+{
+	for (uint64_t i = 0; i < b->n; i++) {
+		command root = new_command_tree ();
+		command_free (root);
+	}
+}
+
+static void bench_command_run_flags (bench *b)
+{
+	bench_timer_stop (b);
+	command root = new_command_tree ();
+	char *args[] = {"ptkl", "-a", "--bravo", "value", "--charlie"};
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (command_run (root, 5, args));
+	}
+
+	bench_timer_stop (b);
+	command_free (root);
+}
+
+static void bench_command_run_subcommand (bench *b)
+{
+	bench_timer_stop (b);
+	command root = new_command_tree ();
+	char *args[] = {"ptkl", "-a", "run", "-d", "--echo=value"};
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (command_run (root, 5, args));
+	}
+
+	bench_timer_stop (b);
+	command_free (root);
+}
+
+static void bench_command_run_deep (bench *b)
+{
+	bench_timer_stop (b);
+	command root = new_deep_command_tree ();
+	char *args[] = {
+		"ptkl",	   "-a",	 "--root5=x",  "one",
+		"-o",	   "--one9",	 "-pvalue",    "two",
+		"-A",	   "--two1=y",	 "--two11",    "three",
+		"-M",	   "--three0",	 "--three5=z", "file.js",
+	};
+	const int argc = sizeof (args) / sizeof (args[0]);
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (command_run (root, argc, args));
+	}
+
+	bench_timer_stop (b);
+	command_free (root);
+}
+
+/* object names, like a bucket listing */
+static completion_index *new_completion_index ()
+{
+	completion_index *idx = completion_new ();
+	char word[64];
+	for (int i = 0; i < 5000; i++) {
+		int len = snprintf (word, sizeof (word),
+				    "bucket-%d/objects/item-%04d.json", i % 7,
+				    i);
+		completion_add (idx, COMPLETION_ROOT, word, len,
+				COMPLETION_WORD);
+	}
+	return idx;
+}
+
+static void bench_completion_prefix_5000 (bench *b)
+{
+	bench_timer_stop (b);
+	completion_index *idx = new_completion_index ();
+	completion out[16];
+	completion_prefix (idx, COMPLETION_ROOT, "", 0, out, 16);
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (completion_prefix (idx, COMPLETION_ROOT,
+					       "bucket-3/objects/item-1", 23,
+					       out, 16));
+	}
+
+	bench_timer_stop (b);
+	completion_free (idx);
+}
+
+static void bench_completion_fuzzy_5000 (bench *b)
+{
+	bench_timer_stop (b);
+	completion_index *idx = new_completion_index ();
+	completion out[16];
+	completion_prefix (idx, COMPLETION_ROOT, "", 0, out, 16);
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (completion_fuzzy (idx, COMPLETION_ROOT, "b3it42", 6,
+					      out, 16));
+	}
+
+	bench_timer_stop (b);
+	completion_free (idx);
+}
+
+void cli_bench ()
+{
+	benchmark (bench_command_new_free);
+	benchmark (bench_command_run_flags);
+	benchmark (bench_command_run_subcommand);
+	benchmark (bench_command_run_deep);
+	benchmark (bench_completion_prefix_5000);
+	benchmark (bench_completion_fuzzy_5000);
+}
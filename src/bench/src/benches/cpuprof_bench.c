@@ -0,0 +1,93 @@
+/*
+ * Benchmarks for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "cpuprof.h"
+
+/*
+ * The CPU profiler's share of a sample: cpuprof_sample interning a
+ * 30-frame stack of recursive calls (like examples/fib.js's) and
+ * appending it, and the check the engine makes at every interrupt check.
+ * The stack capture itself is the engine's, and isn't measured here.
+ */
+
+#define FRAMES 30
+#define STACKS 8
+
+static char *stacks[STACKS];
+
+static void make_stacks ()
+{
+	for (int s = 0; s < STACKS; s++) {
+		size_t cap = FRAMES * 64, len = 0;
+		stacks[s] = malloc (cap);
+		if (!stacks[s]) abort ();
+		/* the same fib frames, under a different caller each */
+		for (int i = 0; i < FRAMES - 1; i++) {
+			len += snprintf (stacks[s] + len, cap - len,
+					 "fib (examples/fib.js:%d:%d)\n",
+					 3 + i % 2, 10 + i % 2);
+		}
+		snprintf (stacks[s] + len, cap - len,
+			  "main%d (examples/fib.js:%d:1)\n", s, 10 + s);
+	}
+}
+
+static void free_stacks ()
+{
+	for (int s = 0; s < STACKS; s++) free (stacks[s]);
+}
+
+static void bench_sample (bench *b)
+{
+	make_stacks ();
+	cpuprof *p = cpuprof_new (CPUPROF_DEFAULT_HZ);
+	for (uint64_t i = 0; i < b->n; i++) {
+		cpuprof_sample (p, stacks[i % STACKS]);
+	}
+	bench_timer_stop (b);
+	bench_keep (p);
+	cpuprof_free (p);
+	free_stacks ();
+}
+
+static void bench_due (bench *b)
+{
+	cpuprof *p = cpuprof_new (CPUPROF_DEFAULT_HZ);
+	bool due = false;
+	for (uint64_t i = 0; i < b->n; i++) due |= cpuprof_due (p);
+	bench_timer_stop (b);
+	bench_keep (&due);
+	cpuprof_free (p);
+}
+
+void cpuprof_bench ()
+{
+	benchmark (bench_sample);
+	benchmark (bench_due);
+}
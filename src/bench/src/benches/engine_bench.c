@@ -0,0 +1,274 @@
+/*
+ * Benchmarks for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "qjs.h"
+
+/* Engine setup: fresh engines against a warm pool (see engine_pool) */
+
+static const char APP[] = "globalThis.handle = (n) => ({status: 200, n});\n";
+static const char REQUEST[] = "globalThis.response = handle (1);\n";
+static const char PATCH[] = "globalThis.handle = (n) => ({status: 500, n});\n";
+
+static bool warm_app (engine *e, void *arg)
+{
+	return engine_eval_buf (e, APP, strlen (APP), "app.js", false);
+}
+
+static void bench_engine_new_free (bench *b)
+{
+	for (uint64_t i = 0; i < b->n; i++) {
+		engine *e = engine_new (nullptr);
+		bench_keep (e);
+		engine_free (e);
+	}
+}
+
+static void bench_engine_reset (bench *b)
+{
+	bench_timer_stop (b);
+	engine *e = engine_new (nullptr);
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (engine_reset (e));
+	}
+
+	bench_timer_stop (b);
+	engine_free (e);
+}
+
+static engine_pool *new_pool ()
+{
+	engine_pool_opts opts = {
+		.engine = ENGINE_OPTS_DEFAULT,
+		.size = 4,
+		.warm = warm_app,
+	};
+	return engine_pool_new (&opts);
+}
+
+static void bench_engine_pool_acquire_release (bench *b)
+{
+	bench_timer_stop (b);
+	engine_pool *pool = new_pool ();
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		engine *e = engine_pool_acquire (pool);
+		engine_pool_release (pool, e, true);
+	}
+
+	bench_timer_stop (b);
+	engine_pool_free (pool);
+}
+
+/* A request that adds a global, so release has something to scrub */
+static void bench_engine_pool_request (bench *b)
+{
+	bench_timer_stop (b);
+	engine_pool *pool = new_pool ();
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		engine *e = engine_pool_acquire (pool);
+		bool ok = engine_eval_buf (e, REQUEST, strlen (REQUEST),
+					   "request.js", false);
+		engine_pool_release (pool, e, ok);
+	}
+
+	bench_timer_stop (b);
+	engine_pool_free (pool);
+}
+
+/* A request that replaces a snapshot global: the scrub fails, and the
+   engine is replaced with a new warm one */
+static void bench_engine_pool_request_patch (bench *b)
+{
+	bench_timer_stop (b);
+	engine_pool *pool = new_pool ();
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		engine *e = engine_pool_acquire (pool);
+		bool ok = engine_eval_buf (e, PATCH, strlen (PATCH),
+					   "request.js", false);
+		engine_pool_release (pool, e, ok);
+	}
+
+	bench_timer_stop (b);
+	engine_pool_free (pool);
+}
+
+/* A request runtime with an allocation-heavy handler, on malloc and in an
+   arena (see arena.h) */
+
+static const char ALLOCS[] =
+	"const rows = [];\n"
+	"for (let i = 0; i < 2000; i++)\n"
+	"  rows.push ({id: i, name: 'row' + i, tags: ['a', String (i)]});\n"
+	"globalThis.out = JSON.stringify (rows.filter ((r) => r.id % 3));\n";
+
+static void request_runtime (bench *b, bool arena)
+{
+	engine_opts opts = ENGINE_OPTS_DEFAULT;
+	opts.arena = arena;
+	for (uint64_t i = 0; i < b->n; i++) {
+		engine *e = engine_new (&opts);
+		bench_keep (engine_eval_buf (e, ALLOCS, strlen (ALLOCS),
+					     "request.js", false));
+		engine_free (e);
+	}
+}
+
+static void bench_request_runtime_malloc (bench *b)
+{
+	request_runtime (b, false);
+}
+
+static void bench_request_runtime_arena (bench *b)
+{
+	request_runtime (b, true);
+}
+
+/* Startup of a 500-module app: loose files (compiled, or loaded from the
+   bytecode cache) against a bundle. The cached run's gain over the
+   compiled one is what run --cache-report estimates as saved time. */
+
+#define APP_MODULES 500
+
+static char app_main[64], app_bundle[64];
+
+/* main.js imports m0.js ... m499.js, each a few small functions */
+static bool write_app ()
+{
+	static bool written, ok;
+	if (written) return ok;
+	written = true;
+
+	char dir[48], path[96];
+	snprintf (dir, sizeof (dir), "/tmp/ptklbench-app-%d", (int)getpid ());
+	if (mkdir (dir, 0755) < 0) return false;
+
+	snprintf (app_main, sizeof (app_main), "%s/main.js", dir);
+	FILE *entry = fopen (app_main, "w");
+	if (!entry) return false;
+	for (int i = 0; i < APP_MODULES; i++) {
+		fprintf (entry, "import {f%d} from './m%d.js';\n", i, i);
+		snprintf (path, sizeof (path), "%s/m%d.js", dir, i);
+		FILE *m = fopen (path, "w");
+		if (!m) return false;
+		fprintf (m,
+			 "const table = [%d, %d, %d];\n"
+			 "function scale (x) { return x * table[x %% 3]; }\n"
+			 "export function f%d (x) { return scale (x) + %d; }\n",
+			 i, i + 1, i + 2, i, i);
+		fclose (m);
+	}
+	fclose (entry);
+
+	snprintf (app_bundle, sizeof (app_bundle), "%s/app.ptkl", dir);
+	engine *e = engine_new (nullptr);
+	bundle_writer *w = bundle_writer_new ();
+	ok = engine_bundle (e, app_main, w) &&
+		  bundle_writer_write (w, app_bundle);
+	bundle_writer_free (w);
+	engine_free (e);
+	return ok;
+}
+
+static void bench_startup_files (bench *b)
+{
+	bench_timer_stop (b);
+	if (!write_app ()) return;
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		engine *e = engine_new (nullptr);
+		bench_keep (engine_eval_file (e, app_main));
+		engine_free (e);
+	}
+}
+
+static void bench_startup_cached (bench *b)
+{
+	bench_timer_stop (b);
+	if (!write_app ()) return;
+	char dir[64];
+	snprintf (dir, sizeof (dir), "/tmp/ptklbench-cache-%d", (int)getpid ());
+	engine_opts opts = ENGINE_OPTS_DEFAULT;
+	opts.cache = codecache_open (dir, CODECACHE_DEFAULT_MAX);
+	if (!opts.cache) return;
+
+	/* fill the cache, so every iteration only hits */
+	engine *e = engine_new (&opts);
+	bench_keep (engine_eval_file (e, app_main));
+	engine_free (e);
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		e = engine_new (&opts);
+		bench_keep (engine_eval_file (e, app_main));
+		engine_free (e);
+	}
+	bench_timer_stop (b);
+	codecache_close (opts.cache);
+}
+
+static void bench_startup_bundle (bench *b)
+{
+	bench_timer_stop (b);
+	if (!write_app ()) return;
+	engine_opts opts = ENGINE_OPTS_DEFAULT;
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		opts.bundle = bundle_open (app_bundle);
+		engine *e = engine_new (&opts);
+		bench_keep (engine_eval_bundle (e));
+		engine_free (e);
+		bundle_close (opts.bundle);
+	}
+}
+
+void engine_bench ()
+{
+	benchmark (bench_engine_new_free);
+	benchmark (bench_engine_reset);
+	benchmark (bench_engine_pool_acquire_release);
+	benchmark (bench_engine_pool_request);
+	benchmark (bench_engine_pool_request_patch);
+	benchmark (bench_request_runtime_malloc);
+	benchmark (bench_request_runtime_arena);
+	benchmark (bench_startup_files);
+	benchmark (bench_startup_cached);
+	benchmark (bench_startup_bundle);
+}
@@ -0,0 +1,100 @@
+/*
+ * Benchmarks for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "heapprof.h"
+
+/*
+ * The cost of the heap profiler's hooks on an allocation-heavy request
+ * (the same mix as the arena benchmarks): every allocation and free goes
+ * through them, and about one allocation in 512 KB is sampled.
+ */
+
+#define REQUEST_OPS 20000
+#define REQUEST_SLOTS 4096
+
+static void *request (heapprof *p, void **live)
+{
+	uint32_t rng = 12345;
+	memset (live, 0, REQUEST_SLOTS * sizeof (void *));
+	for (int i = 0; i < REQUEST_OPS; i++) {
+		rng = rng * 1103515245 + 12345;
+		uint32_t r = rng >> 8;
+		size_t slot = r % REQUEST_SLOTS;
+		void *ptr = live[slot];
+		if (ptr) {
+			if (p) heapprof_release (p, ptr);
+			free (ptr);
+			ptr = nullptr;
+		}
+		if (r % 10 < 7) {
+			size_t size = 16 + (r >> 4) % 80;
+			if (r % 32 == 0) size = 256 + (r >> 4) % 4096;
+			ptr = malloc (size);
+			if (p) heapprof_alloc (p, nullptr, ptr, size);
+			memset (ptr, 0, 16);
+		}
+		live[slot] = ptr;
+	}
+	for (size_t i = 0; i < REQUEST_SLOTS; i++) {
+		if (p && live[i]) heapprof_release (p, live[i]);
+		free (live[i]);
+	}
+	return live;
+}
+
+static void bench_request_unprofiled (bench *b)
+{
+	void **live = malloc (REQUEST_SLOTS * sizeof (void *));
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (request (nullptr, live));
+	}
+	bench_timer_stop (b);
+	free (live);
+}
+
+static void bench_request_profiled (bench *b)
+{
+	void **live = malloc (REQUEST_SLOTS * sizeof (void *));
+	heapprof *p = heapprof_new (HEAPPROF_DEFAULT_INTERVAL);
+	for (uint64_t i = 0; i < b->n; i++) {
+		bench_keep (request (p, live));
+		/* what the engine does at its next interrupt check */
+		heapprof_set_stack (p, "handle (app.js:10:3)");
+	}
+	bench_timer_stop (b);
+	heapprof_free (p);
+	free (live);
+}
+
+void heapprof_bench ()
+{
+	benchmark (bench_request_unprofiled);
+	benchmark (bench_request_profiled);
+}
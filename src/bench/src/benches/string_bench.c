@@ -0,0 +1,86 @@
+/*
+ * Benchmarks for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "strings.h"
+
+static void bench_string_new_free (bench *b)
+{
+	for (uint64_t i = 0; i < b->n; i++) {
+		string s = string_new ("Partikle Runtime");
+		bench_escape (s);
+		string_free (s);
+	}
+}
+
+static void bench_string_cat (bench *b)
+{
+	string s = string_new ("");
+	for (uint64_t i = 0; i < b->n; i++) s = string_cat (s, "x");
+	bench_timer_stop (b);
+	string_free (s);
+}
+
+static void bench_string_cat_fmt (bench *b)
+{
+	string s = string_new ("");
+	for (uint64_t i = 0; i < b->n; i++) {
+		string_clear (s);
+		s = string_cat_fmt (s, "%s:%d", "flag", (int)i);
+	}
+	bench_timer_stop (b);
+	string_free (s);
+}
+
+static void bench_string_split_join (bench *b)
+{
+	bench_timer_stop (b);
+	string s = string_new ("a,bb,ccc,dddd,eeeee,ffffff,ggggggg,hhhhhhhh");
+	bench_timer_start (b);
+
+	for (uint64_t i = 0; i < b->n; i++) {
+		int count = 0;
+		string *tokens = string_split (s, ",", &count);
+		string joined = string_join_strings (tokens, count, ";");
+		bench_escape (joined);
+		string_free (joined);
+		for (int j = 0; j < count; j++) string_free (tokens[j]);
+		free (tokens);
+	}
+
+	bench_timer_stop (b);
+	string_free (s);
+}
+
+void string_bench ()
+{
+	benchmark (bench_string_new_free);
+	benchmark (bench_string_cat);
+	benchmark (bench_string_cat_fmt);
+	benchmark (bench_string_split_join);
+}
@@ -0,0 +1,57 @@
+/*
+ * Benchmarks for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "bench.h"
+#include "log.h"
+
+extern void bench_count_allocs ();
+
+extern void adt_bench ();
+extern void arena_bench ();
+extern void cli_bench ();
+extern void cpuprof_bench ();
+extern void engine_bench ();
+extern void heapprof_bench ();
+extern void string_bench ();
+
+int main (int argc, char **argv)
+{
+	register_signal_panic_handlers ();
+	bench_count_allocs ();
+
+	bench_suite benches[] = {
+		{.name = "libstd: adt benchmarks", .fn = adt_bench},
+		{.name = "libstd: string benchmarks", .fn = string_bench},
+		{.name = "libcli: CLI benchmarks", .fn = cli_bench},
+		{.name = "libqjs: arena benchmarks", .fn = arena_bench},
+		{.name = "libqjs: cpuprof benchmarks", .fn = cpuprof_bench},
+		{.name = "libqjs: engine benchmarks", .fn = engine_bench},
+		{.name = "libqjs: heapprof benchmarks", .fn = heapprof_bench},
+		{},
+	};
+
+	return run_benches (benches, argc, argv);
+}
@@ -0,0 +1,667 @@
+/*
+ * Cold-start benchmark for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ptrace.h>
+#endif
+
+#include "log.h"
+
+/**
+ * ptklstartbench measures cold start: it execs the ptkl binary hundreds of
+ * times per scenario and reports percentiles of
+ *
+ *     wall, user, and sys time
+ *     minor and major page faults
+ *     max RSS (high-water mark)
+ *     syscalls
+ *
+ * and a breakdown of where the wall time goes, from the marks ptkl writes
+ * when PTKL_STARTUP_FD is set (see ptkl_startup_mark in ptkl.h):
+ *
+ *     fork      fork until the child is about to exec
+ *     load      exec, dynamic loading, and libc init, until main
+ *     init      ptkl_init
+ *     commands  building the command tree
+ *     dispatch  parsing args and dispatching to the command
+ *     engine    engine init (ptkl run)
+ *     exit      the rest of the run, teardown, and reaping the process
+ *
+ * Syscalls and max RSS come from a few extra runs under ptrace (Linux),
+ * because tracing slows the process down, and because rusage would also
+ * count memory the child inherited from this process before exec. User and
+ * sys time are only as precise as the kernel's accounting (often a whole
+ * scheduler tick), so compare their means rather than their percentiles.
+ *
+ *     ptklstartbench --ptkl build/release/bin/ptkl --json start.json
+ */
+
+#define DEFAULT_RUNS 200
+#define DEFAULT_WARMUP 5
+#define DEFAULT_TRACED_RUNS 5
+#define MAX_MARKS 16
+#define MAX_PHASES 16
+#define PHASE_NAME_LEN 32
+
+typedef enum metric {
+	WALL,
+	USER,
+	SYS,
+	MINFLT,
+	MAJFLT,
+	MAXRSS,
+	SYSCALLS,
+	METRIC_COUNT,
+} metric;
+
+static const char *metric_label[] = {
+	[WALL] = "wall (us)",	       [USER] = "user (us)",
+	[SYS] = "sys (us)",	       [MINFLT] = "minor faults",
+	[MAJFLT] = "major faults",     [MAXRSS] = "max rss (KB)",
+	[SYSCALLS] = "syscalls",
+};
+
+static const char *metric_key[] = {
+	[WALL] = "wall_us",   [USER] = "user_us",     [SYS] = "sys_us",
+	[MINFLT] = "minflt",  [MAJFLT] = "majflt",    [MAXRSS] = "maxrss_kb",
+	[SYSCALLS] = "syscalls",
+};
+
+typedef struct scenario {
+	const char *name;
+	const char *args[4]; /* null-terminated */
+	const char *script;  /* skipped if this doesn't exist */
+} scenario;
+
+/* one exec of ptkl */
+typedef struct sample {
+	uint64_t start;
+	uint64_t end;
+	bool ok;
+	struct rusage usage;
+	long syscalls; /* traced runs only */
+	long maxrss;   /* KB, traced runs only */
+	size_t nmarks;
+	struct {
+		char name[PHASE_NAME_LEN];
+		uint64_t ns;
+	} marks[MAX_MARKS];
+} sample;
+
+typedef struct series {
+	double *values;
+	size_t count;
+} series;
+
+typedef struct phase {
+	char name[PHASE_NAME_LEN];
+	series times;
+} phase;
+
+typedef struct result {
+	const scenario *scenario;
+	int runs;
+	int failed;
+	series metrics[METRIC_COUNT];
+	phase phases[MAX_PHASES];
+	size_t nphases;
+} result;
+
+typedef struct options {
+	int runs;
+	int warmup;
+	int traced_runs;
+	const char *ptkl;
+	const char *examples;
+	const char *filter;
+	const char *json;
+} options;
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static double timeval_us (struct timeval tv)
+{
+	return (double)tv.tv_sec * 1e6 + (double)tv.tv_usec;
+}
+
+static void series_add (series *s, double value, size_t capacity)
+{
+	if (s->values == nullptr) {
+		s->values = malloc (sizeof (double) * capacity);
+		if (!s->values) panic ("out of memory");
+	}
+	if (s->count < capacity) s->values[s->count++] = value;
+}
+
+static int compare_doubles (const void *a, const void *b)
+{
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of sorted values */
+static double percentile (const series *s, double p)
+{
+	if (s->count == 0) return 0;
+	size_t rank = (size_t)(p / 100.0 * (double)s->count + 0.5);
+	if (rank < 1) rank = 1;
+	if (rank > s->count) rank = s->count;
+	return s->values[rank - 1];
+}
+
+static double mean (const series *s)
+{
+	double sum = 0;
+	for (size_t i = 0; i < s->count; i++) sum += s->values[i];
+	return s->count ? sum / (double)s->count : 0;
+}
+
+/*
+ * Running ptkl
+ */
+
+/* in the child: write the "exec" mark, redirect stdio, and exec ptkl */
+static void exec_child (const options *opts, const scenario *sc, int mark_fd,
+			bool traced)
+{
+	char fd[16];
+	snprintf (fd, sizeof (fd), "%d", mark_fd);
+	setenv ("PTKL_STARTUP_FD", fd, 1);
+
+	int null = open ("/dev/null", O_RDWR);
+	if (null >= 0) {
+		dup2 (null, STDIN_FILENO);
+		dup2 (null, STDOUT_FILENO);
+		dup2 (null, STDERR_FILENO);
+		if (null > STDERR_FILENO) close (null);
+	}
+
+	const char *argv[6] = {opts->ptkl};
+	for (int i = 0; sc->args[i]; i++) argv[i + 1] = sc->args[i];
+
+#ifdef __linux__
+	if (traced) ptrace (PTRACE_TRACEME, 0, nullptr, nullptr);
+#endif
+
+	char line[64];
+	int n = snprintf (line, sizeof (line), "exec %llu\n",
+			  (unsigned long long)now_ns ());
+	if (write (mark_fd, line, n) != n) _exit (127);
+
+	execvp (opts->ptkl, (char *const *)argv);
+	_exit (127);
+}
+
+#ifdef __linux__
+/* VmHWM of a stopped process, in KB */
+static long read_hwm (pid_t pid)
+{
+	char path[64];
+	snprintf (path, sizeof (path), "/proc/%d/status", (int)pid);
+	FILE *f = fopen (path, "r");
+	if (!f) return -1;
+	char line[256];
+	long kb = -1;
+	while (fgets (line, sizeof (line), f)) {
+		if (sscanf (line, "VmHWM: %ld kB", &kb) == 1) break;
+	}
+	fclose (f);
+	return kb;
+}
+
+/* count syscalls until the child exits (it's stopped after exec) */
+static int trace_child (pid_t pid, sample *s)
+{
+	int status = 0;
+	if (wait4 (pid, &status, 0, &s->usage) < 0 || !WIFSTOPPED (status)) {
+		return status;
+	}
+	ptrace (PTRACE_SETOPTIONS, pid, nullptr,
+		PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEEXIT |
+			PTRACE_O_EXITKILL);
+
+	long stops = 0;
+	int sig = 0;
+	for (;;) {
+		if (ptrace (PTRACE_SYSCALL, pid, nullptr, sig) < 0) break;
+		if (wait4 (pid, &status, 0, &s->usage) < 0) break;
+		if (WIFEXITED (status) || WIFSIGNALED (status)) break;
+		sig = 0;
+		if (WSTOPSIG (status) == (SIGTRAP | 0x80)) {
+			stops++;
+		} else if (status >> 16 == PTRACE_EVENT_EXIT) {
+			/* about to exit: the address space is still there */
+			s->maxrss = read_hwm (pid);
+		} else if (WSTOPSIG (status) != SIGTRAP) {
+			sig = WSTOPSIG (status);
+		}
+	}
+	/* each syscall stops on entry and exit, except exit_group */
+	s->syscalls = (stops + 1) / 2;
+	return status;
+}
+#endif
+
+static bool read_marks (int fd, sample *s)
+{
+	char buf[4096];
+	size_t len = 0;
+	ssize_t n;
+	while (len < sizeof (buf) - 1 &&
+	       (n = read (fd, buf + len, sizeof (buf) - 1 - len)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		len += (size_t)n;
+	}
+	buf[len] = '\0';
+
+	s->nmarks = 0;
+	char *save = nullptr;
+	for (char *line = strtok_r (buf, "\n", &save); line;
+	     line = strtok_r (nullptr, "\n", &save)) {
+		if (s->nmarks == MAX_MARKS) break;
+		char name[PHASE_NAME_LEN];
+		unsigned long long ns;
+		if (sscanf (line, "%31s %llu", name, &ns) != 2) continue;
+		strcpy (s->marks[s->nmarks].name, name);
+		s->marks[s->nmarks].ns = ns;
+		s->nmarks++;
+	}
+	return true;
+}
+
+static bool exec_once (const options *opts, const scenario *sc, bool traced,
+		       sample *s)
+{
+	*s = (sample){.syscalls = -1, .maxrss = -1};
+
+	int fds[2];
+	if (pipe (fds) < 0) {
+		log_error ("pipe: %s", strerror (errno));
+		return false;
+	}
+
+	s->start = now_ns ();
+	pid_t pid = fork ();
+	if (pid < 0) {
+		log_error ("fork: %s", strerror (errno));
+		close (fds[0]);
+		close (fds[1]);
+		return false;
+	}
+	if (pid == 0) {
+		close (fds[0]);
+		exec_child (opts, sc, fds[1], traced);
+	}
+	close (fds[1]);
+
+	int status = 0;
+#ifdef __linux__
+	if (traced) status = trace_child (pid, s);
+#endif
+	while (!traced && wait4 (pid, &status, 0, &s->usage) < 0 &&
+	       errno == EINTR) {}
+	s->end = now_ns ();
+
+	read_marks (fds[0], s);
+	close (fds[0]);
+	s->ok = WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS;
+	return true;
+}
+
+/*
+ * Results
+ */
+
+static series *phase_times (result *r, const char *name)
+{
+	for (size_t i = 0; i < r->nphases; i++) {
+		if (strcmp (r->phases[i].name, name) == 0) {
+			return &r->phases[i].times;
+		}
+	}
+	if (r->nphases == MAX_PHASES) return nullptr;
+	phase *p = &r->phases[r->nphases++];
+	snprintf (p->name, sizeof (p->name), "%s", name);
+	return &p->times;
+}
+
+static void add_phases (result *r, const sample *s)
+{
+	/* "exec" ends the fork phase; every later mark ends its own phase */
+	uint64_t prev = s->start;
+	for (size_t i = 0; i < s->nmarks; i++) {
+		const char *name = s->marks[i].name;
+		if (strcmp (name, "exec") == 0) name = "fork";
+		series *times = phase_times (r, name);
+		if (times) {
+			const double us = (double)(s->marks[i].ns - prev) / 1e3;
+			series_add (times, us, r->runs);
+		}
+		prev = s->marks[i].ns;
+	}
+	series *times = phase_times (r, "exit");
+	if (times) series_add (times, (double)(s->end - prev) / 1e3, r->runs);
+}
+
+static void add_sample (result *r, const sample *s, bool traced)
+{
+	if (!s->ok) {
+		r->failed++;
+		return;
+	}
+	const int n = r->runs;
+	if (traced) {
+		if (s->syscalls >= 0) {
+			series_add (&r->metrics[SYSCALLS], (double)s->syscalls,
+				    n);
+		}
+		if (s->maxrss >= 0) {
+			series_add (&r->metrics[MAXRSS], (double)s->maxrss, n);
+		}
+		return;
+	}
+	series_add (&r->metrics[WALL], (double)(s->end - s->start) / 1e3, n);
+	series_add (&r->metrics[USER], timeval_us (s->usage.ru_utime), n);
+	series_add (&r->metrics[SYS], timeval_us (s->usage.ru_stime), n);
+	series_add (&r->metrics[MINFLT], (double)s->usage.ru_minflt, n);
+	series_add (&r->metrics[MAJFLT], (double)s->usage.ru_majflt, n);
+	add_phases (r, s);
+}
+
+static void sort_series (series *s)
+{
+	if (s->count == 0) return;
+	qsort (s->values, s->count, sizeof (double), compare_doubles);
+}
+
+static void free_result (result *r)
+{
+	for (int m = 0; m < METRIC_COUNT; m++) free (r->metrics[m].values);
+	for (size_t i = 0; i < r->nphases; i++) {
+		free (r->phases[i].times.values);
+	}
+}
+
+static bool run_scenario (const options *opts, const scenario *sc, result *r)
+{
+	*r = (result){.scenario = sc, .runs = opts->runs};
+	sample s;
+
+	for (int i = 0; i < opts->warmup; i++) {
+		if (!exec_once (opts, sc, false, &s)) return false;
+	}
+	for (int i = 0; i < opts->runs; i++) {
+		if (!exec_once (opts, sc, false, &s)) return false;
+		add_sample (r, &s, false);
+	}
+#ifdef __linux__
+	for (int i = 0; i < opts->traced_runs && i < opts->runs; i++) {
+		if (!exec_once (opts, sc, true, &s)) return false;
+		if (s.ok) add_sample (r, &s, true);
+	}
+#endif
+
+	for (int m = 0; m < METRIC_COUNT; m++) sort_series (&r->metrics[m]);
+	for (size_t i = 0; i < r->nphases; i++) {
+		sort_series (&r->phases[i].times);
+	}
+	return true;
+}
+
+static void print_series (const char *label, const series *s)
+{
+	if (s->count == 0) {
+		printf ("  %-16s %10s\n", label, "-");
+		return;
+	}
+	printf ("  %-16s %10.1f %10.1f %10.1f %10.1f %10.1f\n", label,
+		percentile (s, 50), percentile (s, 90), percentile (s, 99),
+		s->values[s->count - 1], mean (s));
+}
+
+static void print_result (const options *opts, const result *r)
+{
+	printf ("%s", opts->ptkl);
+	for (int i = 0; r->scenario->args[i]; i++) {
+		printf (" %s", r->scenario->args[i]);
+	}
+	printf ("  (%d runs, %d failed)\n", r->runs, r->failed);
+	printf ("  %-16s %10s %10s %10s %10s %10s\n", "", "p50", "p90",
+		"p99", "max", "mean");
+	for (int m = 0; m < METRIC_COUNT; m++) {
+		print_series (metric_label[m], &r->metrics[m]);
+	}
+	printf ("  phases (us)\n");
+	for (size_t i = 0; i < r->nphases; i++) {
+		char label[PHASE_NAME_LEN + 2];
+		snprintf (label, sizeof (label), "  %s", r->phases[i].name);
+		print_series (label, &r->phases[i].times);
+	}
+	printf ("\n");
+}
+
+static void write_json_series (FILE *f, const char *key, const series *s)
+{
+	fprintf (f,
+		 "\"%s\": {\"count\": %zu, \"p50\": %.3f, \"p90\": %.3f, "
+		 "\"p99\": %.3f, \"max\": %.3f, \"mean\": %.3f}",
+		 key, s->count, percentile (s, 50), percentile (s, 90),
+		 percentile (s, 99), s->count ? s->values[s->count - 1] : 0,
+		 mean (s));
+}
+
+static bool write_json (const options *opts, const result *results,
+			size_t count)
+{
+	FILE *f = fopen (opts->json, "w");
+	if (!f) {
+		log_error ("%s: %s", opts->json, strerror (errno));
+		return false;
+	}
+	fprintf (f, "{\n  \"runs\": %d,\n  \"scenarios\": [", opts->runs);
+	for (size_t i = 0; i < count; i++) {
+		const result *r = &results[i];
+		fprintf (f, "%s\n    {\"name\": \"%s\", \"failed\": %d,\n",
+			 i ? "," : "", r->scenario->name, r->failed);
+		fprintf (f, "     \"metrics\": {");
+		for (int m = 0; m < METRIC_COUNT; m++) {
+			fprintf (f, "%s\n       ", m ? "," : "");
+			write_json_series (f, metric_key[m], &r->metrics[m]);
+		}
+		fprintf (f, "},\n     \"phases_us\": {");
+		for (size_t p = 0; p < r->nphases; p++) {
+			fprintf (f, "%s\n       ", p ? "," : "");
+			write_json_series (f, r->phases[p].name,
+					   &r->phases[p].times);
+		}
+		fprintf (f, "}}");
+	}
+	fprintf (f, "\n  ]\n}\n");
+	return fclose (f) == 0;
+}
+
+/*
+ * Main
+ */
+
+static void usage (const char *prog)
+{
+	fprintf (stderr,
+		 "usage: %s [--ptkl PATH] [--runs N] [--warmup N] "
+		 "[--traced-runs N]\n"
+		 "       [--examples DIR] [--filter STR] [--json FILE]\n\n"
+		 "  --ptkl PATH        ptkl binary (default: next to %s)\n"
+		 "  --runs N           timed runs per scenario (default: %d)\n"
+		 "  --warmup N         untimed runs first (default: %d)\n"
+		 "  --traced-runs N    runs under ptrace for syscalls and max "
+		 "rss (default: %d)\n"
+		 "  --examples DIR     where to find fib.js (default: "
+		 "examples)\n"
+		 "  --filter STR       only run scenarios whose name contains "
+		 "STR\n"
+		 "  --json FILE        also write results as JSON to FILE\n",
+		 prog, prog, DEFAULT_RUNS, DEFAULT_WARMUP,
+		 DEFAULT_TRACED_RUNS);
+}
+
+static bool parse_count (const char *s, int *n)
+{
+	char *end = nullptr;
+	long v = strtol (s, &end, 10);
+	if (*end || v < 0 || v > 1000000) return false;
+	*n = (int)v;
+	return true;
+}
+
+static bool parse_options (int argc, char **argv, options *opts)
+{
+	*opts = (options){
+		.runs = DEFAULT_RUNS,
+		.warmup = DEFAULT_WARMUP,
+		.traced_runs = DEFAULT_TRACED_RUNS,
+		.examples = "examples",
+	};
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (strcmp (arg, "--runs") == 0 && has_value) {
+			if (!parse_count (argv[++i], &opts->runs)) return false;
+		} else if (strcmp (arg, "--warmup") == 0 && has_value) {
+			if (!parse_count (argv[++i], &opts->warmup)) {
+				return false;
+			}
+		} else if (strcmp (arg, "--traced-runs") == 0 && has_value) {
+			if (!parse_count (argv[++i], &opts->traced_runs)) {
+				return false;
+			}
+		} else if (strcmp (arg, "--ptkl") == 0 && has_value) {
+			opts->ptkl = argv[++i];
+		} else if (strcmp (arg, "--examples") == 0 && has_value) {
+			opts->examples = argv[++i];
+		} else if (strcmp (arg, "--filter") == 0 && has_value) {
+			opts->filter = argv[++i];
+		} else if (strcmp (arg, "--json") == 0 && has_value) {
+			opts->json = argv[++i];
+		} else {
+			return false;
+		}
+	}
+	return opts->runs > 0;
+}
+
+/* ptkl is built into the same directory as ptklstartbench */
+static char *default_ptkl (const char *prog)
+{
+	const char *slash = strrchr (prog, '/');
+	const int dirlen = slash ? (int)(slash - prog) : 1;
+	const char *dir = slash ? prog : ".";
+	char *path = malloc (dirlen + sizeof ("/ptkl"));
+	if (!path) panic ("out of memory");
+	sprintf (path, "%.*s/ptkl", dirlen, dir);
+	return path;
+}
+
+int main (int argc, char **argv)
+{
+	register_signal_panic_handlers ();
+
+	options opts;
+	if (!parse_options (argc, argv, &opts)) {
+		usage (argv[0]);
+		return EXIT_FAILURE;
+	}
+	char *ptkl = nullptr;
+	if (!opts.ptkl) opts.ptkl = ptkl = default_ptkl (argv[0]);
+	if (access (opts.ptkl, X_OK) != 0) {
+		log_error ("%s: %s", opts.ptkl, strerror (errno));
+		free (ptkl);
+		return EXIT_FAILURE;
+	}
+
+	/* an empty script, so run's cost is just startup */
+	char empty[] = "/tmp/ptklstartbench-XXXXXX.js";
+	int fd = mkstemps (empty, 3);
+	if (fd < 0) {
+		log_error ("mkstemps: %s", strerror (errno));
+		free (ptkl);
+		return EXIT_FAILURE;
+	}
+	close (fd);
+
+	char fib[PATH_MAX];
+	snprintf (fib, sizeof (fib), "%s/fib.js", opts.examples);
+
+	const scenario scenarios[] = {
+		{"version", {"--version"}},
+		{"help", {"help"}},
+		{"run-empty", {"run", empty}, empty},
+		{"run-fib", {"run", fib}, fib},
+	};
+	const size_t count = sizeof (scenarios) / sizeof (scenarios[0]);
+	result results[sizeof (scenarios) / sizeof (scenarios[0])];
+	size_t ran = 0;
+	bool ok = true;
+
+	for (size_t i = 0; i < count && ok; i++) {
+		const scenario *sc = &scenarios[i];
+		if (opts.filter && !strstr (sc->name, opts.filter)) continue;
+		if (sc->script && access (sc->script, R_OK) != 0) {
+			log_error ("skipping %s: %s: %s", sc->name, sc->script,
+				   strerror (errno));
+			continue;
+		}
+		ok = run_scenario (&opts, sc, &results[ran]);
+		if (ok) print_result (&opts, &results[ran]);
+		ran++;
+	}
+
+	if (ok && opts.json) ok = write_json (&opts, results, ran);
+
+	for (size_t i = 0; i < ran; i++) free_result (&results[i]);
+	unlink (empty);
+	free (ptkl);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -47,7 +47,7 @@ typedef struct flag {
 	flag_arg has_arg;
 	string help;
 
-	/* the original string obtained by getopt */
+	/* the original argv element the flag was parsed from */
 	char *text;
 
 	/* the flag's argument value, if it takes one, after parsing */
@@ -71,6 +71,67 @@ typedef enum command_args {
 	COMMAND_ARGS_NONE = 0,
 } command_args;
 
+/**
+ * Declarative commands
+ *
+ * A command tree can be declared as constant data (string literals, flag
+ * and subcommand arrays), so that it lives in read-only memory and costs
+ * nothing at startup, instead of being built with command_new, command_add,
+ * and command_flag:
+ *
+ *     static const flag_spec verbose_flag = {
+ *             .short_flag = 'V',
+ *             .long_flag = "verbose",
+ *             .help = "print more",
+ *     };
+ *
+ *     static const command_spec run_command = {
+ *             .name = "run",
+ *             .help = "run a program",
+ *             .fn = run,
+ *             .expect_args = COMMAND_ARGS_ANY,
+ *     };
+ *
+ *     static const command_spec main_command = {
+ *             .name = "ptkl",
+ *             .help = "Partikle",
+ *             .flags = (const flag_spec *const[]){&verbose_flag, nullptr},
+ *             .commands = (const command_spec *const[]){&run_command,
+ *                                                       nullptr},
+ *     };
+ *
+ *     command cmd = command_from_spec (&main_command);
+ *     command_run (cmd, argc, argv);
+ *
+ * command_from_spec only constructs the root command. A subcommand is
+ * constructed from its spec the first time it's needed: when command_run
+ * dispatches to it, or when listing subcommands with command_subcommands.
+ * Commands can still be added dynamically (e.g., plugins) with command_add.
+ */
+typedef struct flag_spec {
+	char short_flag;
+	const char *long_flag;
+	flag_arg has_arg;
+	const char *help;
+	flag_fn fn;
+	bool should_exit;
+} flag_spec;
+
+typedef struct command_spec {
+	const char *name;
+	const char *help;
+	const char *group;
+	command_fn fn;
+	int expect_args; /* command_args, or a specific count */
+
+	/* null-terminated arrays */
+	const flag_spec *const *flags;
+	const struct command_spec *const *commands;
+
+	/* settings as key, value pairs (null-terminated) */
+	const char *const *settings;
+} command_spec;
+
 typedef struct command {
 	string name;
 	string help;
@@ -84,6 +145,9 @@ typedef struct command {
 	/* flags after parsing argv */
 	vector *flags;
 
+	/* flag lookup compiled from flags on first run (see command.c) */
+	struct flag_table *flag_table;
+
 	/* how many args to expect (-1 for any number, 0 for none, etc.) */
 	int expect_args;
 
@@ -95,6 +159,10 @@ typedef struct command {
 	vector *ordered_commands; /* for iteration in order */
 	struct command *parent;
 
+	/* declaration this command was created from, if any */
+	const command_spec *spec;
+	bool spec_commands_ready; /* all spec subcommands constructed */
+
 	/* settings: map[char *] -> string */
 	map *settings;
 
@@ -105,6 +173,22 @@ typedef struct command {
 command command_new (const char *name, const char *help, command_fn fn);
 void command_free (command cmd);
 
+/**
+ * Create a command from a declaration (see command_spec above).
+ */
+command command_from_spec (const command_spec *spec);
+
+/**
+ * Find a subcommand by name, constructing it from its spec if necessary.
+ */
+command command_find (command cmd, const char *name);
+
+/**
+ * All subcommands in order (declared, then added), for listing (e.g., help).
+ * Constructs any that haven't been constructed yet from their specs.
+ */
+vector *command_subcommands (command cmd);
+
 void command_set (command cmd, const char *key, const char *value);
 string command_get (command cmd, const char *name);
 
@@ -121,6 +205,15 @@ void command_set_group (command cmd, const char *group);
  */
 void command_expect_args (command cmd, command_args count);
 
+/**
+ * Parse argv and run the command (or the subcommand named by the first
+ * non-flag arg). argv[0] is the command name and isn't parsed.
+ *
+ * Flags can appear anywhere: "-a", "-abc" (grouped), "-bvalue" or "-b value"
+ * (with an argument), "--name", "--name=value" or "--name value", and an
+ * unambiguous prefix of a long name. "--" ends flags. Flags a command
+ * doesn't know are passed to the subcommand. argv isn't modified.
+ */
 bool command_run (command cmd, int argc, char **argv);
 
 
@@ -140,7 +233,9 @@ flag command_flag (command cmd, char short_option, const char *long_option,
  * Set an optional callback function for a flag. This is mostly convenient for
  * flags that short circuit normal processing, like printing help and exiting,
  * but might be useful for other use cases. Flag callbacks run before the
- * callback for the command they belong to.
+ * callback for the command they belong to. When a subcommand runs instead,
+ * callbacks that don't exit still run before the subcommand (so a flag on
+ * the main command can configure global state, like profiling).
  */
 void flag_add_callback (flag f, flag_fn fn, bool should_exit);
 
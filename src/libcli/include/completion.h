@@ -0,0 +1,137 @@
+/*
+ * ptkl command completion
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "command.h"
+
+/**
+ * Completion index
+ *
+ * A prefix trie of the words that can be typed at each point of a command
+ * line: the subcommands and flags of a command tree, and any other words a
+ * caller adds (service names, keys, object names, ...).
+ *
+ * Words are grouped in scopes. COMPLETION_ROOT holds the top-level words,
+ * and every word has a scope of its own for the words that can follow it
+ * (a command's subcommands and flags):
+ *
+ *     completion_index *idx = completion_new ();
+ *     completion_add_command (idx, COMPLETION_ROOT, cmd);
+ *
+ *     completion out[16];
+ *     size_t start;
+ *     size_t n = completion_line (idx, "service li", &start, out, 16);
+ *     // out[0].text = "list", start = 8
+ *
+ * Queries don't allocate: results are written to the caller's array, and
+ * their text points into the index (it isn't null-terminated, use len). The
+ * text is valid until the next completion_add or completion_free.
+ */
+typedef struct completion_index completion_index;
+
+typedef uint32_t completion_scope;
+
+#define COMPLETION_ROOT ((completion_scope)0)
+#define COMPLETION_NONE ((completion_scope)UINT32_MAX)
+
+/* longest word that can be added */
+#define COMPLETION_MAX_WORD 1024
+
+typedef enum completion_kind {
+	COMPLETION_COMMAND,
+	COMPLETION_FLAG,
+	COMPLETION_WORD,
+} completion_kind;
+
+typedef struct completion {
+	const char *text; /* not null-terminated */
+	size_t len;
+	completion_kind kind;
+	completion_scope scope; /* words that can follow this one */
+	int score; /* fuzzy match score (higher is better), 0 for prefixes */
+} completion;
+
+completion_index *completion_new (void);
+void completion_free (completion_index *idx);
+
+/**
+ * Add a word to a scope. Returns the word's own scope (the same one if the
+ * word was already added), or COMPLETION_NONE if scope doesn't exist or the
+ * word is empty or longer than COMPLETION_MAX_WORD.
+ */
+completion_scope completion_add (completion_index *idx, completion_scope scope,
+				 const char *word, size_t len,
+				 completion_kind kind);
+
+/**
+ * Add the flags ("--name", or "-c" if a flag has no long name) and
+ * subcommands of cmd to scope, then the flags and subcommands of each
+ * subcommand to its own scope, and so on. Constructs declared subcommands
+ * (see command_subcommands).
+ */
+void completion_add_command (completion_index *idx, completion_scope scope,
+			     command cmd);
+
+/**
+ * The scope of a word (exact match), or COMPLETION_NONE.
+ */
+completion_scope completion_find (completion_index *idx,
+				  completion_scope scope, const char *word,
+				  size_t len);
+
+/**
+ * Words in scope that start with prefix, in byte order. Writes up to cap
+ * completions to out and returns how many words match (which may be more).
+ */
+size_t completion_prefix (completion_index *idx, completion_scope scope,
+			  const char *prefix, size_t len, completion *out,
+			  size_t cap);
+
+/**
+ * Words in scope that contain the characters of pattern in order (ignoring
+ * case), best first: matches at the start of the word or of its parts
+ * ("-", "_", ".", "/", ":" or camelCase) and runs of consecutive characters
+ * rank higher, gaps lower, and then shorter words. Returns how many
+ * completions were written to out (at most cap).
+ */
+size_t completion_fuzzy (completion_index *idx, completion_scope scope,
+			 const char *pattern, size_t len, completion *out,
+			 size_t cap);
+
+/**
+ * Complete the last word of a command line. The words before it select the
+ * scope (each command word moves into its scope, other words are skipped).
+ * Sets *start to the offset of the last word in line, and returns the
+ * number of completions written to out: the words the last word is a
+ * prefix of, or if there are none, fuzzy matches.
+ */
+size_t completion_line (completion_index *idx, const char *line,
+			size_t *start, completion *out, size_t cap);
+
+#endif /* COMPLETION_H */
@@ -22,7 +22,6 @@
  * THE SOFTWARE.
  */
 
-#include <getopt.h>
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
@@ -32,11 +31,22 @@
 #include "strings.h"
 
 
+/* a command and its containers are allocated together */
+struct command_block {
+	struct command command;
+	map settings;
+	stack errors;
+	vector flags;
+	map commands;
+	vector ordered_commands;
+	vector args;
+};
+
 command command_new (const char *name, const char *help, command_fn fn)
 {
-	command cmd = malloc (sizeof (struct command));
-	if (cmd == nullptr) panic ("out of memory");
-	memset (cmd, 0, sizeof (struct command));
+	struct command_block *block = calloc (1, sizeof (struct command_block));
+	if (block == nullptr) panic ("out of memory");
+	command cmd = &block->command;
 
 	cmd->name = string_new (name);
 	cmd->help = string_new (help);
@@ -44,32 +54,26 @@ command command_new (const char *name, const char *help, command_fn fn)
 	cmd->fn = fn;
 
 	/* settings */
-	cmd->settings = malloc (sizeof (map));
-	if (cmd->settings == nullptr) panic ("out of memory");
+	cmd->settings = &block->settings;
 	map_init (cmd->settings);
 
 	/* error stack */
-	cmd->errors = malloc (sizeof (stack));
-	if (cmd->errors == nullptr) panic ("out of memory");
+	cmd->errors = &block->errors;
 	stack_init (cmd->errors);
 
 	/* options vector */
-	cmd->flags = malloc (sizeof (vector));
-	if (cmd->flags == nullptr) panic ("out of memory");
+	cmd->flags = &block->flags;
 	vector_init (cmd->flags);
 
 	/* command map and vector */
-	cmd->commands = malloc (sizeof (map));
-	if (cmd->commands == nullptr) panic ("out of memory");
+	cmd->commands = &block->commands;
 	map_init (cmd->commands);
 
-	cmd->ordered_commands = malloc (sizeof (vector));
-	if (cmd->ordered_commands == nullptr) panic ("out of memory");
+	cmd->ordered_commands = &block->ordered_commands;
 	vector_init (cmd->ordered_commands);
 
 	/* args vector */
-	cmd->args = malloc (sizeof (vector));
-	if (cmd->args == nullptr) panic ("out of memory");
+	cmd->args = &block->args;
 	vector_init (cmd->args);
 
 	return cmd;
@@ -103,6 +107,7 @@ void command_free (command cmd)
 		string_free (values[i]);
 	}
 	map_free (m);
+	free (values);
 
 	/* shouldn't be any outstanding errors, but in case, free by printing */
 	command_print_errors (cmd);
@@ -114,25 +119,30 @@ void command_free (command cmd)
 		flag f = vector_get (cmd->flags, i);
 		string_free (f->long_flag);
 		string_free (f->help);
+		string_free (f->arg);
 		free (f);
 	}
 	vector_free (cmd->flags);
+	free (cmd->flag_table);
+
+	/* args point into argv, which the command doesn't own */
+	vector_free (cmd->args);
 
 	/* free commands */
 	m = cmd->commands;
 	values = malloc (sizeof (char *) * map_size (m));
 	map_values (m, values);
 	for (int i = 0; i < map_size (m); i++) {
-		/* this vector always stories a copy of the value */
-		free (values[i]);
+		command_free (values[i]);
 	}
-	map_free (cmd->commands);
+	map_free (m);
 	free (values);
 
 	/* free ordered commands vector - no need to free values since they're
 	 * the same command objects stored in the map above and already freed */
 	vector_free (cmd->ordered_commands);
 
+	/* frees the containers too (see command_block) */
 	free (cmd);
 }
 
@@ -174,17 +184,15 @@ void command_print_errors (command cmd)
 }
 
 
-static flag find_flag (command cmd, char short_flag, const char *long_flag)
+/* store the flag's argument, if it has one */
+static void flag_set_arg (flag f, const char *arg)
 {
-	for (int i = 0; i < vector_size (cmd->flags); i++) {
-		flag f = vector_get (cmd->flags, i);
-		if (f->short_flag == short_flag ||
-		    (long_flag != nullptr &&
-		     strcmp (long_flag, f->long_flag) == 0)) {
-			return f;
-		}
+	if (f == nullptr || arg == nullptr) return;
+	if (f->arg == nullptr) {
+		f->arg = string_new (arg);
+	} else {
+		f->arg = string_set (f->arg, arg);
 	}
-	return nullptr;
 }
 
 flag command_flag (command cmd, char short_option, const char *long_option,
@@ -201,6 +209,10 @@ flag command_flag (command cmd, char short_option, const char *long_option,
 	f->help = string_new (help);
 
 	vector_add (cmd->flags, f);
+
+	/* recompile flag lookup on the next run */
+	free (cmd->flag_table);
+	cmd->flag_table = nullptr;
 	return f;
 }
 
@@ -223,6 +235,99 @@ command command_add (command cmd, const char *name, const char *help,
 }
 
 
+command command_from_spec (const command_spec *spec)
+{
+	command cmd = command_new (spec->name, spec->help, spec->fn);
+	cmd->spec = spec;
+	cmd->expect_args = spec->expect_args;
+	if (spec->group != nullptr) command_set_group (cmd, spec->group);
+
+	for (const flag_spec *const *fs = spec->flags; fs && *fs; fs++) {
+		const flag_spec *s = *fs;
+		flag f = command_flag (cmd, s->short_flag, s->long_flag,
+				       s->has_arg, s->help);
+		if (s->fn != nullptr) {
+			flag_add_callback (f, s->fn, s->should_exit);
+		}
+	}
+
+	for (const char *const *kv = spec->settings; kv && kv[0]; kv += 2) {
+		command_set (cmd, kv[0], kv[1]);
+	}
+	return cmd;
+}
+
+
+/* construct a declared subcommand (see command_find) */
+static command add_from_spec (command cmd, const command_spec *spec)
+{
+	command subcmd = command_from_spec (spec);
+	subcmd->parent = cmd;
+	map_put (cmd->commands, spec->name, subcmd);
+	vector_add (cmd->ordered_commands, subcmd);
+	return subcmd;
+}
+
+
+static bool has_spec_commands (command cmd)
+{
+	return cmd->spec != nullptr && cmd->spec->commands != nullptr &&
+	       cmd->spec->commands[0] != nullptr;
+}
+
+
+static bool is_spec_command (command cmd, command subcmd)
+{
+	if (subcmd->spec == nullptr || !has_spec_commands (cmd)) return false;
+	for (const command_spec *const *cs = cmd->spec->commands; *cs; cs++) {
+		if (*cs == subcmd->spec) return true;
+	}
+	return false;
+}
+
+
+command command_find (command cmd, const char *name)
+{
+	command subcmd = map_get (cmd->commands, name);
+	if (subcmd != nullptr || !has_spec_commands (cmd)) return subcmd;
+	if (cmd->spec_commands_ready) return nullptr;
+
+	for (const command_spec *const *cs = cmd->spec->commands; *cs; cs++) {
+		if (strcmp ((*cs)->name, name) == 0) {
+			return add_from_spec (cmd, *cs);
+		}
+	}
+	return nullptr;
+}
+
+
+vector *command_subcommands (command cmd)
+{
+	if (cmd->spec_commands_ready || !has_spec_commands (cmd)) {
+		return cmd->ordered_commands;
+	}
+
+	/* declared subcommands first (in declaration order), then any added
+	 * with command_add */
+	vector ordered;
+	vector_init (&ordered);
+	for (const command_spec *const *cs = cmd->spec->commands; *cs; cs++) {
+		vector_add (&ordered, command_find (cmd, (*cs)->name));
+	}
+	for (size_t i = 0; i < vector_size (cmd->ordered_commands); i++) {
+		command subcmd = vector_get (cmd->ordered_commands, i);
+		if (!is_spec_command (cmd, subcmd)) {
+			vector_add (&ordered, subcmd);
+		}
+	}
+
+	vector_free (cmd->ordered_commands);
+	*cmd->ordered_commands = ordered;
+	cmd->spec_commands_ready = true;
+	return cmd->ordered_commands;
+}
+
+
 void command_push_error (command cmd, const char *error)
 {
 	stack_push (cmd->errors, string_new (error));
@@ -244,216 +349,231 @@ void command_push_errorf (command cmd, const char *fmt, ...)
 }
 
 
+/* argv sizes that command_run can parse without allocating scratch space */
+#define COMMAND_SCRATCH_ARGS 32
+
 /**
- * Transforms command flags into a format suitable for calling getopt_long().
- *
- * For example:
+ * Flag dispatch table, compiled from a command's flags the first time the
+ * command runs (and again only if flags are added after that), so parsing
+ * never rebuilds option state:
  *
- *     struct option long_options[] = {
- *             { "version",  no_argument,        nullptr,  'v' },
- *             { "help",     optional_argument,  nullptr,  'h' },
- *             { "foo",      required_argument,  nullptr,  'f' },
- *             {},
- *     };
+ * - short flags index directly into a 256-entry table
+ * - long flags are sorted by name for binary search, which also makes
+ *   unambiguous prefixes ("--vers" for "--version") cheap to match, like
+ *   getopt_long
  *
- *     char *short_options = ":vhf:";
- *
- *    int optindex;
- *    int c = getopt_long (argc, argv, short_options, long_options, &optindex);
- *
- *    Reference:
- *    https://man7.org/linux/man-pages/man3/getopt.3.html
+ * The table and its sorted long flags are a single allocation.
  */
-
-struct getopt_options {
-	struct option *long_options;
-	string short_options;
+struct flag_table {
+	flag short_flags[UCHAR_MAX + 1];
+	size_t long_count;
+	flag long_flags[];
 };
 
-struct getopt_options *new_getopt_options (command cmd)
+static int compare_long_flags (const void *a, const void *b)
 {
-	struct getopt_options *options =
-		malloc (sizeof (struct getopt_options));
-	if (options == nullptr) panic ("out of memory");
-	memset (options, 0, sizeof (struct getopt_options));
-
-	size_t flag_count = vector_size (cmd->flags);
-
-	/* prepare long_options to store results of flags enumeration */
-	/* add room for terminating empty option */
-	size_t total_count = flag_count + 1;
-	struct option *long_options =
-		malloc (sizeof (struct option) * total_count);
-	if (long_options == nullptr) panic ("out of memory");
-	memset (long_options, 0, sizeof (struct option) * total_count);
-
-	string short_options = string_new (":");
-
-	/* transform flags to long_options */
-	int long_option_count = 0;
-	for (int i = 0; i < flag_count; i++) {
-		flag f = vector_get (cmd->flags, i);
-		char *long_option = f->long_flag;
-		char short_option = f->short_flag;
-		flag_arg has_arg = f->has_arg;
-
-		/*
-		if (long_option != nullptr) {
-			printf ("flag: long: %s, short: %c, has_arg: %d\n",
-				long_option, short_option, has_arg);
-		}
-		*/
-
+	return strcmp ((*(const flag *)a)->long_flag,
+		       (*(const flag *)b)->long_flag);
+}
 
-		long_options[i] = (struct option){long_option, short_option,
-						  nullptr, has_arg};
-		long_option_count++;
+static struct flag_table *compile_flags (command cmd)
+{
+	size_t count = vector_size (cmd->flags);
+	struct flag_table *table =
+		calloc (1, sizeof (struct flag_table) + count * sizeof (flag));
+	if (table == nullptr) panic ("out of memory");
 
-		if (short_option != 0) {
-			short_options = string_cat_fmt (short_options, "%c",
-							short_option);
-			if (has_arg == REQUIRED_ARGUMENT) {
-				short_options = string_cat (short_options, ":");
-			} else if (has_arg == OPTIONAL_ARGUMENT) {
-				short_options =
-					string_cat (short_options, "::");
-			}
+	for (size_t i = 0; i < count; i++) {
+		flag f = vector_get (cmd->flags, i);
+		unsigned char c = (unsigned char)f->short_flag;
+		/* the first flag registered wins, like a linear search */
+		if (c != 0 && table->short_flags[c] == nullptr) {
+			table->short_flags[c] = f;
+		}
+		if (f->long_flag != nullptr && f->long_flag[0] != '\0') {
+			table->long_flags[table->long_count++] = f;
 		}
-
-
-		TRACE ("short_options: \"%s\"\n", short_options);
 	}
+	qsort (table->long_flags, table->long_count, sizeof (flag),
+	       compare_long_flags);
+	return table;
+}
 
-	/* terminate long_options for getopt */
-	long_options[long_option_count] = (struct option){};
+/*
+ * Find a long flag by name (name isn't null-terminated, it may be followed
+ * by "=value"). An exact match wins; otherwise, the name may be a prefix of
+ * exactly one flag.
+ */
+static flag find_long_flag (const struct flag_table *table, const char *name,
+			    size_t len)
+{
+	/* lower bound: first flag that doesn't sort before name */
+	size_t lo = 0, hi = table->long_count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const char *long_flag = table->long_flags[mid]->long_flag;
+		if (strncmp (long_flag, name, len) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == table->long_count) return nullptr;
 
-	/* store results */
-	options->long_options = long_options;
-	options->short_options = short_options;
+	flag f = table->long_flags[lo];
+	if (strncmp (f->long_flag, name, len) != 0) return nullptr;
+	if (f->long_flag[len] == '\0') return f;
 
-	return options;
+	/* prefix match, but not if ambiguous */
+	if (lo + 1 < table->long_count &&
+	    strncmp (table->long_flags[lo + 1]->long_flag, name, len) == 0) {
+		return nullptr;
+	}
+	return f;
 }
 
-void free_getopt_options (struct getopt_options *opts)
+/* flags that were parsed, in order, so their callbacks can run later */
+static void add_pending (vector *pending, flag f)
 {
-	if (opts == nullptr) return;
-	if (opts->long_options != nullptr) free (opts->long_options);
-	if (opts->short_options != nullptr) string_free (opts->short_options);
-	free (opts);
+	if (f->fn != nullptr) vector_add (pending, f);
 }
 
 
 bool command_run (command cmd, int argc, char **argv)
 {
 	bool ok = false;
-	opterr = 0;
-	int c = 0;
 	flag f = nullptr;
 
-	/* TODO: getopt mutates argv, so save a copy for handing off if we fork
-	 */
+	/* argv isn't modified (unlike getopt, nothing is permuted) */
 	cmd->argc = argc;
 	cmd->argv = argv;
 
-	/* collect any unhandled flags in case they apply to a subcommand */
-	vector unhandled_flags;
-	vector_init (&unhandled_flags);
+	if (cmd->flag_table == nullptr) cmd->flag_table = compile_flags (cmd);
+	const struct flag_table *table = cmd->flag_table;
+
+	/*
+	 * Scratch space for the remaining non-flag args, for unhandled flags,
+	 * and for both of them in their original order (forward), in case
+	 * they apply to a subcommand: an unhandled flag may take the next arg
+	 * as its value (-o out.ptkl), so the subcommand gets them in order.
+	 */
+	char *scratch_buf[3 * COMMAND_SCRATCH_ARGS];
+	int slots = argc > 0 ? argc : 1;
+	char **scratch = scratch_buf;
+	if (slots > COMMAND_SCRATCH_ARGS) {
+		scratch = malloc (sizeof (char *) * 3 * (size_t)slots);
+		if (scratch == nullptr) panic ("out of memory");
+	}
+	char **args = scratch;
+	char **unhandled_flags = scratch + slots;
+	char **forward = scratch + 2 * slots;
+	int args_count = 0;
+	int unhandled_count = 0;
+	int forward_count = 0;
+	int first_arg = -1; /* index of args[0] in forward */
 
 	/* flag handlers to run after parsing all the args */
 	vector pending_flag_handlers;
 	vector_init (&pending_flag_handlers);
 
-	/* transform command flags to getopt options */
-	struct getopt_options *options = new_getopt_options (cmd);
+	/* args from a previous run don't apply */
+	vector_clear (cmd->args);
 
 	TRACE ("start parse loop");
-	while (1) {
-		int long_options_i;
-		struct option *long_options = options->long_options;
-		string short_options = options->short_options;
-
-		c = getopt_long (argc, argv, short_options, long_options,
-				 &long_options_i);
-
-		/* No more options */
-		if (c == -1) break;
-
-		/* If the short option has a handler, invoke it */
-		f = find_flag (cmd, c, nullptr);
-		TRACE ("look up short option: '%c' (%s)", c, c == 0 ? "0" : "");
-		if (f != nullptr && f->fn != nullptr) {
-			TRACE ("add pending flag handler for: %c", c);
-			vector_add (&pending_flag_handlers, f);
+	for (int i = 1; i < argc; i++) {
+		char *arg = argv[i];
+
+		/* non-flag args (including "-") */
+		if (arg[0] != '-' || arg[1] == '\0') {
+			if (args_count == 0) first_arg = forward_count;
+			args[args_count++] = arg;
+			forward[forward_count++] = arg;
 			continue;
 		}
 
-		switch (c) {
-		case 0: {
-			TRACE ("case 0");
-			/*
-			 * Check the long option. If it has a corresponding
-			 * short option, then the handler was already invoked
-			 * above.
-			 *
-			 * TODO: add support for repeating flags
-			 *
-			 * When we reach this point, the following name and
-			 * flag pointers are guaranteed to not be null (but
-			 * still need to confirm the flag handler pointer).
-			 */
-			const char *name = long_options[long_options_i].name;
-			TRACE ("long option: %s", name);
-			f = find_flag (cmd, 0, name);
-			// if (f->short_flag == 0 && f->fn != nullptr) {
-			TRACE ("add pending flag handler for: %s", name);
-			vector_add (&pending_flag_handlers, f);
-			//}
-			TRACE ("case 0 break");
+		/* "--" ends flags, everything after is an arg */
+		if (arg[1] == '-' && arg[2] == '\0') {
+			forward[forward_count++] = arg;
+			while (++i < argc) {
+				if (args_count == 0) first_arg = forward_count;
+				args[args_count++] = argv[i];
+				forward[forward_count++] = argv[i];
+			}
 			break;
 		}
 
-		case '?': {
-			TRACE ("case ?");
-			/* unhandled option */
-			vector_add (&unhandled_flags, argv[optind - 1]);
-			TRACE ("case ? break");
-			break;
+		/* --name, --name=value, or --name value */
+		if (arg[1] == '-') {
+			const char *name = arg + 2;
+			const char *value = strchr (name, '=');
+			size_t len =
+				value ? (size_t)(value - name) : strlen (name);
+			if (value != nullptr) value++;
+
+			f = find_long_flag (table, name, len);
+			TRACE ("look up long option: %s (%s)", name,
+			       f ? "found" : "not found");
+			if (f == nullptr ||
+			    (f->has_arg == NO_ARGUMENT && value != nullptr)) {
+				unhandled_flags[unhandled_count++] = arg;
+				forward[forward_count++] = arg;
+				continue;
+			}
+			if (f->has_arg == REQUIRED_ARGUMENT && !value) {
+				if (i + 1 == argc) {
+					command_push_errorf (
+						cmd,
+						"missing expected argument for "
+						"option: %s",
+						arg);
+					goto done;
+				}
+				value = argv[++i];
+			}
+			f->text = arg;
+			flag_set_arg (f, value);
+			add_pending (&pending_flag_handlers, f);
+			continue;
 		}
 
-		case ':': {
-			trace ("case :");
-			/* TODO: optarg holds an option argument */
-			command_push_errorf (
-				cmd, "missing expected argument for option: %s",
-				argv[optind - 1]);
-
-			trace ("case : goto done");
-			goto done;
-		}
+		/* -a, -abc, -bvalue, or -b value */
+		for (const char *c = arg + 1; *c != '\0'; c++) {
+			f = table->short_flags[(unsigned char)*c];
+			TRACE ("look up short option: '%c' (%s)", *c,
+			       f ? "found" : "not found");
+			if (f == nullptr) {
+				/* hand the whole group to a subcommand */
+				unhandled_flags[unhandled_count++] = arg;
+				forward[forward_count++] = arg;
+				break;
+			}
+			f->text = arg;
+			if (f->has_arg == NO_ARGUMENT) {
+				add_pending (&pending_flag_handlers, f);
+				continue;
+			}
 
-		default: {
-			trace ("case default");
-			command_push_errorf (cmd, "unexpected: %s",
-					     argv[optind - 1]);
-			trace ("case default goto done");
-			goto done;
-		}
+			/* the rest of the group is the argument */
+			const char *value = c[1] != '\0' ? c + 1 : nullptr;
+			if (f->has_arg == REQUIRED_ARGUMENT && !value) {
+				if (i + 1 == argc) {
+					command_push_errorf (
+						cmd,
+						"missing expected argument for "
+						"option: %s",
+						arg);
+					goto done;
+				}
+				value = argv[++i];
+			}
+			flag_set_arg (f, value);
+			add_pending (&pending_flag_handlers, f);
+			break;
 		}
 	}
 
 	TRACE ("done with parse loop");
 
-	/* Collect remaining non-option args to pass them to this command or to
-	 * a subcommand (along with any unhandled flags) */
-	vector args;
-	vector_init (&args);
-
-	while (optind < argc) {
-		char *arg = argv[optind++];
-		vector_add (&args, arg);
-		TRACE ("collecting args: %s", arg);
-	}
-
 	/*
 	 * The command's argv has been parsed, so if there are remaining args or
 	 * unhandled flags:
@@ -473,9 +593,10 @@ bool command_run (command cmd, int argc, char **argv)
 	 * - Otherwise, report an error for the unhandled flags.
 	 */
 
-	bool has_subcommands = map_size (cmd->commands) > 0;
-	bool has_unhandled_flags = vector_size (&unhandled_flags) > 0;
-	bool has_args = vector_size (&args) > 0;
+	bool has_subcommands =
+		map_size (cmd->commands) > 0 || has_spec_commands (cmd);
+	bool has_unhandled_flags = unhandled_count > 0;
+	bool has_args = args_count > 0;
 
 	TRACE ("has_subcommands: %s", has_subcommands ? "true" : "false");
 	TRACE ("has_unhandled_flags: %s",
@@ -493,59 +614,54 @@ bool command_run (command cmd, int argc, char **argv)
 		TRACE ("unhandled flags and no subcommands, push error and "
 		       "goto done");
 		command_push_errorf (cmd, "unknown option: %s",
-				     vector_get (&unhandled_flags, 0));
+				     unhandled_flags[0]);
 		goto done;
 	}
 
 	/* If unhandled flags and no args to match against a subcommand, error
 	 */
 	if (has_unhandled_flags && !has_args) {
-		TRACE ("unexpected option: %s",
-		       vector_get (&unhandled_flags, 0));
+		TRACE ("unexpected option: %s", unhandled_flags[0]);
 		command_push_errorf (cmd, "unexpected option: %s",
-				     vector_get (&unhandled_flags, 0));
+				     unhandled_flags[0]);
 		goto done;
 	}
 
 	/* check if first arg matches a subcommand, if so, run that */
 	TRACE ("has_args: %s", has_args ? "true" : "false");
 	TRACE ("map_get");
-	TRACE ("size of args: %lu", vector_size (&args));
-	command subcmd = map_get (cmd->commands, vector_get (&args, 0));
+	TRACE ("size of args: %d", args_count);
+	command subcmd = command_find (cmd, args[0]);
 	TRACE ("DONE map_get");
 	TRACE ("there are args, first check to see if first arg matches a "
 	       "subcommand");
 	if (subcmd != nullptr) {
 		TRACE ("subcommand match: %s", subcmd->name);
 
-		/* get total count of flags and args to pass to subcommand */
-		int sub_argc = (int)vector_size (&args);
-		sub_argc += (int)vector_size (&unhandled_flags);
-
-		/* prepare to run subcommand */
-		char **sub_argv = (char **)malloc (sub_argc * sizeof (char *));
-		if (sub_argv == nullptr) panic ("out of memory");
-		memset (sub_argv, 0, sub_argc * sizeof (char *));
-
-		/* increment index across loops */
-		int index = 0;
-
-		/* add args */
-		for (int i = 0; i < vector_size (&args); i++) {
-			char *arg = vector_get (&args, i);
-			sub_argv[index++] = arg;
-		}
-
-		/* add options (continue index from previous loop) */
-		for (int i = 0; i < vector_size (&unhandled_flags); i++) {
-			char *opt = vector_get (&unhandled_flags, i);
-			sub_argv[index++] = opt;
+		/* subcommand argv: the subcommand name, then the other args
+		 * and the unhandled flags in their original order (any
+		 * unhandled flags before the name move after it) */
+		int sub_argc = forward_count;
+		char **sub_argv = forward;
+		memmove (sub_argv + 1, sub_argv,
+			 sizeof (char *) * (size_t)first_arg);
+		sub_argv[0] = args[0];
+
+		/* run pending flag callbacks that don't exit, since they
+		 * configure state that the subcommand relies on (callbacks
+		 * that exit only run if this command runs, see below) */
+		for (int i = 0; i < vector_size (&pending_flag_handlers); i++) {
+			f = vector_get (&pending_flag_handlers, i);
+			if (f->fn != nullptr && !f->should_exit) f->fn (f);
 		}
 
 		/* run the subcommand */
 		TRACE ("running subcommand: %s", subcmd->name);
-		optind = 0;
 		ok = command_run (subcmd, sub_argc, sub_argv);
+
+		/* scratch is freed below */
+		subcmd->argc = 0;
+		subcmd->argv = nullptr;
 		if (!ok) {
 			TRACE ("subcommand %s failed, printing errors, goto "
 			       "done",
@@ -561,27 +677,24 @@ bool command_run (command cmd, int argc, char **argv)
 	if (cmd->expect_args == 0) {
 		TRACE ("the command doesn't expect any args, so add error and "
 		       "goto done");
-		command_push_errorf (cmd, "unexpected argument: %s",
-				     vector_get (&args, 0));
+		command_push_errorf (cmd, "unexpected argument: %s", args[0]);
 		goto done;
 	}
-	if (cmd->expect_args > 0 && vector_size (&args) > cmd->expect_args) {
+	if (cmd->expect_args > 0 && args_count > cmd->expect_args) {
 		TRACE ("too many args, expected up to %d, got %d, add error "
 		       "and goto done",
-		       cmd->expect_args, vector_size (&args));
+		       cmd->expect_args, args_count);
 		command_push_errorf (cmd,
 				     "too many arguments (expected up "
 				     "to %d, got %d)",
-				     cmd->expect_args, vector_size (&args));
+				     cmd->expect_args, args_count);
 		goto done;
 	}
-	for (int i = 0; i < vector_size (&args); i++) {
-		TRACE ("  adding: %s\n", vector_get (&args, i));
-		vector_add (cmd->args, vector_get (&args, i));
+	for (int i = 0; i < args_count; i++) {
+		TRACE ("  adding: %s\n", args[i]);
+		vector_add (cmd->args, args[i]);
 	}
 
-	vector_free (&args);
-
 run:
 	TRACE ("run: running command: %s", cmd->name);
 
@@ -591,7 +704,6 @@ run:
 	TRACE ("  1. run any pending callbacks for: %s", cmd->name);
 	for (int i = 0; i < vector_size (&pending_flag_handlers); i++) {
 		f = vector_get (&pending_flag_handlers, i);
-		/* TODO: still need to ensure optarg gets added to f->arg */
 		if (f->fn != nullptr) {
 			TRACE ("    running: -%c, --%s", f->short_flag,
 			       f->long_flag);
@@ -632,9 +744,8 @@ run:
 
 done:
 	TRACE ("done: clean up, and return if ok: %s", ok ? "true" : "false");
-	vector_free (&unhandled_flags);
+	if (scratch != scratch_buf) free (scratch);
 	vector_free (&pending_flag_handlers);
-	free_getopt_options (options);
 
 	return ok;
 }
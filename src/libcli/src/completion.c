@@ -0,0 +1,458 @@
+/*
+ * ptkl command completion
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "completion.h"
+#include "log.h"
+
+#define NONE UINT32_MAX
+
+/*
+ * Trie nodes are stored in one array and linked by index. A node's children
+ * are kept sorted by byte, so walking the trie depth first visits words in
+ * byte order.
+ */
+typedef struct node {
+	uint32_t child; /* first child */
+	uint32_t sibling; /* next child of the parent */
+	uint32_t entry; /* word that ends at this node */
+	uint32_t lo, hi; /* words under this node: order[lo, hi) */
+	unsigned char c;
+} node;
+
+typedef struct entry {
+	uint32_t offset, len; /* text in words */
+	uint64_t mask; /* characters in the text (see char_bit) */
+	uint32_t root; /* trie node for the word's scope, if it has words */
+	completion_kind kind;
+} entry;
+
+struct completion_index {
+	char *words;
+	size_t words_len, words_cap;
+
+	entry *entries; /* the scope of entries[i] is i + 1 */
+	uint32_t entry_count, entry_cap;
+
+	node *nodes; /* nodes[0] is the root of COMPLETION_ROOT */
+	uint32_t node_count, node_cap;
+
+	/* entry indexes in trie order (each scope's words are contiguous),
+	 * rebuilt after words are added */
+	uint32_t *order;
+	bool ordered;
+};
+
+static void *grow (void *items, uint32_t *cap, size_t size)
+{
+	*cap = *cap ? *cap * 2 : 16;
+	items = realloc (items, *cap * size);
+	if (items == nullptr) panic ("out of memory");
+	return items;
+}
+
+static uint32_t new_node (completion_index *idx, unsigned char c)
+{
+	if (idx->node_count == idx->node_cap) {
+		idx->nodes = grow (idx->nodes, &idx->node_cap, sizeof (node));
+	}
+	idx->nodes[idx->node_count] = (node){
+		.child = NONE,
+		.sibling = NONE,
+		.entry = NONE,
+		.c = c,
+	};
+	return idx->node_count++;
+}
+
+completion_index *completion_new (void)
+{
+	completion_index *idx = calloc (1, sizeof (completion_index));
+	if (idx == nullptr) panic ("out of memory");
+	new_node (idx, 0);
+	return idx;
+}
+
+void completion_free (completion_index *idx)
+{
+	if (idx == nullptr) return;
+	free (idx->words);
+	free (idx->entries);
+	free (idx->nodes);
+	free (idx->order);
+	free (idx);
+}
+
+/*
+ * Characters are folded into a 64-bit set so that fuzzy matching can skip
+ * words that don't contain every character of the pattern without looking
+ * at them.
+ */
+static uint64_t char_bit (unsigned char c)
+{
+	c = tolower (c);
+	if (c >= 'a' && c <= 'z') return 1ull << (c - 'a');
+	if (c >= '0' && c <= '9') return 1ull << (26 + c - '0');
+	return 1ull << (36 + c % 28);
+}
+
+static uint64_t char_mask (const char *s, size_t len)
+{
+	uint64_t mask = 0;
+	for (size_t i = 0; i < len; i++) mask |= char_bit (s[i]);
+	return mask;
+}
+
+/* the root node of a scope, or NONE if nothing has been added to it */
+static uint32_t scope_root (completion_index *idx, completion_scope scope)
+{
+	if (scope == COMPLETION_ROOT) return 0;
+	if (scope > idx->entry_count) return NONE;
+	return idx->entries[scope - 1].root;
+}
+
+/* the child of n for byte c, or where it would be inserted (*prev) */
+static uint32_t find_child (completion_index *idx, uint32_t n,
+			    unsigned char c, uint32_t *prev)
+{
+	*prev = NONE;
+	uint32_t child = idx->nodes[n].child;
+	while (child != NONE && idx->nodes[child].c < c) {
+		*prev = child;
+		child = idx->nodes[child].sibling;
+	}
+	return child != NONE && idx->nodes[child].c == c ? child : NONE;
+}
+
+static uint32_t find_node (completion_index *idx, uint32_t n, const char *s,
+			   size_t len)
+{
+	uint32_t prev;
+	for (size_t i = 0; i < len && n != NONE; i++) {
+		n = find_child (idx, n, (unsigned char)s[i], &prev);
+	}
+	return n;
+}
+
+completion_scope completion_add (completion_index *idx, completion_scope scope,
+				 const char *word, size_t len,
+				 completion_kind kind)
+{
+	if (len == 0 || len > COMPLETION_MAX_WORD) return COMPLETION_NONE;
+	if (scope != COMPLETION_ROOT && scope > idx->entry_count) {
+		return COMPLETION_NONE;
+	}
+
+	uint32_t n = scope_root (idx, scope);
+	if (n == NONE) {
+		n = new_node (idx, 0);
+		idx->entries[scope - 1].root = n;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = word[i];
+		uint32_t prev;
+		uint32_t child = find_child (idx, n, c, &prev);
+		if (child == NONE) {
+			child = new_node (idx, c);
+			uint32_t *link = prev == NONE
+						 ? &idx->nodes[n].child
+						 : &idx->nodes[prev].sibling;
+			idx->nodes[child].sibling = *link;
+			*link = child;
+		}
+		n = child;
+	}
+	if (idx->nodes[n].entry != NONE) return idx->nodes[n].entry + 1;
+
+	if (idx->words_len + len > idx->words_cap) {
+		idx->words_cap = idx->words_cap ? idx->words_cap * 2 : 1024;
+		if (idx->words_cap < idx->words_len + len) {
+			idx->words_cap = idx->words_len + len;
+		}
+		idx->words = realloc (idx->words, idx->words_cap);
+		if (idx->words == nullptr) panic ("out of memory");
+	}
+	memcpy (idx->words + idx->words_len, word, len);
+
+	if (idx->entry_count == idx->entry_cap) {
+		idx->entries = grow (idx->entries, &idx->entry_cap,
+				     sizeof (entry));
+	}
+	idx->entries[idx->entry_count] = (entry){
+		.offset = idx->words_len,
+		.len = len,
+		.mask = char_mask (word, len),
+		.root = NONE,
+		.kind = kind,
+	};
+	idx->words_len += len;
+	idx->nodes[n].entry = idx->entry_count;
+	idx->ordered = false;
+	return ++idx->entry_count;
+}
+
+void completion_add_command (completion_index *idx, completion_scope scope,
+			     command cmd)
+{
+	if (scope == COMPLETION_NONE) return;
+
+	for (size_t i = 0; i < vector_size (cmd->flags); i++) {
+		flag f = vector_get (cmd->flags, i);
+		char word[COMPLETION_MAX_WORD];
+		int len;
+		if (f->long_flag != nullptr && f->long_flag[0] != '\0') {
+			len = snprintf (word, sizeof (word), "--%s",
+					f->long_flag);
+		} else {
+			len = snprintf (word, sizeof (word), "-%c",
+					f->short_flag);
+		}
+		if (len > 0 && (size_t)len < sizeof (word)) {
+			completion_add (idx, scope, word, len,
+					COMPLETION_FLAG);
+		}
+	}
+
+	vector *subcommands = command_subcommands (cmd);
+	for (size_t i = 0; i < vector_size (subcommands); i++) {
+		command subcmd = vector_get (subcommands, i);
+		completion_scope sub =
+			completion_add (idx, scope, subcmd->name,
+					strlen (subcmd->name),
+					COMPLETION_COMMAND);
+		completion_add_command (idx, sub, subcmd);
+	}
+}
+
+static void order_node (completion_index *idx, uint32_t n, uint32_t *pos)
+{
+	idx->nodes[n].lo = *pos;
+	if (idx->nodes[n].entry != NONE) {
+		idx->order[(*pos)++] = idx->nodes[n].entry;
+	}
+	for (uint32_t c = idx->nodes[n].child; c != NONE;
+	     c = idx->nodes[c].sibling) {
+		order_node (idx, c, pos);
+	}
+	idx->nodes[n].hi = *pos;
+}
+
+/* number the words of every scope in trie order (after words were added) */
+static void ensure_ordered (completion_index *idx)
+{
+	if (idx->ordered) return;
+
+	free (idx->order);
+	idx->order = malloc ((idx->entry_count + 1) * sizeof (uint32_t));
+	if (idx->order == nullptr) panic ("out of memory");
+
+	uint32_t pos = 0;
+	order_node (idx, 0, &pos);
+	for (uint32_t i = 0; i < idx->entry_count; i++) {
+		if (idx->entries[i].root != NONE) {
+			order_node (idx, idx->entries[i].root, &pos);
+		}
+	}
+	idx->ordered = true;
+}
+
+static completion to_completion (completion_index *idx, uint32_t i, int score)
+{
+	const entry *e = &idx->entries[i];
+	return (completion){
+		.text = idx->words + e->offset,
+		.len = e->len,
+		.kind = e->kind,
+		.scope = i + 1,
+		.score = score,
+	};
+}
+
+completion_scope completion_find (completion_index *idx,
+				  completion_scope scope, const char *word,
+				  size_t len)
+{
+	uint32_t n = scope_root (idx, scope);
+	if (n == NONE || len == 0) return COMPLETION_NONE;
+	n = find_node (idx, n, word, len);
+	if (n == NONE || idx->nodes[n].entry == NONE) return COMPLETION_NONE;
+	return idx->nodes[n].entry + 1;
+}
+
+size_t completion_prefix (completion_index *idx, completion_scope scope,
+			  const char *prefix, size_t len, completion *out,
+			  size_t cap)
+{
+	uint32_t n = scope_root (idx, scope);
+	if (n == NONE) return 0;
+	n = find_node (idx, n, prefix, len);
+	if (n == NONE) return 0;
+
+	ensure_ordered (idx);
+	const node *nd = &idx->nodes[n];
+	for (uint32_t i = nd->lo; i < nd->hi && i - nd->lo < cap; i++) {
+		out[i - nd->lo] = to_completion (idx, idx->order[i], 0);
+	}
+	return nd->hi - nd->lo;
+}
+
+static bool is_boundary (const char *s, size_t i)
+{
+	if (i == 0) return true;
+	char prev = s[i - 1];
+	if (strchr ("-_./: ", prev) != nullptr) return true;
+	return islower ((unsigned char)prev) && isupper ((unsigned char)s[i]);
+}
+
+static bool same_char (char a, char b)
+{
+	return tolower ((unsigned char)a) == tolower ((unsigned char)b);
+}
+
+/*
+ * Score text for pattern, or return -1 if it doesn't contain the pattern's
+ * characters in order. The first (leftmost) match is found forward, then
+ * tightened backward from where it ends, so "svc" in "service" matches
+ * "s..v.c" rather than characters spread further apart.
+ */
+static int fuzzy_score (const char *text, size_t len, const char *pattern,
+			size_t plen)
+{
+	size_t p = 0, end = 0;
+	for (size_t i = 0; i < len && p < plen; i++) {
+		if (same_char (text[i], pattern[p])) {
+			p++;
+			end = i;
+		}
+	}
+	if (p < plen) return -1;
+
+	size_t start = end;
+	p = plen;
+	for (size_t i = end + 1; i-- > 0 && p > 0;) {
+		if (same_char (text[i], pattern[p - 1])) {
+			p--;
+			start = i;
+		}
+	}
+
+	int score = 0;
+	size_t last = SIZE_MAX;
+	p = 0;
+	for (size_t i = start; i <= end && p < plen; i++) {
+		if (!same_char (text[i], pattern[p])) continue;
+		score += 16;
+		if (text[i] == pattern[p]) score += 1;
+		if (is_boundary (text, i)) score += p == 0 ? 16 : 8;
+		if (last != SIZE_MAX) {
+			size_t gap = i - last - 1;
+			score += gap == 0 ? 8 : -3 - (int)(gap < 16 ? gap : 16);
+		}
+		last = i;
+		p++;
+	}
+	return score;
+}
+
+static bool ranks_before (completion a, completion b)
+{
+	return a.score > b.score || (a.score == b.score && a.len < b.len);
+}
+
+/* insert c into out (best first, at most cap) */
+static void rank (completion *out, size_t *count, size_t cap, completion c)
+{
+	size_t i = *count;
+	if (i == cap) {
+		if (cap == 0 || !ranks_before (c, out[cap - 1])) return;
+		i--;
+	} else {
+		(*count)++;
+	}
+	while (i > 0 && ranks_before (c, out[i - 1])) {
+		out[i] = out[i - 1];
+		i--;
+	}
+	out[i] = c;
+}
+
+size_t completion_fuzzy (completion_index *idx, completion_scope scope,
+			 const char *pattern, size_t len, completion *out,
+			 size_t cap)
+{
+	uint32_t n = scope_root (idx, scope);
+	if (n == NONE) return 0;
+	ensure_ordered (idx);
+
+	uint64_t mask = char_mask (pattern, len);
+	size_t count = 0;
+	for (uint32_t i = idx->nodes[n].lo; i < idx->nodes[n].hi; i++) {
+		const entry *e = &idx->entries[idx->order[i]];
+		if ((mask & e->mask) != mask) continue;
+		int score = fuzzy_score (idx->words + e->offset, e->len,
+					 pattern, len);
+		if (score < 0) continue;
+		rank (out, &count, cap,
+		      to_completion (idx, idx->order[i], score));
+	}
+	return count;
+}
+
+size_t completion_line (completion_index *idx, const char *line,
+			size_t *start, completion *out, size_t cap)
+{
+	completion_scope scope = COMPLETION_ROOT;
+	size_t i = 0;
+	for (;;) {
+		while (line[i] == ' ' || line[i] == '\t') i++;
+		size_t word = i;
+		while (line[i] != '\0' && line[i] != ' ' && line[i] != '\t') {
+			i++;
+		}
+		if (line[i] == '\0') {
+			*start = word;
+			break;
+		}
+
+		/* a complete word: move into a command's scope */
+		completion_scope found =
+			completion_find (idx, scope, line + word, i - word);
+		if (found != COMPLETION_NONE &&
+		    idx->entries[found - 1].kind == COMPLETION_COMMAND) {
+			scope = found;
+		}
+	}
+
+	const char *prefix = line + *start;
+	size_t len = strlen (prefix);
+	size_t count = completion_prefix (idx, scope, prefix, len, out, cap);
+	if (count > 0) return count < cap ? count : cap;
+	if (len == 0) return 0;
+	return completion_fuzzy (idx, scope, prefix, len, out, cap);
+}
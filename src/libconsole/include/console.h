@@ -11,10 +11,26 @@
 #include <curses.h>
 #include <stdbool.h>
 
+#include "scrollback.h"
+
 typedef struct console_t *console;
 
 /* Command handling */
-typedef char** (*command_completion) (console c, const char *prefix, int *count);
+typedef struct console_completion {
+	const char *text; /* not null-terminated */
+	size_t len;
+} console_completion;
+
+#define CONSOLE_MAX_COMPLETIONS 32
+
+/*
+ * Complete the word being typed at the end of line: write up to cap
+ * completions to out, set *start to the offset of the word in line, and
+ * return how many were written. The console doesn't copy or free the text,
+ * which must stay valid until the next call.
+ */
+typedef int (*command_completion) (console c, const char *line, int *start,
+				   console_completion *out, int cap);
 typedef void (*command_handler) (console c, const char *cmd);
 
 /* Console lifecycle */
@@ -34,16 +50,84 @@ bool console_create_windows (console c);
 void console_refresh_windows (console c);
 void console_resize_windows (console c);
 
-/* Event loop */
+/*
+ * Rendering: changes only mark the windows they affect, and are drawn in
+ * frames (one terminal update each) at most max_fps times a second, so bursts
+ * of output are coalesced. console_render draws pending changes immediately.
+ */
+#define CONSOLE_DEFAULT_MAX_FPS 60
+void console_set_max_fps (console c, int fps); /* 0 for no cap */
+void console_render (console c);
+
+/*
+ * Event loop: console_run waits (in poll) for terminal input, registered file
+ * descriptors (e.g., a log being tailed or a metrics channel), the next timer,
+ * or the next frame, and dispatches to their callbacks on the console's
+ * thread. Callbacks can add or remove sources, print, or stop the console.
+ */
 bool console_run (console c);
 void console_stop (console c);
 
+/*
+ * Call fn whenever fd is ready for events (POLLIN, POLLOUT). revents may also
+ * include POLLHUP or POLLERR; remove the fd when it reaches end of file.
+ * Returns false if the fd is already registered or memory runs out.
+ */
+typedef void (*console_fd_handler) (console c, int fd, short revents,
+				    void *data);
+bool console_add_fd (console c, int fd, short events, console_fd_handler fn,
+		     void *data);
+bool console_remove_fd (console c, int fd);
+
+/*
+ * Call fn every interval_ms until it returns false (return false for a
+ * one-shot timer). Returns a timer id for console_remove_timer, or -1.
+ */
+typedef bool (*console_timer_handler) (console c, void *data);
+int console_add_timer (console c, long interval_ms, console_timer_handler fn,
+		       void *data);
+bool console_remove_timer (console c, int id);
+
 /* Input handling */
 void console_handle_input (console c, int ch);
 
+/* Called with each key before the console handles it; return true if fn
+ * handled the key */
+typedef bool (*console_key_handler) (console c, int ch, void *data);
+void console_set_key_handler (console c, console_key_handler fn, void *data);
+
 /* Output */
 void console_print (console c, const char *fmt, ...);
 void console_error (console c, const char *fmt, ...);
 void console_clear (console c);
 
+/*
+ * Scrollback: printed lines are kept in a bounded history (by default
+ * SCROLLBACK_DEFAULT_BYTES of text and SCROLLBACK_DEFAULT_LINES lines; the
+ * oldest are dropped) and only the lines in view are drawn. Page Up/Down,
+ * Home, and End scroll; "/text" in the command bar searches back through the
+ * history ("/" alone finds the next older match).
+ */
+typedef enum {
+	CONSOLE_PAGE_UP,
+	CONSOLE_PAGE_DOWN,
+	CONSOLE_SCROLL_TOP,
+	CONSOLE_SCROLL_END, /* Follow new output */
+} console_scroll_to;
+
+void console_scroll (console c, console_scroll_to to);
+bool console_search (console c, const char *text);
+bool console_set_scrollback (console c, size_t max_bytes, size_t max_lines);
+
+/*
+ * Panes: draw the content window with fn instead of the scrollback (e.g., a
+ * dashboard). Output printed meanwhile is still kept in the scrollback. fn is
+ * called (with the window erased) whenever the content is redrawn; call
+ * console_redraw_pane when the pane's data changes. Pass NULL for fn to go
+ * back to the scrollback.
+ */
+typedef void (*console_pane_fn) (console c, WINDOW *win, void *data);
+void console_set_pane (console c, console_pane_fn fn, void *data);
+void console_redraw_pane (console c);
+
 #endif /* PTKL_CONSOLE_H */
@@ -0,0 +1,79 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ * Copyright (c) 2025 Tony Pujals
+ */
+
+#ifndef PTKL_JOBS_H
+#define PTKL_JOBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "console.h"
+
+/*
+ * Jobs: run console commands on a pool of worker threads so that long
+ * operations don't freeze input and rendering.
+ *
+ * A job function runs on a worker and streams its output back with
+ * console_job_print (complete lines appear in the content window, prefixed
+ * with the job id, as they're printed). It should check
+ * console_job_cancelled regularly and return early when it's set. Output is
+ * passed to the console's thread through a pipe it polls, so printing
+ * never touches curses from a worker; a job that prints faster than the
+ * console draws waits (up to JOBS_MAX_PENDING bytes are buffered).
+ */
+typedef struct console_jobs console_jobs;
+typedef struct console_job console_job;
+
+/* fn owns arg (free it before returning if it was allocated) */
+typedef void (*console_job_fn) (console_job *job, void *arg);
+
+typedef enum console_job_state {
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_DONE,
+	JOB_CANCELLED,
+} console_job_state;
+
+typedef struct console_job_info {
+	int id;
+	char name[64];
+	console_job_state state;
+	double seconds; /* running (or ran) for */
+	uint64_t lines; /* lines printed */
+} console_job_info;
+
+#define JOBS_DEFAULT_WORKERS 4
+#define JOBS_MAX_PENDING (1 << 20)
+
+/* Returns NULL if the output pipe can't be created */
+console_jobs *console_jobs_new (console c, int workers);
+
+/* Cancel all jobs and wait for them to return */
+void console_jobs_free (console_jobs *jobs);
+
+/* Queue fn to run; returns the job id, or -1 */
+int console_job_start (console_jobs *jobs, const char *name,
+		       console_job_fn fn, void *arg);
+
+/* Ask job id (-1 for the newest unfinished one) to stop; false if none */
+bool console_job_cancel (console_jobs *jobs, int id);
+
+/* Jobs in the order started (finished ones are kept for a while) */
+int console_job_list (console_jobs *jobs, console_job_info *out, int cap);
+
+/*
+ * Take the output waiting to be printed (the caller frees it; NULL if
+ * there is none). The console does this when the jobs' pipe is ready.
+ */
+char *console_jobs_take_output (console_jobs *jobs, size_t *len);
+
+/* For job functions */
+void console_job_print (console_job *job, const char *fmt, ...);
+bool console_job_cancelled (const console_job *job);
+int console_job_id (const console_job *job);
+
+#endif /* PTKL_JOBS_H */
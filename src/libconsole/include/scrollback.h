@@ -0,0 +1,59 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ * Copyright (c) 2025 Tony Pujals
+ */
+
+#ifndef PTKL_SCROLLBACK_H
+#define PTKL_SCROLLBACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Scrollback: bounded line history for the console's content window.
+ *
+ * Line text is appended to a fixed-size byte ring (the arena), and a ring of
+ * (offset, length) records indexes the lines, so appending never allocates
+ * and memory stays constant however long the console runs: when either ring
+ * is full, the oldest lines are dropped.
+ *
+ * Lines are numbered from the first line ever appended, so a position stays
+ * valid while older lines are dropped. The lines still stored are
+ * [scrollback_first, scrollback_end); the last one may be unterminated (text
+ * appended without a newline yet).
+ */
+typedef struct scrollback scrollback;
+
+#define SCROLLBACK_DEFAULT_BYTES (8u << 20)
+#define SCROLLBACK_DEFAULT_LINES (256u << 10)
+
+/* Returns NULL if out of memory */
+scrollback *scrollback_new (size_t max_bytes, size_t max_lines);
+void scrollback_free (scrollback *sb);
+
+/* Append text; each newline ends a line ("\r\n" too) */
+void scrollback_append (scrollback *sb, const char *text, size_t len);
+
+/* Drop all lines (line numbers keep counting up) */
+void scrollback_clear (scrollback *sb);
+
+uint64_t scrollback_first (const scrollback *sb);
+uint64_t scrollback_end (const scrollback *sb);
+
+/*
+ * The text of line n (not null-terminated, without the newline), or NULL if
+ * n isn't stored. The text is only valid until the next append.
+ */
+const char *scrollback_line (const scrollback *sb, uint64_t n, size_t *len);
+
+/*
+ * Find the nearest line containing text, starting at line from and moving
+ * backward (toward older lines) or forward. Returns the line number, or -1.
+ */
+int64_t scrollback_find (const scrollback *sb, const char *text,
+			 uint64_t from, bool backward);
+
+#endif /* PTKL_SCROLLBACK_H */
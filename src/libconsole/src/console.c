@@ -6,20 +6,58 @@
  */
 
 #include "console.h"
+#include "scrollback.h"
 #include <ctype.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 /* Window dimensions */
 #define MIN_TERM_WIDTH 80
 #define MIN_TERM_HEIGHT 24
 
+/*
+ * Damage tracking: changes mark the windows they affect, and a frame redraws
+ * only those windows, staging them with wnoutrefresh and writing them to the
+ * terminal with a single doupdate. Frames are rate limited, so a burst of
+ * console_print calls is rendered once.
+ */
+#define DAMAGE_HEADER (1u << 0)
+#define DAMAGE_CONTENT (1u << 1)
+#define DAMAGE_STATUS (1u << 2)
+#define DAMAGE_CMD (1u << 3)
+#define DAMAGE_SCREEN (1u << 4) /* everything, e.g., after a resize */
+#define DAMAGE_ALL                                                             \
+	(DAMAGE_HEADER | DAMAGE_CONTENT | DAMAGE_STATUS | DAMAGE_CMD |         \
+	 DAMAGE_SCREEN)
+
+/* Event sources (removed sources have fn == NULL until compacted) */
+struct console_fd {
+	int fd;
+	short events;
+	console_fd_handler fn;
+	void *data;
+};
+
+struct console_timer {
+	int id;
+	long interval; /* ns */
+	long deadline; /* ns */
+	console_timer_handler fn;
+	void *data;
+};
+
 /* Forward declarations */
-static void console_free_completions(console c);
+static void console_reset_completions(console c);
+static void console_complete_typed(console c);
+static void console_apply_completion(console c, int i);
 static void console_update_completions(console c);
 static void console_update_status(console c);
+static void console_damage(console c, unsigned damage);
 
 struct console_t {
 	/* Main windows */
@@ -39,6 +77,8 @@ struct console_t {
 	int cmd_pos; /* Current position in command buffer */
 	int typed_pos; /* Current position in typed buffer */
 	command_handler cmd_handler; /* Command handler callback */
+	console_key_handler key_handler; /* Sees keys first, if set */
+	void *key_data;
 
 	/* Error state */
 	char *error_status; /* Saved status during error */
@@ -46,11 +86,45 @@ struct console_t {
 
 	/* Command completion */
 	command_completion completion_handler; /* Command completion callback */
-	char **completions; /* Array of possible completions */
+	console_completion completions[CONSOLE_MAX_COMPLETIONS];
 	int completion_count; /* Number of completions */
+	int completion_start; /* Where the completed word starts */
 	int current_completion; /* Currently selected completion */
+	bool completing; /* completions are for the current input */
+
+	/* Rendering */
+	unsigned damage; /* DAMAGE_* flags for windows that need redrawing */
+	long frame_interval; /* Minimum ns between frames (0 for no cap) */
+	long last_frame; /* When the last frame was rendered (ns) */
+
+	/* Event sources */
+	struct console_fd *fds; /* Registered file descriptors */
+	int fd_count;
+	int fd_capacity;
+	struct pollfd *pollfds; /* Terminal input, then fds (fd_capacity + 1) */
+	struct console_timer *timers; /* Registered timers */
+	int timer_count;
+	int timer_capacity;
+	int next_timer_id;
+
+	/* Content: only the lines in view are drawn (see draw_content) */
+	scrollback *scrollback; /* Bounded history of printed lines */
+	bool follow; /* Keep the newest line in view */
+	uint64_t view_bottom; /* Line at the bottom of the view if not */
+	uint64_t view_top; /* Line at the top of the view (last drawn) */
+	int64_t search_hit; /* Line highlighted by the last search, or -1 */
+	char *search; /* Text of the last search */
+	console_pane_fn pane; /* Draws the content instead, if set */
+	void *pane_data;
 };
 
+static long now_ns (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
 console console_new (void)
 {
 	console c = calloc (1, sizeof (struct console_t));
@@ -67,6 +141,16 @@ console console_new (void)
 	c->cmd_handler = NULL;
 	c->error_status = NULL;
 	c->error_start = 0;
+	c->damage = DAMAGE_ALL;
+	c->frame_interval = 1000000000L / CONSOLE_DEFAULT_MAX_FPS;
+	c->follow = true;
+	c->search_hit = -1;
+	c->scrollback = scrollback_new (SCROLLBACK_DEFAULT_BYTES,
+					SCROLLBACK_DEFAULT_LINES);
+	if (c->scrollback == NULL) {
+		console_free (c);
+		return NULL;
+	}
 
 	return c;
 }
@@ -77,6 +161,11 @@ void console_free (console c)
 
 	free (c->title);
 	free (c->status);
+	free (c->fds);
+	free (c->pollfds);
+	free (c->timers);
+	free (c->search);
+	scrollback_free (c->scrollback);
 	free (c);
 }
 
@@ -146,62 +235,184 @@ bool console_create_windows (console c)
 	c->cmd_win = newwin (1, max_x, max_y - 1, 0);
 	if (c->cmd_win == NULL) return false;
 
-	/* Enable scrolling for content window */
-	scrollok (c->content_win, TRUE);
-
 	/* Initial refresh */
 	console_refresh_windows (c);
 
 	return true;
 }
 
-void console_refresh_windows (console c)
+static void draw_header (console c)
 {
-	if (c == NULL) return;
-
-	/* Refresh header */
 	wmove (c->header_win, 0, 0);
 	wclrtoeol (c->header_win);
-	mvwprintw (c->header_win, 0, 0, "%s", c->title);
-	wrefresh (c->header_win);
+	if (c->title != NULL) {
+		mvwprintw (c->header_win, 0, 0, "%s", c->title);
+	}
+}
 
-	/* Refresh status */
+static void draw_status (console c)
+{
 	wmove (c->status_win, 0, 0);
 	wclrtoeol (c->status_win);
 	if (c->status != NULL) {
 		mvwprintw (c->status_win, 0, 0, "%s", c->status);
 	}
-	wrefresh (c->status_win);
+}
 
-	/* Refresh command bar */
-	if (c->cmd_prompt) {
-		wmove (c->cmd_win, 0, 0);
-		wclrtoeol (c->cmd_win);
-		mvwprintw (c->cmd_win, 0, 0, "%s %s", c->cmd_prompt,
-			   c->cmd_buffer);
-
-		/* Position cursor and highlight current character */
-		int prompt_len = strlen(c->cmd_prompt) + 1; /* +1 for the space */
-		int cursor_x = prompt_len + c->cmd_pos;
-		wmove(c->cmd_win, 0, cursor_x);
-
-		/* If at end of input, show block cursor on a space */
-		if (c->cmd_pos == strlen(c->cmd_buffer)) {
-			wattron(c->cmd_win, A_REVERSE);
-			mvwaddch(c->cmd_win, 0, cursor_x, ' ');
-			wattroff(c->cmd_win, A_REVERSE);
-		} else {
-			/* Highlight current character */
-			wattron(c->cmd_win, A_REVERSE);
-			mvwaddch(c->cmd_win, 0, cursor_x, c->cmd_buffer[c->cmd_pos]);
-			wattroff(c->cmd_win, A_REVERSE);
-		}
+static void draw_command_bar (console c)
+{
+	wmove (c->cmd_win, 0, 0);
+	wclrtoeol (c->cmd_win);
+	if (c->cmd_prompt == NULL) return;
+
+	mvwprintw (c->cmd_win, 0, 0, "%s %s", c->cmd_prompt, c->cmd_buffer);
+
+	/* Position cursor and highlight current character */
+	int prompt_len = strlen (c->cmd_prompt) + 1; /* +1 for the space */
+	int cursor_x = prompt_len + c->cmd_pos;
+
+	/* At the end of input, show a block cursor on a space */
+	chtype under = c->cmd_pos == strlen (c->cmd_buffer)
+			       ? ' '
+			       : (unsigned char)c->cmd_buffer[c->cmd_pos];
+	wattron (c->cmd_win, A_REVERSE);
+	mvwaddch (c->cmd_win, 0, cursor_x, under);
+	wattroff (c->cmd_win, A_REVERSE);
+}
+
+/* Rows a line takes when wrapped to the window width */
+static int line_rows (const scrollback *sb, uint64_t n, int cols)
+{
+	size_t len = 0;
+	scrollback_line (sb, n, &len);
+	return len == 0 ? 1 : (int)((len + cols - 1) / cols);
+}
+
+/*
+ * Draw the lines that fit in the content window, ending with the newest line
+ * (when following) or view_bottom, so the cost of a frame doesn't depend on
+ * how much history there is.
+ */
+static void draw_content (console c)
+{
+	const scrollback *sb = c->scrollback;
+	const uint64_t first = scrollback_first (sb);
+	const uint64_t end = scrollback_end (sb);
+	int rows, cols;
+	getmaxyx (c->content_win, rows, cols);
+	werase (c->content_win);
+	if (c->pane) {
+		c->pane (c, c->content_win, c->pane_data);
+		return;
+	}
+	if (first == end || rows <= 0 || cols <= 0) return;
+
+	uint64_t bottom = c->follow ? end - 1 : c->view_bottom;
+	if (bottom < first) bottom = first;
+	if (bottom >= end) bottom = end - 1;
+
+	/* Walk up from the bottom line to find the top of the view */
+	uint64_t top = bottom;
+	int used = line_rows (sb, bottom, cols);
+	while (top > first) {
+		int n = line_rows (sb, top - 1, cols);
+		if (used + n > rows) break;
+		used += n;
+		top--;
+	}
+	c->view_top = top;
+	c->view_bottom = bottom;
+
+	/* Fill from the top until there's enough history to fill the view */
+	int row = top > first && used < rows ? rows - used : 0;
+	for (uint64_t n = top; n <= bottom && row < rows; n++) {
+		size_t len = 0;
+		const char *text = scrollback_line (sb, n, &len);
+		bool hit = (int64_t)n == c->search_hit;
+		if (hit) wattron (c->content_win, A_REVERSE);
+		size_t off = 0;
+		do {
+			size_t chunk = len - off < (size_t)cols ? len - off
+								 : (size_t)cols;
+			mvwaddnstr (c->content_win, row++, 0, text + off,
+				    (int)chunk);
+			off += chunk;
+		} while (off < len && row < rows);
+		if (hit) wattroff (c->content_win, A_REVERSE);
+	}
+}
 
-		wrefresh (c->cmd_win);
+void console_render (console c)
+{
+	if (c == NULL || c->content_win == NULL) return;
+
+	const unsigned damage = c->damage;
+	c->damage = 0;
+	c->last_frame = now_ns ();
+	if (damage == 0) return;
+
+	/* Stage the damaged windows, then write them out together */
+	if (damage & DAMAGE_SCREEN) {
+		/* Clears stdscr's pending changes, which getch would flush */
+		wnoutrefresh (stdscr);
+		touchwin (c->header_win);
+		touchwin (c->content_win);
+		touchwin (c->status_win);
+		touchwin (c->cmd_win);
 	}
+	if (damage & (DAMAGE_HEADER | DAMAGE_SCREEN)) {
+		draw_header (c);
+		wnoutrefresh (c->header_win);
+	}
+	if (damage & (DAMAGE_CONTENT | DAMAGE_SCREEN)) {
+		draw_content (c);
+		wnoutrefresh (c->content_win);
+	}
+	if (damage & (DAMAGE_STATUS | DAMAGE_SCREEN)) {
+		draw_status (c);
+		wnoutrefresh (c->status_win);
+	}
+	if (damage & (DAMAGE_CMD | DAMAGE_SCREEN)) {
+		draw_command_bar (c);
+		wnoutrefresh (c->cmd_win);
+	}
+	doupdate ();
+}
+
+/* Milliseconds until the next frame can be rendered, or -1 if none is due */
+static int console_frame_timeout (console c)
+{
+	if (c->damage == 0) return -1;
+	long wait = c->last_frame + c->frame_interval - now_ns ();
+	if (wait <= 0) return 0;
+	return (int)((wait + 999999) / 1000000);
+}
+
+static void console_render_if_due (console c)
+{
+	if (console_frame_timeout (c) == 0) console_render (c);
+}
+
+/* Mark windows for redrawing; render now unless a frame was just rendered */
+static void console_damage (console c, unsigned damage)
+{
+	c->damage |= damage;
+	if (c->content_win != NULL) console_render_if_due (c);
+}
+
+void console_set_max_fps (console c, int fps)
+{
+	if (c == NULL) return;
+	c->frame_interval = fps > 0 ? 1000000000L / fps : 0;
+}
 
-	/* Refresh content */
-	wrefresh (c->content_win);
+void console_refresh_windows (console c)
+{
+	if (c == NULL) return;
+
+	/* Redraw everything now */
+	c->damage = DAMAGE_ALL;
+	console_render (c);
 }
 
 void console_resize_windows (console c)
@@ -216,27 +427,208 @@ void console_resize_windows (console c)
 
 	/* Resize and move other windows */
 	wresize (c->header_win, 1, max_x);
-	wresize (c->content_win, max_y - 2, max_x);
+	wresize (c->content_win, max_y - 3, max_x);
 	wresize (c->status_win, 1, max_x);
+	wresize (c->cmd_win, 1, max_x);
 
-	mvwin (c->status_win, max_y - 1, 0);
+	mvwin (c->status_win, max_y - 2, 0);
+	mvwin (c->cmd_win, max_y - 1, 0);
 
 	/* Refresh all windows */
 	console_refresh_windows (c);
 }
 
+bool console_add_fd (console c, int fd, short events, console_fd_handler fn,
+		     void *data)
+{
+	if (c == NULL || fd < 0 || fn == NULL) return false;
+
+	for (int i = 0; i < c->fd_count; i++) {
+		if (c->fds[i].fd == fd && c->fds[i].fn != NULL) return false;
+	}
+
+	if (c->fd_count == c->fd_capacity) {
+		int capacity = c->fd_capacity ? c->fd_capacity * 2 : 4;
+		struct console_fd *fds =
+			realloc (c->fds, capacity * sizeof (*fds));
+		if (fds == NULL) return false;
+		c->fds = fds;
+		struct pollfd *pollfds =
+			realloc (c->pollfds, (capacity + 1) * sizeof (*pollfds));
+		if (pollfds == NULL) return false;
+		c->pollfds = pollfds;
+		c->fd_capacity = capacity;
+	}
+
+	c->fds[c->fd_count++] = (struct console_fd){fd, events, fn, data};
+	return true;
+}
+
+bool console_remove_fd (console c, int fd)
+{
+	if (c == NULL) return false;
+
+	/* Compacted after dispatch (this may be called from a handler) */
+	for (int i = 0; i < c->fd_count; i++) {
+		if (c->fds[i].fd == fd && c->fds[i].fn != NULL) {
+			c->fds[i].fn = NULL;
+			return true;
+		}
+	}
+	return false;
+}
+
+int console_add_timer (console c, long interval_ms, console_timer_handler fn,
+		       void *data)
+{
+	if (c == NULL || interval_ms < 0 || fn == NULL) return -1;
+
+	if (c->timer_count == c->timer_capacity) {
+		int capacity = c->timer_capacity ? c->timer_capacity * 2 : 4;
+		struct console_timer *timers =
+			realloc (c->timers, capacity * sizeof (*timers));
+		if (timers == NULL) return -1;
+		c->timers = timers;
+		c->timer_capacity = capacity;
+	}
+
+	long interval = interval_ms * 1000000L;
+	int id = ++c->next_timer_id;
+	c->timers[c->timer_count++] = (struct console_timer){
+		.id = id,
+		.interval = interval,
+		.deadline = now_ns () + interval,
+		.fn = fn,
+		.data = data,
+	};
+	return id;
+}
+
+bool console_remove_timer (console c, int id)
+{
+	if (c == NULL) return false;
+
+	for (int i = 0; i < c->timer_count; i++) {
+		if (c->timers[i].id == id && c->timers[i].fn != NULL) {
+			c->timers[i].fn = NULL;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Drop sources removed during dispatch */
+static void console_compact_sources (console c)
+{
+	int n = 0;
+	for (int i = 0; i < c->fd_count; i++) {
+		if (c->fds[i].fn != NULL) c->fds[n++] = c->fds[i];
+	}
+	c->fd_count = n;
+
+	n = 0;
+	for (int i = 0; i < c->timer_count; i++) {
+		if (c->timers[i].fn != NULL) c->timers[n++] = c->timers[i];
+	}
+	c->timer_count = n;
+}
+
+/* Milliseconds until the next timer or frame is due, or -1 for neither */
+static int console_poll_timeout (console c)
+{
+	int timeout = console_frame_timeout (c);
+	long now = now_ns ();
+	for (int i = 0; i < c->timer_count; i++) {
+		long wait = c->timers[i].deadline - now;
+		int ms = wait > 0 ? (int)((wait + 999999) / 1000000) : 0;
+		if (timeout < 0 || ms < timeout) timeout = ms;
+	}
+	return timeout;
+}
+
+static void console_run_timers (console c)
+{
+	long now = now_ns ();
+	int count = c->timer_count; /* Not timers added by these handlers */
+	for (int i = 0; i < count && c->running; i++) {
+		struct console_timer *t = &c->timers[i];
+		if (t->fn == NULL || t->deadline > now) continue;
+
+		/* Skip missed ticks instead of running them back to back */
+		t->deadline += t->interval;
+		if (t->deadline <= now) t->deadline = now + t->interval;
+
+		if (!t->fn (c, t->data)) {
+			/* The array may have moved if the handler added timers */
+			c->timers[i].fn = NULL;
+		}
+	}
+}
+
+static void console_read_input (console c)
+{
+	/* Drain everything curses has buffered */
+	int ch;
+	while (c->running && (ch = getch ()) != ERR) {
+		console_handle_input (c, ch);
+	}
+}
+
 bool console_run (console c)
 {
 	if (c == NULL) return false;
 
 	c->running = true;
 
-	/* Event loop */
+	/*
+	 * Input is read from stdscr (which is never drawn on) because getch
+	 * refreshes the window it reads from if it changed, which would bypass
+	 * batching. poll decides when to read, so getch never blocks.
+	 */
+	if (c->pollfds == NULL) {
+		c->pollfds = malloc (sizeof (struct pollfd));
+		if (c->pollfds == NULL) return false;
+	}
+	nodelay (stdscr, TRUE);
+	console_read_input (c);
+
 	while (c->running) {
-		int ch = wgetch (c->content_win);
-		console_handle_input (c, ch);
+		console_render_if_due (c);
+
+		int nfds = c->fd_count;
+		c->pollfds[0] = (struct pollfd){.fd = STDIN_FILENO,
+						.events = POLLIN};
+		for (int i = 0; i < nfds; i++) {
+			c->pollfds[i + 1] = (struct pollfd){
+				.fd = c->fds[i].fn ? c->fds[i].fd : -1,
+				.events = c->fds[i].events,
+			};
+		}
+
+		int ready = poll (c->pollfds, nfds + 1,
+				  console_poll_timeout (c));
+		if (ready < 0 && errno != EINTR) return false;
+
+		/* Also read after EINTR: SIGWINCH becomes KEY_RESIZE */
+		if (ready < 0 || c->pollfds[0].revents) console_read_input (c);
+
+		for (int i = 0; ready > 0 && i < nfds && c->running; i++) {
+			short revents = c->pollfds[i + 1].revents;
+			struct console_fd f = c->fds[i];
+			if (revents == 0 || f.fn == NULL) continue;
+			if (revents & POLLNVAL) {
+				/* Closed without being removed */
+				c->fds[i].fn = NULL;
+				continue;
+			}
+			f.fn (c, f.fd, revents, f.data);
+		}
+
+		console_run_timers (c);
+		console_compact_sources (c);
 	}
 
+	nodelay (stdscr, FALSE);
 	return true;
 }
 
@@ -257,7 +649,7 @@ static void console_clear_error(console c)
 	c->error_start = 0;
 
 	/* Refresh display */
-	console_refresh_windows(c);
+	console_damage(c, DAMAGE_STATUS);
 }
 
 void console_handle_input (console c, int ch)
@@ -269,6 +661,18 @@ void console_handle_input (console c, int ch)
 		console_clear_error(c);
 	}
 
+	/* Keys the application handles itself (e.g., cancel) */
+	if (c->key_handler && c->key_handler(c, ch, c->key_data)) return;
+
+	/* Scrolling and resizing work whether or not there's a prompt */
+	switch (ch) {
+	case KEY_PPAGE: console_scroll (c, CONSOLE_PAGE_UP); return;
+	case KEY_NPAGE: console_scroll (c, CONSOLE_PAGE_DOWN); return;
+	case KEY_HOME: console_scroll (c, CONSOLE_SCROLL_TOP); return;
+	case KEY_END: console_scroll (c, CONSOLE_SCROLL_END); return;
+	case KEY_RESIZE: console_resize_windows (c); return;
+	}
+
 	/* If command prompt is active, handle command input */
 	if (c->cmd_prompt) {
 		switch (ch) {
@@ -280,8 +684,8 @@ void console_handle_input (console c, int ch)
 			c->typed_pos = 0;
 			free(c->status);
 			c->status = NULL;
-			console_free_completions(c);
-			console_refresh_windows(c);
+			console_reset_completions(c);
+			console_damage(c, DAMAGE_STATUS | DAMAGE_CMD);
 			break;
 
 		case KEY_BACKSPACE:
@@ -290,71 +694,54 @@ void console_handle_input (console c, int ch)
 				c->typed_buffer[--c->typed_pos] = '\0';
 				strncpy(c->cmd_buffer, c->typed_buffer, sizeof(c->cmd_buffer) - 1);
 				c->cmd_pos = c->typed_pos;
-				console_free_completions(c);
-
-				/* Check for command matches */
-				if (c->completion_handler) {
-					int count;
-					char **matches = c->completion_handler(c, c->typed_buffer, &count);
-					if (count == 1) {
-						/* Single match - update command buffer if typed buffer is a prefix */
-						if (strncmp(matches[0], c->typed_buffer, strlen(c->typed_buffer)) == 0) {
-							strncpy(c->cmd_buffer, matches[0], sizeof(c->cmd_buffer) - 1);
-							c->cmd_pos = strlen(c->cmd_buffer);
-						}
-						/* Clear status bar */
-						free(c->status);
-						c->status = NULL;
-					} else if (count > 0) {
-						/* Multiple matches - show in status bar */
-						c->completions = matches;
-						c->completion_count = count;
-						c->current_completion = -1;
-						console_update_status(c);
-					} else {
-						/* No matches - show error */
-						free(c->status);
-						asprintf(&c->status, "invalid command: %s", c->typed_buffer);
-						free(matches);
-					}
-				}
-				console_refresh_windows(c);
+				console_reset_completions(c);
+
+				console_complete_typed(c);
+				console_damage(c, DAMAGE_STATUS | DAMAGE_CMD);
 			}
 			break;
 
 		case '\t': /* Tab key */
 			if (c->completion_handler) {
-				if (c->completions == NULL) {
-					/* First tab - get completions */
-					c->current_completion = -1;
+				if (!c->completing) {
+					/* First tab - complete what's shown */
+					strncpy(c->typed_buffer, c->cmd_buffer, sizeof(c->typed_buffer) - 1);
+					c->typed_pos = strlen(c->typed_buffer);
 					console_update_completions(c);
-					if (c->completion_count > 1) {
-						/* Multiple matches - show first but don't select */
-						c->current_completion = -1;
+					if (c->completion_count == 1) {
+						/* Single match - take it */
+						console_apply_completion(c, 0);
+						strncpy(c->typed_buffer, c->cmd_buffer, sizeof(c->typed_buffer) - 1);
+						c->typed_pos = c->cmd_pos;
+						console_reset_completions(c);
+						free(c->status);
+						c->status = NULL;
 					}
 				} else if (c->completion_count > 0) {
 					/* Subsequent tabs - cycle through matches */
 					c->current_completion = (c->current_completion + 1) % c->completion_count;
-					strncpy(c->cmd_buffer, c->completions[c->current_completion], sizeof(c->cmd_buffer) - 1);
-					c->cmd_pos = strlen(c->cmd_buffer);
+					console_apply_completion(c, c->current_completion);
 					/* Update status bar with new selection */
 					console_update_status(c);
 				}
-				console_refresh_windows(c);
+				console_damage(c, DAMAGE_STATUS | DAMAGE_CMD);
 			}
 			break;
 
 		case '\n':
 		case KEY_ENTER:
-			if (c->cmd_handler) {
+			/* "/text" searches back through the content */
+			if (c->cmd_buffer[0] == '/') {
+				console_search(c, c->cmd_buffer + 1);
+			} else if (c->cmd_handler) {
 				c->cmd_handler(c, c->cmd_buffer);
 			}
 			c->cmd_buffer[0] = '\0';
 			c->cmd_pos = 0;
 			c->typed_buffer[0] = '\0';
 			c->typed_pos = 0;
-			console_free_completions(c);
-			console_refresh_windows(c);
+			console_reset_completions(c);
+			console_damage(c, DAMAGE_CMD);
 			break;
 
 		default:
@@ -366,40 +753,10 @@ void console_handle_input (console c, int ch)
 				/* Always show what was typed */
 				strncpy(c->cmd_buffer, c->typed_buffer, sizeof(c->cmd_buffer) - 1);
 				c->cmd_pos = c->typed_pos;
-				console_free_completions(c);
-
-				/* Check for completions */
-				if (c->completion_handler) {
-					int count;
-					char **matches = c->completion_handler(c, c->typed_buffer, &count);
-					if (count == 1) {
-						/* Single match - update command buffer if typed buffer is a prefix */
-						if (strncmp(matches[0], c->typed_buffer, strlen(c->typed_buffer)) == 0) {
-							strncpy(c->cmd_buffer, matches[0], sizeof(c->cmd_buffer) - 1);
-							c->cmd_pos = strlen(c->cmd_buffer);
-						}
-						/* Clear status bar */
-						free(c->status);
-						c->status = NULL;
-						/* Free the matches */
-						for (int i = 0; i < count; i++) {
-							free(matches[i]);
-						}
-						free(matches);
-					} else if (count > 1) {
-						/* Multiple matches - show in status bar */
-						c->completions = matches;
-						c->completion_count = count;
-						c->current_completion = -1;
-						console_update_status(c);
-					} else {
-						/* No matches - show error */
-						free(c->status);
-						asprintf(&c->status, "invalid command: %s", c->typed_buffer);
-						free(matches);
-					}
-				}
-				console_refresh_windows(c);
+				console_reset_completions(c);
+
+				console_complete_typed(c);
+				console_damage(c, DAMAGE_STATUS | DAMAGE_CMD);
 			}
 			break;
 		}
@@ -408,8 +765,6 @@ void console_handle_input (console c, int ch)
 
 	/* Otherwise handle normal input */
 	switch (ch) {
-	case KEY_RESIZE: console_resize_windows (c); break;
-
 	case 'q':
 	case 'Q': console_stop (c); break;
 
@@ -423,12 +778,113 @@ void console_print (console c, const char *fmt, ...)
 {
 	if (c == NULL || fmt == NULL) return;
 
+	char buf[1024];
 	va_list args;
 	va_start (args, fmt);
-	vw_printw (c->content_win, fmt, args);
+	int len = vsnprintf (buf, sizeof (buf), fmt, args);
 	va_end (args);
+	if (len < 0) return;
+
+	char *text = buf;
+	if ((size_t)len >= sizeof (buf)) {
+		text = malloc (len + 1);
+		if (text == NULL) return;
+		va_start (args, fmt);
+		vsnprintf (text, len + 1, fmt, args);
+		va_end (args);
+	}
+	scrollback_append (c->scrollback, text, len);
+	if (text != buf) free (text);
+
+	/* Rendered with the next frame, so bursts of output cost one */
+	console_damage (c, DAMAGE_CONTENT);
+}
+
+void console_scroll (console c, console_scroll_to to)
+{
+	if (c == NULL) return;
+
+	const uint64_t first = scrollback_first (c->scrollback);
+	const uint64_t end = scrollback_end (c->scrollback);
+	if (first == end) return;
+	const uint64_t shown = c->view_bottom - c->view_top + 1;
+
+	switch (to) {
+	case CONSOLE_PAGE_UP:
+		/* The top line becomes the bottom line */
+		if (c->view_top < c->view_bottom || c->view_top == first) {
+			c->view_bottom = c->view_top;
+		} else {
+			c->view_bottom = c->view_top - 1;
+		}
+		c->follow = false;
+		break;
+	case CONSOLE_PAGE_DOWN:
+		if (c->follow) return;
+		c->view_bottom = c->view_bottom + shown - 1;
+		if (c->view_bottom >= end - 1) c->follow = true;
+		break;
+	case CONSOLE_SCROLL_TOP:
+		c->view_bottom = first + shown - 1;
+		c->follow = c->view_bottom >= end - 1;
+		break;
+	case CONSOLE_SCROLL_END:
+		c->follow = true;
+		c->search_hit = -1;
+		break;
+	}
+	console_damage (c, DAMAGE_CONTENT);
+}
+
+bool console_search (console c, const char *text)
+{
+	if (c == NULL || text == NULL) return false;
+
+	/* An empty search repeats the last one, further back */
+	uint64_t from = c->follow ? scrollback_end (c->scrollback) - 1
+				  : c->view_bottom;
+	if (*text == '\0') {
+		if (c->search == NULL) return false;
+		text = c->search;
+		if (c->search_hit >= 0) {
+			from = (uint64_t)c->search_hit;
+			if (from <= scrollback_first (c->scrollback)) {
+				console_error (c, "no more matches: %s", text);
+				return false;
+			}
+			from--;
+		}
+	} else {
+		free (c->search);
+		c->search = strdup (text);
+		if (c->search == NULL) return false;
+		text = c->search;
+	}
+
+	int64_t hit = scrollback_find (c->scrollback, text, from, true);
+	if (hit < 0) {
+		console_error (c, "not found: %s", text);
+		return false;
+	}
+	c->search_hit = hit;
+	c->view_bottom = (uint64_t)hit;
+	c->follow = false;
+	console_damage (c, DAMAGE_CONTENT);
+	return true;
+}
+
+bool console_set_scrollback (console c, size_t max_bytes, size_t max_lines)
+{
+	if (c == NULL) return false;
 
-	wrefresh (c->content_win);
+	scrollback *sb = scrollback_new (max_bytes, max_lines);
+	if (sb == NULL) return false;
+	scrollback_free (c->scrollback);
+	c->scrollback = sb;
+	c->follow = true;
+	c->search_hit = -1;
+	console_damage (c, DAMAGE_CONTENT);
+	return true;
 }
 
 void console_error (console c, const char *fmt, ...)
@@ -437,7 +893,7 @@ void console_error (console c, const char *fmt, ...)
 
 	/* Save current status if not already in error state */
 	if (!c->error_status) {
-		c->error_status = strdup (c->status);
+		c->error_status = strdup (c->status ? c->status : "");
 	}
 
 	/* Format error message */
@@ -455,7 +911,7 @@ void console_error (console c, const char *fmt, ...)
 	c->error_start = time(NULL);
 
 	/* Refresh status window */
-	console_refresh_windows (c);
+	console_damage (c, DAMAGE_STATUS);
 }
 
 void console_set_title (console c, const char *title)
@@ -471,7 +927,7 @@ void console_set_title (console c, const char *title)
 	c->title = title ? strdup(title) : NULL;
 
 	/* Refresh display */
-	console_refresh_windows(c);
+	console_damage(c, DAMAGE_HEADER);
 }
 
 void console_set_command_handler (console c, command_handler handler)
@@ -486,20 +942,50 @@ void console_set_completion_handler (console c, command_completion handler)
 	c->completion_handler = handler;
 }
 
-static void console_free_completions (console c)
+static void console_reset_completions (console c)
 {
-	if (c == NULL || c->completions == NULL) return;
-
-	/* Free each completion string */
-	for (int i = 0; i < c->completion_count; i++) {
-		free(c->completions[i]);
-	}
-
-	/* Free the array */
-	free(c->completions);
-	c->completions = NULL;
+	if (c == NULL) return;
 	c->completion_count = 0;
 	c->current_completion = -1;
+	c->completing = false;
+}
+
+/* Show completion i in the command bar in place of the word being typed */
+static void console_apply_completion (console c, int i)
+{
+	console_completion m = c->completions[i];
+	snprintf(c->cmd_buffer, sizeof(c->cmd_buffer), "%.*s%.*s",
+		 c->completion_start, c->typed_buffer, (int)m.len, m.text);
+	c->cmd_pos = strlen(c->cmd_buffer);
+}
+
+/* Complete the typed word as it's typed (only when there's one match) */
+static void console_complete_typed (console c)
+{
+	if (!c->completion_handler || c->typed_buffer[0] == '/') return;
+
+	console_update_completions(c);
+	const char *word = c->typed_buffer + c->completion_start;
+	size_t len = strlen(word);
+	if (c->completion_count == 1) {
+		/* Single match - fill it in if the typed word is a prefix */
+		console_completion m = c->completions[0];
+		if (m.len >= len && strncmp(m.text, word, len) == 0) {
+			console_apply_completion(c, 0);
+		}
+		console_reset_completions(c);
+		/* Clear status bar */
+		free(c->status);
+		c->status = NULL;
+	} else if (c->completion_count == 0 && len > 0) {
+		/* No matches - show error */
+		free(c->status);
+		if (c->completion_start == 0) {
+			asprintf(&c->status, "invalid command: %s", word);
+		} else {
+			asprintf(&c->status, "no match: %s", word);
+		}
+	}
 }
 
 static void console_update_status (console c)
@@ -515,7 +1001,7 @@ static void console_update_status (console c)
 		/* Find max completion length */
 		size_t max_len = 0;
 		for (int i = 0; i < c->completion_count; i++) {
-			size_t len = strlen(c->completions[i]);
+			size_t len = c->completions[i].len;
 			if (len > max_len) max_len = len;
 		}
 
@@ -523,10 +1009,10 @@ static void console_update_status (console c)
 		for (int i = 0; i < c->completion_count; i++) {
 			if (i == c->current_completion) {
 				/* Selected completion with brackets */
-				pos += snprintf(status + pos, sizeof(status) - pos, "[%-*s]  ", (int)max_len, c->completions[i]);
+				pos += snprintf(status + pos, sizeof(status) - pos, "[%-*.*s]  ", (int)max_len, (int)c->completions[i].len, c->completions[i].text);
 			} else {
 				/* Non-selected completion with padding */
-				pos += snprintf(status + pos, sizeof(status) - pos, " %-*s   ", (int)max_len, c->completions[i]);
+				pos += snprintf(status + pos, sizeof(status) - pos, " %-*.*s   ", (int)max_len, (int)c->completions[i].len, c->completions[i].text);
 			}
 			if (pos >= sizeof(status) - 1) break;
 		}
@@ -534,7 +1020,7 @@ static void console_update_status (console c)
 		/* Update status */
 		free(c->status);
 		c->status = strdup(status);
-		console_refresh_windows(c);
+		console_damage(c, DAMAGE_STATUS);
 	}
 }
 
@@ -543,9 +1029,16 @@ static void console_update_completions (console c)
 	if (c == NULL || !c->completion_handler) return;
 
 	/* Only get new completions if we don't have any */
-	if (c->completions == NULL) {
-		/* Get new completions */
-		c->completions = c->completion_handler(c, c->cmd_buffer, &c->completion_count);
+	if (!c->completing) {
+		/* Get new completions (for what was typed) */
+		int start = 0;
+		int count = c->completion_handler(c, c->typed_buffer, &start,
+						  c->completions,
+						  CONSOLE_MAX_COMPLETIONS);
+		c->completion_count = count < 0 ? 0 : count;
+		c->completion_start = start;
+		c->current_completion = -1;
+		c->completing = true;
 	}
 
 	/* Update status bar */
@@ -567,7 +1060,7 @@ void console_show_command_bar (console c, const char *prompt)
 	c->cmd_pos = 0;
 
 	/* Refresh windows to show/hide command bar */
-	console_refresh_windows (c);
+	console_damage (c, DAMAGE_CMD);
 }
 
 void console_clear (console c)
@@ -575,6 +1068,29 @@ void console_clear (console c)
 	if (c == NULL) return;
 
 	/* Clear content window */
-	werase(c->content_win);
-	wrefresh(c->content_win);
+	scrollback_clear(c->scrollback);
+	c->follow = true;
+	c->search_hit = -1;
+	console_damage(c, DAMAGE_CONTENT);
+}
+
+void console_set_pane (console c, console_pane_fn fn, void *data)
+{
+	if (c == NULL) return;
+	c->pane = fn;
+	c->pane_data = data;
+	console_damage (c, DAMAGE_CONTENT);
+}
+
+void console_redraw_pane (console c)
+{
+	if (c == NULL || c->pane == NULL) return;
+	console_damage (c, DAMAGE_CONTENT);
+}
+
+void console_set_key_handler (console c, console_key_handler fn, void *data)
+{
+	if (c == NULL) return;
+	c->key_handler = fn;
+	c->key_data = data;
 }
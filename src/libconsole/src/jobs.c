@@ -0,0 +1,431 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ * Copyright (c) 2025 Tony Pujals
+ */
+
+#include "jobs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Finished jobs kept for console_job_list */
+#define JOBS_KEEP 32
+
+struct console_job {
+	console_jobs *jobs;
+	int id;
+	char name[64];
+	console_job_fn fn;
+	void *arg;
+	console_job_state state; /* Guarded by jobs->lock */
+	atomic_bool cancel;
+	long start_ns, end_ns;
+	uint64_t lines;
+	struct console_job *next; /* In the queue */
+
+	/* The unterminated end of the output (only the worker touches it) */
+	char *partial;
+	size_t partial_len;
+	size_t partial_cap;
+};
+
+struct console_jobs {
+	console c;
+	pthread_mutex_t lock;
+	pthread_cond_t queued; /* A job was queued, or shutting down */
+	pthread_cond_t drained; /* The console took the pending output */
+	pthread_t *threads;
+	int thread_count;
+	int workers;
+	int idle;
+	bool shutdown;
+
+	/* All jobs (in the order started), and the ones waiting for a worker */
+	console_job **all;
+	int count;
+	int capacity;
+	console_job *head, *tail;
+	int next_id;
+
+	/*
+	 * Output waiting to be printed by the console's thread. The first
+	 * output after the console takes it writes a byte to the pipe, which
+	 * the console polls (see take_output).
+	 */
+	char *pending;
+	size_t pending_len;
+	size_t pending_cap;
+	bool woken;
+	int pipe[2];
+};
+
+static long now_ns (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* Append to the pending output (with the lock held) */
+static void emit (console_jobs *jobs, const char *text, size_t len)
+{
+	if (jobs->pending_len + len > jobs->pending_cap) {
+		size_t cap = jobs->pending_cap ? jobs->pending_cap * 2 : 4096;
+		while (cap < jobs->pending_len + len) cap *= 2;
+		char *pending = realloc (jobs->pending, cap);
+		if (pending == NULL) return;
+		jobs->pending = pending;
+		jobs->pending_cap = cap;
+	}
+	memcpy (jobs->pending + jobs->pending_len, text, len);
+	jobs->pending_len += len;
+
+	if (!jobs->woken) {
+		jobs->woken = write (jobs->pipe[1], "", 1) == 1;
+	}
+}
+
+static void emitf (console_jobs *jobs, const char *fmt, ...)
+{
+	char buf[256];
+	va_list args;
+	va_start (args, fmt);
+	int len = vsnprintf (buf, sizeof (buf), fmt, args);
+	va_end (args);
+	if (len < 0) return;
+	emit (jobs, buf, (size_t)len < sizeof (buf) ? (size_t)len
+						     : sizeof (buf) - 1);
+}
+
+/* Move the complete lines of a job's output to the pending output */
+static void emit_lines (console_job *job, bool flush)
+{
+	console_jobs *jobs = job->jobs;
+	pthread_mutex_lock (&jobs->lock);
+
+	/* Wait for the console to catch up with a job that prints a lot */
+	while (jobs->pending_len > JOBS_MAX_PENDING && !jobs->shutdown &&
+	       !atomic_load (&job->cancel)) {
+		pthread_cond_wait (&jobs->drained, &jobs->lock);
+	}
+
+	size_t start = 0;
+	for (size_t i = 0; i < job->partial_len; i++) {
+		if (job->partial[i] != '\n') continue;
+		emitf (jobs, "[%d] ", job->id);
+		emit (jobs, job->partial + start, i + 1 - start);
+		job->lines++;
+		start = i + 1;
+	}
+	if (flush && start < job->partial_len) {
+		emitf (jobs, "[%d] ", job->id);
+		emit (jobs, job->partial + start, job->partial_len - start);
+		emit (jobs, "\n", 1);
+		job->lines++;
+		start = job->partial_len;
+	}
+	pthread_mutex_unlock (&jobs->lock);
+
+	memmove (job->partial, job->partial + start, job->partial_len - start);
+	job->partial_len -= start;
+}
+
+void console_job_print (console_job *job, const char *fmt, ...)
+{
+	if (job == NULL || fmt == NULL) return;
+
+	va_list args;
+	va_start (args, fmt);
+	int len = vsnprintf (NULL, 0, fmt, args);
+	va_end (args);
+	if (len <= 0) return;
+
+	if (job->partial_len + len + 1 > job->partial_cap) {
+		size_t cap = job->partial_cap ? job->partial_cap : 256;
+		while (cap < job->partial_len + len + 1) cap *= 2;
+		char *partial = realloc (job->partial, cap);
+		if (partial == NULL) return;
+		job->partial = partial;
+		job->partial_cap = cap;
+	}
+	va_start (args, fmt);
+	vsnprintf (job->partial + job->partial_len, len + 1, fmt, args);
+	va_end (args);
+	job->partial_len += len;
+
+	if (memchr (job->partial + job->partial_len - len, '\n', len)) {
+		emit_lines (job, false);
+	}
+}
+
+bool console_job_cancelled (const console_job *job)
+{
+	return job != NULL && atomic_load (&job->cancel);
+}
+
+int console_job_id (const console_job *job)
+{
+	return job ? job->id : -1;
+}
+
+static void *worker (void *data)
+{
+	console_jobs *jobs = data;
+	pthread_mutex_lock (&jobs->lock);
+	for (;;) {
+		while (jobs->head == NULL && !jobs->shutdown) {
+			jobs->idle++;
+			pthread_cond_wait (&jobs->queued, &jobs->lock);
+			jobs->idle--;
+		}
+		console_job *job = jobs->head;
+		if (job == NULL) break;
+		jobs->head = job->next;
+		if (jobs->head == NULL) jobs->tail = NULL;
+
+		job->state = JOB_RUNNING;
+		job->start_ns = now_ns ();
+		pthread_mutex_unlock (&jobs->lock);
+
+		/* Called even if cancelled already, so fn can free arg */
+		job->fn (job, job->arg);
+		emit_lines (job, true);
+
+		pthread_mutex_lock (&jobs->lock);
+		job->end_ns = now_ns ();
+		bool cancelled = atomic_load (&job->cancel);
+		job->state = cancelled ? JOB_CANCELLED : JOB_DONE;
+		emitf (jobs, "[%d] %s: %s (%.2fs)\n", job->id, job->name,
+		       cancelled ? "cancelled" : "done",
+		       (job->end_ns - job->start_ns) / 1e9);
+	}
+	pthread_mutex_unlock (&jobs->lock);
+	return NULL;
+}
+
+char *console_jobs_take_output (console_jobs *jobs, size_t *len)
+{
+	pthread_mutex_lock (&jobs->lock);
+	char *text = jobs->pending;
+	*len = jobs->pending_len;
+	jobs->pending = NULL;
+	jobs->pending_len = 0;
+	jobs->pending_cap = 0;
+	jobs->woken = false;
+	pthread_cond_broadcast (&jobs->drained);
+	pthread_mutex_unlock (&jobs->lock);
+	return text;
+}
+
+/* Print pending output (on the console's thread) */
+static void take_output (console c, int fd, short revents, void *data)
+{
+	console_jobs *jobs = data;
+	char buf[64];
+	while (read (fd, buf, sizeof (buf)) > 0) {
+	}
+
+	size_t len;
+	char *text = console_jobs_take_output (jobs, &len);
+	if (len > 0) console_print (c, "%.*s", (int)len, text);
+	free (text);
+}
+
+console_jobs *console_jobs_new (console c, int workers)
+{
+	if (c == NULL) return NULL;
+	console_jobs *jobs = calloc (1, sizeof (*jobs));
+	if (jobs == NULL) return NULL;
+	jobs->threads = calloc (workers > 0 ? workers : 1, sizeof (pthread_t));
+	if (jobs->threads == NULL || pipe (jobs->pipe) < 0) {
+		free (jobs->threads);
+		free (jobs);
+		return NULL;
+	}
+	for (int i = 0; i < 2; i++) {
+		fcntl (jobs->pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl (jobs->pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	jobs->c = c;
+	jobs->workers = workers > 0 ? workers : 1;
+	jobs->next_id = 1;
+	pthread_mutex_init (&jobs->lock, NULL);
+	pthread_cond_init (&jobs->queued, NULL);
+	pthread_cond_init (&jobs->drained, NULL);
+
+	if (!console_add_fd (c, jobs->pipe[0], POLLIN, take_output, jobs)) {
+		console_jobs_free (jobs);
+		return NULL;
+	}
+	return jobs;
+}
+
+void console_jobs_free (console_jobs *jobs)
+{
+	if (jobs == NULL) return;
+	console_remove_fd (jobs->c, jobs->pipe[0]);
+
+	pthread_mutex_lock (&jobs->lock);
+	jobs->shutdown = true;
+	for (int i = 0; i < jobs->count; i++) {
+		atomic_store (&jobs->all[i]->cancel, true);
+	}
+	pthread_cond_broadcast (&jobs->queued);
+	pthread_cond_broadcast (&jobs->drained);
+	pthread_mutex_unlock (&jobs->lock);
+
+	for (int i = 0; i < jobs->thread_count; i++) {
+		pthread_join (jobs->threads[i], NULL);
+	}
+	for (int i = 0; i < jobs->count; i++) {
+		free (jobs->all[i]->partial);
+		free (jobs->all[i]);
+	}
+	pthread_mutex_destroy (&jobs->lock);
+	pthread_cond_destroy (&jobs->queued);
+	pthread_cond_destroy (&jobs->drained);
+	close (jobs->pipe[0]);
+	close (jobs->pipe[1]);
+	free (jobs->pending);
+	free (jobs->all);
+	free (jobs->threads);
+	free (jobs);
+}
+
+/* Drop the oldest finished jobs beyond JOBS_KEEP (with the lock held) */
+static void prune (console_jobs *jobs)
+{
+	int finished = 0;
+	for (int i = 0; i < jobs->count; i++) {
+		finished += jobs->all[i]->state >= JOB_DONE;
+	}
+	int n = 0;
+	for (int i = 0; i < jobs->count; i++) {
+		console_job *job = jobs->all[i];
+		if (finished > JOBS_KEEP && job->state >= JOB_DONE) {
+			free (job->partial);
+			free (job);
+			finished--;
+			continue;
+		}
+		jobs->all[n++] = job;
+	}
+	jobs->count = n;
+}
+
+/* Start another worker if they're all busy (with the lock held) */
+static void add_worker (console_jobs *jobs)
+{
+	if (jobs->idle > 0 || jobs->thread_count == jobs->workers) return;
+
+	/* Signals (e.g., SIGWINCH) are for the console's thread */
+	sigset_t all, old;
+	sigfillset (&all);
+	pthread_sigmask (SIG_SETMASK, &all, &old);
+	if (pthread_create (&jobs->threads[jobs->thread_count], NULL, worker,
+			    jobs) == 0) {
+		jobs->thread_count++;
+	}
+	pthread_sigmask (SIG_SETMASK, &old, NULL);
+}
+
+int console_job_start (console_jobs *jobs, const char *name,
+		       console_job_fn fn, void *arg)
+{
+	if (jobs == NULL || fn == NULL) return -1;
+	console_job *job = calloc (1, sizeof (*job));
+	if (job == NULL) return -1;
+	job->jobs = jobs;
+	job->fn = fn;
+	job->arg = arg;
+	job->state = JOB_QUEUED;
+	snprintf (job->name, sizeof (job->name), "%s", name ? name : "job");
+
+	pthread_mutex_lock (&jobs->lock);
+	prune (jobs);
+	if (jobs->count == jobs->capacity) {
+		int capacity = jobs->capacity ? jobs->capacity * 2 : 16;
+		console_job **all =
+			realloc (jobs->all, capacity * sizeof (*all));
+		if (all == NULL) {
+			pthread_mutex_unlock (&jobs->lock);
+			free (job);
+			return -1;
+		}
+		jobs->all = all;
+		jobs->capacity = capacity;
+	}
+	job->id = jobs->next_id++;
+	jobs->all[jobs->count++] = job;
+	if (jobs->tail) {
+		jobs->tail->next = job;
+	} else {
+		jobs->head = job;
+	}
+	jobs->tail = job;
+	add_worker (jobs);
+	if (jobs->thread_count == 0) {
+		/* No worker could be started */
+		jobs->count--;
+		jobs->head = jobs->tail = NULL;
+		pthread_mutex_unlock (&jobs->lock);
+		free (job);
+		return -1;
+	}
+	pthread_cond_signal (&jobs->queued);
+	int id = job->id;
+	pthread_mutex_unlock (&jobs->lock);
+	return id;
+}
+
+bool console_job_cancel (console_jobs *jobs, int id)
+{
+	if (jobs == NULL) return false;
+	bool found = false;
+	pthread_mutex_lock (&jobs->lock);
+	for (int i = jobs->count - 1; i >= 0 && !found; i--) {
+		console_job *job = jobs->all[i];
+		if (job->state >= JOB_DONE) continue;
+		if (id == -1 || job->id == id) {
+			atomic_store (&job->cancel, true);
+			found = true;
+		}
+	}
+	/* Wake a job waiting for its output to be taken */
+	pthread_cond_broadcast (&jobs->drained);
+	pthread_mutex_unlock (&jobs->lock);
+	return found;
+}
+
+int console_job_list (console_jobs *jobs, console_job_info *out, int cap)
+{
+	if (jobs == NULL) return 0;
+	long now = now_ns ();
+	pthread_mutex_lock (&jobs->lock);
+	int n = 0;
+	for (int i = 0; i < jobs->count && n < cap; i++) {
+		const console_job *job = jobs->all[i];
+		console_job_info *info = &out[n++];
+		info->id = job->id;
+		memcpy (info->name, job->name, sizeof (info->name));
+		info->state = job->state;
+		info->lines = job->lines;
+		long end = job->state >= JOB_DONE ? job->end_ns : now;
+		info->seconds = job->state == JOB_QUEUED
+					? 0
+					: (end - job->start_ns) / 1e9;
+	}
+	pthread_mutex_unlock (&jobs->lock);
+	return n;
+}
@@ -0,0 +1,189 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ * Copyright (c) 2025 Tony Pujals
+ */
+
+#include "scrollback.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Where a line's text is in the arena */
+struct line_ref {
+	uint64_t offset; /* Absolute byte offset (arena index is % size) */
+	size_t len;
+};
+
+struct scrollback {
+	/* Byte ring: a line is never split across the end of the arena */
+	char *arena;
+	size_t arena_size;
+	uint64_t tail; /* Absolute offset for the next line */
+
+	/* Line ring: line n is lines[n % max_lines] */
+	struct line_ref *lines;
+	size_t max_lines;
+	uint64_t first; /* Oldest line stored */
+	uint64_t end; /* One past the newest complete line */
+
+	/* The unterminated last line (at most arena_size bytes) */
+	char *partial;
+	size_t partial_len;
+	size_t partial_cap;
+};
+
+scrollback *scrollback_new (size_t max_bytes, size_t max_lines)
+{
+	if (max_bytes == 0 || max_lines == 0) return NULL;
+
+	scrollback *sb = calloc (1, sizeof (*sb));
+	if (sb == NULL) return NULL;
+	sb->arena = malloc (max_bytes);
+	sb->lines = malloc (max_lines * sizeof (*sb->lines));
+	if (sb->arena == NULL || sb->lines == NULL) {
+		scrollback_free (sb);
+		return NULL;
+	}
+	sb->arena_size = max_bytes;
+	sb->max_lines = max_lines;
+	return sb;
+}
+
+void scrollback_free (scrollback *sb)
+{
+	if (sb == NULL) return;
+	free (sb->arena);
+	free (sb->lines);
+	free (sb->partial);
+	free (sb);
+}
+
+void scrollback_clear (scrollback *sb)
+{
+	sb->end += sb->partial_len > 0;
+	sb->first = sb->end;
+	sb->partial_len = 0;
+}
+
+static void add_line (scrollback *sb, const char *text, size_t len)
+{
+	if (len > 0 && text[len - 1] == '\r') len--;
+	if (len > sb->arena_size) len = sb->arena_size;
+
+	/* Start at the beginning of the arena if the line won't fit */
+	uint64_t start = sb->tail;
+	size_t at = start % sb->arena_size;
+	if (at + len > sb->arena_size) {
+		start += sb->arena_size - at;
+		at = 0;
+	}
+
+	/* Drop lines the new one overwrites, and the oldest if full */
+	while (sb->first < sb->end &&
+	       sb->lines[sb->first % sb->max_lines].offset + sb->arena_size <
+		       start + len) {
+		sb->first++;
+	}
+	if (sb->end - sb->first == sb->max_lines) sb->first++;
+
+	memcpy (sb->arena + at, text, len);
+	sb->lines[sb->end % sb->max_lines] = (struct line_ref){start, len};
+	sb->end++;
+	sb->tail = start + len;
+}
+
+static void add_partial (scrollback *sb, const char *text, size_t len)
+{
+	if (len > sb->arena_size - sb->partial_len) {
+		len = sb->arena_size - sb->partial_len;
+	}
+	if (sb->partial_len + len > sb->partial_cap) {
+		size_t cap = sb->partial_cap ? sb->partial_cap : 64;
+		while (cap < sb->partial_len + len) cap *= 2;
+		if (cap > sb->arena_size) cap = sb->arena_size;
+		char *partial = realloc (sb->partial, cap);
+		if (partial == NULL) return;
+		sb->partial = partial;
+		sb->partial_cap = cap;
+	}
+	memcpy (sb->partial + sb->partial_len, text, len);
+	sb->partial_len += len;
+}
+
+void scrollback_append (scrollback *sb, const char *text, size_t len)
+{
+	const char *end = text + len;
+	const char *nl;
+	while ((nl = memchr (text, '\n', end - text)) != NULL) {
+		if (sb->partial_len > 0) {
+			add_partial (sb, text, nl - text);
+			add_line (sb, sb->partial, sb->partial_len);
+			sb->partial_len = 0;
+		} else {
+			add_line (sb, text, nl - text);
+		}
+		text = nl + 1;
+	}
+	if (text < end) add_partial (sb, text, end - text);
+}
+
+uint64_t scrollback_first (const scrollback *sb)
+{
+	return sb->first;
+}
+
+uint64_t scrollback_end (const scrollback *sb)
+{
+	return sb->end + (sb->partial_len > 0);
+}
+
+const char *scrollback_line (const scrollback *sb, uint64_t n, size_t *len)
+{
+	if (n < sb->first || n >= scrollback_end (sb)) return NULL;
+	if (n == sb->end) {
+		*len = sb->partial_len;
+		return sb->partial;
+	}
+	const struct line_ref *ref = &sb->lines[n % sb->max_lines];
+	*len = ref->len;
+	return sb->arena + ref->offset % sb->arena_size;
+}
+
+static bool contains (const char *line, size_t len, const char *text,
+		      size_t text_len)
+{
+	if (text_len == 0) return true;
+	const char *end = line + len;
+	while (len >= text_len) {
+		const char *p = memchr (line, text[0], len - text_len + 1);
+		if (p == NULL) return false;
+		if (memcmp (p, text, text_len) == 0) return true;
+		line = p + 1;
+		len = end - line;
+	}
+	return false;
+}
+
+int64_t scrollback_find (const scrollback *sb, const char *text,
+			 uint64_t from, bool backward)
+{
+	const uint64_t first = sb->first, end = scrollback_end (sb);
+	if (first == end) return -1;
+	if (from < first) from = first;
+	if (from >= end) from = end - 1;
+
+	const size_t text_len = strlen (text);
+	for (uint64_t n = from;;) {
+		size_t len;
+		const char *line = scrollback_line (sb, n, &len);
+		if (contains (line, len, text, text_len)) return (int64_t)n;
+		if (backward) {
+			if (n == first) break;
+			n--;
+		} else {
+			if (++n == end) break;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,136 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Runtime metrics shared between processes.
+ *
+ * Each service process publishes its metrics into a slot of a shared-memory
+ * segment (POSIX shm, METRICS_SEGMENT by default), and the admin console (or
+ * any other reader) maps the segment read-only to show them:
+ *
+ *     metrics_publisher *m = metrics_publish (nullptr, "api");
+ *     ...
+ *     metrics_request (m, elapsed_ns, ok);  // per request
+ *     metrics_set (m, METRIC_QUEUE_DEPTH, depth);
+ *     ...
+ *     metrics_unpublish (m);
+ *
+ * Publishing never waits for readers: a slot is written only by the
+ * process that owns it, and each of its values by one thread (requests by
+ * the thread that calls metrics_request, gauges and updated_ns by the one
+ * that calls metrics_set and metrics_sample_rss), so an update is a plain
+ * (relaxed atomic) load and store to memory the process already owns, with
+ * no locks, locked instructions, or system calls. Readers only load. The
+ * values in a reading are each current, but a reading can catch a request
+ * counted and not yet added to the latency histogram.
+ *
+ * Counters (requests, errors, latency histogram) only increase, so a reader
+ * computes rates and latency percentiles for an interval from the
+ * difference of two readings.
+ */
+
+#define METRICS_SEGMENT "/ptkl-metrics"
+#define METRICS_SLOTS 64
+#define METRICS_NAME_MAX 32
+
+/*
+ * Latency histogram buckets (in microseconds): 0-3 exactly, then 4 buckets
+ * for each power of 2, up to about an hour (values within 25%).
+ */
+#define METRICS_BUCKETS 128
+
+typedef enum metric_gauge {
+	METRIC_HEAP_USED,  /* JS heap in use (bytes, JS_ComputeMemoryUsage) */
+	METRIC_HEAP_LIMIT, /* JS heap limit (bytes, 0 for none) */
+	METRIC_RSS,	   /* resident set size (bytes) */
+	METRIC_QUEUE_DEPTH, /* requests waiting */
+	METRIC_GAUGE_COUNT,
+} metric_gauge;
+
+typedef struct metrics_publisher metrics_publisher;
+typedef struct metrics_reader metrics_reader;
+
+/* one service's metrics, as read from its slot */
+typedef struct metrics_snapshot {
+	int pid;
+	char service[METRICS_NAME_MAX];
+	uint64_t requests;
+	uint64_t errors;
+	uint64_t latency[METRICS_BUCKETS];
+	uint64_t gauges[METRIC_GAUGE_COUNT];
+	uint64_t updated_ns; /* CLOCK_MONOTONIC, when a gauge was last set */
+} metrics_snapshot;
+
+/**
+ * Claim a slot for this process in segment (nullptr for METRICS_SEGMENT),
+ * creating the segment if it doesn't exist yet. Slots of processes that
+ * exited without unpublishing (even while claiming one) are reclaimed.
+ * Returns nullptr (and logs why) if the segment can't be opened or all
+ * slots are in use.
+ */
+metrics_publisher *metrics_publish (const char *segment, const char *service);
+void metrics_unpublish (metrics_publisher *m);
+
+/* count a request and its latency */
+void metrics_request (metrics_publisher *m, uint64_t latency_ns, bool ok);
+void metrics_set (metrics_publisher *m, metric_gauge gauge, uint64_t value);
+
+/* set METRIC_RSS from /proc/self/statm (call it periodically, not per
+ * request) */
+void metrics_sample_rss (metrics_publisher *m);
+
+/**
+ * Map segment (nullptr for METRICS_SEGMENT) read-only. Returns nullptr if
+ * no service has created it yet.
+ */
+metrics_reader *metrics_open (const char *segment);
+void metrics_close (metrics_reader *r);
+
+/**
+ * Read the slots of the services publishing now (at most cap, in slot
+ * order). Returns how many were read.
+ */
+int metrics_read (metrics_reader *r, metrics_snapshot *out, int cap);
+
+/* the histogram bucket for a latency, and the lowest latency in a bucket */
+int metrics_bucket (uint64_t latency_us);
+uint64_t metrics_bucket_floor (int bucket);
+
+/**
+ * The latency (microseconds) below which fraction q (0 to 1) of the
+ * requests counted in latency fall: the upper bound of the bucket the
+ * percentile falls in. Returns 0 if there are none.
+ */
+uint64_t metrics_percentile (const uint64_t latency[METRICS_BUCKETS],
+			     double q);
+
+#endif /* METRICS_H */
@@ -28,8 +28,31 @@
 #define PTKL_H
 
 /**
- * Set up signal handlers and perform any other initialization
+ * Set up signal handlers. Everything else (storage, the engine, ...) is a
+ * subsystem that initializes on first use (see subsystem.h), so commands only
+ * pay for what they use. Registers ptkl_finish to run at exit.
  */
 void ptkl_init ();
 
+/**
+ * Tear down the subsystems that were initialized. With the PTKL_STARTUP_TRACE
+ * environment variable set, first print the subsystems the command
+ * initialized and how long each took (to stderr).
+ */
+void ptkl_finish ();
+
+/**
+ * Startup trace
+ *
+ * Marks record when startup reaches the end of a phase (e.g., "init" after
+ * ptkl_init). When the PTKL_STARTUP_FD environment variable names an open
+ * file descriptor, each mark writes a line to it:
+ *
+ *     <phase> <CLOCK_MONOTONIC ns>
+ *
+ * The cold-start benchmark (ptklstartbench) uses this to break exec time
+ * down by phase. Without PTKL_STARTUP_FD, a mark costs a branch.
+ */
+void ptkl_startup_mark (const char *phase);
+
 #endif /* PTKL_H */
@@ -0,0 +1,148 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SUBSYSTEM_H
+#define SUBSYSTEM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Lazily initialized subsystems.
+ *
+ * A subsystem (storage, data, messaging, the engine, ...) is declared
+ * statically with its init and teardown hooks, and initialized the first time
+ * something calls subsystem_use() on it, so a command only pays for the
+ * subsystems it actually uses:
+ *
+ *     static bool storage_init () { ... }
+ *     static void storage_teardown () { ... }
+ *
+ *     subsystem storage = SUBSYSTEM ("storage", storage_init,
+ *                                    storage_teardown);
+ *
+ *     if (!subsystem_use (&storage)) return;  // init failed
+ *
+ * Init runs exactly once, even when several threads use a subsystem at the
+ * same time (the others wait for it to finish); after that, subsystem_use is
+ * an atomic load. An init hook may use other subsystems (its dependencies),
+ * and a dependency cycle panics instead of deadlocking. If init fails,
+ * subsystem_use returns false from then on without retrying.
+ *
+ * subsystem_teardown_all() runs the teardown hooks in reverse order of
+ * initialization, so dependents are torn down before their dependencies.
+ *
+ * Each init is recorded in a trace (name, nesting, start, and duration) that
+ * subsystem_print_trace() prints to show what a command initialized.
+ */
+
+typedef enum subsystem_state {
+	SUBSYSTEM_UNINITIALIZED,
+	SUBSYSTEM_INITIALIZING,
+	SUBSYSTEM_READY,
+	SUBSYSTEM_FAILED,
+} subsystem_state;
+
+typedef bool (*subsystem_init_fn) ();
+typedef void (*subsystem_teardown_fn) ();
+
+typedef struct subsystem {
+	const char *name;
+	subsystem_init_fn init;		/* optional */
+	subsystem_teardown_fn teardown; /* optional */
+
+	/* managed by subsystem_use */
+	_Atomic subsystem_state state;
+	struct subsystem *next_ready; /* initialized subsystems, newest first */
+} subsystem;
+
+/* static initializer for a subsystem */
+#define SUBSYSTEM(name_, init_, teardown_)                                     \
+	{.name = (name_), .init = (init_), .teardown = (teardown_)}
+
+bool subsystem_use_slow (subsystem *s);
+
+/**
+ * Initialize the subsystem if this is its first use. Returns false if its
+ * init failed (now or on first use).
+ */
+static inline bool subsystem_use (subsystem *s)
+{
+	if (atomic_load_explicit (&s->state, memory_order_acquire) ==
+	    SUBSYSTEM_READY) {
+		return true;
+	}
+	return subsystem_use_slow (s);
+}
+
+/**
+ * Return true if the subsystem has been initialized (without initializing
+ * it).
+ */
+bool subsystem_ready (subsystem *s);
+
+/**
+ * Tear down all initialized subsystems, newest first, and mark them
+ * uninitialized (a later subsystem_use initializes them again). Call this when
+ * no other threads are using subsystems.
+ */
+void subsystem_teardown_all ();
+
+/**
+ * Startup trace
+ */
+
+typedef struct subsystem_trace_entry {
+	const char *name;
+	int depth;	      /* 0 unless initialized by another's init */
+	uint64_t start_ns;    /* CLOCK_MONOTONIC */
+	uint64_t duration_ns; /* including dependencies initialized by it */
+	uint64_t self_ns;     /* excluding them */
+	bool ok;
+} subsystem_trace_entry;
+
+/**
+ * Number of inits recorded, and a copy of the ith (in the order they
+ * started). An init is recorded when it finishes, so a trace taken while
+ * others are initializing doesn't include them yet. Returns false if i is
+ * out of range.
+ */
+size_t subsystem_trace_count ();
+bool subsystem_trace_get (size_t i, subsystem_trace_entry *entry);
+
+/**
+ * Print the trace as a table: each init (indented under the subsystem whose
+ * init used it), when it started relative to since_ns, and how long it took.
+ */
+void subsystem_print_trace (FILE *f, uint64_t since_ns);
+
+/**
+ * Forget the recorded inits.
+ */
+void subsystem_reset_trace ();
+
+#endif /* SUBSYSTEM_H */
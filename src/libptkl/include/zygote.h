@@ -0,0 +1,142 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Fork server (zygote).
+ *
+ * A zygote process does the expensive startup once (creates the engine,
+ * evaluates the app's top-level code, warms caches), then forks workers
+ * that start with a copy-on-write copy of its initialized heap instead of
+ * repeating that work:
+ *
+ *     zygote_opts opts = {.worker = serve_requests, .prefork = collect,
+ *                         .arg = js};
+ *     zygote *z = zygote_new (&opts);
+ *     zygote_spawn (z, nullptr);           // or zygote_serve (z, in, out)
+ *     ...
+ *     zygote_free (z);
+ *
+ * prefork runs in the zygote before each fork. Collecting garbage there
+ * means workers don't inherit (and then dirty, by freeing) garbage pages.
+ * The worker function runs in the child, which exits with its result.
+ *
+ * zygote_serve runs a line-based control protocol, so a supervisor (or a
+ * person at a terminal) can scale workers up and down. Every response ends
+ * with a line that is "ok", "bye", or starts with "error:".
+ *
+ *     spawn [N]   spawn N workers (default 1):
+ *                   "spawned PID INDEX SPAWN_US" per worker
+ *     reap        report workers that exited: "exited PID INDEX STATUS"
+ *                 (STATUS is the exit code, or "signal N")
+ *     list        one line per running worker with its memory (KB):
+ *                   "worker PID INDEX rss=N pss=N shared=N private=N"
+ *     kill PID    send a worker SIGTERM
+ *     quit        terminate the workers and return ("bye")
+ */
+typedef struct zygote zygote;
+
+/* runs in a new worker; returns its exit status */
+typedef int (*zygote_worker_fn) (int index, void *arg);
+typedef void (*zygote_prefork_fn) (void *arg);
+
+#define ZYGOTE_MAX_WORKERS 256
+
+typedef struct zygote_opts {
+	zygote_worker_fn worker;
+	zygote_prefork_fn prefork; /* optional */
+	void *arg;
+	int max_workers; /* 0 for ZYGOTE_MAX_WORKERS */
+} zygote_opts;
+
+typedef struct zygote_worker {
+	pid_t pid;
+	int index;	   /* spawn order, from 0 */
+	uint64_t spawn_ns; /* from fork until the worker was running */
+	int status;	   /* wait status, once it exited */
+} zygote_worker;
+
+/* from /proc/PID/smaps_rollup, in bytes */
+typedef struct zygote_memory {
+	size_t rss;
+	size_t pss;	/* shared pages divided among their sharers */
+	size_t shared;	/* pages also mapped by other processes */
+	size_t private; /* pages only this process maps (copied or new) */
+} zygote_memory;
+
+zygote *zygote_new (const zygote_opts *opts);
+
+/**
+ * Terminate the workers (SIGTERM, then SIGKILL if they haven't exited
+ * after a second), wait for them, and free the zygote.
+ */
+void zygote_free (zygote *z);
+
+/**
+ * Fork a worker. Returns its pid, or -1 (and logs why) if it can't be
+ * forked or max_workers are running. Sets *spawn_ns (if not null) to the
+ * time from fork until the worker was running.
+ */
+pid_t zygote_spawn (zygote *z, uint64_t *spawn_ns);
+
+/**
+ * Send a running worker SIGTERM. Returns false if pid isn't one.
+ */
+bool zygote_kill (zygote *z, pid_t pid);
+
+/**
+ * Workers that exited since the last call, without waiting. Writes up to
+ * cap of them to out and returns how many were written.
+ */
+size_t zygote_reap (zygote *z, zygote_worker *out, size_t cap);
+
+/**
+ * Running workers (up to cap). Returns how many were written to out.
+ */
+size_t zygote_workers (zygote *z, zygote_worker *out, size_t cap);
+
+/**
+ * Memory of a process (a worker, or the zygote itself with getpid ()).
+ * Returns false if /proc/PID/smaps_rollup can't be read.
+ */
+bool zygote_read_memory (pid_t pid, zygote_memory *m);
+
+/**
+ * Read control commands from in and write responses to out until "quit",
+ * SIGINT, or SIGTERM (the signals are handled while serving; workers get
+ * the previous handlers back). At the end of input, commands stop but the
+ * workers keep running and are still supervised. Exited workers are
+ * collected while waiting. Returns false on a read or write error.
+ */
+bool zygote_serve (zygote *z, int in, int out);
+
+#endif /* ZYGOTE_H */
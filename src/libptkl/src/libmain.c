@@ -1,8 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
 #include <log.h>
 
 #include "ptkl.h"
+#include "subsystem.h"
+
+static uint64_t init_ns;
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
 
 void ptkl_init ()
 {
+	init_ns = now_ns ();
 	register_signal_panic_handlers ();
+	atexit (ptkl_finish);
+}
+
+void ptkl_finish ()
+{
+	static bool finished;
+	if (finished) return;
+	finished = true;
+
+	if (getenv ("PTKL_STARTUP_TRACE") != nullptr) {
+		fprintf (stderr, "\nstartup trace (since ptkl_init)\n");
+		subsystem_print_trace (stderr, init_ns);
+	}
+	subsystem_teardown_all ();
+}
+
+/* -1: not tracing; -2: PTKL_STARTUP_FD not checked yet */
+static int startup_fd = -2;
+
+void ptkl_startup_mark (const char *phase)
+{
+	if (startup_fd == -2) {
+		const char *env = getenv ("PTKL_STARTUP_FD");
+		startup_fd = env != nullptr ? atoi (env) : -1;
+		if (startup_fd <= STDERR_FILENO) startup_fd = -1;
+	}
+	if (startup_fd < 0) return;
+
+	char line[128];
+	int n = snprintf (line, sizeof (line), "%s %llu\n", phase,
+			  (unsigned long long)now_ns ());
+	if (n > 0 && (size_t)n < sizeof (line)) {
+		/* one write per mark, so lines never interleave */
+		if (write (startup_fd, line, n) != n) startup_fd = -1;
+	}
 }
@@ -0,0 +1,350 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "metrics.h"
+
+#define MAGIC 0x7274656d6c6b7470ull /* "ptklmetr" */
+#define VERSION 2
+
+enum { SLOT_FREE, SLOT_CLAIMED, SLOT_ACTIVE };
+
+/* a slot's state and its owner's pid, changed together */
+#define OWNER(state, pid) ((uint64_t)(uint32_t)(pid) << 32 | (state))
+
+static uint32_t owner_state (uint64_t owner)
+{
+	return (uint32_t)owner;
+}
+
+static pid_t owner_pid (uint64_t owner)
+{
+	return (pid_t)(owner >> 32);
+}
+
+/*
+ * A slot is written only by the process that owns it. A process claims a
+ * free slot, or one whose owner has exited (-> CLAIMED with its pid, so a
+ * process that dies before activating it doesn't hold it forever), resets
+ * it, and then makes it visible to readers (-> ACTIVE, with release
+ * ordering so readers that see ACTIVE also see the service name). Slots
+ * are cache-line aligned so that services never share a line.
+ */
+struct slot {
+	alignas (64) _Atomic uint64_t owner; /* OWNER (state, pid) */
+	char service[METRICS_NAME_MAX];
+	_Atomic uint64_t updated_ns;
+	_Atomic uint64_t requests;
+	_Atomic uint64_t errors;
+	_Atomic uint64_t gauges[METRIC_GAUGE_COUNT];
+	_Atomic uint64_t latency[METRICS_BUCKETS];
+};
+
+struct segment {
+	_Atomic uint64_t magic; /* set last, once the header is written */
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t slot_size;
+	struct slot slots[METRICS_SLOTS];
+};
+
+struct metrics_publisher {
+	struct segment *segment;
+	struct slot *slot;
+};
+
+struct metrics_reader {
+	const struct segment *segment;
+};
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool process_gone (pid_t pid)
+{
+	return pid <= 0 || (kill (pid, 0) < 0 && errno == ESRCH);
+}
+
+static bool valid_header (const struct segment *seg)
+{
+	return atomic_load_explicit (&seg->magic, memory_order_acquire) ==
+		       MAGIC &&
+	       seg->version == VERSION && seg->slot_count == METRICS_SLOTS &&
+	       seg->slot_size == sizeof (struct slot);
+}
+
+static struct segment *map_segment (const char *name, bool writable)
+{
+	int fd = shm_open (name, writable ? O_RDWR | O_CREAT : O_RDONLY, 0600);
+	if (fd < 0) {
+		if (writable || errno != ENOENT) {
+			log_error ("metrics: can't open %s: %s", name,
+				   strerror (errno));
+		}
+		return nullptr;
+	}
+
+	/* growing is idempotent, so racing creators agree on the size */
+	struct stat st;
+	bool ok = fstat (fd, &st) == 0;
+	if (ok && (size_t)st.st_size < sizeof (struct segment)) {
+		ok = writable && ftruncate (fd, sizeof (struct segment)) == 0;
+	}
+	void *p = ok ? mmap (nullptr, sizeof (struct segment),
+			     writable ? PROT_READ | PROT_WRITE : PROT_READ,
+			     MAP_SHARED, fd, 0)
+		     : MAP_FAILED;
+	close (fd);
+	if (p == MAP_FAILED) {
+		if (writable) log_error ("metrics: can't map %s", name);
+		return nullptr;
+	}
+
+	struct segment *seg = p;
+	if (writable && atomic_load (&seg->magic) == 0) {
+		/* every creator writes the same header */
+		seg->version = VERSION;
+		seg->slot_count = METRICS_SLOTS;
+		seg->slot_size = sizeof (struct slot);
+		atomic_store_explicit (&seg->magic, MAGIC,
+				       memory_order_release);
+	}
+	if (!valid_header (seg)) {
+		log_error ("metrics: %s has an incompatible layout", name);
+		munmap (p, sizeof (struct segment));
+		return nullptr;
+	}
+	return seg;
+}
+
+metrics_publisher *metrics_publish (const char *segment, const char *service)
+{
+	struct segment *seg =
+		map_segment (segment ? segment : METRICS_SEGMENT, true);
+	if (seg == nullptr) return nullptr;
+
+	pid_t self = getpid ();
+	for (int i = 0; i < METRICS_SLOTS; i++) {
+		struct slot *s = &seg->slots[i];
+		uint64_t owner = atomic_load (&s->owner);
+		if (owner_state (owner) != SLOT_FREE &&
+		    !process_gone (owner_pid (owner))) {
+			continue;
+		}
+		if (!atomic_compare_exchange_strong (
+			    &s->owner, &owner, OWNER (SLOT_CLAIMED, self))) {
+			continue;
+		}
+
+		atomic_store_explicit (&s->requests, 0, memory_order_relaxed);
+		atomic_store_explicit (&s->errors, 0, memory_order_relaxed);
+		for (int g = 0; g < METRIC_GAUGE_COUNT; g++) {
+			atomic_store_explicit (&s->gauges[g], 0,
+					       memory_order_relaxed);
+		}
+		for (int b = 0; b < METRICS_BUCKETS; b++) {
+			atomic_store_explicit (&s->latency[b], 0,
+					       memory_order_relaxed);
+		}
+		memset (s->service, 0, sizeof (s->service));
+		strncpy (s->service, service, sizeof (s->service) - 1);
+		atomic_store_explicit (&s->updated_ns, now_ns (),
+				       memory_order_relaxed);
+		atomic_store_explicit (&s->owner, OWNER (SLOT_ACTIVE, self),
+				       memory_order_release);
+
+		metrics_publisher *m = malloc (sizeof (metrics_publisher));
+		if (m == nullptr) panic ("out of memory");
+		*m = (metrics_publisher){.segment = seg, .slot = s};
+		return m;
+	}
+
+	log_error ("metrics: all %d slots are in use", METRICS_SLOTS);
+	munmap (seg, sizeof (struct segment));
+	return nullptr;
+}
+
+void metrics_unpublish (metrics_publisher *m)
+{
+	if (m == nullptr) return;
+	atomic_store_explicit (&m->slot->owner, OWNER (SLOT_FREE, 0),
+			       memory_order_release);
+	munmap (m->segment, sizeof (struct segment));
+	free (m);
+}
+
+/* only the owner writes a slot, so adding doesn't need a locked instruction */
+static inline void add (_Atomic uint64_t *v, uint64_t n)
+{
+	atomic_store_explicit (
+		v, atomic_load_explicit (v, memory_order_relaxed) + n,
+		memory_order_relaxed);
+}
+
+void metrics_request (metrics_publisher *m, uint64_t latency_ns, bool ok)
+{
+	if (m == nullptr) return;
+	add (&m->slot->requests, 1);
+	if (!ok) add (&m->slot->errors, 1);
+	add (&m->slot->latency[metrics_bucket (latency_ns / 1000)], 1);
+}
+
+void metrics_set (metrics_publisher *m, metric_gauge gauge, uint64_t value)
+{
+	if (m == nullptr || gauge >= METRIC_GAUGE_COUNT) return;
+	atomic_store_explicit (&m->slot->gauges[gauge], value,
+			       memory_order_relaxed);
+	atomic_store_explicit (&m->slot->updated_ns, now_ns (),
+			       memory_order_relaxed);
+}
+
+void metrics_sample_rss (metrics_publisher *m)
+{
+	if (m == nullptr) return;
+	int fd = open ("/proc/self/statm", O_RDONLY);
+	if (fd < 0) return;
+	char buf[128];
+	ssize_t n = read (fd, buf, sizeof (buf) - 1);
+	close (fd);
+	if (n <= 0) return;
+	buf[n] = '\0';
+
+	/* size resident shared text lib data dt (pages) */
+	char *p = strchr (buf, ' ');
+	if (p == nullptr) return;
+	uint64_t pages = strtoull (p + 1, nullptr, 10);
+	metrics_set (m, METRIC_RSS, pages * (uint64_t)sysconf (_SC_PAGESIZE));
+}
+
+metrics_reader *metrics_open (const char *segment)
+{
+	struct segment *seg =
+		map_segment (segment ? segment : METRICS_SEGMENT, false);
+	if (seg == nullptr) return nullptr;
+	metrics_reader *r = malloc (sizeof (metrics_reader));
+	if (r == nullptr) panic ("out of memory");
+	r->segment = seg;
+	return r;
+}
+
+void metrics_close (metrics_reader *r)
+{
+	if (r == nullptr) return;
+	munmap ((void *)r->segment, sizeof (struct segment));
+	free (r);
+}
+
+int metrics_read (metrics_reader *r, metrics_snapshot *out, int cap)
+{
+	if (r == nullptr) return 0;
+	int count = 0;
+	for (int i = 0; i < METRICS_SLOTS && count < cap; i++) {
+		const struct slot *s = &r->segment->slots[i];
+		uint64_t owner =
+			atomic_load_explicit (&s->owner, memory_order_acquire);
+		if (owner_state (owner) != SLOT_ACTIVE) continue;
+		pid_t pid = owner_pid (owner);
+		if (process_gone (pid)) continue;
+
+		metrics_snapshot *snap = &out[count];
+		snap->pid = pid;
+		memcpy (snap->service, s->service, sizeof (snap->service));
+		snap->service[METRICS_NAME_MAX - 1] = '\0';
+		snap->requests = atomic_load_explicit (&s->requests,
+						       memory_order_relaxed);
+		snap->errors =
+			atomic_load_explicit (&s->errors, memory_order_relaxed);
+		for (int g = 0; g < METRIC_GAUGE_COUNT; g++) {
+			snap->gauges[g] = atomic_load_explicit (
+				&s->gauges[g], memory_order_relaxed);
+		}
+		for (int b = 0; b < METRICS_BUCKETS; b++) {
+			snap->latency[b] = atomic_load_explicit (
+				&s->latency[b], memory_order_relaxed);
+		}
+		snap->updated_ns = atomic_load_explicit (&s->updated_ns,
+							 memory_order_relaxed);
+
+		/* the slot changed hands while it was being read */
+		atomic_thread_fence (memory_order_acquire);
+		if (atomic_load_explicit (&s->owner, memory_order_relaxed) !=
+		    owner) {
+			continue;
+		}
+		count++;
+	}
+	return count;
+}
+
+int metrics_bucket (uint64_t latency_us)
+{
+	if (latency_us < 4) return (int)latency_us;
+	int msb = 63 - __builtin_clzll (latency_us);
+	int bucket = (msb - 1) * 4 + (int)((latency_us >> (msb - 2)) & 3);
+	return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+uint64_t metrics_bucket_floor (int bucket)
+{
+	if (bucket < 4) return bucket;
+	return (4ull + bucket % 4) << (bucket / 4 - 1);
+}
+
+uint64_t metrics_percentile (const uint64_t latency[METRICS_BUCKETS],
+			     double q)
+{
+	uint64_t total = 0;
+	for (int b = 0; b < METRICS_BUCKETS; b++) total += latency[b];
+	if (total == 0) return 0;
+
+	double r = q * (double)total;
+	uint64_t rank = (uint64_t)r;
+	if ((double)rank < r || rank == 0) rank++;
+	if (rank > total) rank = total;
+
+	uint64_t seen = 0;
+	for (int b = 0; b < METRICS_BUCKETS; b++) {
+		seen += latency[b];
+		if (seen < rank) continue;
+		return b < 4 ? (uint64_t)b : metrics_bucket_floor (b + 1) - 1;
+	}
+	return metrics_bucket_floor (METRICS_BUCKETS - 1);
+}
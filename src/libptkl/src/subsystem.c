@@ -0,0 +1,244 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <time.h>
+
+#include "log.h"
+#include "subsystem.h"
+
+/* inits nested deeper than this (within one thread) are a bug */
+#define MAX_DEPTH 32
+
+/* inits recorded in the trace; later ones are counted but not recorded */
+#define MAX_TRACE 64
+
+/*
+ * The lock only guards state transitions, the ready list, and the trace;
+ * init hooks run unlocked so they can use other subsystems, and so that
+ * unrelated subsystems can initialize concurrently. Threads that find a
+ * subsystem initializing wait on state_changed.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t state_changed = PTHREAD_COND_INITIALIZER;
+static subsystem *ready;
+
+static subsystem_trace_entry inits[MAX_TRACE];
+static size_t trace_count;
+static size_t trace_dropped;
+
+/* inits in progress on this thread, innermost last (to detect cycles) */
+static _Thread_local struct {
+	subsystem *subsystem;
+	uint64_t child_ns; /* time spent initializing its dependencies */
+} initializing[MAX_DEPTH];
+static _Thread_local int depth;
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static bool initializing_on_this_thread (const subsystem *s)
+{
+	for (int i = 0; i < depth; i++) {
+		if (initializing[i].subsystem == s) return true;
+	}
+	return false;
+}
+
+/* returns false if s doesn't need to be initialized by this thread */
+static bool claim (subsystem *s, bool *result)
+{
+	for (;;) {
+		switch (atomic_load_explicit (&s->state,
+					      memory_order_acquire)) {
+		case SUBSYSTEM_READY:
+			*result = true;
+			return false;
+		case SUBSYSTEM_FAILED:
+			*result = false;
+			return false;
+		case SUBSYSTEM_UNINITIALIZED:
+			atomic_store_explicit (&s->state,
+					       SUBSYSTEM_INITIALIZING,
+					       memory_order_relaxed);
+			return true;
+		case SUBSYSTEM_INITIALIZING:
+			if (initializing_on_this_thread (s)) {
+				pthread_mutex_unlock (&lock);
+				panic ("subsystem dependency cycle: %s",
+				       s->name);
+			}
+			pthread_cond_wait (&state_changed, &lock);
+			break;
+		}
+	}
+}
+
+/*
+ * Add a finished init to the trace (with the lock held). Dependencies
+ * finish first, so entries are inserted in the order they started: only
+ * complete entries are ever visible.
+ */
+static void record (const subsystem_trace_entry *entry)
+{
+	if (trace_count == MAX_TRACE) {
+		trace_dropped++;
+		return;
+	}
+	size_t i = trace_count++;
+	for (; i > 0; i--) {
+		const subsystem_trace_entry *prev = &inits[i - 1];
+		if (prev->start_ns < entry->start_ns ||
+		    (prev->start_ns == entry->start_ns &&
+		     prev->depth <= entry->depth)) {
+			break;
+		}
+		inits[i] = *prev;
+	}
+	inits[i] = *entry;
+}
+
+bool subsystem_use_slow (subsystem *s)
+{
+	bool result;
+	pthread_mutex_lock (&lock);
+	if (!claim (s, &result)) {
+		pthread_mutex_unlock (&lock);
+		return result;
+	}
+	if (depth == MAX_DEPTH) {
+		pthread_mutex_unlock (&lock);
+		panic ("subsystems nested too deeply: %s", s->name);
+	}
+	pthread_mutex_unlock (&lock);
+
+	const int level = depth++;
+	initializing[level].subsystem = s;
+	initializing[level].child_ns = 0;
+
+	const uint64_t start = now_ns ();
+	const bool ok = s->init == nullptr || s->init ();
+	const uint64_t duration = now_ns () - start;
+
+	depth--;
+	if (level > 0) initializing[level - 1].child_ns += duration;
+
+	pthread_mutex_lock (&lock);
+	record (&(subsystem_trace_entry){
+		.name = s->name,
+		.depth = level,
+		.start_ns = start,
+		.duration_ns = duration,
+		.self_ns = duration - initializing[level].child_ns,
+		.ok = ok,
+	});
+	if (ok) {
+		s->next_ready = ready;
+		ready = s;
+	} else {
+		log_error ("failed to initialize %s", s->name);
+	}
+	atomic_store_explicit (&s->state,
+			       ok ? SUBSYSTEM_READY : SUBSYSTEM_FAILED,
+			       memory_order_release);
+	pthread_cond_broadcast (&state_changed);
+	pthread_mutex_unlock (&lock);
+	return ok;
+}
+
+bool subsystem_ready (subsystem *s)
+{
+	return atomic_load_explicit (&s->state, memory_order_acquire) ==
+	       SUBSYSTEM_READY;
+}
+
+void subsystem_teardown_all ()
+{
+	pthread_mutex_lock (&lock);
+	subsystem *s = ready;
+	ready = nullptr;
+	pthread_mutex_unlock (&lock);
+
+	while (s) {
+		subsystem *next = s->next_ready;
+		if (s->teardown) s->teardown ();
+		s->next_ready = nullptr;
+		atomic_store_explicit (&s->state, SUBSYSTEM_UNINITIALIZED,
+				       memory_order_release);
+		s = next;
+	}
+}
+
+size_t subsystem_trace_count ()
+{
+	pthread_mutex_lock (&lock);
+	size_t count = trace_count;
+	pthread_mutex_unlock (&lock);
+	return count;
+}
+
+bool subsystem_trace_get (size_t i, subsystem_trace_entry *entry)
+{
+	pthread_mutex_lock (&lock);
+	bool found = i < trace_count;
+	if (found) *entry = inits[i];
+	pthread_mutex_unlock (&lock);
+	return found;
+}
+
+void subsystem_print_trace (FILE *f, uint64_t since_ns)
+{
+	pthread_mutex_lock (&lock);
+	fprintf (f, "%-24s %10s %10s %10s\n", "subsystem", "at (us)",
+		 "init (us)", "self (us)");
+	for (size_t i = 0; i < trace_count; i++) {
+		const subsystem_trace_entry *e = &inits[i];
+		const int indent = e->depth * 2;
+		const uint64_t at_ns =
+			e->start_ns > since_ns ? e->start_ns - since_ns : 0;
+		const double at = (double)at_ns / 1e3;
+		fprintf (f, "%*s%-*s %10.1f %10.1f %10.1f%s\n", indent, "",
+			 24 - indent, e->name, at, (double)e->duration_ns / 1e3,
+			 (double)e->self_ns / 1e3, e->ok ? "" : "  FAILED");
+	}
+	if (trace_count == 0) fprintf (f, "(none initialized)\n");
+	if (trace_dropped) {
+		fprintf (f, "(%zu more not recorded)\n", trace_dropped);
+	}
+	pthread_mutex_unlock (&lock);
+}
+
+void subsystem_reset_trace ()
+{
+	pthread_mutex_lock (&lock);
+	trace_count = 0;
+	trace_dropped = 0;
+	pthread_mutex_unlock (&lock);
+}
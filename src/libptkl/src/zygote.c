@@ -0,0 +1,439 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "zygote.h"
+
+#define TERM_GRACE_NS 1000000000ull
+#define LINE_MAX_LEN 1024
+
+struct zygote {
+	zygote_opts opts;
+	int next_index;
+	int control; /* fd commands are read from, -1 if not serving */
+
+	/* SIGINT and SIGTERM dispositions from before zygote_serve, which
+	   workers get back */
+	struct sigaction saved_int, saved_term;
+
+	zygote_worker *running;
+	size_t running_count;
+
+	/* exited and not yet reaped (the oldest are dropped when full) */
+	zygote_worker *exited;
+	size_t exited_count;
+};
+
+/* Set by SIGINT or SIGTERM while serving */
+static volatile sig_atomic_t stop_signal;
+
+static void request_stop (int sig)
+{
+	stop_signal = sig;
+}
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+zygote *zygote_new (const zygote_opts *opts)
+{
+	zygote *z = calloc (1, sizeof (*z));
+	if (!z) panic ("out of memory");
+	z->opts = *opts;
+	if (z->opts.max_workers <= 0) z->opts.max_workers = ZYGOTE_MAX_WORKERS;
+	z->control = -1;
+	z->running = calloc (z->opts.max_workers, sizeof (zygote_worker));
+	z->exited = calloc (z->opts.max_workers, sizeof (zygote_worker));
+	if (!z->running || !z->exited) panic ("out of memory");
+	return z;
+}
+
+/* Move a worker that exited to the exited list */
+static void worker_exited (zygote *z, size_t i, int status)
+{
+	zygote_worker w = z->running[i];
+	w.status = status;
+	z->running[i] = z->running[--z->running_count];
+
+	if (z->exited_count == (size_t)z->opts.max_workers) {
+		memmove (z->exited, z->exited + 1,
+			 --z->exited_count * sizeof (zygote_worker));
+	}
+	z->exited[z->exited_count++] = w;
+}
+
+/* Collect workers that exited, without waiting */
+static void collect (zygote *z)
+{
+	for (size_t i = 0; i < z->running_count;) {
+		int status;
+		pid_t pid = waitpid (z->running[i].pid, &status, WNOHANG);
+		if (pid == z->running[i].pid) {
+			worker_exited (z, i, status);
+		} else if (pid < 0 && errno == ECHILD) {
+			worker_exited (z, i, 0);
+		} else {
+			i++;
+		}
+	}
+}
+
+/* SIGTERM, then SIGKILL for workers still running after TERM_GRACE_NS */
+static void terminate_all (zygote *z)
+{
+	for (size_t i = 0; i < z->running_count; i++) {
+		kill (z->running[i].pid, SIGTERM);
+	}
+	uint64_t deadline = now_ns () + TERM_GRACE_NS;
+	while (z->running_count > 0 && now_ns () < deadline) {
+		collect (z);
+		if (z->running_count > 0) usleep (10000);
+	}
+	for (size_t i = 0; i < z->running_count; i++) {
+		kill (z->running[i].pid, SIGKILL);
+	}
+	while (z->running_count > 0) {
+		int status;
+		while (waitpid (z->running[0].pid, &status, 0) < 0 &&
+		       errno == EINTR) {
+		}
+		worker_exited (z, 0, status);
+	}
+}
+
+void zygote_free (zygote *z)
+{
+	if (!z) return;
+	terminate_all (z);
+	free (z->running);
+	free (z->exited);
+	free (z);
+}
+
+/* In the new worker: runs the worker function and exits */
+static void run_worker (zygote *z, int ready, int index)
+{
+	/* Commands are for the zygote */
+	if (z->control >= 0) {
+		int null = open ("/dev/null", O_RDONLY);
+		dup2 (null, z->control);
+		close (null);
+		sigaction (SIGINT, &z->saved_int, nullptr);
+		sigaction (SIGTERM, &z->saved_term, nullptr);
+	}
+
+	char c = 1;
+	while (write (ready, &c, 1) < 0 && errno == EINTR) {
+	}
+	close (ready);
+
+	int status = z->opts.worker (index, z->opts.arg);
+
+	/* Exit without the zygote's atexit handlers, which clean up state
+	   that belongs to the zygote */
+	fflush (nullptr);
+	_exit (status);
+}
+
+pid_t zygote_spawn (zygote *z, uint64_t *spawn_ns)
+{
+	collect (z);
+	if (z->running_count == (size_t)z->opts.max_workers) {
+		log_error ("zygote: %d workers already running",
+			   z->opts.max_workers);
+		return -1;
+	}
+
+	int ready[2];
+	if (pipe (ready) < 0) {
+		log_error ("zygote: pipe: %s", strerror (errno));
+		return -1;
+	}
+
+	/* Collect garbage first, so workers don't inherit it */
+	if (z->opts.prefork) z->opts.prefork (z->opts.arg);
+
+	/* Buffered output would be written by the worker too */
+	fflush (nullptr);
+
+	int index = z->next_index;
+	uint64_t start = now_ns ();
+	pid_t pid = fork ();
+	if (pid < 0) {
+		log_error ("zygote: fork: %s", strerror (errno));
+		close (ready[0]);
+		close (ready[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		close (ready[0]);
+		run_worker (z, ready[1], index);
+	}
+
+	/* Wait until the worker is running */
+	close (ready[1]);
+	char c;
+	while (read (ready[0], &c, 1) < 0 && errno == EINTR) {
+	}
+	close (ready[0]);
+	uint64_t elapsed = now_ns () - start;
+
+	z->running[z->running_count++] = (zygote_worker){
+		.pid = pid,
+		.index = index,
+		.spawn_ns = elapsed,
+	};
+	z->next_index++;
+	if (spawn_ns) *spawn_ns = elapsed;
+	return pid;
+}
+
+bool zygote_kill (zygote *z, pid_t pid)
+{
+	for (size_t i = 0; i < z->running_count; i++) {
+		if (z->running[i].pid == pid) return kill (pid, SIGTERM) == 0;
+	}
+	return false;
+}
+
+size_t zygote_reap (zygote *z, zygote_worker *out, size_t cap)
+{
+	collect (z);
+	size_t n = z->exited_count < cap ? z->exited_count : cap;
+	memcpy (out, z->exited, n * sizeof (zygote_worker));
+	z->exited_count -= n;
+	memmove (z->exited, z->exited + n,
+		 z->exited_count * sizeof (zygote_worker));
+	return n;
+}
+
+size_t zygote_workers (zygote *z, zygote_worker *out, size_t cap)
+{
+	collect (z);
+	size_t n = z->running_count < cap ? z->running_count : cap;
+	memcpy (out, z->running, n * sizeof (zygote_worker));
+	return n;
+}
+
+bool zygote_read_memory (pid_t pid, zygote_memory *m)
+{
+	char path[64];
+	snprintf (path, sizeof (path), "/proc/%d/smaps_rollup", (int)pid);
+	FILE *f = fopen (path, "r");
+	if (!f) return false;
+
+	*m = (zygote_memory){};
+	bool found = false;
+	char line[256];
+	while (fgets (line, sizeof (line), f)) {
+		char name[64];
+		unsigned long long kb;
+		if (sscanf (line, "%63[^:]: %llu kB", name, &kb) != 2) continue;
+		size_t bytes = (size_t)kb * 1024;
+		if (strcmp (name, "Rss") == 0) {
+			m->rss = bytes;
+			found = true;
+		} else if (strcmp (name, "Pss") == 0) {
+			m->pss = bytes;
+		} else if (strncmp (name, "Shared_", 7) == 0) {
+			m->shared += bytes;
+		} else if (strncmp (name, "Private_", 8) == 0) {
+			m->private += bytes;
+		}
+	}
+	fclose (f);
+	return found;
+}
+
+/*
+ * Control protocol (see zygote.h)
+ */
+
+static void format_status (int status, char *buf, size_t size)
+{
+	if (WIFSIGNALED (status)) {
+		snprintf (buf, size, "signal %d", WTERMSIG (status));
+	} else {
+		snprintf (buf, size, "%d", WEXITSTATUS (status));
+	}
+}
+
+static bool cmd_spawn (zygote *z, const char *arg, int out)
+{
+	int n = *arg ? atoi (arg) : 1;
+	if (n <= 0) return dprintf (out, "error: invalid count: %s\n", arg) > 0;
+	for (int i = 0; i < n; i++) {
+		uint64_t ns;
+		pid_t pid = zygote_spawn (z, &ns);
+		if (pid < 0) {
+			dprintf (out, "error: spawned %d of %d\n", i, n);
+			return true;
+		}
+		if (dprintf (out, "spawned %d %d %llu\n", (int)pid,
+			     z->next_index - 1,
+			     (unsigned long long)(ns / 1000)) < 0) {
+			return false;
+		}
+	}
+	return dprintf (out, "ok\n") > 0;
+}
+
+static bool cmd_reap (zygote *z, int out)
+{
+	zygote_worker w;
+	while (zygote_reap (z, &w, 1) == 1) {
+		char status[32];
+		format_status (w.status, status, sizeof (status));
+		if (dprintf (out, "exited %d %d %s\n", (int)w.pid, w.index,
+			     status) < 0) {
+			return false;
+		}
+	}
+	return dprintf (out, "ok\n") > 0;
+}
+
+static bool cmd_list (zygote *z, int out)
+{
+	collect (z);
+	for (size_t i = 0; i < z->running_count; i++) {
+		zygote_worker *w = &z->running[i];
+		zygote_memory m = {};
+		zygote_read_memory (w->pid, &m);
+		if (dprintf (out, "worker %d %d rss=%zu pss=%zu shared=%zu "
+				  "private=%zu\n",
+			     (int)w->pid, w->index, m.rss / 1024, m.pss / 1024,
+			     m.shared / 1024, m.private / 1024) < 0) {
+			return false;
+		}
+	}
+	return dprintf (out, "ok\n") > 0;
+}
+
+static bool cmd_kill (zygote *z, const char *arg, int out)
+{
+	pid_t pid = (pid_t)atoi (arg);
+	if (!zygote_kill (z, pid)) {
+		return dprintf (out, "error: no worker %s\n", arg) > 0;
+	}
+	return dprintf (out, "ok\n") > 0;
+}
+
+/* Run a command line. Sets *quit for "quit"; false on a write error. */
+static bool command (zygote *z, char *line, int out, bool *quit)
+{
+	line[strcspn (line, "\r")] = '\0';
+	char *cmd = line + strspn (line, " \t");
+	char *arg = cmd + strcspn (cmd, " \t");
+	if (*arg) *arg++ = '\0';
+	arg += strspn (arg, " \t");
+
+	if (*cmd == '\0') return true;
+	if (strcmp (cmd, "spawn") == 0) return cmd_spawn (z, arg, out);
+	if (strcmp (cmd, "reap") == 0) return cmd_reap (z, out);
+	if (strcmp (cmd, "list") == 0) return cmd_list (z, out);
+	if (strcmp (cmd, "kill") == 0) return cmd_kill (z, arg, out);
+	if (strcmp (cmd, "quit") == 0) {
+		terminate_all (z);
+		*quit = true;
+		return dprintf (out, "bye\n") > 0;
+	}
+	return dprintf (out, "error: unknown command: %s\n", cmd) > 0;
+}
+
+bool zygote_serve (zygote *z, int in, int out)
+{
+	char buf[LINE_MAX_LEN];
+	size_t len = 0;
+	bool ok = true, quit = false;
+	z->control = in;
+
+	/* Without SA_RESTART, so a signal interrupts the poll */
+	struct sigaction sa = {.sa_handler = request_stop};
+	sigemptyset (&sa.sa_mask);
+	stop_signal = 0;
+	sigaction (SIGINT, &sa, &z->saved_int);
+	sigaction (SIGTERM, &sa, &z->saved_term);
+
+	while (ok && !quit && !stop_signal) {
+		/* (poll ignores a negative fd, so after the end of input this
+		   just waits to collect workers) */
+		struct pollfd p = {.fd = in, .events = POLLIN};
+		int ready = poll (&p, 1, 1000);
+		collect (z);
+		if (ready < 0 && errno != EINTR) ok = false;
+		if (ready <= 0) continue;
+
+		ssize_t n = read (in, buf + len, sizeof (buf) - len);
+		if (n < 0) {
+			if (errno != EINTR) ok = false;
+			continue;
+		}
+		if (n == 0) {
+			/* No more commands, but the workers keep running */
+			log_info ("zygote: end of control input, supervising "
+				  "until quit or a signal");
+			in = -1;
+			continue;
+		}
+		len += (size_t)n;
+
+		/* Run each complete line */
+		char *line = buf, *end;
+		while (ok && !quit &&
+		       (end = memchr (line, '\n', buf + len - line))) {
+			*end = '\0';
+			ok = command (z, line, out, &quit);
+			line = end + 1;
+		}
+		len -= (size_t)(line - buf);
+		memmove (buf, line, len);
+
+		/* Drop a line that doesn't fit */
+		if (len == sizeof (buf)) len = 0;
+	}
+	if (stop_signal) {
+		log_info ("zygote: %s, stopping", strsignal (stop_signal));
+	}
+	sigaction (SIGINT, &z->saved_int, nullptr);
+	sigaction (SIGTERM, &z->saved_term, nullptr);
+	z->control = -1;
+	return ok;
+}
@@ -0,0 +1,113 @@
+/*
+ * Partikle request heap arena
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Request heap arena
+ *
+ * An allocator for heaps that are thrown away whole, like the JS heap of a
+ * runtime that serves one request: blocks come from size-class free lists
+ * and a bump pointer into large chunks, and arena_reset releases all of
+ * them at once, without visiting any.
+ *
+ *     arena *a = arena_new (0);
+ *     void *p = arena_alloc (a, 100);
+ *     p = arena_resize (a, p, 200);
+ *     arena_release (a, p);      // optional
+ *     arena_reset (a);           // everything is gone, the chunks stay
+ *     arena_free (a);
+ *
+ * Small blocks (up to ARENA_SMALL_MAX bytes) are rounded up to one of 28
+ * size classes (16-byte steps to 128, then four per doubling), and a
+ * released block goes on its class's free list for the next allocation of
+ * that class. Larger blocks are allocated with malloc, and freed with the
+ * arena. Every block is 16-byte aligned.
+ *
+ * The chunks are kept by arena_reset, so a recycled arena doesn't go back
+ * to malloc until it needs more than it did before.
+ *
+ * An arena isn't thread-safe.
+ */
+typedef struct arena arena;
+
+typedef struct arena_stats {
+	size_t malloc_size;  /* usable bytes of the live blocks */
+	size_t malloc_count; /* live blocks */
+	size_t footprint;    /* bytes taken from malloc */
+	uint64_t resets;
+} arena_stats;
+
+#define ARENA_CHUNK_DEFAULT ((size_t)256 << 10)
+#define ARENA_SMALL_MAX 4096
+
+/**
+ * Create an arena that takes memory from malloc chunk_size bytes at a time
+ * (0 for ARENA_CHUNK_DEFAULT).
+ */
+arena *arena_new (size_t chunk_size);
+
+/**
+ * Free the arena, and every block and chunk.
+ */
+void arena_free (arena *a);
+
+/**
+ * Allocate a block. Returns null if malloc fails.
+ */
+void *arena_alloc (arena *a, size_t size);
+
+/**
+ * Resize a block (in place if it stays in the same size class), like
+ * realloc: a null block is allocated, and a size of 0 releases the block
+ * and returns null. Returns null (keeping the block) if malloc fails.
+ */
+void *arena_resize (arena *a, void *p, size_t size);
+
+/**
+ * Release a block for reuse (a null block is ignored).
+ */
+void arena_release (arena *a, void *p);
+
+/**
+ * The usable size of a block: at least the size it was allocated with.
+ */
+size_t arena_usable_size (const void *p);
+
+/**
+ * Release every block at once.
+ */
+void arena_reset (arena *a);
+
+void arena_get_stats (arena *a, arena_stats *stats);
+
+#endif /* ARENA_H */
@@ -0,0 +1,134 @@
+/*
+ * Partikle application bundles
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Application bundle (.ptkl)
+ *
+ * A single file holding a whole application: the compiled bytecode of
+ * every module in its import graph, any static assets, and an index from
+ * name to item, so loading a module is a hash lookup in a mapped file
+ * rather than a path search, a read, and a compile.
+ *
+ *     bundle_writer *w = bundle_writer_new ();
+ *     bundle_writer_add (w, "app/main.js", BUNDLE_MODULE, code, len);
+ *     bundle_writer_set_main (w, "app/main.js");
+ *     bundle_writer_write (w, "app.ptkl");
+ *     bundle_writer_free (w);
+ *
+ *     bundle *b = bundle_open ("app.ptkl");
+ *     bundle_item item;
+ *     if (bundle_find (b, "app/lib.js", &item)) ... item.data, item.len ...
+ *     bundle_close (b);
+ *
+ * Layout (native byte order, every section 8-byte aligned):
+ *
+ *     header   magic, version, item count, offsets of the sections
+ *     items    name, kind, and data location of each item
+ *     slots    open-addressed hash table of item numbers (+1, 0 is empty)
+ *     names    null-terminated item names
+ *     data     item contents
+ *
+ * The file is mapped read-only, and found items point into the mapping
+ * (valid until bundle_close). Everything is bounds-checked when the bundle
+ * is opened, so a damaged file is rejected rather than read out of bounds.
+ */
+typedef struct bundle bundle;
+typedef struct bundle_writer bundle_writer;
+
+typedef enum bundle_kind {
+	BUNDLE_MODULE, /* module bytecode (JS_WriteObject) */
+	BUNDLE_SCRIPT, /* script bytecode */
+	BUNDLE_ASSET,  /* anything else, as is */
+} bundle_kind;
+
+typedef struct bundle_item {
+	const char *name;
+	bundle_kind kind;
+	const uint8_t *data;
+	size_t len;
+} bundle_item;
+
+#define BUNDLE_SUFFIX ".ptkl"
+
+bundle_writer *bundle_writer_new (void);
+void bundle_writer_free (bundle_writer *w);
+
+/**
+ * Add a copy of an item. Returns false if the name was already added.
+ */
+bool bundle_writer_add (bundle_writer *w, const char *name, bundle_kind kind,
+			const void *data, size_t len);
+
+/**
+ * Whether an item has been added.
+ */
+bool bundle_writer_has (bundle_writer *w, const char *name);
+
+/**
+ * Set the item that's run first (a module or script). Returns false if it
+ * hasn't been added or is an asset.
+ */
+bool bundle_writer_set_main (bundle_writer *w, const char *name);
+
+/**
+ * Write the bundle: to a temporary file, renamed into place, so a bundle
+ * that's being run is never seen half written. Returns false (and logs
+ * why) on error.
+ */
+bool bundle_writer_write (bundle_writer *w, const char *path);
+
+/**
+ * Open and validate a bundle. Returns null (and logs why) on error.
+ */
+bundle *bundle_open (const char *path);
+void bundle_close (bundle *b);
+
+size_t bundle_count (bundle *b);
+
+/**
+ * The item with a name. Returns false if there's none.
+ */
+bool bundle_find (bundle *b, const char *name, bundle_item *item);
+
+/**
+ * The i-th item (in the order they were added).
+ */
+bool bundle_item_at (bundle *b, size_t i, bundle_item *item);
+
+/**
+ * The main item. Returns false if the bundle has none.
+ */
+bool bundle_main (bundle *b, bundle_item *item);
+
+#endif /* BUNDLE_H */
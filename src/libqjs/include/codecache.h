@@ -0,0 +1,142 @@
+/*
+ * Partikle JavaScript engine
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mapfile.h"
+
+/**
+ * Bytecode cache
+ *
+ * A directory of compiled code, addressed by content: the key is a 128-bit
+ * hash of the source and a salt (the engine version, compile flags, and
+ * file name, which the bytecode embeds), so an edited file, a different
+ * engine, or different flags simply miss.
+ *
+ *     codecache *cache = codecache_open (dir, CODECACHE_DEFAULT_MAX);
+ *     codecache_key key = codecache_key_for (src, len, salt);
+ *     codecache_entry entry;
+ *     if (codecache_get (cache, key, &entry)) {
+ *             ... use entry.data, entry.len ...
+ *             codecache_release (&entry);
+ *     } else {
+ *             ... compile ...
+ *             codecache_put (cache, key, bytecode, size, compile_ns);
+ *     }
+ *
+ * Entries are validated when they're loaded (header, key, length, and a
+ * checksum of the data); an invalid entry is removed and reported as a
+ * miss. Entries are written to a temporary file and renamed into place, so
+ * readers (including other processes) never see a partial entry.
+ *
+ * The directory is kept under a size limit by evicting the least recently
+ * used entries when one is added (a hit updates the entry's modification
+ * time). The directory is only scanned when the cache's running size
+ * estimate goes over the limit, and every so many puts to pick up other
+ * processes' entries.
+ *
+ * A hit isn't copied: the entry is mapped read-only, and its data points
+ * into the mapping until it's released.
+ *
+ * Each entry records how long it took to compile, so a hit knows how much
+ * time it saved.
+ */
+typedef struct codecache codecache;
+
+typedef struct codecache_key {
+	uint64_t hash[2];
+} codecache_key;
+
+typedef struct codecache_entry {
+	const uint8_t *data; /* valid until codecache_release */
+	size_t len;
+	uint64_t cost_ns; /* time it took to compile */
+	mapped_file map;
+} codecache_entry;
+
+typedef struct codecache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t invalid; /* entries that failed validation (removed) */
+	uint64_t writes;
+	uint64_t evictions;
+} codecache_stats;
+
+#define CODECACHE_DEFAULT_MAX ((size_t)256 << 20)
+
+/**
+ * Open (creating it and its parents if needed) a cache directory that's
+ * kept under max_bytes. Returns null (and logs why) if it can't be created.
+ */
+codecache *codecache_open (const char *dir, size_t max_bytes);
+void codecache_close (codecache *c);
+
+/**
+ * The default cache directory: $PTKL_CACHE_DIR, or ptkl/bytecode in
+ * $XDG_CACHE_HOME or ~/.cache. Returns false if there's no home directory
+ * or the path doesn't fit in size.
+ */
+bool codecache_default_dir (char *dir, size_t size);
+
+/**
+ * The key for source compiled in a context described by salt.
+ */
+codecache_key codecache_key_for (const void *source, size_t len,
+				 const char *salt);
+
+/**
+ * Map a valid entry. Returns false on a miss.
+ */
+bool codecache_get (codecache *c, codecache_key key, codecache_entry *entry);
+
+/**
+ * Unmap an entry returned by codecache_get.
+ */
+void codecache_release (codecache_entry *entry);
+
+/**
+ * Add an entry (replacing any with the same key), then, if the cache may be
+ * over its size limit, evict the least recently used entries until it
+ * isn't. Returns false if the entry can't be written.
+ */
+bool codecache_put (codecache *c, codecache_key key, const void *data,
+		    size_t len, uint64_t cost_ns);
+
+/**
+ * Evict least recently used entries until the cache is under max_bytes.
+ * Returns the number of entries removed.
+ */
+size_t codecache_evict (codecache *c, size_t max_bytes);
+
+void codecache_get_stats (codecache *c, codecache_stats *stats);
+
+#endif /* CODECACHE_H */
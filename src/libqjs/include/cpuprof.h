@@ -0,0 +1,137 @@
+/*
+ * Partikle JavaScript CPU profiler
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef CPUPROF_H
+#define CPUPROF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Sampling CPU profiler for JavaScript
+ *
+ * Where guest code spends its time, by JS function (libstd's profiler.h
+ * samples native stacks instead). A timer thread marks a sample due at
+ * the configured rate; the engine checks at its interrupt checks (the
+ * interpreter makes one every few thousand branches and calls) and, when
+ * one is due, captures the JS stack and records it with the time since
+ * the last sample:
+ *
+ *     cpuprof *p = cpuprof_new (CPUPROF_DEFAULT_HZ);
+ *     opts.cpu_profile = p;
+ *     engine *e = engine_new (&opts);
+ *     cpuprof_start (p);
+ *     engine_eval_file (e, "app.js");
+ *     cpuprof_stop (p);
+ *     cpuprof_write_cpuprofile (p, f);
+ *
+ * Only running JavaScript is sampled: while the event loop waits, or C
+ * code runs without calling back into JS, no checks are made. A sample
+ * more than two intervals after the one before gets one interval, and
+ * the rest of the time goes to a CPUPROF_OUTSIDE_JS sample before it (the
+ * profiler can't tell native code, GC, and idle time apart). The folded
+ * stacks and the top table count a sample for each interval of its time,
+ * so they agree with the .cpuprofile's time deltas.
+ *
+ * Overhead: between samples, the engine's interrupt checks cost an
+ * atomic load (cpuprof_due, about 3 ns in cpuprof_bench). A sample costs
+ * a stack capture (an Error's stack, as the heap profiler captures it)
+ * and cpuprof_sample, which interns the stack and appends 8 bytes.
+ * cpuprof_bench times only cpuprof_sample (about 1.25 us for 30-frame
+ * stacks); the capture walks and formats the JS stack and isn't in that
+ * figure. Compare
+ *
+ *     ptkl run examples/fib.js
+ *     ptkl run --cpu-profile=fib.cpuprofile examples/fib.js
+ *
+ * for the whole cost, and lower --cpu-profile-hz if it shows.
+ */
+typedef struct cpuprof cpuprof;
+
+#define CPUPROF_DEFAULT_HZ 1000
+
+/* the stack of time spent outside JavaScript (as DevTools names it) */
+#define CPUPROF_OUTSIDE_JS "(program)"
+
+cpuprof *cpuprof_new (unsigned hz);
+
+/**
+ * Stop the profiler if it's running, and free it.
+ */
+void cpuprof_free (cpuprof *p);
+
+/**
+ * Start the timer thread. Returns false if the profiler is running or the
+ * thread can't be started. Threads don't survive fork: a forked process
+ * starts its own.
+ */
+bool cpuprof_start (cpuprof *p);
+
+/**
+ * Stop the timer thread. Samples are kept.
+ */
+void cpuprof_stop (cpuprof *p);
+
+/**
+ * Whether a sample is due, and if so, take the mark: the caller should
+ * call cpuprof_sample.
+ */
+bool cpuprof_due (cpuprof *p);
+
+/**
+ * Record a sample of a stack (one frame per line, innermost first, see
+ * jsframe.h), or of no stack if frames is null.
+ */
+void cpuprof_sample (cpuprof *p, const char *frames);
+
+/**
+ * The samples recorded, with those for time outside JavaScript.
+ */
+size_t cpuprof_samples (cpuprof *p);
+
+/**
+ * Write the samples as folded stacks ("root;...;leaf N", N samples), for
+ * flamegraph.pl or speedscope. Returns the number of stacks written.
+ */
+size_t cpuprof_write_folded (cpuprof *p, FILE *f);
+
+/**
+ * Write the samples as a Chrome DevTools .cpuprofile (JSON). Returns false
+ * if the write failed.
+ */
+bool cpuprof_write_cpuprofile (cpuprof *p, FILE *f);
+
+/**
+ * Write a table of the top functions (by name and file) by self samples
+ * (with them on top of the stack), with their total samples (with them
+ * anywhere on the stack).
+ */
+void cpuprof_write_top (cpuprof *p, FILE *f, int top);
+
+#endif /* CPUPROF_H */
@@ -0,0 +1,156 @@
+/*
+ * Partikle sampling heap profiler
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef HEAPPROF_H
+#define HEAPPROF_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Sampling heap profiler
+ *
+ * Which JavaScript code holds the heap. Rather than recording every
+ * allocation (see heaptrace.h), it samples one about every interval bytes
+ * allocated, at exponentially distributed distances (a Poisson process),
+ * so every byte is equally likely to be sampled and a sample of size s
+ * stands for 1 / (1 - exp(-s / interval)) allocations like it. Sampled
+ * allocations are kept until they're freed, so the profile is the live
+ * heap:
+ *
+ *     heapprof *p = heapprof_new (HEAPPROF_DEFAULT_INTERVAL);
+ *     heapprof_alloc (p, heap, ptr, size);   // in the allocator
+ *     heapprof_release (p, ptr);             // in free
+ *     ...
+ *     heapprof_write_pprof (p, f);
+ *
+ * Between samples, the hooks are inline: heapprof_alloc subtracts from a
+ * per-thread counter and heapprof_release reads one slot of a filter of
+ * the sampled addresses; neither calls, locks or does an atomic
+ * read-modify-write. They still cost something on every allocation (see
+ * heapprof_bench.c), so the profiler is opt-in (--heap-profile).
+ *
+ * An allocator can't see the JS stack, so a sample is made pending: the
+ * thread's next heapprof_set_stack (the engine calls it at interpreter
+ * interrupt checks, every few thousand branches) gives the thread's
+ * pending samples, which it keeps in a list, that stack.
+ *
+ * The profiler is thread safe; one can be shared by many engines.
+ */
+typedef struct heapprof heapprof;
+
+#define HEAPPROF_DEFAULT_INTERVAL ((size_t)512 << 10)
+
+#define HEAPPROF_FILTER_SLOTS 4096
+
+/* The start of every profiler, for the inline hooks */
+typedef struct heapprof_head {
+	/* counts of the live samples by address hash */
+	_Atomic uint16_t filter[HEAPPROF_FILTER_SLOTS];
+} heapprof_head;
+
+/* bytes the calling thread allocates before its next sample */
+extern _Thread_local int64_t heapprof_countdown;
+
+static inline size_t heapprof_hash (const void *ptr)
+{
+	uint64_t h = (uint64_t)(uintptr_t)ptr >> 4;
+	return (size_t)(h * 0x9e3779b97f4a7c15ull >> 32);
+}
+
+typedef struct heapprof_stats {
+	uint64_t samples;    /* taken */
+	uint64_t live;	     /* samples not yet freed */
+	uint64_t live_bytes; /* estimated live bytes they stand for */
+	uint64_t pending;    /* live samples waiting for a stack */
+} heapprof_stats;
+
+/**
+ * A profiler sampling every interval bytes on average (0 for the
+ * default).
+ */
+heapprof *heapprof_new (size_t interval);
+void heapprof_free (heapprof *p);
+
+void heapprof_alloc_slow (heapprof *p, const void *heap, const void *ptr,
+			  size_t size);
+void heapprof_release_slow (heapprof *p, const void *ptr);
+
+/* heap identifies the heap ptr is in, for heapprof_release_heap */
+static inline void heapprof_alloc (heapprof *p, const void *heap,
+				   const void *ptr, size_t size)
+{
+	if ((heapprof_countdown -= (int64_t)size) > 0) return;
+	heapprof_alloc_slow (p, heap, ptr, size);
+}
+
+static inline void heapprof_release (heapprof *p, const void *ptr)
+{
+	const heapprof_head *head = (const heapprof_head *)p;
+	size_t slot = heapprof_hash (ptr) % HEAPPROF_FILTER_SLOTS;
+	if (atomic_load_explicit (&head->filter[slot], memory_order_relaxed)) {
+		heapprof_release_slow (p, ptr);
+	}
+}
+
+/**
+ * Release every sample in a heap, for a heap freed whole (like a request
+ * arena) rather than block by block.
+ */
+void heapprof_release_heap (heapprof *p, const void *heap);
+
+/**
+ * Whether the calling thread has samples waiting for a stack.
+ */
+bool heapprof_pending (heapprof *p);
+
+/**
+ * Give the calling thread's pending samples a stack (one frame per line,
+ * innermost first, see jsframe.h), or no stack if frames is null.
+ */
+void heapprof_set_stack (heapprof *p, const char *frames);
+
+void heapprof_get_stats (heapprof *p, heapprof_stats *stats);
+
+/**
+ * Write the live samples by stack as folded stacks ("root;...;leaf N", N
+ * the estimated live bytes), for flamegraph.pl or speedscope. Returns the
+ * number of stacks written.
+ */
+size_t heapprof_write_folded (heapprof *p, FILE *f);
+
+/**
+ * Write the live samples as a pprof profile (uncompressed protobuf, with
+ * inuse_objects and inuse_space values), for go tool pprof. Returns false
+ * if the write failed.
+ */
+bool heapprof_write_pprof (heapprof *p, FILE *f);
+
+#endif /* HEAPPROF_H */
@@ -0,0 +1,121 @@
+/*
+ * Partikle heap allocation traces
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef HEAPTRACE_H
+#define HEAPTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Heap allocation trace
+ *
+ * A binary record of every allocation, free, and reallocation a heap
+ * makes, compact enough to leave on for a whole run: each thread appends
+ * records to its own buffer, which is written to the trace file when it
+ * fills (and when the trace is closed), so recording doesn't take a lock.
+ *
+ *     heaptrace *t = heaptrace_open ("app.htrace");
+ *     void *p = malloc (n);
+ *     heaptrace_alloc (t, p, n);
+ *     heaptrace_free (t, p, n);
+ *     free (p);
+ *     heaptrace_close (t);
+ *
+ * Records can carry a stack: heaptrace_stack interns a stack's text (one
+ * frame per line) as a number, and heaptrace_set_stack makes it the stack
+ * of the thread's following records.
+ *
+ * A heap freed whole (a request arena, see arena.h) has no free records:
+ * heaptrace_reset records that the blocks the thread allocated are gone.
+ *
+ * A record is a tag byte (the operation, and whether the stack changed),
+ * then varints: the time since the thread's previous record (ns), the new
+ * stack if it changed, the address as a (zigzag) difference from the
+ * previous record's, the old address of a reallocation as a difference
+ * from the new one, and the size. A reset is just the tag and the time. A
+ * file is a header and then blocks of records, one thread's buffer each,
+ * each block starting from zero.
+ *
+ * heaptrace_analyze reads a trace back (see ptkl heap analyze).
+ */
+typedef struct heaptrace heaptrace;
+
+/* records per thread between writes (at most 32 bytes each) */
+#define HEAPTRACE_BUFFER_SIZE ((size_t)64 << 10)
+
+/**
+ * Create a trace file. Returns null (and logs why) on error.
+ */
+heaptrace *heaptrace_open (const char *path);
+
+/**
+ * Write every thread's buffered records, and close the file. Returns false
+ * if any write failed. No thread may record while or after it's closed.
+ */
+bool heaptrace_close (heaptrace *t);
+
+void heaptrace_alloc (heaptrace *t, const void *p, size_t size);
+void heaptrace_free (heaptrace *t, const void *p, size_t size);
+void heaptrace_realloc (heaptrace *t, const void *old, const void *p,
+			size_t size);
+
+/**
+ * Record that every block the calling thread allocated and didn't free is
+ * gone (so it's wrong for a thread with more than one traced heap).
+ */
+void heaptrace_reset (heaptrace *t);
+
+/**
+ * The number of a stack (one frame per line, innermost first), the same
+ * for the same text. 0 is no stack. Asking again for the thread's previous
+ * stack doesn't lock.
+ */
+uint32_t heaptrace_stack (heaptrace *t, const char *frames);
+
+/**
+ * Set the stack of the calling thread's following records.
+ */
+void heaptrace_set_stack (heaptrace *t, uint32_t stack);
+
+typedef struct heaptrace_analyze_opts {
+	int buckets; /* of the live heap timeline, 0 for 20 */
+	int top;     /* stacks listed for the peak and leaks, 0 for 10 */
+} heaptrace_analyze_opts;
+
+/**
+ * Read a trace and write a report to out: totals, the live heap over time,
+ * a histogram of allocation sizes, what was live at the peak (by stack),
+ * and what was never freed (leak candidates, by stack). opts may be null.
+ * Returns false (and logs why) if the trace can't be read.
+ */
+bool heaptrace_analyze (const char *path, FILE *out,
+			const heaptrace_analyze_opts *opts);
+
+#endif /* HEAPTRACE_H */
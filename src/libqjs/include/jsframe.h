@@ -0,0 +1,78 @@
+/*
+ * Partikle JavaScript stack frames
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef JSFRAME_H
+#define JSFRAME_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * JavaScript stack frames
+ *
+ * The engine captures the JS stack as text, one frame per line, innermost
+ * first, the way an Error's stack reads without the "at":
+ *
+ *     parse (app.js:3:5)
+ *     JSON.parse (native)
+ *     <anonymous> (app.js:9)
+ *
+ * js_frame_parse splits a line into its function, file, and position.
+ * The fields point into the line (they aren't null-terminated).
+ */
+/* a frame for samples taken without a stack */
+#define JS_NO_STACK "(no stack)"
+
+typedef struct js_frame {
+	const char *name;
+	size_t name_len;
+	const char *file; /* "native" for C functions */
+	size_t file_len;
+	int line;   /* from 1, 0 if unknown */
+	int column; /* from 1, 0 if unknown */
+} js_frame;
+
+/**
+ * Parse a frame. Returns false if len is 0. A line without a location is
+ * all name, with an empty file.
+ */
+bool js_frame_parse (const char *text, size_t len, js_frame *f);
+
+/**
+ * The length of the frame line at text (up to a newline or the end), and
+ * sets *next to the following line (or null after the last).
+ */
+size_t js_frame_line (const char *text, const char **next);
+
+/**
+ * Write a stack's frames root first, separated by ";" (a folded stack, as
+ * flame graph tools read them).
+ */
+void js_frames_fold (FILE *f, const char *frames);
+
+#endif /* JSFRAME_H */
@@ -0,0 +1,68 @@
+/*
+ * Partikle read-only file mappings
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Read-only file mapping
+ *
+ * Compiled code is read once, front to back, and never written, so rather
+ * than copying a file into the heap it can be mapped and read in place:
+ *
+ *     mapped_file f;
+ *     if (map_file (path, &f)) {
+ *             JS_ReadObject (ctx, f.data, f.len, JS_READ_OBJ_BYTECODE);
+ *             unmap_file (&f);
+ *     }
+ *
+ * The pages come from (and stay in) the page cache, so processes loading
+ * the same file share one copy, and nothing is read until it's touched.
+ */
+typedef struct mapped_file {
+	const uint8_t *data;
+	size_t len;
+} mapped_file;
+
+/**
+ * Map a file. Returns false (with errno set) if it can't be opened or
+ * mapped. An empty file maps to a null data pointer and a length of 0.
+ */
+bool map_file (const char *path, mapped_file *f);
+
+/**
+ * Map an open file (the mapping doesn't keep fd open).
+ */
+bool map_fd (int fd, mapped_file *f);
+
+void unmap_file (mapped_file *f);
+
+#endif /* MAPFILE_H */
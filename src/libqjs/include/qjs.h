@@ -29,6 +29,338 @@
 #ifndef QJS_H
 #define QJS_H
 
-void test_engine ();
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bundle.h"
+#include "codecache.h"
+#include "cpuprof.h"
+#include "heapprof.h"
+#include "heaptrace.h"
+
+typedef struct JSRuntime JSRuntime;
+typedef struct JSContext JSContext;
+
+/**
+ * JavaScript engine
+ *
+ * An engine is a QuickJS runtime and a context set up the one way ptkl
+ * runs JavaScript (run, serve, and compile use it; repl isn't migrated
+ * yet): memory and stack limits, the intrinsics (built-in objects) to
+ * add, the std and os modules, the ES module loader, and the event loop
+ * handlers.
+ *
+ *     engine_opts opts = ENGINE_OPTS_DEFAULT;
+ *     opts.memory_limit = 64 << 20;
+ *     engine *e = engine_new (&opts);
+ *     if (!e) return;
+ *     if (engine_eval_file (e, "app.js")) engine_run_loop (e);
+ *     engine_free (e);
+ *
+ * An engine can be reused: engine_reset replaces the context with a new
+ * one (nothing from the previous run is reachable after it) but keeps the
+ * runtime, so a run after the first skips creating the runtime and its
+ * atom and shape tables.
+ *
+ * An engine must only be used by one thread at a time.
+ */
+typedef struct engine engine;
+
+/* intrinsics (built-in objects) that can be added to a context */
+typedef enum engine_intrinsic {
+	/* Object, Function, Array, Error, Number, String, Symbol, BigInt,
+	   Math, Reflect, generators, ... (always added) */
+	ENGINE_INTRINSIC_BASE = 1 << 0,
+	ENGINE_INTRINSIC_DATE = 1 << 1,
+	ENGINE_INTRINSIC_EVAL = 1 << 2, /* eval, Function(); modules need it */
+	ENGINE_INTRINSIC_STRING_NORMALIZE = 1 << 3,
+	ENGINE_INTRINSIC_REGEXP_COMPILER = 1 << 4,
+	ENGINE_INTRINSIC_REGEXP = 1 << 5,
+	ENGINE_INTRINSIC_JSON = 1 << 6,
+	ENGINE_INTRINSIC_PROXY = 1 << 7,
+	ENGINE_INTRINSIC_MAP_SET = 1 << 8,
+	ENGINE_INTRINSIC_TYPED_ARRAYS = 1 << 9,
+	ENGINE_INTRINSIC_PROMISE = 1 << 10,
+	ENGINE_INTRINSIC_WEAKREF = 1 << 11, /* WeakRef, FinalizationRegistry */
+} engine_intrinsic;
+
+/* the intrinsics of a standard context (JS_NewContext) */
+#define ENGINE_INTRINSICS_ALL ((uint32_t)(1 << 12) - 1)
+
+typedef struct engine_opts {
+	size_t memory_limit; /* bytes, 0 for no limit */
+	size_t stack_size;   /* bytes, 0 for the QuickJS default (256 KB) */
+	size_t gc_threshold; /* bytes allocated between GCs, 0 for default */
+	uint32_t intrinsics; /* engine_intrinsic flags */
+	bool std_modules;    /* add the std and os modules */
+	bool track_rejections; /* report unhandled promise rejections */
+
+	/* allocate the JS heap from a request arena (see arena.h), freed
+	   whole by engine_free and engine_reset: timers and I/O handlers
+	   are dropped, but there's no final GC and no finalizers run, so
+	   std FILEs the script left open stay open and os.Worker threads
+	   keep running (use it for handlers that don't need them) */
+	bool arena;
+
+	/* scriptArgs (only with std_modules) */
+	int argc;
+	char **argv;
+
+	/* compiled files and modules are cached here (optional; the cache
+	   must outlive the engine) */
+	codecache *cache;
+
+	/* modules are imported from here, not the filesystem, and its assets
+	   are available as bundleAsset(name) (optional; the bundle must
+	   outlive the engine) */
+	bundle *bundle;
+
+	/* every JS heap allocation is recorded here (optional; the trace
+	   must outlive the engine). Records carry the JS stack as of the
+	   interpreter's last interrupt check, which it makes every few
+	   thousand branches: close to, but not exactly, the allocating
+	   frame */
+	heaptrace *heap_trace;
+
+	/* JS heap allocations are sampled here (optional; the profiler must
+	   outlive the engine, and can be shared). Samples get the stack at
+	   the next interrupt check, as heap_trace records do */
+	heapprof *heap_profile;
+
+	/* the JS stack is sampled here when the profiler's timer says so
+	   (optional; the profiler must outlive the engine, and is started
+	   and stopped by its owner) */
+	cpuprof *cpu_profile;
+
+	/* the app reports each request it handles with reportRequest(ms[,
+	   ok]), which calls on_request (optional; without it, reportRequest
+	   isn't defined) */
+	void (*on_request) (void *arg, uint64_t latency_ns, bool ok);
+	void *request_arg;
+
+	/* the heap's size is read at interrupt checks when
+	   engine_sample_memory asks for it */
+	bool sample_memory;
+} engine_opts;
+
+#define ENGINE_OPTS_DEFAULT                                                    \
+	(engine_opts)                                                          \
+	{                                                                      \
+		.intrinsics = ENGINE_INTRINSICS_ALL, .std_modules = true,      \
+		.track_rejections = true,                                      \
+	}
+
+/* setup times and memory use */
+typedef struct engine_stats {
+	uint64_t runtime_ns; /* JS_NewRuntime and its configuration */
+	uint64_t context_ns; /* the most recent context (new or reset) */
+	uint64_t resets;
+	uint64_t scrubs;
+	size_t memory_used; /* bytes allocated by the runtime */
+	size_t memory_limit;
+
+	/* files and modules compiled from source, or loaded from the cache */
+	uint64_t compiled;
+	uint64_t compile_ns;
+	uint64_t cache_hits;
+	uint64_t cache_load_ns;
+	uint64_t cache_saved_ns; /* compile time of the hits, minus load time */
+} engine_stats;
+
+/**
+ * Create an engine. opts may be null for ENGINE_OPTS_DEFAULT. Returns null
+ * (and logs why) if the runtime or context can't be created.
+ */
+engine *engine_new (const engine_opts *opts);
+
+/**
+ * Free the engine, its context, and its runtime.
+ */
+void engine_free (engine *e);
+
+/**
+ * Replace the context with a new one, dropping any pending jobs, timers,
+ * and handlers from the previous run and collecting garbage (with an
+ * arena, the runtime is replaced too and its heap dropped whole, so
+ * engine_runtime changes). Returns false if the new context can't be
+ * created (the engine is then unusable and must be freed).
+ */
+bool engine_reset (engine *e);
+
+/**
+ * Record the global object's properties and their values as the engine's
+ * clean state (after evaluating an app's top-level code, for example), for
+ * engine_scrub.
+ */
+bool engine_snapshot (engine *e);
+
+/**
+ * Make the context clean again after a run, much faster than engine_reset:
+ * delete global object properties added since engine_snapshot, drop
+ * timers and I/O handlers, and clear any pending exception. Returns false
+ * if the engine shouldn't be reused (reset or replace it instead): promise
+ * jobs are still pending (the run didn't finish), an added global can't be
+ * deleted (a global var), or a snapshot global was replaced or deleted.
+ *
+ * Only the global object's own properties are checked. Changes inside the
+ * objects they hold (Array.prototype.map = ..., JSON.parse = ...) and
+ * lexical globals (let, const, class) added by a script aren't detected,
+ * so reuse is only safe for trusted code that runs functions, not new
+ * scripts.
+ */
+bool engine_scrub (engine *e);
+
+/**
+ * Evaluate a file, as a module if its name ends with .mjs or it contains
+ * import or export statements, otherwise as a script. An uncaught
+ * exception is printed to stderr. Returns false on error.
+ *
+ * With a cache (see engine_opts), the file and the modules it imports are
+ * loaded as bytecode when they haven't changed since they were compiled.
+ */
+bool engine_eval_file (engine *e, const char *path);
+
+/**
+ * Evaluate source text (not necessarily null-terminated, but buf[len] must
+ * be readable and zero, as for JS_Eval). filename is used in stack traces.
+ */
+bool engine_eval_buf (engine *e, const char *buf, size_t len,
+		      const char *filename, bool module);
+
+/**
+ * Evaluate bytecode written by JS_WriteObject (a script or module compiled
+ * by ptkl compile). Returns false on error, including invalid bytecode.
+ */
+bool engine_eval_bytecode (engine *e, const uint8_t *buf, size_t len);
+
+/**
+ * Compile a file, and every module it imports (directly or not), into a
+ * bundle, with the file as its main item. Nothing is run. Use a fresh
+ * engine, and free it afterwards: the modules stay loaded.
+ */
+bool engine_bundle (engine *e, const char *path, bundle_writer *w);
+
+/**
+ * Evaluate the main item of the engine's bundle (see engine_opts).
+ */
+bool engine_eval_bundle (engine *e);
+
+/**
+ * Run pending jobs (promises) and the event loop (timers, I/O handlers,
+ * workers) until there is nothing left to do.
+ */
+void engine_run_loop (engine *e);
+
+/**
+ * Collect garbage now, e.g., before forking workers that share the heap.
+ */
+void engine_gc (engine *e);
+
+/**
+ * Setup times and memory use so far.
+ */
+void engine_get_stats (engine *e, engine_stats *stats);
+
+/**
+ * The JS heap's size (as engine_stats.memory_used) at the last reading, and
+ * ask for another at the engine's next interrupt check. Unlike
+ * engine_get_stats, it can be called from any thread while the engine
+ * runs, but readings are only taken while JS runs (the heap of an idle
+ * engine doesn't change). Needs opts.sample_memory; returns 0 until the
+ * first reading.
+ */
+size_t engine_sample_memory (engine *e);
+
+/**
+ * The underlying runtime and (current) context, for adding host functions
+ * and modules.
+ */
+JSRuntime *engine_runtime (engine *e);
+JSContext *engine_context (engine *e);
+
+/**
+ * Engine pool
+ *
+ * Creating an engine costs milliseconds (runtime, context, modules, then
+ * the app's own top-level code), so a server keeps a pool of engines that
+ * are ready to run, and each request borrows one:
+ *
+ *     engine_pool_opts opts = {.engine = ENGINE_OPTS_DEFAULT, .size = 8,
+ *                              .warm = load_app, .warm_arg = app};
+ *     engine_pool *pool = engine_pool_new (&opts);
+ *
+ *     engine *e = engine_pool_acquire (pool);   // per request
+ *     bool ok = handle (e, request);
+ *     engine_pool_release (pool, e, ok);
+ *
+ * Releasing an engine scrubs it (see engine_scrub) and checks its health.
+ * A scrub doesn't undo everything a run can change (a builtin prototype
+ * patched by the handler, say), so the pool is for trusted handlers; use
+ * engine_reset per request for code that isn't.
+ * An engine that failed (the caller passes ok = false after an uncaught
+ * exception or out of memory), can't be scrubbed, has served max_uses
+ * requests, or whose heap grew past max_heap is discarded and replaced
+ * with a new warm one, so a poisoned context never serves another request.
+ *
+ * engine_bench measures a request's trip through the pool (acquire, a
+ * small handler, scrub, and release) against engine_new and engine_reset,
+ * and the cost of replacing an engine whose scrub failed.
+ *
+ * Idle engines are reused most recently released first (their memory is
+ * most likely to be in cache). The pool is thread safe; each engine is
+ * used by one thread at a time.
+ *
+ * ptkl serve doesn't use a pool: its workers each run the app's event
+ * loop in one engine (see serve.c).
+ */
+typedef struct engine_pool engine_pool;
+
+/* Prepares a new engine, e.g., evaluates the app; false discards it */
+typedef bool (*engine_warm_fn) (engine *e, void *arg);
+
+typedef struct engine_pool_opts {
+	engine_opts engine;
+	size_t size; /* engines in the pool */
+	engine_warm_fn warm; /* optional */
+	void *warm_arg;
+	size_t max_heap;   /* bytes, 0 for no limit */
+	uint32_t max_uses; /* requests per engine, 0 for no limit */
+} engine_pool_opts;
+
+/* checked every ENGINE_POOL_HEAP_CHECK uses (measuring the heap walks it) */
+#define ENGINE_POOL_HEAP_CHECK 16
+
+typedef struct engine_pool_stats {
+	uint64_t acquired;
+	uint64_t waited; /* acquires that waited for an engine */
+	uint64_t created;
+	uint64_t discarded;
+	uint64_t warm_ns; /* creating and warming the newest engine */
+} engine_pool_stats;
+
+/**
+ * Create a pool with opts->size engines, all created and warmed before it
+ * returns. Returns null (and logs why) if any of them fails.
+ */
+engine_pool *engine_pool_new (const engine_pool_opts *opts);
+
+/**
+ * Free the pool and its engines. All engines must have been released.
+ */
+void engine_pool_free (engine_pool *pool);
+
+/**
+ * Borrow an engine, waiting for one if they're all in use. Returns null if
+ * a replacement for a discarded engine can't be created.
+ */
+engine *engine_pool_acquire (engine_pool *pool);
+
+/**
+ * Return an engine to the pool. ok is false if the run failed in a way
+ * that may have left the context unusable.
+ */
+void engine_pool_release (engine_pool *pool, engine *e, bool ok);
+
+void engine_pool_get_stats (engine_pool *pool, engine_pool_stats *stats);
 
 #endif /* QJS_H */
@@ -0,0 +1,292 @@
+/*
+ * Partikle request heap arena
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "log.h"
+
+#define ALIGN 16
+#define SMALL_CLASSES 28
+#define BIG UINT32_MAX
+
+/* the smallest chunk holds a few of the largest small blocks */
+#define CHUNK_MIN (4 * (ARENA_SMALL_MAX + sizeof (struct header)))
+
+/* precedes every block (the headers keep blocks aligned: all are 16 bytes
+   on 64-bit platforms) */
+struct header {
+	uint32_t cls; /* size class, or BIG */
+	uint32_t unused;
+	size_t size; /* usable */
+};
+
+/* precedes the header of a block larger than ARENA_SMALL_MAX */
+struct big {
+	struct big *prev;
+	struct big *next;
+};
+
+struct chunk {
+	struct chunk *next;
+	size_t size; /* of the data that follows */
+};
+
+/* a released small block */
+struct free_block {
+	struct free_block *next;
+};
+
+struct arena {
+	size_t chunk_size;
+	struct chunk *chunks;  /* all of them, in order */
+	struct chunk *current; /* the one being bumped */
+	uint8_t *bump;
+	uint8_t *end;
+	struct free_block *free[SMALL_CLASSES];
+	struct big *bigs;
+	arena_stats stats;
+};
+
+/* 16-byte steps to 128, then four classes per doubling, to 4096 */
+static unsigned class_of (size_t size)
+{
+	if (size <= 128) return size ? (unsigned)((size - 1) >> 4) : 0;
+	unsigned log = 63 - (unsigned)__builtin_clzll (size - 1);
+	return 8 + (log - 7) * 4 + (unsigned)((size - 1) >> (log - 2)) - 4;
+}
+
+static size_t class_size (unsigned cls)
+{
+	if (cls < 8) return (cls + 1) * 16;
+	unsigned log = 7 + (cls - 8) / 4;
+	return (size_t)(5 + (cls - 8) % 4) << (log - 2);
+}
+
+static inline struct header *header_of (const void *p)
+{
+	return (struct header *)p - 1;
+}
+
+arena *arena_new (size_t chunk_size)
+{
+	arena *a = calloc (1, sizeof (*a));
+	if (!a) panic ("out of memory");
+	if (chunk_size == 0) chunk_size = ARENA_CHUNK_DEFAULT;
+	a->chunk_size = chunk_size < CHUNK_MIN ? CHUNK_MIN : chunk_size;
+	return a;
+}
+
+static void free_bigs (arena *a)
+{
+	struct big *b = a->bigs;
+	while (b) {
+		struct big *next = b->next;
+		free (b);
+		b = next;
+	}
+	a->bigs = nullptr;
+}
+
+void arena_free (arena *a)
+{
+	if (!a) return;
+	free_bigs (a);
+	struct chunk *c = a->chunks;
+	while (c) {
+		struct chunk *next = c->next;
+		free (c);
+		c = next;
+	}
+	free (a);
+}
+
+/* Start bumping the next chunk: a kept one, or a new one */
+static bool next_chunk (arena *a)
+{
+	struct chunk *c = a->current ? a->current->next : a->chunks;
+	if (!c) {
+		c = malloc (sizeof (*c) + a->chunk_size);
+		if (!c) return false;
+		c->next = nullptr;
+		c->size = a->chunk_size;
+		if (a->current) {
+			a->current->next = c;
+		} else {
+			a->chunks = c;
+		}
+		a->stats.footprint += sizeof (*c) + c->size;
+	}
+	a->current = c;
+	a->bump = (uint8_t *)(c + 1);
+	a->end = a->bump + c->size;
+	return true;
+}
+
+static void *alloc_small (arena *a, unsigned cls)
+{
+	struct free_block *f = a->free[cls];
+	if (f) {
+		a->free[cls] = f->next;
+		return f;
+	}
+
+	size_t need = sizeof (struct header) + class_size (cls);
+	if ((size_t)(a->end - a->bump) < need && !next_chunk (a)) {
+		return nullptr;
+	}
+	struct header *h = (struct header *)a->bump;
+	a->bump += need;
+	h->cls = cls;
+	h->size = class_size (cls);
+	return h + 1;
+}
+
+static void *alloc_big (arena *a, size_t size)
+{
+	size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+	struct big *b = malloc (sizeof (*b) + sizeof (struct header) + size);
+	if (!b) return nullptr;
+	b->prev = nullptr;
+	b->next = a->bigs;
+	if (a->bigs) a->bigs->prev = b;
+	a->bigs = b;
+	a->stats.footprint += sizeof (*b) + sizeof (struct header) + size;
+
+	struct header *h = (struct header *)(b + 1);
+	h->cls = BIG;
+	h->size = size;
+	return h + 1;
+}
+
+/* realloc, keeping the block's place in the list */
+static void *resize_big (arena *a, void *p, size_t size)
+{
+	size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+	struct header *h = header_of (p);
+	size_t old = h->size;
+	struct big *b = realloc ((struct big *)h - 1,
+				 sizeof (*b) + sizeof (*h) + size);
+	if (!b) return nullptr;
+	if (b->prev) {
+		b->prev->next = b;
+	} else {
+		a->bigs = b;
+	}
+	if (b->next) b->next->prev = b;
+
+	h = (struct header *)(b + 1);
+	h->size = size;
+	a->stats.malloc_size += size - old;
+	a->stats.footprint += size - old;
+	return h + 1;
+}
+
+void *arena_alloc (arena *a, size_t size)
+{
+	void *p = size <= ARENA_SMALL_MAX ? alloc_small (a, class_of (size))
+					  : alloc_big (a, size);
+	if (p) {
+		a->stats.malloc_count++;
+		a->stats.malloc_size += header_of (p)->size;
+	}
+	return p;
+}
+
+void arena_release (arena *a, void *p)
+{
+	if (!p) return;
+	struct header *h = header_of (p);
+	a->stats.malloc_count--;
+	a->stats.malloc_size -= h->size;
+	if (h->cls != BIG) {
+		struct free_block *f = p;
+		f->next = a->free[h->cls];
+		a->free[h->cls] = f;
+		return;
+	}
+
+	struct big *b = (struct big *)h - 1;
+	if (b->prev) {
+		b->prev->next = b->next;
+	} else {
+		a->bigs = b->next;
+	}
+	if (b->next) b->next->prev = b->prev;
+	a->stats.footprint -= sizeof (*b) + sizeof (*h) + h->size;
+	free (b);
+}
+
+void *arena_resize (arena *a, void *p, size_t size)
+{
+	if (!p) return arena_alloc (a, size);
+	if (size == 0) {
+		arena_release (a, p);
+		return nullptr;
+	}
+	struct header *h = header_of (p);
+	if (h->cls != BIG && size <= ARENA_SMALL_MAX &&
+	    class_of (size) == h->cls) {
+		return p;
+	}
+	if (h->cls == BIG && size > ARENA_SMALL_MAX) {
+		return resize_big (a, p, size);
+	}
+
+	void *q = arena_alloc (a, size);
+	if (!q) return nullptr;
+	memcpy (q, p, h->size < size ? h->size : size);
+	arena_release (a, p);
+	return q;
+}
+
+size_t arena_usable_size (const void *p)
+{
+	return p ? header_of (p)->size : 0;
+}
+
+void arena_reset (arena *a)
+{
+	free_bigs (a);
+	memset (a->free, 0, sizeof (a->free));
+	a->current = nullptr;
+	a->bump = a->end = nullptr;
+	a->stats.malloc_size = 0;
+	a->stats.malloc_count = 0;
+	a->stats.footprint = 0;
+	for (struct chunk *c = a->chunks; c; c = c->next) {
+		a->stats.footprint += sizeof (*c) + c->size;
+	}
+	a->stats.resets++;
+}
+
+void arena_get_stats (arena *a, arena_stats *stats)
+{
+	*stats = a->stats;
+}
@@ -0,0 +1,389 @@
+/*
+ * Partikle application bundles
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bundle.h"
+#include "log.h"
+#include "mapfile.h"
+
+#define MAGIC 0x646e626c6b7470ull /* "ptklbnd" */
+#define FORMAT_VERSION 1
+#define NO_MAIN UINT32_MAX
+
+struct header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t count;
+	uint32_t slots; /* a power of two, more than count */
+	uint32_t main;	/* item number, or NO_MAIN */
+	uint32_t item_size;
+	uint64_t items_offset;
+	uint64_t slots_offset;
+	uint64_t size; /* of the file */
+};
+
+struct item {
+	uint64_t hash; /* of the name */
+	uint64_t name_offset;
+	uint64_t data_offset;
+	uint64_t data_len;
+	uint32_t name_len;
+	uint32_t kind;
+};
+
+struct bundle {
+	mapped_file map;
+	const struct header *h;
+	const struct item *items;
+	const uint32_t *slots;
+};
+
+typedef struct writer_item {
+	char *name;
+	size_t name_len;
+	bundle_kind kind;
+	void *data;
+	size_t len;
+} writer_item;
+
+struct bundle_writer {
+	writer_item *items;
+	size_t count;
+	size_t cap;
+	uint32_t main;
+};
+
+/* FNV-1a */
+static uint64_t hash_name (const char *name, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < len; i++) {
+		h ^= (uint8_t)name[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+static inline uint64_t align8 (uint64_t n)
+{
+	return (n + 7) & ~(uint64_t)7;
+}
+
+bundle_writer *bundle_writer_new (void)
+{
+	bundle_writer *w = calloc (1, sizeof (*w));
+	if (!w) panic ("out of memory");
+	w->main = NO_MAIN;
+	return w;
+}
+
+void bundle_writer_free (bundle_writer *w)
+{
+	if (!w) return;
+	for (size_t i = 0; i < w->count; i++) {
+		free (w->items[i].name);
+		free (w->items[i].data);
+	}
+	free (w->items);
+	free (w);
+}
+
+static writer_item *writer_find (bundle_writer *w, const char *name)
+{
+	for (size_t i = 0; i < w->count; i++) {
+		if (strcmp (w->items[i].name, name) == 0) return &w->items[i];
+	}
+	return nullptr;
+}
+
+bool bundle_writer_has (bundle_writer *w, const char *name)
+{
+	return writer_find (w, name) != nullptr;
+}
+
+bool bundle_writer_add (bundle_writer *w, const char *name, bundle_kind kind,
+			const void *data, size_t len)
+{
+	if (writer_find (w, name)) return false;
+	if (w->count == w->cap) {
+		w->cap = w->cap ? w->cap * 2 : 16;
+		w->items = realloc (w->items, w->cap * sizeof (writer_item));
+		if (!w->items) panic ("out of memory");
+	}
+	writer_item *item = &w->items[w->count++];
+	item->name = strdup (name);
+	item->data = malloc (len ? len : 1);
+	if (!item->name || !item->data) panic ("out of memory");
+	if (len) memcpy (item->data, data, len);
+	item->name_len = strlen (name);
+	item->kind = kind;
+	item->len = len;
+	return true;
+}
+
+bool bundle_writer_set_main (bundle_writer *w, const char *name)
+{
+	writer_item *item = writer_find (w, name);
+	if (!item || item->kind == BUNDLE_ASSET) return false;
+	w->main = (uint32_t)(item - w->items);
+	return true;
+}
+
+static bool write_full (int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	while (len > 0) {
+		ssize_t n = write (fd, p, len);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+/* Lay out the whole file in memory */
+static uint8_t *build (bundle_writer *w, size_t *size)
+{
+	uint32_t slots = 8;
+	while (slots <= w->count * 2) slots *= 2;
+
+	uint64_t items_offset = align8 (sizeof (struct header));
+	uint64_t slots_offset =
+		align8 (items_offset + w->count * sizeof (struct item));
+	uint64_t names_offset = align8 (slots_offset + slots * 4ull);
+	uint64_t data_offset = names_offset;
+	for (size_t i = 0; i < w->count; i++) {
+		data_offset += w->items[i].name_len + 1;
+	}
+	data_offset = align8 (data_offset);
+	uint64_t end = data_offset;
+	for (size_t i = 0; i < w->count; i++) {
+		end = align8 (end + w->items[i].len);
+	}
+
+	uint8_t *buf = calloc (1, end);
+	if (!buf) panic ("out of memory");
+	*(struct header *)buf = (struct header){
+		.magic = MAGIC,
+		.version = FORMAT_VERSION,
+		.header_size = sizeof (struct header),
+		.count = (uint32_t)w->count,
+		.slots = slots,
+		.main = w->main,
+		.item_size = sizeof (struct item),
+		.items_offset = items_offset,
+		.slots_offset = slots_offset,
+		.size = end,
+	};
+
+	struct item *items = (struct item *)(buf + items_offset);
+	uint32_t *table = (uint32_t *)(buf + slots_offset);
+	uint64_t name = names_offset, data = data_offset;
+	for (size_t i = 0; i < w->count; i++) {
+		writer_item *wi = &w->items[i];
+		uint64_t h = hash_name (wi->name, wi->name_len);
+		items[i] = (struct item){
+			.hash = h,
+			.name_offset = name,
+			.data_offset = data,
+			.data_len = wi->len,
+			.name_len = (uint32_t)wi->name_len,
+			.kind = wi->kind,
+		};
+		memcpy (buf + name, wi->name, wi->name_len + 1);
+		memcpy (buf + data, wi->data, wi->len);
+		name += wi->name_len + 1;
+		data = align8 (data + wi->len);
+
+		uint32_t slot = (uint32_t)h & (slots - 1);
+		while (table[slot]) slot = (slot + 1) & (slots - 1);
+		table[slot] = (uint32_t)i + 1;
+	}
+	*size = end;
+	return buf;
+}
+
+bool bundle_writer_write (bundle_writer *w, const char *path)
+{
+	char temp[PATH_MAX];
+	if (snprintf (temp, sizeof (temp), "%s.%d.tmp", path,
+		      (int)getpid ()) >= (int)sizeof (temp)) {
+		log_error ("%s: path too long", path);
+		return false;
+	}
+	size_t size;
+	uint8_t *buf = build (w, &size);
+
+	int fd = open (temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	bool ok = fd >= 0 && write_full (fd, buf, size);
+	if (fd >= 0) ok = close (fd) == 0 && ok;
+	ok = ok && rename (temp, path) == 0;
+	if (!ok) {
+		log_error ("%s: %s", path, strerror (errno));
+		unlink (temp);
+	}
+	free (buf);
+	return ok;
+}
+
+static bool in_bounds (const bundle *b, uint64_t offset, uint64_t len)
+{
+	return offset <= b->map.len && len <= b->map.len - offset;
+}
+
+static bool valid_item (const bundle *b, const struct item *it)
+{
+	if (it->kind > BUNDLE_ASSET ||
+	    !in_bounds (b, it->name_offset, it->name_len + 1ull) ||
+	    !in_bounds (b, it->data_offset, it->data_len)) {
+		return false;
+	}
+	const char *name = (const char *)b->map.data + it->name_offset;
+	return name[it->name_len] == '\0' &&
+	       hash_name (name, it->name_len) == it->hash;
+}
+
+static bool validate (bundle *b)
+{
+	const struct header *h = b->h;
+	if (b->map.len < sizeof (*h) || h->magic != MAGIC ||
+	    h->version != FORMAT_VERSION || h->header_size != sizeof (*h) ||
+	    h->item_size != sizeof (struct item) || h->size != b->map.len) {
+		return false;
+	}
+	if (h->slots == 0 || (h->slots & (h->slots - 1)) ||
+	    h->slots <= h->count || h->items_offset % 8 ||
+	    h->slots_offset % 8 ||
+	    !in_bounds (b, h->items_offset,
+			h->count * (uint64_t)sizeof (struct item)) ||
+	    !in_bounds (b, h->slots_offset, h->slots * 4ull)) {
+		return false;
+	}
+	b->items = (const struct item *)(b->map.data + h->items_offset);
+	b->slots = (const uint32_t *)(b->map.data + h->slots_offset);
+
+	for (uint32_t i = 0; i < h->count; i++) {
+		if (!valid_item (b, &b->items[i])) return false;
+	}
+	for (uint32_t i = 0; i < h->slots; i++) {
+		if (b->slots[i] > h->count) return false;
+	}
+	return h->main == NO_MAIN ||
+	       (h->main < h->count && b->items[h->main].kind != BUNDLE_ASSET);
+}
+
+bundle *bundle_open (const char *path)
+{
+	bundle *b = calloc (1, sizeof (*b));
+	if (!b) panic ("out of memory");
+	if (!map_file (path, &b->map)) {
+		log_error ("%s: %s", path, strerror (errno));
+		free (b);
+		return nullptr;
+	}
+	b->h = (const struct header *)b->map.data;
+
+	/* The index is probed at random and modules are read one at a time,
+	   not in order (map_file advised sequential reads) */
+	if (b->map.len) madvise ((void *)b->map.data, b->map.len, MADV_RANDOM);
+	if (!validate (b)) {
+		log_error ("%s: not a valid bundle", path);
+		bundle_close (b);
+		return nullptr;
+	}
+	return b;
+}
+
+void bundle_close (bundle *b)
+{
+	if (!b) return;
+	unmap_file (&b->map);
+	free (b);
+}
+
+size_t bundle_count (bundle *b)
+{
+	return b->h->count;
+}
+
+static void get_item (bundle *b, uint32_t i, bundle_item *item)
+{
+	const struct item *it = &b->items[i];
+	*item = (bundle_item){
+		.name = (const char *)b->map.data + it->name_offset,
+		.kind = (bundle_kind)it->kind,
+		.data = b->map.data + it->data_offset,
+		.len = it->data_len,
+	};
+}
+
+bool bundle_find (bundle *b, const char *name, bundle_item *item)
+{
+	size_t len = strlen (name);
+	uint64_t h = hash_name (name, len);
+	uint32_t mask = b->h->slots - 1;
+	uint32_t slot = (uint32_t)h & mask;
+
+	/* Bounded, in case a damaged table has no empty slot */
+	for (uint32_t n = 0; n < b->h->slots; n++) {
+		uint32_t i = b->slots[slot];
+		if (i == 0) return false;
+		const struct item *it = &b->items[i - 1];
+		if (it->hash == h && it->name_len == len &&
+		    memcmp (b->map.data + it->name_offset, name, len) == 0) {
+			get_item (b, i - 1, item);
+			return true;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return false;
+}
+
+bool bundle_item_at (bundle *b, size_t i, bundle_item *item)
+{
+	if (i >= b->h->count) return false;
+	get_item (b, (uint32_t)i, item);
+	return true;
+}
+
+bool bundle_main (bundle *b, bundle_item *item)
+{
+	if (b->h->main == NO_MAIN) return false;
+	get_item (b, b->h->main, item);
+	return true;
+}
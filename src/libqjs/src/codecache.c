@@ -0,0 +1,436 @@
+/*
+ * Partikle JavaScript bytecode cache
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "codecache.h"
+#include "log.h"
+#include "mapfile.h"
+
+#define MAGIC 0x6362716c6b7470ull /* "ptklqbc" */
+#define FORMAT_VERSION 1
+#define SUFFIX ".qbc"
+#define NAME_LEN (32 + sizeof (SUFFIX) - 1) /* hex key + suffix */
+
+/* temporary files older than this were left by a process that died */
+#define STALE_TEMP_SECONDS 3600
+
+/* puts between directory scans, to see other processes' entries */
+#define SCAN_EVERY 64
+
+struct header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t key[2];
+	uint64_t len;
+	uint64_t checksum; /* of the data */
+	uint64_t cost_ns;
+};
+
+struct codecache {
+	char *dir;
+	size_t max_bytes;
+	_Atomic uint64_t hits;
+	_Atomic uint64_t misses;
+	_Atomic uint64_t invalid;
+	_Atomic uint64_t writes;
+	_Atomic uint64_t evictions;
+
+	/* the directory's size at the last scan plus the entries put since
+	   (so a put only scans when the cache may be over its limit) */
+	_Atomic size_t bytes;
+	_Atomic unsigned puts;
+};
+
+/*
+ * MurmurHash3 (x64, 128-bit): fast, and well distributed enough that two
+ * different sources (or an entry and a damaged copy of it) won't collide.
+ */
+
+static inline uint64_t rotl64 (uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64 (uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdull;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ull;
+	k ^= k >> 33;
+	return k;
+}
+
+static void hash128 (const void *key, size_t len, uint64_t seed,
+		     uint64_t out[2])
+{
+	const uint8_t *data = key;
+	const uint64_t c1 = 0x87c37b91114253d5ull;
+	const uint64_t c2 = 0x4cf5ad432745937full;
+	uint64_t h1 = seed, h2 = seed;
+	uint64_t k1, k2;
+
+	size_t blocks = len / 16;
+	for (size_t i = 0; i < blocks; i++) {
+		memcpy (&k1, data + i * 16, 8);
+		memcpy (&k2, data + i * 16 + 8, 8);
+		k1 *= c1;
+		k1 = rotl64 (k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+		h1 = rotl64 (h1, 27) + h2;
+		h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2;
+		k2 = rotl64 (k2, 33);
+		k2 *= c1;
+		h2 ^= k2;
+		h2 = rotl64 (h2, 31) + h1;
+		h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	/* the last 0-15 bytes, zero padded */
+	uint8_t tail[16] = {0};
+	size_t rest = len & 15;
+	memcpy (tail, data + blocks * 16, rest);
+	memcpy (&k1, tail, 8);
+	memcpy (&k2, tail + 8, 8);
+	if (rest > 8) {
+		k2 *= c2;
+		k2 = rotl64 (k2, 33);
+		k2 *= c1;
+		h2 ^= k2;
+	}
+	if (rest > 0) {
+		k1 *= c1;
+		k1 = rotl64 (k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+	}
+
+	h1 ^= len;
+	h2 ^= len;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64 (h1);
+	h2 = fmix64 (h2);
+	h1 += h2;
+	h2 += h1;
+	out[0] = h1;
+	out[1] = h2;
+}
+
+codecache_key codecache_key_for (const void *source, size_t len,
+				 const char *salt)
+{
+	uint64_t seed[2];
+	hash128 (salt, strlen (salt), 0, seed);
+	codecache_key key;
+	hash128 (source, len, seed[0] ^ seed[1], key.hash);
+	return key;
+}
+
+static uint64_t checksum (const void *data, size_t len)
+{
+	uint64_t h[2];
+	hash128 (data, len, MAGIC, h);
+	return h[0];
+}
+
+/* mkdir -p */
+static bool make_dirs (const char *dir)
+{
+	char path[PATH_MAX];
+	if (snprintf (path, sizeof (path), "%s", dir) >= (int)sizeof (path)) {
+		return false;
+	}
+	for (char *p = path + 1; *p; p++) {
+		if (*p != '/') continue;
+		*p = '\0';
+		if (mkdir (path, 0755) < 0 && errno != EEXIST) return false;
+		*p = '/';
+	}
+	return mkdir (path, 0755) == 0 || errno == EEXIST;
+}
+
+bool codecache_default_dir (char *dir, size_t size)
+{
+	const char *env = getenv ("PTKL_CACHE_DIR");
+	if (env && *env) return snprintf (dir, size, "%s", env) < (int)size;
+	env = getenv ("XDG_CACHE_HOME");
+	if (env && *env) {
+		return snprintf (dir, size, "%s/ptkl/bytecode", env) <
+		       (int)size;
+	}
+	env = getenv ("HOME");
+	if (!env || !*env) return false;
+	return snprintf (dir, size, "%s/.cache/ptkl/bytecode", env) <
+	       (int)size;
+}
+
+codecache *codecache_open (const char *dir, size_t max_bytes)
+{
+	if (!make_dirs (dir)) {
+		log_error ("bytecode cache: can't create %s: %s", dir,
+			   strerror (errno));
+		return nullptr;
+	}
+	codecache *c = calloc (1, sizeof (*c));
+	if (!c) panic ("out of memory");
+	c->dir = strdup (dir);
+	if (!c->dir) panic ("out of memory");
+	c->max_bytes = max_bytes;
+	/* unknown until the first scan */
+	c->bytes = max_bytes + 1;
+	return c;
+}
+
+void codecache_close (codecache *c)
+{
+	if (!c) return;
+	free (c->dir);
+	free (c);
+}
+
+static void entry_path (codecache *c, codecache_key key, char *path,
+			size_t size)
+{
+	snprintf (path, size, "%s/%016llx%016llx" SUFFIX, c->dir,
+		  (unsigned long long)key.hash[0],
+		  (unsigned long long)key.hash[1]);
+}
+
+static bool write_full (int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	while (len > 0) {
+		ssize_t n = write (fd, p, len);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+/* Map and validate an entry; the caller owns fd */
+static bool read_entry (int fd, codecache_key key, codecache_entry *entry)
+{
+	mapped_file map;
+	if (!map_fd (fd, &map)) return false;
+
+	/* The header may not be aligned in the mapping */
+	struct header h;
+	if (map.len < sizeof (h)) goto invalid;
+	memcpy (&h, map.data, sizeof (h));
+	if (h.magic != MAGIC || h.version != FORMAT_VERSION ||
+	    h.header_size != sizeof (h) || h.key[0] != key.hash[0] ||
+	    h.key[1] != key.hash[1] || h.len != map.len - sizeof (h) ||
+	    checksum (map.data + sizeof (h), h.len) != h.checksum) {
+		goto invalid;
+	}
+	*entry = (codecache_entry){
+		.data = map.data + sizeof (h),
+		.len = h.len,
+		.cost_ns = h.cost_ns,
+		.map = map,
+	};
+	return true;
+
+invalid:
+	unmap_file (&map);
+	return false;
+}
+
+bool codecache_get (codecache *c, codecache_key key, codecache_entry *entry)
+{
+	char path[PATH_MAX];
+	entry_path (c, key, path, sizeof (path));
+	int fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		atomic_fetch_add_explicit (&c->misses, 1, memory_order_relaxed);
+		return false;
+	}
+
+	bool ok = read_entry (fd, key, entry);
+	if (ok) {
+		/* Recently used (the modification time orders eviction) */
+		futimens (fd, nullptr);
+		atomic_fetch_add_explicit (&c->hits, 1, memory_order_relaxed);
+	} else {
+		unlink (path);
+		atomic_fetch_add_explicit (&c->invalid, 1,
+					   memory_order_relaxed);
+		atomic_fetch_add_explicit (&c->misses, 1, memory_order_relaxed);
+	}
+	close (fd);
+	return ok;
+}
+
+void codecache_release (codecache_entry *entry)
+{
+	unmap_file (&entry->map);
+	entry->data = nullptr;
+	entry->len = 0;
+}
+
+bool codecache_put (codecache *c, codecache_key key, const void *data,
+		    size_t len, uint64_t cost_ns)
+{
+	static _Atomic unsigned temp_count;
+	char path[PATH_MAX], temp[PATH_MAX];
+	entry_path (c, key, path, sizeof (path));
+	snprintf (temp, sizeof (temp), "%s/.%016llx.%d.%u.tmp", c->dir,
+		  (unsigned long long)key.hash[0], (int)getpid (),
+		  atomic_fetch_add (&temp_count, 1));
+
+	/* No fsync: an entry damaged by a crash fails validation */
+	int fd = open (temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0) return false;
+	struct header h = {
+		.magic = MAGIC,
+		.version = FORMAT_VERSION,
+		.header_size = sizeof (h),
+		.key = {key.hash[0], key.hash[1]},
+		.len = len,
+		.checksum = checksum (data, len),
+		.cost_ns = cost_ns,
+	};
+	bool ok = write_full (fd, &h, sizeof (h)) &&
+		  write_full (fd, data, len);
+	ok = close (fd) == 0 && ok;
+	if (!ok || rename (temp, path) < 0) {
+		unlink (temp);
+		return false;
+	}
+	atomic_fetch_add_explicit (&c->writes, 1, memory_order_relaxed);
+
+	if (c->max_bytes) {
+		size_t bytes = atomic_fetch_add (&c->bytes, sizeof (h) + len) +
+			       sizeof (h) + len;
+		if (bytes > c->max_bytes ||
+		    atomic_fetch_add (&c->puts, 1) % SCAN_EVERY ==
+			    SCAN_EVERY - 1) {
+			codecache_evict (c, c->max_bytes);
+		}
+	}
+	return true;
+}
+
+typedef struct file_info {
+	char name[NAME_LEN + 1];
+	size_t size;
+	struct timespec mtime;
+} file_info;
+
+static int compare_mtime (const void *a, const void *b)
+{
+	const struct timespec *x = &((const file_info *)a)->mtime;
+	const struct timespec *y = &((const file_info *)b)->mtime;
+	if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+	return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+size_t codecache_evict (codecache *c, size_t max_bytes)
+{
+	DIR *d = opendir (c->dir);
+	if (!d) return 0;
+
+	file_info *files = nullptr;
+	size_t count = 0, cap = 0, total = 0;
+	time_t now = time (nullptr);
+	struct dirent *ent;
+	while ((ent = readdir (d))) {
+		struct stat st;
+		if (fstatat (dirfd (d), ent->d_name, &st, 0) < 0 ||
+		    !S_ISREG (st.st_mode)) {
+			continue;
+		}
+		size_t len = strlen (ent->d_name);
+		if (ent->d_name[0] == '.') {
+			if (now - st.st_mtime > STALE_TEMP_SECONDS) {
+				unlinkat (dirfd (d), ent->d_name, 0);
+			}
+			continue;
+		}
+		if (len != NAME_LEN ||
+		    strcmp (ent->d_name + len - strlen (SUFFIX), SUFFIX)) {
+			continue;
+		}
+		if (count == cap) {
+			cap = cap ? cap * 2 : 64;
+			files = realloc (files, cap * sizeof (file_info));
+			if (!files) panic ("out of memory");
+		}
+		memcpy (files[count].name, ent->d_name, len + 1);
+		files[count].size = (size_t)st.st_size;
+		files[count].mtime = st.st_mtim;
+		total += (size_t)st.st_size;
+		count++;
+	}
+
+	/* Oldest first */
+	size_t removed = 0;
+	if (total > max_bytes) {
+		qsort (files, count, sizeof (file_info), compare_mtime);
+		for (size_t i = 0; i < count && total > max_bytes; i++) {
+			if (unlinkat (dirfd (d), files[i].name, 0) == 0) {
+				total -= files[i].size;
+				removed++;
+			}
+		}
+	}
+	closedir (d);
+	free (files);
+	atomic_store (&c->bytes, total);
+	atomic_fetch_add_explicit (&c->evictions, removed,
+				   memory_order_relaxed);
+	return removed;
+}
+
+void codecache_get_stats (codecache *c, codecache_stats *stats)
+{
+	*stats = (codecache_stats){
+		.hits = atomic_load (&c->hits),
+		.misses = atomic_load (&c->misses),
+		.invalid = atomic_load (&c->invalid),
+		.writes = atomic_load (&c->writes),
+		.evictions = atomic_load (&c->evictions),
+	};
+}
@@ -0,0 +1,506 @@
+/*
+ * Partikle JavaScript CPU profiler
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpuprof.h"
+#include "jsframe.h"
+#include "log.h"
+#include "map.h"
+
+/* a sample: its stack, and the time since the one before */
+typedef struct tick {
+	uint32_t stack;
+	uint32_t delta_us;
+} tick;
+
+struct cpuprof {
+	unsigned hz;
+	_Atomic bool due;
+	_Atomic bool running;
+	pthread_t timer;
+
+	/* the rest with the lock held */
+	pthread_mutex_t lock;
+	tick *ticks;
+	size_t count, cap;
+	uint64_t start_ns, last_ns;
+	map stacks;   /* text -> id */
+	char **texts; /* by id, [0] is null (no stack) */
+	uint32_t stack_count;
+};
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+cpuprof *cpuprof_new (unsigned hz)
+{
+	cpuprof *p = calloc (1, sizeof (*p));
+	if (!p) panic ("out of memory");
+	p->hz = hz ? hz : CPUPROF_DEFAULT_HZ;
+	pthread_mutex_init (&p->lock, nullptr);
+	map_init (&p->stacks);
+	return p;
+}
+
+void cpuprof_free (cpuprof *p)
+{
+	if (!p) return;
+	cpuprof_stop (p);
+	for (uint32_t i = 1; i <= p->stack_count; i++) free (p->texts[i]);
+	free (p->texts);
+	free (p->ticks);
+	map_free (&p->stacks);
+	pthread_mutex_destroy (&p->lock);
+	free (p);
+}
+
+static void *run_timer (void *arg)
+{
+	cpuprof *p = arg;
+	uint64_t interval = 1000000000ull / p->hz;
+	uint64_t next = now_ns ();
+	while (atomic_load (&p->running)) {
+		next += interval;
+		uint64_t now = now_ns ();
+		if (next < now) next = now + interval; /* fell behind: skip */
+		struct timespec ts = {
+			.tv_sec = (time_t)(next / 1000000000ull),
+			.tv_nsec = (long)(next % 1000000000ull),
+		};
+		while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+					nullptr) == EINTR) {
+		}
+		atomic_store_explicit (&p->due, true, memory_order_relaxed);
+	}
+	return nullptr;
+}
+
+bool cpuprof_start (cpuprof *p)
+{
+	if (atomic_exchange (&p->running, true)) return false;
+	pthread_mutex_lock (&p->lock);
+	if (!p->start_ns) p->start_ns = now_ns ();
+	p->last_ns = now_ns ();
+	pthread_mutex_unlock (&p->lock);
+	if (pthread_create (&p->timer, nullptr, run_timer, p) != 0) {
+		log_error ("cpu profile: cannot start the timer thread");
+		atomic_store (&p->running, false);
+		return false;
+	}
+	return true;
+}
+
+void cpuprof_stop (cpuprof *p)
+{
+	if (!atomic_exchange (&p->running, false)) return;
+	pthread_join (p->timer, nullptr);
+	atomic_store (&p->due, false);
+}
+
+bool cpuprof_due (cpuprof *p)
+{
+	/* (a load first: checks are frequent, samples aren't) */
+	return atomic_load_explicit (&p->due, memory_order_relaxed) &&
+	       atomic_exchange_explicit (&p->due, false, memory_order_relaxed);
+}
+
+static uint32_t intern_stack (cpuprof *p, const char *frames)
+{
+	uint32_t id = (uint32_t)(uintptr_t)map_get (&p->stacks, frames);
+	if (id) return id;
+	id = ++p->stack_count;
+	map_put (&p->stacks, frames, (void *)(uintptr_t)id);
+	p->texts = realloc (p->texts, (id + 1) * sizeof (char *));
+	if (!p->texts) panic ("out of memory");
+	p->texts[0] = nullptr;
+	p->texts[id] = strdup (frames);
+	if (!p->texts[id]) panic ("out of memory");
+	return id;
+}
+
+static inline uint64_t interval_us (cpuprof *p)
+{
+	return 1000000 / p->hz;
+}
+
+static void add_tick (cpuprof *p, uint32_t stack, uint64_t delta_us)
+{
+	if (p->count == p->cap) {
+		p->cap = p->cap ? p->cap * 2 : 4096;
+		p->ticks = realloc (p->ticks, p->cap * sizeof (tick));
+		if (!p->ticks) panic ("out of memory");
+	}
+	p->ticks[p->count++] = (tick){
+		.stack = stack,
+		.delta_us = delta_us > UINT32_MAX ? UINT32_MAX
+						  : (uint32_t)delta_us,
+	};
+}
+
+void cpuprof_sample (cpuprof *p, const char *frames)
+{
+	uint64_t now = now_ns ();
+	pthread_mutex_lock (&p->lock);
+	uint64_t delta = p->last_ns && now > p->last_ns
+				 ? (now - p->last_ns) / 1000
+				 : 0;
+
+	/* No checks for more than two intervals: the time went to native
+	   code, GC, or the event loop, not (all) to this stack */
+	if (delta > 2 * interval_us (p)) {
+		add_tick (p, intern_stack (p, CPUPROF_OUTSIDE_JS),
+			  delta - interval_us (p));
+		delta = interval_us (p);
+	}
+	add_tick (p, frames && *frames ? intern_stack (p, frames) : 0, delta);
+	p->last_ns = now;
+	pthread_mutex_unlock (&p->lock);
+}
+
+size_t cpuprof_samples (cpuprof *p)
+{
+	pthread_mutex_lock (&p->lock);
+	size_t count = p->count;
+	pthread_mutex_unlock (&p->lock);
+	return count;
+}
+
+static const char *stack_text (cpuprof *p, uint32_t stack)
+{
+	return stack ? p->texts[stack] : JS_NO_STACK;
+}
+
+/* Samples by stack id (with the lock held), each tick counting for the
+   intervals of its time (at least one), as the .cpuprofile's time deltas
+   do, and their sum in *total if it isn't null; the caller frees them */
+static uint64_t *counts_by_stack (cpuprof *p, uint64_t *total)
+{
+	uint64_t *counts = calloc (p->stack_count + 1, sizeof (uint64_t));
+	if (!counts) panic ("out of memory");
+	uint64_t interval = interval_us (p), sum = 0;
+	for (size_t i = 0; i < p->count; i++) {
+		uint64_t n = (p->ticks[i].delta_us + interval / 2) / interval;
+		if (n == 0) n = 1;
+		counts[p->ticks[i].stack] += n;
+		sum += n;
+	}
+	if (total) *total = sum;
+	return counts;
+}
+
+size_t cpuprof_write_folded (cpuprof *p, FILE *f)
+{
+	size_t written = 0;
+	pthread_mutex_lock (&p->lock);
+	uint64_t *counts = counts_by_stack (p, nullptr);
+	for (uint32_t i = 0; i <= p->stack_count; i++) {
+		if (!counts[i]) continue;
+		js_frames_fold (f, stack_text (p, i));
+		fprintf (f, " %llu\n", (unsigned long long)counts[i]);
+		written++;
+	}
+	pthread_mutex_unlock (&p->lock);
+	free (counts);
+	return written;
+}
+
+/*
+ * The functions of the sampled stacks (by name and file), for the call
+ * tree of a .cpuprofile and the top table.
+ */
+
+typedef struct function {
+	js_frame frame; /* of its first sample: the line is where it was */
+	uint32_t script;
+	uint64_t self, total;
+	uint32_t seen; /* the last stack counted in total, plus 1 */
+} function;
+
+typedef struct functions {
+	function *list;
+	uint32_t count, cap;
+	map index;   /* "name\nfile" -> index + 1 */
+	map scripts; /* file -> id */
+	uint32_t script_count;
+} functions;
+
+static uint32_t find_function (functions *fns, const js_frame *frame)
+{
+	char key[1024];
+	snprintf (key, sizeof (key), "%.*s\n%.*s", (int)frame->name_len,
+		  frame->name, (int)frame->file_len, frame->file);
+	uint32_t i = (uint32_t)(uintptr_t)map_get (&fns->index, key);
+	if (i) return i - 1;
+
+	if (fns->count == fns->cap) {
+		fns->cap = fns->cap ? fns->cap * 2 : 64;
+		fns->list = realloc (fns->list, fns->cap * sizeof (function));
+		if (!fns->list) panic ("out of memory");
+	}
+	i = fns->count++;
+	map_put (&fns->index, key, (void *)(uintptr_t)(i + 1));
+	fns->list[i] = (function){.frame = *frame};
+
+	snprintf (key, sizeof (key), "%.*s", (int)frame->file_len,
+		  frame->file);
+	uint32_t script = (uint32_t)(uintptr_t)map_get (&fns->scripts, key);
+	if (!script && frame->file_len) {
+		script = ++fns->script_count;
+		map_put (&fns->scripts, key, (void *)(uintptr_t)script);
+	}
+	fns->list[i].script = script;
+	return i;
+}
+
+static void free_functions (functions *fns)
+{
+	free (fns->list);
+	map_free (&fns->index);
+	map_free (&fns->scripts);
+}
+
+/* The functions of a stack, innermost first, into out (up to cap);
+   returns how many */
+static size_t stack_functions (functions *fns, const char *text,
+			       uint32_t *out, size_t cap)
+{
+	size_t n = 0;
+	const char *next = text;
+	while (next && n < cap) {
+		const char *line = next;
+		size_t len = js_frame_line (line, &next);
+		js_frame frame;
+		if (js_frame_parse (line, len, &frame)) {
+			out[n++] = find_function (fns, &frame);
+		}
+	}
+	return n;
+}
+
+#define MAX_DEPTH 512
+
+static int compare_self (const void *a, const void *b)
+{
+	const function *x = *(const function *const *)a;
+	const function *y = *(const function *const *)b;
+	if (x->self != y->self) return x->self < y->self ? 1 : -1;
+	return (x->total < y->total) - (x->total > y->total);
+}
+
+void cpuprof_write_top (cpuprof *p, FILE *f, int top)
+{
+	functions fns = {0};
+	map_init (&fns.index);
+	map_init (&fns.scripts);
+	uint32_t frames[MAX_DEPTH];
+
+	pthread_mutex_lock (&p->lock);
+	uint64_t samples;
+	uint64_t *counts = counts_by_stack (p, &samples);
+	for (uint32_t s = 0; s <= p->stack_count; s++) {
+		if (!counts[s]) continue;
+		size_t n = stack_functions (&fns, stack_text (p, s), frames,
+					    MAX_DEPTH);
+		if (n) fns.list[frames[0]].self += counts[s];
+		for (size_t i = 0; i < n; i++) {
+			function *fn = &fns.list[frames[i]];
+			if (fn->seen == s + 1) continue; /* recursion */
+			fn->seen = s + 1;
+			fn->total += counts[s];
+		}
+	}
+	pthread_mutex_unlock (&p->lock);
+	free (counts);
+
+	function **sorted = malloc ((fns.count + 1) * sizeof (function *));
+	if (!sorted) panic ("out of memory");
+	for (uint32_t i = 0; i < fns.count; i++) sorted[i] = &fns.list[i];
+	qsort (sorted, fns.count, sizeof (function *), compare_self);
+
+	fprintf (f, "%llu samples at %u Hz\n", (unsigned long long)samples,
+		 p->hz);
+	fprintf (f, "%15s %15s  function\n", "self", "total");
+	double scale = samples ? 100.0 / (double)samples : 0;
+	for (uint32_t i = 0; i < fns.count && i < (uint32_t)top; i++) {
+		const function *fn = sorted[i];
+		fprintf (f, "%8llu %5.1f%% %8llu %5.1f%%  %.*s",
+			 (unsigned long long)fn->self, fn->self * scale,
+			 (unsigned long long)fn->total, fn->total * scale,
+			 (int)fn->frame.name_len, fn->frame.name);
+		if (fn->frame.file_len) {
+			fprintf (f, " (%.*s)", (int)fn->frame.file_len,
+				 fn->frame.file);
+		}
+		fputc ('\n', f);
+	}
+	free (sorted);
+	free_functions (&fns);
+}
+
+/*
+ * .cpuprofile: the call tree (a node per function per path from the
+ * root), the node of each sample, and the time between samples.
+ */
+
+typedef struct node {
+	uint32_t function; /* UINT32_MAX for the root */
+	uint32_t first_child, next_sibling; /* node ids, 0 for none */
+	uint64_t hits;
+} node;
+
+typedef struct tree {
+	node *nodes; /* by id, from 1 (the root) */
+	uint32_t count, cap;
+} tree;
+
+static uint32_t add_node (tree *t, uint32_t function)
+{
+	if (t->count + 1 >= t->cap) {
+		t->cap = t->cap ? t->cap * 2 : 256;
+		t->nodes = realloc (t->nodes, t->cap * sizeof (node));
+		if (!t->nodes) panic ("out of memory");
+	}
+	uint32_t id = ++t->count;
+	t->nodes[id] = (node){.function = function};
+	return id;
+}
+
+static uint32_t child_node (tree *t, uint32_t parent, uint32_t function)
+{
+	uint32_t id = t->nodes[parent].first_child;
+	for (; id; id = t->nodes[id].next_sibling) {
+		if (t->nodes[id].function == function) return id;
+	}
+	id = add_node (t, function);
+	t->nodes[id].next_sibling = t->nodes[parent].first_child;
+	t->nodes[parent].first_child = id;
+	return id;
+}
+
+static void json_string (FILE *f, const char *s, size_t len)
+{
+	fputc ('"', f);
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)s[i];
+		if (c == '"' || c == '\\') {
+			fprintf (f, "\\%c", c);
+		} else if (c < 0x20) {
+			fprintf (f, "\\u%04x", c);
+		} else {
+			fputc (c, f);
+		}
+	}
+	fputc ('"', f);
+}
+
+static void write_node (FILE *f, const tree *t, const functions *fns,
+			uint32_t id)
+{
+	const node *n = &t->nodes[id];
+	fprintf (f, "{\"id\":%u,\"callFrame\":{\"functionName\":", id);
+	if (n->function == UINT32_MAX) {
+		fprintf (f, "\"(root)\",\"scriptId\":\"0\",\"url\":\"\","
+			    "\"lineNumber\":-1,\"columnNumber\":-1");
+	} else {
+		const function *fn = &fns->list[n->function];
+		json_string (f, fn->frame.name, fn->frame.name_len);
+		fprintf (f, ",\"scriptId\":\"%u\",\"url\":", fn->script);
+		json_string (f, fn->frame.file, fn->frame.file_len);
+		/* (zero-based) */
+		fprintf (f, ",\"lineNumber\":%d,\"columnNumber\":%d",
+			 fn->frame.line - 1, fn->frame.column - 1);
+	}
+	fprintf (f, "},\"hitCount\":%llu,\"children\":[",
+		 (unsigned long long)n->hits);
+	for (uint32_t c = n->first_child; c; c = t->nodes[c].next_sibling) {
+		fprintf (f, "%s%u", c == n->first_child ? "" : ",", c);
+	}
+	fputs ("]}", f);
+}
+
+bool cpuprof_write_cpuprofile (cpuprof *p, FILE *f)
+{
+	functions fns = {0};
+	map_init (&fns.index);
+	map_init (&fns.scripts);
+	tree t = {0};
+	uint32_t root = add_node (&t, UINT32_MAX);
+	uint32_t frames[MAX_DEPTH];
+
+	pthread_mutex_lock (&p->lock);
+	/* the node of each stack: its innermost frame's */
+	uint32_t *leaf = calloc (p->stack_count + 1, sizeof (uint32_t));
+	if (!leaf) panic ("out of memory");
+	for (size_t i = 0; i < p->count; i++) {
+		uint32_t s = p->ticks[i].stack;
+		if (!leaf[s]) {
+			size_t n = stack_functions (&fns, stack_text (p, s),
+						    frames, MAX_DEPTH);
+			uint32_t id = root;
+			while (n > 0) id = child_node (&t, id, frames[--n]);
+			leaf[s] = id;
+		}
+		t.nodes[leaf[s]].hits++;
+	}
+
+	fputs ("{\"nodes\":[", f);
+	for (uint32_t id = 1; id <= t.count; id++) {
+		if (id > 1) fputc (',', f);
+		write_node (f, &t, &fns, id);
+	}
+	uint64_t end_us = p->start_ns / 1000;
+	for (size_t i = 0; i < p->count; i++) end_us += p->ticks[i].delta_us;
+	fprintf (f, "],\"startTime\":%llu,\"endTime\":%llu,\"samples\":[",
+		 (unsigned long long)(p->start_ns / 1000),
+		 (unsigned long long)end_us);
+	for (size_t i = 0; i < p->count; i++) {
+		fprintf (f, "%s%u", i ? "," : "", leaf[p->ticks[i].stack]);
+	}
+	fputs ("],\"timeDeltas\":[", f);
+	for (size_t i = 0; i < p->count; i++) {
+		fprintf (f, "%s%u", i ? "," : "", p->ticks[i].delta_us);
+	}
+	fputs ("]}\n", f);
+	pthread_mutex_unlock (&p->lock);
+
+	free (leaf);
+	free (t.nodes);
+	free_functions (&fns);
+	return !ferror (f);
+}
@@ -26,10 +26,951 @@
  * THE SOFTWARE.
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "cutils.h"
 #include "log.h"
-#include "qjsc.h"
+#include "qjs.h"
+#include "quickjs-libc.h"
+#include "quickjs.h"
+
+/* blocks the interrupt handler can keep out of the heap trace at once */
+#define HELD_MAX 32
+
+struct engine {
+	JSRuntime *rt;
+	JSContext *ctx;
+	engine_opts opts;
+	engine_stats stats;
+
+	/* global object properties at engine_snapshot (sorted by name) */
+	struct global {
+		JSAtom name;
+		JSValue value;
+	} *globals;
+	uint32_t globals_count;
+
+	/* engine_bundle: the modules loaded are added here */
+	bundle_writer *collect;
+
+	/* the JS heap, with opts.arena */
+	arena *arena;
+
+	/* engine_sample_memory, with opts.sample_memory */
+	_Atomic bool memory_due;
+	_Atomic size_t memory_used;
+
+	/* blocks allocated while the interrupt handler reads the JS stack,
+	   kept out of the heap trace unless they outlive it */
+	bool holding;
+	struct held_block {
+		void *p;
+		size_t size;
+	} held[HELD_MAX];
+	int held_count;
+};
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Worker contexts (new Worker() in the os module) are standard contexts */
+static JSContext *new_worker_context (JSRuntime *rt)
+{
+	JSContext *ctx = JS_NewContext (rt);
+	if (!ctx) return nullptr;
+	js_init_module_std (ctx, "std");
+	js_init_module_os (ctx, "os");
+	return ctx;
+}
+
+static JSModuleDef *load_module (JSContext *ctx, const char *name,
+				 void *opaque);
+
+/* bundleAsset(name): a copy of an asset in the bundle, or undefined */
+static JSValue bundle_asset (JSContext *ctx, JSValueConst this_val, int argc,
+			     JSValueConst *argv)
+{
+	engine *e = JS_GetContextOpaque (ctx);
+	const char *name = JS_ToCString (ctx, argv[0]);
+	if (!name) return JS_EXCEPTION;
+	bundle_item item;
+	bool found = bundle_find (e->opts.bundle, name, &item) &&
+		     item.kind == BUNDLE_ASSET;
+	JS_FreeCString (ctx, name);
+	if (!found) return JS_UNDEFINED;
+	return JS_NewArrayBufferCopy (ctx, item.data, item.len);
+}
+
+/* reportRequest(ms[, ok]): count a request the app handled */
+static JSValue report_request (JSContext *ctx, JSValueConst this_val,
+			       int argc, JSValueConst *argv)
+{
+	engine *e = JS_GetContextOpaque (ctx);
+	double ms;
+	if (JS_ToFloat64 (ctx, &ms, argv[0]) < 0) return JS_EXCEPTION;
+	bool ok = argc < 2 || JS_ToBool (ctx, argv[1]);
+	uint64_t ns = ms > 0 ? (uint64_t)(ms * 1e6) : 0;
+	e->opts.on_request (e->opts.request_arg, ns, ok);
+	return JS_UNDEFINED;
+}
+
+static JSContext *new_context (engine *e)
+{
+	/* A raw context has no intrinsics, so only the ones asked for (and
+	   the base objects) are created */
+	JSContext *ctx = JS_NewContextRaw (e->rt);
+	if (!ctx) return nullptr;
+
+	uint32_t in = e->opts.intrinsics | ENGINE_INTRINSIC_BASE;
+	JS_AddIntrinsicBaseObjects (ctx);
+	if (in & ENGINE_INTRINSIC_DATE) JS_AddIntrinsicDate (ctx);
+	if (in & ENGINE_INTRINSIC_EVAL) JS_AddIntrinsicEval (ctx);
+	if (in & ENGINE_INTRINSIC_STRING_NORMALIZE) {
+		JS_AddIntrinsicStringNormalize (ctx);
+	}
+	if (in & ENGINE_INTRINSIC_REGEXP_COMPILER) {
+		JS_AddIntrinsicRegExpCompiler (ctx);
+	}
+	if (in & ENGINE_INTRINSIC_REGEXP) JS_AddIntrinsicRegExp (ctx);
+	if (in & ENGINE_INTRINSIC_JSON) JS_AddIntrinsicJSON (ctx);
+	if (in & ENGINE_INTRINSIC_PROXY) JS_AddIntrinsicProxy (ctx);
+	if (in & ENGINE_INTRINSIC_MAP_SET) JS_AddIntrinsicMapSet (ctx);
+	if (in & ENGINE_INTRINSIC_TYPED_ARRAYS) {
+		JS_AddIntrinsicTypedArrays (ctx);
+	}
+	if (in & ENGINE_INTRINSIC_PROMISE) JS_AddIntrinsicPromise (ctx);
+	if (in & ENGINE_INTRINSIC_WEAKREF) JS_AddIntrinsicWeakRef (ctx);
+
+	if (e->opts.std_modules) {
+		js_init_module_std (ctx, "std");
+		js_init_module_os (ctx, "os");
+		js_std_add_helpers (ctx, e->opts.argc, e->opts.argv);
+	}
+	JS_SetContextOpaque (ctx, e);
+	JSValue global = JS_GetGlobalObject (ctx);
+	if (e->opts.bundle) {
+		JS_SetPropertyStr (
+			ctx, global, "bundleAsset",
+			JS_NewCFunction (ctx, bundle_asset, "bundleAsset", 1));
+	}
+	if (e->opts.on_request) {
+		JS_SetPropertyStr (ctx, global, "reportRequest",
+				   JS_NewCFunction (ctx, report_request,
+						    "reportRequest", 1));
+	}
+	JS_FreeValue (ctx, global);
+	return ctx;
+}
+
+/*
+ * The JS heap in a request arena (see arena.h). QuickJS leaves the
+ * accounting to the allocator: keep malloc_size and malloc_count exactly
+ * as its default allocator does, so the memory limit and memory usage
+ * work the same. The allocator's opaque is the engine.
+ */
+
+#define MALLOC_OVERHEAD 8
+
+static void *arena_js_malloc (JSMallocState *s, size_t size)
+{
+	if (s->malloc_size + size > s->malloc_limit) return nullptr;
+	void *p = arena_alloc (((engine *)s->opaque)->arena, size);
+	if (!p) return nullptr;
+	s->malloc_count++;
+	s->malloc_size += arena_usable_size (p) + MALLOC_OVERHEAD;
+	return p;
+}
+
+static void arena_js_free (JSMallocState *s, void *p)
+{
+	if (!p) return;
+	s->malloc_count--;
+	s->malloc_size -= arena_usable_size (p) + MALLOC_OVERHEAD;
+	arena_release (((engine *)s->opaque)->arena, p);
+}
+
+static void *arena_js_realloc (JSMallocState *s, void *p, size_t size)
+{
+	if (!p) return size ? arena_js_malloc (s, size) : nullptr;
+	if (size == 0) {
+		arena_js_free (s, p);
+		return nullptr;
+	}
+	size_t old = arena_usable_size (p);
+	if (s->malloc_size + size - old > s->malloc_limit) return nullptr;
+	p = arena_resize (((engine *)s->opaque)->arena, p, size);
+	if (!p) return nullptr;
+	s->malloc_size += arena_usable_size (p) - old;
+	return p;
+}
+
+static const JSMallocFunctions arena_mf = {
+	.js_malloc = arena_js_malloc,
+	.js_free = arena_js_free,
+	.js_realloc = arena_js_realloc,
+	.js_malloc_usable_size = arena_usable_size,
+};
+
+/*
+ * With a heap trace or profile, the arena or malloc (the same as QuickJS's
+ * own allocator) makes each allocation, and the hooks see it made.
+ *
+ * The interrupt handler's new Error().stack allocates too: while it runs,
+ * a block isn't traced until it's still live at the end (nearly all are
+ * freed before), so the trace isn't full of the tracer's own Errors.
+ */
+
+static bool hold (engine *e, void *p, size_t size)
+{
+	if (!e->holding || e->held_count == HELD_MAX) return false;
+	e->held[e->held_count++] = (struct held_block){p, size};
+	return true;
+}
+
+/* If p is held, drop it (or move it to q) and return true */
+static bool held (engine *e, void *p, void *q, size_t size)
+{
+	for (int i = 0; i < e->held_count; i++) {
+		if (e->held[i].p != p) continue;
+		if (q) {
+			e->held[i] = (struct held_block){q, size};
+		} else {
+			e->held[i] = e->held[--e->held_count];
+		}
+		return true;
+	}
+	return false;
+}
+
+static void *heap_js_malloc (JSMallocState *s, size_t size)
+{
+	if (s->malloc_size + size > s->malloc_limit) return nullptr;
+	void *p = malloc (size);
+	if (!p) return nullptr;
+	s->malloc_count++;
+	s->malloc_size += malloc_usable_size (p) + MALLOC_OVERHEAD;
+	return p;
+}
+
+static void heap_js_free (JSMallocState *s, void *p)
+{
+	if (!p) return;
+	s->malloc_count--;
+	s->malloc_size -= malloc_usable_size (p) + MALLOC_OVERHEAD;
+	free (p);
+}
+
+static void *heap_js_realloc (JSMallocState *s, void *p, size_t size)
+{
+	if (!p) return size ? heap_js_malloc (s, size) : nullptr;
+	if (size == 0) {
+		heap_js_free (s, p);
+		return nullptr;
+	}
+	size_t old = malloc_usable_size (p);
+	if (s->malloc_size + size - old > s->malloc_limit) return nullptr;
+	p = realloc (p, size);
+	if (!p) return nullptr;
+	s->malloc_size += malloc_usable_size (p) - old;
+	return p;
+}
+
+static size_t heap_usable_size (const void *p)
+{
+	return malloc_usable_size ((void *)p);
+}
+
+static void *hooked_js_malloc (JSMallocState *s, size_t size)
+{
+	engine *e = s->opaque;
+	void *p = e->arena ? arena_js_malloc (s, size)
+			   : heap_js_malloc (s, size);
+	if (!p) return nullptr;
+	if (e->opts.heap_trace && !hold (e, p, size)) {
+		heaptrace_alloc (e->opts.heap_trace, p, size);
+	}
+	if (e->opts.heap_profile) {
+		heapprof_alloc (e->opts.heap_profile, e, p, size);
+	}
+	return p;
+}
+
+static void hooked_js_free (JSMallocState *s, void *p)
+{
+	if (!p) return;
+	engine *e = s->opaque;
+	if (e->opts.heap_trace && !held (e, p, nullptr, 0)) {
+		size_t size = e->arena ? arena_usable_size (p)
+				       : heap_usable_size (p);
+		heaptrace_free (e->opts.heap_trace, p, size);
+	}
+	if (e->opts.heap_profile) heapprof_release (e->opts.heap_profile, p);
+	if (e->arena) {
+		arena_js_free (s, p);
+	} else {
+		heap_js_free (s, p);
+	}
+}
+
+static void *hooked_js_realloc (JSMallocState *s, void *p, size_t size)
+{
+	engine *e = s->opaque;
+	if (!p || size == 0) {
+		if (p) hooked_js_free (s, p);
+		return p ? nullptr : hooked_js_malloc (s, size);
+	}
+	void *q = e->arena ? arena_js_realloc (s, p, size)
+			   : heap_js_realloc (s, p, size);
+	if (!q) return nullptr;
+	if (e->opts.heap_trace && !held (e, p, q, size)) {
+		heaptrace_realloc (e->opts.heap_trace, p, q, size);
+	}
+	if (e->opts.heap_profile) {
+		heapprof_release (e->opts.heap_profile, p);
+		heapprof_alloc (e->opts.heap_profile, e, q, size);
+	}
+	return q;
+}
+
+/* (malloc_usable_size has no opaque: one table per allocator) */
+static const JSMallocFunctions hooked_mf = {
+	.js_malloc = hooked_js_malloc,
+	.js_free = hooked_js_free,
+	.js_realloc = hooked_js_realloc,
+	.js_malloc_usable_size = heap_usable_size,
+};
+
+static const JSMallocFunctions hooked_arena_mf = {
+	.js_malloc = hooked_js_malloc,
+	.js_free = hooked_js_free,
+	.js_realloc = hooked_js_realloc,
+	.js_malloc_usable_size = arena_usable_size,
+};
+
+/* The current JS stack, one frame per line ("f (app.js:3:5)"), innermost
+   first, into buf. Returns false if there's no stack. */
+static bool js_stack (JSContext *ctx, char *buf, size_t size)
+{
+	JSValue error = JS_NewError (ctx);
+	if (JS_IsException (error)) return false;
+	JSValue stack = JS_GetPropertyStr (ctx, error, "stack");
+	const char *s = JS_IsUndefined (stack) ? nullptr
+					       : JS_ToCString (ctx, stack);
+	JS_FreeValue (ctx, stack);
+	JS_FreeValue (ctx, error);
+	if (!s) return false;
+
+	/* "    at f (app.js:3:5)\n" */
+	size_t len = 0;
+	for (const char *line = s; *line && len + 1 < size;) {
+		while (*line == ' ') line++;
+		if (strncmp (line, "at ", 3) == 0) line += 3;
+		const char *end = strchr (line, '\n');
+		size_t n = end ? (size_t)(end - line) : strlen (line);
+		if (n > size - len - 2) n = size - len - 2;
+		if (n > 0) {
+			memcpy (buf + len, line, n);
+			len += n;
+			buf[len++] = '\n';
+		}
+		line = end ? end + 1 : line + n;
+	}
+	if (len > 0) len--; /* the last newline */
+	buf[len] = '\0';
+	JS_FreeCString (ctx, s);
+	return len > 0;
+}
+
+/* The interpreter checks in every few thousand branches: read the heap's
+   size if engine_sample_memory asked, and give the heap trace and
+   profile, and the CPU profile, the JS stack there */
+static int interrupt (JSRuntime *rt, void *opaque)
+{
+	engine *e = opaque;
+	heaptrace *trace = e->opts.heap_trace;
+	heapprof *profile = e->opts.heap_profile;
+	cpuprof *cpu = e->opts.cpu_profile;
+	if (atomic_load_explicit (&e->memory_due, memory_order_relaxed) &&
+	    atomic_exchange (&e->memory_due, false)) {
+		JSMemoryUsage usage;
+		JS_ComputeMemoryUsage (rt, &usage);
+		atomic_store (&e->memory_used, (size_t)usage.malloc_size);
+	}
+	if (profile && !heapprof_pending (profile)) profile = nullptr;
+	if (cpu && !cpuprof_due (cpu)) cpu = nullptr;
+	if (!e->ctx || (!trace && !profile && !cpu)) return 0;
+
+	char stack[2048];
+	e->holding = trace != nullptr;
+	bool found = js_stack (e->ctx, stack, sizeof (stack));
+	e->holding = false;
+	if (trace) {
+		uint32_t id = found ? heaptrace_stack (trace, stack) : 0;
+		heaptrace_set_stack (trace, id);
+		for (int i = 0; i < e->held_count; i++) {
+			heaptrace_alloc (trace, e->held[i].p, e->held[i].size);
+		}
+		e->held_count = 0;
+	}
+	if (profile) heapprof_set_stack (profile, found ? stack : nullptr);
+	if (cpu) cpuprof_sample (cpu, found ? stack : nullptr);
+	return 0;
+}
+
+static bool new_runtime (engine *e)
+{
+	bool hooked = e->opts.heap_trace || e->opts.heap_profile;
+	if (hooked) {
+		const JSMallocFunctions *mf =
+			e->arena ? &hooked_arena_mf : &hooked_mf;
+		e->rt = JS_NewRuntime2 (mf, e);
+	} else if (e->arena) {
+		e->rt = JS_NewRuntime2 (&arena_mf, e);
+	} else {
+		e->rt = JS_NewRuntime ();
+	}
+	if (!e->rt) return false;
+	if (hooked || e->opts.cpu_profile || e->opts.sample_memory) {
+		JS_SetInterruptHandler (e->rt, interrupt, e);
+	}
+	if (e->opts.memory_limit) {
+		JS_SetMemoryLimit (e->rt, e->opts.memory_limit);
+	}
+	if (e->opts.stack_size) JS_SetMaxStackSize (e->rt, e->opts.stack_size);
+	if (e->opts.gc_threshold) {
+		JS_SetGCThreshold (e->rt, e->opts.gc_threshold);
+	}
+	js_std_set_worker_new_context_func (new_worker_context);
+	js_std_init_handlers (e->rt);
+	JS_SetModuleLoaderFunc (e->rt, nullptr, load_module, e);
+	if (e->opts.track_rejections) {
+		JS_SetHostPromiseRejectionTracker (
+			e->rt, js_std_promise_rejection_tracker, nullptr);
+	}
+	return true;
+}
+
+engine *engine_new (const engine_opts *opts)
+{
+	engine *e = calloc (1, sizeof (*e));
+	if (!e) panic ("out of memory");
+	e->opts = opts ? *opts : ENGINE_OPTS_DEFAULT;
+	if (e->opts.arena) e->arena = arena_new (0);
+
+	uint64_t start = now_ns ();
+	if (!new_runtime (e)) {
+		log_error ("engine: cannot allocate JS runtime");
+		arena_free (e->arena);
+		free (e);
+		return nullptr;
+	}
+	e->stats.runtime_ns = now_ns () - start;
+
+	start = now_ns ();
+	e->ctx = new_context (e);
+	if (!e->ctx) {
+		log_error ("engine: cannot allocate JS context");
+		engine_free (e);
+		return nullptr;
+	}
+	e->stats.context_ns = now_ns () - start;
+	e->stats.memory_limit = e->opts.memory_limit;
+	return e;
+}
+
+static void free_snapshot (engine *e)
+{
+	/* (in an arena, the atoms and values go with the heap) */
+	for (uint32_t i = 0; !e->arena && i < e->globals_count; i++) {
+		JS_FreeAtomRT (e->rt, e->globals[i].name);
+		JS_FreeValueRT (e->rt, e->globals[i].value);
+	}
+	free (e->globals);
+	e->globals = nullptr;
+	e->globals_count = 0;
+}
+
+/* The heap is about to go whole, without a free for each block */
+static void drop_heap (engine *e)
+{
+	if (e->opts.heap_profile) {
+		heapprof_release_heap (e->opts.heap_profile, e);
+	}
+	if (e->opts.heap_trace) heaptrace_reset (e->opts.heap_trace);
+}
+
+void engine_free (engine *e)
+{
+	if (!e) return;
+	free_snapshot (e);
+	if (e->arena) {
+		/* The whole heap at once: no finalizers, no final GC. The
+		   std handlers' state is malloc'd outside the heap (and
+		   their timers and ports hold heap values), so free it
+		   first */
+		if (e->rt) js_std_free_handlers (e->rt);
+		drop_heap (e);
+		arena_free (e->arena);
+	} else {
+		js_std_free_handlers (e->rt);
+		if (e->ctx) JS_FreeContext (e->ctx);
+		JS_FreeRuntime (e->rt);
+	}
+	free (e);
+}
+
+/* Drop the runtime with its heap, and start over in the same arena */
+static bool reset_arena (engine *e)
+{
+	free_snapshot (e);
+	if (e->rt) js_std_free_handlers (e->rt);
+	drop_heap (e);
+	arena_reset (e->arena);
+	e->ctx = nullptr;
+	if (!new_runtime (e)) {
+		log_error ("engine: cannot allocate JS runtime");
+		return false;
+	}
+	e->ctx = new_context (e);
+	if (!e->ctx) {
+		log_error ("engine: cannot allocate JS context");
+		return false;
+	}
+	return true;
+}
+
+bool engine_reset (engine *e)
+{
+	uint64_t start = now_ns ();
+	if (e->arena) {
+		if (!reset_arena (e)) return false;
+		e->stats.context_ns = now_ns () - start;
+		e->stats.resets++;
+		return true;
+	}
+
+	/* QuickJS can't drop queued promise jobs (each holds a reference to
+	   its context), so finish them before the context goes */
+	JSContext *job_ctx;
+	while (JS_IsJobPending (e->rt)) {
+		if (JS_ExecutePendingJob (e->rt, &job_ctx) < 0) {
+			js_std_dump_error (job_ctx);
+		}
+	}
+
+	/* Timers, I/O and signal handlers, and worker ports */
+	free_snapshot (e);
+	js_std_free_handlers (e->rt);
+	JS_FreeContext (e->ctx);
+	e->ctx = nullptr;
+	JS_RunGC (e->rt);
+	js_std_init_handlers (e->rt);
+
+	e->ctx = new_context (e);
+	if (!e->ctx) {
+		log_error ("engine: cannot allocate JS context");
+		return false;
+	}
+	e->stats.context_ns = now_ns () - start;
+	e->stats.resets++;
+	return true;
+}
+
+/* (by the name of a global, or an atom to look one up) */
+static int compare_atoms (const void *a, const void *b)
+{
+	JSAtom x = *(const JSAtom *)a, y = *(const JSAtom *)b;
+	return (x > y) - (x < y);
+}
+
+/* Whether a global still has its snapshot value: the same object, or the
+   SameValue primitive (an equal string can be a copy, which counts as
+   new) */
+static bool same_value (JSValue a, JSValue b)
+{
+	int tag = JS_VALUE_GET_TAG (a);
+	if (tag != JS_VALUE_GET_TAG (b)) return false;
+	if (JS_VALUE_HAS_REF_COUNT (a)) {
+		return JS_VALUE_GET_PTR (a) == JS_VALUE_GET_PTR (b);
+	}
+	if (JS_TAG_IS_FLOAT64 (tag)) {
+		/* NaN is NaN, but 0 isn't -0: compare the bits */
+		double x = JS_VALUE_GET_FLOAT64 (a);
+		double y = JS_VALUE_GET_FLOAT64 (b);
+		if (isnan (x)) return isnan (y);
+		return memcmp (&x, &y, sizeof (x)) == 0;
+	}
+	if (tag == JS_TAG_SHORT_BIG_INT) {
+		return JS_VALUE_GET_SHORT_BIG_INT (a) ==
+		       JS_VALUE_GET_SHORT_BIG_INT (b);
+	}
+	return JS_VALUE_GET_INT (a) == JS_VALUE_GET_INT (b);
+}
+
+static bool global_names (engine *e, JSValue global, JSPropertyEnum **names,
+			  uint32_t *count)
+{
+	int flags = JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK;
+	return JS_GetOwnPropertyNames (e->ctx, names, count, global, flags) >=
+	       0;
+}
+
+bool engine_snapshot (engine *e)
+{
+	JSValue global = JS_GetGlobalObject (e->ctx);
+	JSPropertyEnum *names;
+	uint32_t count;
+	bool ok = global_names (e, global, &names, &count);
+	JS_FreeValue (e->ctx, global);
+	if (!ok) return false;
+
+	/* Keep the atoms and values (they're freed with the snapshot) */
+	free_snapshot (e);
+	e->globals = malloc ((count ? count : 1) * sizeof (struct global));
+	if (!e->globals) panic ("out of memory");
+	global = JS_GetGlobalObject (e->ctx);
+	for (uint32_t i = 0; i < count; i++) {
+		JSAtom name = names[i].atom;
+		e->globals[i] = (struct global){
+			.name = name,
+			.value = JS_GetProperty (e->ctx, global, name),
+		};
+	}
+	JS_FreeValue (e->ctx, global);
+	e->globals_count = count;
+	js_free (e->ctx, names);
+	qsort (e->globals, count, sizeof (struct global), compare_atoms);
+	return true;
+}
+
+bool engine_scrub (engine *e)
+{
+	/* The run left work behind (e.g., an unsettled request) */
+	if (JS_IsJobPending (e->rt)) return false;
+
+	JSValue exception = JS_GetException (e->ctx);
+	JS_FreeValue (e->ctx, exception);
+
+	/* Timers, I/O and signal handlers, and worker ports */
+	js_std_free_handlers (e->rt);
+	js_std_init_handlers (e->rt);
+
+	/* Globals added since the snapshot are deleted; one that was
+	   replaced (globalThis.JSON = ...) or deleted can't be put back */
+	JSValue global = JS_GetGlobalObject (e->ctx);
+	JSPropertyEnum *names = nullptr;
+	uint32_t count = 0, kept = 0;
+	bool ok = global_names (e, global, &names, &count);
+	for (uint32_t i = 0; ok && i < count; i++) {
+		JSAtom name = names[i].atom;
+		struct global *g =
+			bsearch (&name, e->globals, e->globals_count,
+				 sizeof (struct global), compare_atoms);
+		if (g) {
+			JSValue value = JS_GetProperty (e->ctx, global, name);
+			ok = same_value (value, g->value);
+			JS_FreeValue (e->ctx, value);
+			kept++;
+			continue;
+		}
+		/* false for non-configurable properties (var, function) */
+		ok = JS_DeleteProperty (e->ctx, global, name, 0) == 1;
+	}
+	ok = ok && kept == e->globals_count;
+	if (names) {
+		for (uint32_t i = 0; i < count; i++) {
+			JS_FreeAtom (e->ctx, names[i].atom);
+		}
+		js_free (e->ctx, names);
+	}
+	JS_FreeValue (e->ctx, global);
+	if (ok) e->stats.scrubs++;
+	return ok;
+}
+
+/* Run a compiled script or module; on_disk if its name is a file path */
+static bool eval_function (JSContext *ctx, JSValue fn, bool on_disk)
+{
+	JSValue val;
+	if (JS_VALUE_GET_TAG (fn) == JS_TAG_MODULE) {
+		if (JS_ResolveModule (ctx, fn) < 0) {
+			JS_FreeValue (ctx, fn);
+			js_std_dump_error (ctx);
+			return false;
+		}
+		js_module_set_import_meta (ctx, fn, on_disk, TRUE);
+		val = js_std_await (ctx, JS_EvalFunction (ctx, fn));
+	} else {
+		val = JS_EvalFunction (ctx, fn);
+	}
+	if (JS_IsException (val)) {
+		js_std_dump_error (ctx);
+		return false;
+	}
+	JS_FreeValue (ctx, val);
+	return true;
+}
+
+/* Compile source, without running it */
+static JSValue compile (engine *e, const char *buf, size_t len,
+			const char *filename, bool module)
+{
+	int flags = module ? JS_EVAL_TYPE_MODULE : JS_EVAL_TYPE_GLOBAL;
+	uint64_t start = now_ns ();
+	JSValue fn = JS_Eval (e->ctx, buf, len, filename,
+			      flags | JS_EVAL_FLAG_COMPILE_ONLY);
+	e->stats.compile_ns += now_ns () - start;
+	e->stats.compiled++;
+	return fn;
+}
+
+/*
+ * Compile a file's source, or load it from the cache. The key covers what
+ * the bytecode depends on besides the source: the QuickJS version and
+ * source (QJS_ENGINE_ID, see CMakeLists.txt), whether it's a module, and
+ * the file name (embedded for stack traces).
+ */
+static JSValue compile_cached (engine *e, const char *buf, size_t len,
+			       const char *filename, bool module)
+{
+	codecache *cache = e->opts.cache;
+	if (!cache) return compile (e, buf, len, filename, module);
+
+	char salt[PATH_MAX + 64];
+	snprintf (salt, sizeof (salt), "qjs %s %s %s", QJS_ENGINE_ID,
+		  module ? "module" : "script", filename);
+	codecache_key key = codecache_key_for (buf, len, salt);
+
+	uint64_t start = now_ns ();
+	codecache_entry entry;
+	if (codecache_get (cache, key, &entry)) {
+		JSValue fn = JS_ReadObject (e->ctx, entry.data, entry.len,
+					    JS_READ_OBJ_BYTECODE);
+		codecache_release (&entry);
+		if (!JS_IsException (fn)) {
+			uint64_t load_ns = now_ns () - start;
+			e->stats.cache_hits++;
+			e->stats.cache_load_ns += load_ns;
+			if (entry.cost_ns > load_ns) {
+				e->stats.cache_saved_ns +=
+					entry.cost_ns - load_ns;
+			}
+			return fn;
+		}
+		/* Valid, but not bytecode this engine can read */
+		JS_FreeValue (e->ctx, JS_GetException (e->ctx));
+	}
+
+	start = now_ns ();
+	JSValue fn = compile (e, buf, len, filename, module);
+	uint64_t cost_ns = now_ns () - start;
+	if (JS_IsException (fn)) return fn;
+
+	size_t size;
+	uint8_t *bytecode = JS_WriteObject (e->ctx, &size, fn,
+					    JS_WRITE_OBJ_BYTECODE);
+	if (bytecode) {
+		codecache_put (cache, key, bytecode, size, cost_ns);
+		js_free (e->ctx, bytecode);
+	}
+	return fn;
+}
+
+/* Add compiled code to the bundle being collected */
+static bool collect (engine *e, const char *name, bundle_kind kind,
+		     JSValue fn)
+{
+	if (bundle_writer_has (e->collect, name)) return true;
+	size_t size;
+	uint8_t *bytecode = JS_WriteObject (e->ctx, &size, fn,
+					    JS_WRITE_OBJ_BYTECODE);
+	if (!bytecode) return false;
+	bundle_writer_add (e->collect, name, kind, bytecode, size);
+	js_free (e->ctx, bytecode);
+	return true;
+}
+
+/* A module from the bundle: no path search, no read, no compile */
+static JSModuleDef *load_bundled (JSContext *ctx, bundle *b, const char *name)
+{
+	bundle_item item;
+	if (!bundle_find (b, name, &item) || item.kind != BUNDLE_MODULE) {
+		JS_ThrowReferenceError (ctx, "module '%s' is not in the bundle",
+					name);
+		return nullptr;
+	}
+	JSValue fn = JS_ReadObject (ctx, item.data, item.len,
+				    JS_READ_OBJ_BYTECODE);
+	if (JS_IsException (fn)) return nullptr;
+
+	js_module_set_import_meta (ctx, fn, FALSE, FALSE);
+	JSModuleDef *m = JS_VALUE_GET_PTR (fn);
+	JS_FreeValue (ctx, fn);
+	return m;
+}
+
+/* Like js_module_loader, but through the cache (or the bundle) */
+static JSModuleDef *load_module (JSContext *ctx, const char *name,
+				 void *opaque)
+{
+	engine *e = opaque;
+	if (e->opts.bundle) return load_bundled (ctx, e->opts.bundle, name);
+	if (has_suffix (name, ".so")) {
+		return js_module_loader (ctx, name, nullptr);
+	}
+
+	size_t len;
+	uint8_t *buf = js_load_file (ctx, &len, name);
+	if (!buf) {
+		JS_ThrowReferenceError (ctx, "could not load module '%s'",
+					name);
+		return nullptr;
+	}
+	JSValue fn = compile_cached (e, (const char *)buf, len, name, true);
+	js_free (ctx, buf);
+	if (JS_IsException (fn)) return nullptr;
+	if (e->collect && !collect (e, name, BUNDLE_MODULE, fn)) {
+		JS_FreeValue (ctx, fn);
+		return nullptr;
+	}
+
+	js_module_set_import_meta (ctx, fn, TRUE, FALSE);
+	JSModuleDef *m = JS_VALUE_GET_PTR (fn);
+	JS_FreeValue (ctx, fn);
+	return m;
+}
+
+bool engine_eval_buf (engine *e, const char *buf, size_t len,
+		      const char *filename, bool module)
+{
+	/* Compile, then run, to be able to set import.meta for modules */
+	JSValue fn = compile (e, buf, len, filename, module);
+	if (JS_IsException (fn)) {
+		js_std_dump_error (e->ctx);
+		return false;
+	}
+	return eval_function (e->ctx, fn, true);
+}
+
+bool engine_eval_file (engine *e, const char *path)
+{
+	size_t len;
+	uint8_t *buf = js_load_file (e->ctx, &len, path);
+	if (!buf) {
+		log_error ("%s: %s", path, strerror (errno));
+		return false;
+	}
+	bool module = has_suffix (path, ".mjs") ||
+		      JS_DetectModule ((const char *)buf, len);
+	JSValue fn = compile_cached (e, (const char *)buf, len, path, module);
+	js_free (e->ctx, buf);
+	if (JS_IsException (fn)) {
+		js_std_dump_error (e->ctx);
+		return false;
+	}
+	return eval_function (e->ctx, fn, true);
+}
+
+bool engine_eval_bytecode (engine *e, const uint8_t *buf, size_t len)
+{
+	JSValue fn = JS_ReadObject (e->ctx, buf, len, JS_READ_OBJ_BYTECODE);
+	if (JS_IsException (fn)) {
+		js_std_dump_error (e->ctx);
+		return false;
+	}
+	return eval_function (e->ctx, fn, true);
+}
+
+bool engine_bundle (engine *e, const char *path, bundle_writer *w)
+{
+	size_t len;
+	uint8_t *buf = js_load_file (e->ctx, &len, path);
+	if (!buf) {
+		log_error ("%s: %s", path, strerror (errno));
+		return false;
+	}
+	bool module = has_suffix (path, ".mjs") ||
+		      JS_DetectModule ((const char *)buf, len);
+	JSValue fn = compile (e, (const char *)buf, len, path, module);
+	js_free (e->ctx, buf);
+	if (JS_IsException (fn)) {
+		js_std_dump_error (e->ctx);
+		return false;
+	}
+
+	/* Resolving a module loads its imports (without running anything),
+	   and the loader adds each one */
+	e->collect = w;
+	bool ok = collect (e, path, module ? BUNDLE_MODULE : BUNDLE_SCRIPT,
+			   fn);
+	if (ok && module && JS_ResolveModule (e->ctx, fn) < 0) {
+		js_std_dump_error (e->ctx);
+		ok = false;
+	}
+	e->collect = nullptr;
+	JS_FreeValue (e->ctx, fn);
+	return ok && bundle_writer_set_main (w, path);
+}
+
+bool engine_eval_bundle (engine *e)
+{
+	bundle_item item;
+	if (!e->opts.bundle || !bundle_main (e->opts.bundle, &item)) {
+		log_error ("engine: no bundle to run");
+		return false;
+	}
+	JSValue fn = JS_ReadObject (e->ctx, item.data, item.len,
+				    JS_READ_OBJ_BYTECODE);
+	if (JS_IsException (fn)) {
+		js_std_dump_error (e->ctx);
+		return false;
+	}
+	return eval_function (e->ctx, fn, false);
+}
+
+void engine_run_loop (engine *e)
+{
+	js_std_loop (e->ctx);
+}
+
+void engine_gc (engine *e)
+{
+	JS_RunGC (e->rt);
+}
+
+void engine_get_stats (engine *e, engine_stats *stats)
+{
+	JSMemoryUsage usage;
+	JS_ComputeMemoryUsage (e->rt, &usage);
+	*stats = e->stats;
+	stats->memory_used = (size_t)usage.malloc_size;
+}
+
+size_t engine_sample_memory (engine *e)
+{
+	atomic_store (&e->memory_due, true);
+	return atomic_load (&e->memory_used);
+}
+
+JSRuntime *engine_runtime (engine *e)
+{
+	return e->rt;
+}
 
-void test_engine ()
+JSContext *engine_context (engine *e)
 {
-	INFO ("engine test");
+	return e->ctx;
 }
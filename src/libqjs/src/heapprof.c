@@ -0,0 +1,567 @@
+/*
+ * Partikle sampling heap profiler
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "heapprof.h"
+#include "jsframe.h"
+#include "log.h"
+#include "map.h"
+
+typedef struct sample {
+	struct sample *next; /* in its bucket */
+	struct sample *pending_next; /* in its thread's pending list */
+	uintptr_t ptr;
+	const void *heap;
+	size_t size;
+	double objects; /* allocations it stands for */
+	uint32_t stack;
+	bool pending;
+	bool released; /* while pending: its thread frees it */
+} sample;
+
+struct heapprof {
+	heapprof_head head; /* first, see heapprof.h */
+	uint64_t id;
+	size_t interval;
+
+	/* the rest with the lock held */
+	pthread_mutex_t lock;
+	sample **buckets; /* live samples by address */
+	size_t bucket_count;
+	size_t live;
+	uint64_t samples;
+	map stacks;   /* text -> id */
+	char **texts; /* by id, [0] is null (no stack) */
+	uint32_t stack_count;
+};
+
+/* each thread's sampling state for the profiler it last sampled for (the
+   countdown is heapprof_countdown, read inline) */
+typedef struct sampler {
+	uint64_t id;
+	uint64_t rng;
+	sample *pending; /* samples waiting for a stack */
+} sampler;
+
+static _Atomic uint64_t profiler_ids;
+static _Thread_local sampler local;
+
+_Thread_local int64_t heapprof_countdown;
+
+static inline size_t hash_ptr (uintptr_t ptr)
+{
+	return heapprof_hash ((const void *)ptr);
+}
+
+heapprof *heapprof_new (size_t interval)
+{
+	heapprof *p = calloc (1, sizeof (*p));
+	if (!p) panic ("out of memory");
+	p->id = atomic_fetch_add (&profiler_ids, 1) + 1;
+	p->interval = interval ? interval : HEAPPROF_DEFAULT_INTERVAL;
+	pthread_mutex_init (&p->lock, nullptr);
+	p->bucket_count = 256;
+	p->buckets = calloc (p->bucket_count, sizeof (sample *));
+	if (!p->buckets) panic ("out of memory");
+	map_init (&p->stacks);
+	return p;
+}
+
+void heapprof_free (heapprof *p)
+{
+	if (!p) return;
+
+	/* Released samples in the thread's pending list (the others are in
+	   the buckets; another thread's released ones are lost with its
+	   list) */
+	for (sample *s = local.id == p->id ? local.pending : nullptr; s;) {
+		sample *next = s->pending_next;
+		if (s->released) free (s);
+		s = next;
+	}
+	for (size_t i = 0; i < p->bucket_count; i++) {
+		sample *s = p->buckets[i];
+		while (s) {
+			sample *next = s->next;
+			free (s);
+			s = next;
+		}
+	}
+	free (p->buckets);
+	for (uint32_t i = 1; i <= p->stack_count; i++) free (p->texts[i]);
+	free (p->texts);
+	map_free (&p->stacks);
+	pthread_mutex_destroy (&p->lock);
+	if (local.id == p->id) {
+		local = (sampler){0};
+		heapprof_countdown = 0;
+	}
+	free (p);
+}
+
+/* xorshift64*: good enough for sampling distances */
+static uint64_t next_random (sampler *s)
+{
+	s->rng ^= s->rng >> 12;
+	s->rng ^= s->rng << 25;
+	s->rng ^= s->rng >> 27;
+	return s->rng * 0x2545f4914f6cdd1dull;
+}
+
+/* An exponentially distributed distance with the interval as its mean */
+static int64_t next_distance (heapprof *p, sampler *s)
+{
+	double u = (double)(next_random (s) >> 11) * 0x1p-53; /* [0, 1) */
+	double d = -log (1.0 - u) * (double)p->interval;
+	return d < 1.0 ? 1 : d > 1e15 ? (int64_t)1e15 : (int64_t)d;
+}
+
+static void grow (heapprof *p)
+{
+	size_t count = p->bucket_count * 2;
+	sample **buckets = calloc (count, sizeof (sample *));
+	if (!buckets) panic ("out of memory");
+	for (size_t i = 0; i < p->bucket_count; i++) {
+		sample *s = p->buckets[i];
+		while (s) {
+			sample *next = s->next;
+			size_t b = hash_ptr (s->ptr) & (count - 1);
+			s->next = buckets[b];
+			buckets[b] = s;
+			s = next;
+		}
+	}
+	free (p->buckets);
+	p->buckets = buckets;
+	p->bucket_count = count;
+}
+
+static void take_sample (heapprof *p, const void *heap, const void *ptr,
+			 size_t size)
+{
+	sample *s = malloc (sizeof (*s));
+	if (!s) panic ("out of memory");
+	*s = (sample){
+		.pending_next = local.pending,
+		.ptr = (uintptr_t)ptr,
+		.heap = heap,
+		.size = size,
+		.objects = 1.0 / -expm1 (-(double)size / (double)p->interval),
+		.pending = true,
+	};
+	size_t h = hash_ptr (s->ptr);
+	pthread_mutex_lock (&p->lock);
+	if (p->live >= p->bucket_count) grow (p);
+	size_t b = h & (p->bucket_count - 1);
+	s->next = p->buckets[b];
+	p->buckets[b] = s;
+	p->live++;
+	p->samples++;
+	atomic_fetch_add_explicit (&p->head.filter[h % HEAPPROF_FILTER_SLOTS],
+				   1, memory_order_relaxed);
+	pthread_mutex_unlock (&p->lock);
+	local.pending = s;
+}
+
+/* The countdown ran out (or was never set for this profiler) */
+void heapprof_alloc_slow (heapprof *p, const void *heap, const void *ptr,
+			  size_t size)
+{
+	if (local.id != p->id) {
+		/* The distances are memoryless, so starting over is fair to
+		   both profilers */
+		uint64_t seed = (uint64_t)(uintptr_t)&local ^
+				(uint64_t)time (nullptr);
+		local = (sampler){.id = p->id, .rng = seed | 1};
+		heapprof_countdown = next_distance (p, &local) - (int64_t)size;
+		if (heapprof_countdown > 0) return;
+	}
+	/* One sample, however many intervals a large allocation spans */
+	heapprof_countdown = next_distance (p, &local);
+	take_sample (p, heap, ptr, size);
+}
+
+/* Take a live sample out (with the lock held). Returns it to be freed, or
+   null if it's still in its thread's pending list. */
+static sample *unlink_sample (heapprof *p, sample **link)
+{
+	sample *s = *link;
+	*link = s->next;
+	p->live--;
+	size_t h = hash_ptr (s->ptr);
+	atomic_fetch_sub_explicit (&p->head.filter[h % HEAPPROF_FILTER_SLOTS],
+				   1, memory_order_relaxed);
+	if (!s->pending) return s;
+	s->released = true;
+	return nullptr;
+}
+
+/* The filter has a live sample with ptr's hash (maybe ptr's) */
+void heapprof_release_slow (heapprof *p, const void *ptr)
+{
+	size_t h = hash_ptr ((uintptr_t)ptr);
+	pthread_mutex_lock (&p->lock);
+	sample **link = &p->buckets[h & (p->bucket_count - 1)];
+	while (*link && (*link)->ptr != (uintptr_t)ptr) link = &(*link)->next;
+	sample *s = *link ? unlink_sample (p, link) : nullptr;
+	pthread_mutex_unlock (&p->lock);
+	free (s);
+}
+
+void heapprof_release_heap (heapprof *p, const void *heap)
+{
+	pthread_mutex_lock (&p->lock);
+	for (size_t i = 0; i < p->bucket_count; i++) {
+		sample **link = &p->buckets[i];
+		while (*link) {
+			if ((*link)->heap == heap) {
+				free (unlink_sample (p, link));
+			} else {
+				link = &(*link)->next;
+			}
+		}
+	}
+	pthread_mutex_unlock (&p->lock);
+}
+
+bool heapprof_pending (heapprof *p)
+{
+	return local.id == p->id && local.pending;
+}
+
+static uint32_t intern_stack (heapprof *p, const char *frames)
+{
+	uint32_t id = (uint32_t)(uintptr_t)map_get (&p->stacks, frames);
+	if (id) return id;
+	id = ++p->stack_count;
+	map_put (&p->stacks, frames, (void *)(uintptr_t)id);
+	p->texts = realloc (p->texts, (id + 1) * sizeof (char *));
+	if (!p->texts) panic ("out of memory");
+	p->texts[0] = nullptr;
+	p->texts[id] = strdup (frames);
+	if (!p->texts[id]) panic ("out of memory");
+	return id;
+}
+
+void heapprof_set_stack (heapprof *p, const char *frames)
+{
+	if (!heapprof_pending (p)) return;
+	sample *s = local.pending;
+	local.pending = nullptr;
+	pthread_mutex_lock (&p->lock);
+	uint32_t stack = frames && *frames ? intern_stack (p, frames) : 0;
+	while (s) {
+		sample *next = s->pending_next;
+		if (s->released) {
+			free (s);
+		} else {
+			s->stack = stack;
+			s->pending = false;
+		}
+		s = next;
+	}
+	pthread_mutex_unlock (&p->lock);
+}
+
+void heapprof_get_stats (heapprof *p, heapprof_stats *stats)
+{
+	*stats = (heapprof_stats){0};
+	double bytes = 0;
+	pthread_mutex_lock (&p->lock);
+	stats->samples = p->samples;
+	stats->live = p->live;
+	for (size_t i = 0; i < p->bucket_count; i++) {
+		for (sample *s = p->buckets[i]; s; s = s->next) {
+			bytes += s->objects * (double)s->size;
+			if (s->pending) stats->pending++;
+		}
+	}
+	pthread_mutex_unlock (&p->lock);
+	stats->live_bytes = (uint64_t)llround (bytes);
+}
+
+/*
+ * Output: the live samples summed by stack.
+ */
+
+typedef struct stack_total {
+	double objects;
+	double bytes;
+} stack_total;
+
+/* Totals by stack id (with the lock held); the caller frees them */
+static stack_total *totals_by_stack (heapprof *p)
+{
+	stack_total *totals = calloc (p->stack_count + 1, sizeof (stack_total));
+	if (!totals) panic ("out of memory");
+	for (size_t i = 0; i < p->bucket_count; i++) {
+		for (sample *s = p->buckets[i]; s; s = s->next) {
+			totals[s->stack].objects += s->objects;
+			totals[s->stack].bytes += s->objects * (double)s->size;
+		}
+	}
+	return totals;
+}
+
+size_t heapprof_write_folded (heapprof *p, FILE *f)
+{
+	size_t written = 0;
+	pthread_mutex_lock (&p->lock);
+	stack_total *totals = totals_by_stack (p);
+	for (uint32_t i = 0; i <= p->stack_count; i++) {
+		long long bytes = llround (totals[i].bytes);
+		if (bytes <= 0) continue;
+		js_frames_fold (f, i ? p->texts[i] : JS_NO_STACK);
+		fprintf (f, " %lld\n", bytes);
+		written++;
+	}
+	pthread_mutex_unlock (&p->lock);
+	free (totals);
+	return written;
+}
+
+/*
+ * pprof: profile.proto, written by hand. Messages are built in buffers
+ * and appended to their parent, length first.
+ */
+
+typedef struct pb {
+	uint8_t *data;
+	size_t len, cap;
+} pb;
+
+enum { PB_VARINT = 0, PB_BYTES = 2 };
+
+static void pb_append (pb *b, const void *data, size_t len)
+{
+	if (b->len + len > b->cap) {
+		b->cap = (b->len + len) * 2;
+		b->data = realloc (b->data, b->cap);
+		if (!b->data) panic ("out of memory");
+	}
+	memcpy (b->data + b->len, data, len);
+	b->len += len;
+}
+
+static void pb_varint (pb *b, uint64_t v)
+{
+	uint8_t buf[10], *out = buf;
+	while (v >= 0x80) {
+		*out++ = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	*out++ = (uint8_t)v;
+	pb_append (b, buf, (size_t)(out - buf));
+}
+
+static void pb_int (pb *b, int field, uint64_t v)
+{
+	pb_varint (b, (uint64_t)field << 3 | PB_VARINT);
+	pb_varint (b, v);
+}
+
+static void pb_bytes (pb *b, int field, const void *data, size_t len)
+{
+	pb_varint (b, (uint64_t)field << 3 | PB_BYTES);
+	pb_varint (b, len);
+	pb_append (b, data, len);
+}
+
+/* Append a message, and empty it for the next one */
+static void pb_message (pb *b, int field, pb *m)
+{
+	pb_bytes (b, field, m->data, m->len);
+	m->len = 0;
+}
+
+/* profile.proto field numbers */
+enum {
+	PROFILE_SAMPLE_TYPE = 1,
+	PROFILE_SAMPLE = 2,
+	PROFILE_LOCATION = 4,
+	PROFILE_FUNCTION = 5,
+	PROFILE_STRING_TABLE = 6,
+	PROFILE_TIME_NANOS = 9,
+	PROFILE_PERIOD_TYPE = 11,
+	PROFILE_PERIOD = 12,
+	PROFILE_DEFAULT_SAMPLE_TYPE = 14,
+	VALUE_TYPE_TYPE = 1,
+	VALUE_TYPE_UNIT = 2,
+	SAMPLE_LOCATION_ID = 1,
+	SAMPLE_VALUE = 2,
+	LOCATION_ID = 1,
+	LOCATION_LINE = 4,
+	LINE_FUNCTION_ID = 1,
+	LINE_LINE = 2,
+	FUNCTION_ID = 1,
+	FUNCTION_NAME = 2,
+	FUNCTION_FILENAME = 4,
+};
+
+/* The string table, functions, and locations, each numbered from 1 (0
+   is the empty string) by their text */
+typedef struct pprof_tables {
+	map strings, functions, locations;
+	uint64_t string_count, function_count, location_count;
+	pb string_table, function_list, location_list, scratch;
+} pprof_tables;
+
+static uint64_t pprof_string (pprof_tables *t, const char *s, size_t len)
+{
+	if (len == 0) return 0;
+	char *key = strndup (s, len);
+	if (!key) panic ("out of memory");
+	uint64_t id = (uint64_t)(uintptr_t)map_get (&t->strings, key);
+	if (!id) {
+		id = ++t->string_count;
+		map_put (&t->strings, key, (void *)(uintptr_t)id);
+		pb_bytes (&t->string_table, PROFILE_STRING_TABLE, s, len);
+	}
+	free (key);
+	return id;
+}
+
+/* The location of a frame line: its function and line */
+static uint64_t pprof_location (pprof_tables *t, const char *text,
+				size_t len)
+{
+	js_frame f;
+	js_frame_parse (text, len, &f);
+
+	char key[1024];
+	snprintf (key, sizeof (key), "%.*s\n%.*s", (int)f.name_len, f.name,
+		  (int)f.file_len, f.file);
+	uint64_t function = (uint64_t)(uintptr_t)map_get (&t->functions, key);
+	if (!function) {
+		function = ++t->function_count;
+		map_put (&t->functions, key, (void *)(uintptr_t)function);
+		pb_int (&t->scratch, FUNCTION_ID, function);
+		pb_int (&t->scratch, FUNCTION_NAME,
+			pprof_string (t, f.name, f.name_len));
+		pb_int (&t->scratch, FUNCTION_FILENAME,
+			pprof_string (t, f.file, f.file_len));
+		pb_message (&t->function_list, PROFILE_FUNCTION, &t->scratch);
+	}
+
+	snprintf (key, sizeof (key), "%llu:%d", (unsigned long long)function,
+		  f.line);
+	uint64_t location = (uint64_t)(uintptr_t)map_get (&t->locations, key);
+	if (!location) {
+		location = ++t->location_count;
+		map_put (&t->locations, key, (void *)(uintptr_t)location);
+		pb line = {0};
+		pb_int (&line, LINE_FUNCTION_ID, function);
+		pb_int (&line, LINE_LINE, (uint64_t)f.line);
+		pb_int (&t->scratch, LOCATION_ID, location);
+		pb_message (&t->scratch, LOCATION_LINE, &line);
+		pb_message (&t->location_list, PROFILE_LOCATION, &t->scratch);
+		free (line.data);
+	}
+	return location;
+}
+
+static void pprof_value_type (pprof_tables *t, pb *out, int field,
+			      const char *type, const char *unit)
+{
+	pb m = {0};
+	pb_int (&m, VALUE_TYPE_TYPE, pprof_string (t, type, strlen (type)));
+	pb_int (&m, VALUE_TYPE_UNIT, pprof_string (t, unit, strlen (unit)));
+	pb_message (out, field, &m);
+	free (m.data);
+}
+
+bool heapprof_write_pprof (heapprof *p, FILE *f)
+{
+	pprof_tables t = {0};
+	map_init (&t.strings);
+	map_init (&t.functions);
+	map_init (&t.locations);
+	pb_bytes (&t.string_table, PROFILE_STRING_TABLE, "", 0);
+
+	pb out = {0}, sample = {0}, ids = {0}, values = {0};
+	pprof_value_type (&t, &out, PROFILE_SAMPLE_TYPE, "inuse_objects",
+			  "count");
+	pprof_value_type (&t, &out, PROFILE_SAMPLE_TYPE, "inuse_space",
+			  "bytes");
+
+	pthread_mutex_lock (&p->lock);
+	stack_total *totals = totals_by_stack (p);
+	for (uint32_t i = 0; i <= p->stack_count; i++) {
+		long long objects = llround (totals[i].objects);
+		long long bytes = llround (totals[i].bytes);
+		if (bytes <= 0) continue;
+		const char *next = i ? p->texts[i] : JS_NO_STACK;
+		while (next) {
+			const char *line = next;
+			size_t len = js_frame_line (line, &next);
+			if (len == 0) continue;
+			pb_varint (&ids, pprof_location (&t, line, len));
+		}
+		pb_varint (&values, (uint64_t)objects);
+		pb_varint (&values, (uint64_t)bytes);
+		pb_message (&sample, SAMPLE_LOCATION_ID, &ids);
+		pb_message (&sample, SAMPLE_VALUE, &values);
+		pb_message (&out, PROFILE_SAMPLE, &sample);
+	}
+	size_t interval = p->interval;
+	pthread_mutex_unlock (&p->lock);
+	free (totals);
+
+	pb_append (&out, t.location_list.data, t.location_list.len);
+	pb_append (&out, t.function_list.data, t.function_list.len);
+	struct timespec now;
+	clock_gettime (CLOCK_REALTIME, &now);
+	pb_int (&out, PROFILE_TIME_NANOS,
+		(uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec);
+	pprof_value_type (&t, &out, PROFILE_PERIOD_TYPE, "space", "bytes");
+	pb_int (&out, PROFILE_PERIOD, interval);
+	pb_int (&out, PROFILE_DEFAULT_SAMPLE_TYPE,
+		pprof_string (&t, "inuse_space", 11));
+	pb_append (&out, t.string_table.data, t.string_table.len);
+
+	bool ok = fwrite (out.data, 1, out.len, f) == out.len;
+	free (out.data);
+	free (sample.data);
+	free (ids.data);
+	free (values.data);
+	free (t.string_table.data);
+	free (t.function_list.data);
+	free (t.location_list.data);
+	free (t.scratch.data);
+	map_free (&t.strings);
+	map_free (&t.functions);
+	map_free (&t.locations);
+	return ok;
+}
@@ -0,0 +1,790 @@
+/*
+ * Partikle heap allocation traces
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "heaptrace.h"
+#include "log.h"
+#include "map.h"
+#include "mapfile.h"
+
+#define MAGIC 0x7274686c6b7470ull /* "ptklhtr" */
+#define FORMAT_VERSION 2 /* 1 is the same, without resets */
+
+/* record tags: the operation, and a flag */
+enum {
+	TAG_STACK = 0, /* a stack's text: id, length, bytes */
+	TAG_ALLOC = 1,
+	TAG_FREE = 2,
+	TAG_REALLOC = 3,
+	TAG_OP_MASK = 3,
+	TAG_NEW_STACK = 4, /* the stack changed: its id follows */
+	TAG_RESET = TAG_STACK | TAG_NEW_STACK, /* the thread's heap is gone */
+};
+
+/* the largest record: a tag and five 64-bit varints */
+#define MAX_RECORD (1 + 5 * 10)
+
+struct header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t start; /* CLOCK_REALTIME, ns */
+};
+
+struct block {
+	uint32_t thread; /* 0 for stack definitions */
+	uint32_t len;
+};
+
+typedef struct buffer {
+	struct buffer *next;
+	uint32_t thread;
+	uint32_t stack;		/* of the thread's following records */
+	uint32_t written_stack; /* of the block's last record */
+	uint64_t last_ns;
+	uint64_t last_addr;
+	char *last_frames; /* the text heaptrace_stack was last asked for */
+	uint32_t last_frames_id;
+	size_t len;
+	uint8_t data[HEAPTRACE_BUFFER_SIZE];
+} buffer;
+
+struct heaptrace {
+	uint64_t id;
+	int fd;
+	uint64_t start_ns;
+	bool failed;
+
+	/* the file, the buffers list, and the stacks */
+	pthread_mutex_t lock;
+	buffer *buffers;
+	uint32_t threads;
+	map stacks; /* text -> id */
+	uint32_t stack_count;
+};
+
+/* each thread's buffer for the trace it last recorded to (by id, since
+   that trace may be gone) */
+static _Atomic uint64_t trace_ids;
+static _Thread_local uint64_t local_id;
+static _Thread_local buffer *local;
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static bool write_full (int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	while (len > 0) {
+		ssize_t n = write (fd, p, len);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+static inline uint8_t *put_varint (uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static inline uint64_t zigzag (int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag (uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+heaptrace *heaptrace_open (const char *path)
+{
+	int fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		log_error ("%s: %s", path, strerror (errno));
+		return nullptr;
+	}
+	struct timespec now;
+	clock_gettime (CLOCK_REALTIME, &now);
+	struct header h = {
+		.magic = MAGIC,
+		.version = FORMAT_VERSION,
+		.header_size = sizeof (h),
+		.start = (uint64_t)now.tv_sec * 1000000000ull +
+			 (uint64_t)now.tv_nsec,
+	};
+	if (!write_full (fd, &h, sizeof (h))) {
+		log_error ("%s: %s", path, strerror (errno));
+		close (fd);
+		return nullptr;
+	}
+
+	heaptrace *t = calloc (1, sizeof (*t));
+	if (!t) panic ("out of memory");
+	t->id = atomic_fetch_add (&trace_ids, 1) + 1;
+	t->fd = fd;
+	t->start_ns = now_ns ();
+	pthread_mutex_init (&t->lock, nullptr);
+	map_init (&t->stacks);
+	return t;
+}
+
+/* Write a block (with the lock held) */
+static void write_block (heaptrace *t, uint32_t thread, const void *data,
+			 size_t len)
+{
+	struct block b = {.thread = thread, .len = (uint32_t)len};
+	if (!write_full (t->fd, &b, sizeof (b)) ||
+	    !write_full (t->fd, data, len)) {
+		t->failed = true;
+	}
+}
+
+/* Write a buffer's records and start a new block */
+static void flush (heaptrace *t, buffer *b)
+{
+	if (b->len == 0) return;
+	pthread_mutex_lock (&t->lock);
+	write_block (t, b->thread, b->data, b->len);
+	pthread_mutex_unlock (&t->lock);
+	b->len = 0;
+	b->last_ns = 0;
+	b->last_addr = 0;
+	b->written_stack = 0;
+}
+
+static buffer *thread_buffer (heaptrace *t)
+{
+	if (local_id == t->id) return local;
+	buffer *b = calloc (1, sizeof (*b));
+	if (!b) panic ("out of memory");
+	pthread_mutex_lock (&t->lock);
+	b->thread = ++t->threads;
+	b->next = t->buffers;
+	t->buffers = b;
+	pthread_mutex_unlock (&t->lock);
+	local_id = t->id;
+	local = b;
+	return b;
+}
+
+static void record (heaptrace *t, int op, const void *old, const void *p,
+		    size_t size)
+{
+	buffer *b = thread_buffer (t);
+	if (HEAPTRACE_BUFFER_SIZE - b->len < MAX_RECORD) flush (t, b);
+
+	uint64_t ns = now_ns () - t->start_ns;
+	uint8_t *out = b->data + b->len;
+	bool new_stack = b->stack != b->written_stack;
+	*out++ = (uint8_t)(op | (new_stack ? TAG_NEW_STACK : 0));
+	out = put_varint (out, ns - b->last_ns);
+	if (new_stack) {
+		out = put_varint (out, b->stack);
+		b->written_stack = b->stack;
+	}
+	uint64_t addr = (uintptr_t)p;
+	out = put_varint (out, zigzag ((int64_t)(addr - b->last_addr)));
+	if (op == TAG_REALLOC) {
+		int64_t delta = (int64_t)((uintptr_t)old - addr);
+		out = put_varint (out, zigzag (delta));
+	}
+	out = put_varint (out, size);
+	b->len = (size_t)(out - b->data);
+	b->last_ns = ns;
+	b->last_addr = addr;
+}
+
+void heaptrace_alloc (heaptrace *t, const void *p, size_t size)
+{
+	record (t, TAG_ALLOC, nullptr, p, size);
+}
+
+void heaptrace_free (heaptrace *t, const void *p, size_t size)
+{
+	record (t, TAG_FREE, nullptr, p, size);
+}
+
+void heaptrace_realloc (heaptrace *t, const void *old, const void *p,
+			size_t size)
+{
+	record (t, TAG_REALLOC, old, p, size);
+}
+
+void heaptrace_reset (heaptrace *t)
+{
+	buffer *b = thread_buffer (t);
+	if (HEAPTRACE_BUFFER_SIZE - b->len < MAX_RECORD) flush (t, b);
+
+	uint64_t ns = now_ns () - t->start_ns;
+	uint8_t *out = b->data + b->len;
+	*out++ = TAG_RESET;
+	out = put_varint (out, ns - b->last_ns);
+	b->len = (size_t)(out - b->data);
+	b->last_ns = ns;
+}
+
+uint32_t heaptrace_stack (heaptrace *t, const char *frames)
+{
+	/* The same stack again (a loop, say) doesn't lock */
+	buffer *b = thread_buffer (t);
+	if (b->last_frames && strcmp (b->last_frames, frames) == 0) {
+		return b->last_frames_id;
+	}
+
+	pthread_mutex_lock (&t->lock);
+	uint32_t id = (uint32_t)(uintptr_t)map_get (&t->stacks, frames);
+	if (id == 0) {
+		id = ++t->stack_count;
+		map_put (&t->stacks, frames, (void *)(uintptr_t)id);
+
+		size_t len = strlen (frames);
+		uint8_t *def = malloc (1 + 20 + len);
+		if (!def) panic ("out of memory");
+		uint8_t *p = def;
+		*p++ = TAG_STACK;
+		p = put_varint (p, id);
+		p = put_varint (p, len);
+		memcpy (p, frames, len);
+		write_block (t, 0, def, (size_t)(p - def) + len);
+		free (def);
+	}
+	pthread_mutex_unlock (&t->lock);
+
+	free (b->last_frames);
+	b->last_frames = strdup (frames);
+	if (!b->last_frames) panic ("out of memory");
+	b->last_frames_id = id;
+	return id;
+}
+
+void heaptrace_set_stack (heaptrace *t, uint32_t stack)
+{
+	thread_buffer (t)->stack = stack;
+}
+
+bool heaptrace_close (heaptrace *t)
+{
+	if (!t) return true;
+	buffer *b = t->buffers;
+	while (b) {
+		buffer *next = b->next;
+		flush (t, b);
+		free (b->last_frames);
+		free (b);
+		b = next;
+	}
+	if (local_id == t->id) local_id = 0;
+	bool ok = !t->failed && close (t->fd) == 0;
+	pthread_mutex_destroy (&t->lock);
+	map_free (&t->stacks);
+	free (t);
+	return ok;
+}
+
+/*
+ * Analysis: decode every block into one list of events, order them by
+ * time, and replay them against a table of the live blocks.
+ */
+
+typedef struct event {
+	uint64_t ns;
+	uint64_t seq; /* order in the file, for equal times */
+	uint64_t addr;
+	uint64_t old;
+	uint64_t size;
+	uint32_t stack;
+	uint32_t thread;
+	uint8_t op;
+} event;
+
+typedef struct trace_data {
+	event *events;
+	size_t count, cap;
+	char **stacks; /* by id, [0] is null */
+	uint32_t stack_count;
+	uint32_t threads;
+} trace_data;
+
+/* a live block, in an open-addressed table keyed by address */
+typedef struct live {
+	uint64_t addr; /* 0 is empty */
+	uint64_t size;
+	uint32_t stack;
+	uint32_t thread;
+	bool deleted;
+} live;
+
+typedef struct live_table {
+	live *slots;
+	size_t cap, used;
+	uint64_t bytes, count;
+} live_table;
+
+typedef struct stack_total {
+	uint32_t stack;
+	uint64_t bytes, count;
+} stack_total;
+
+static bool get_varint (const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+	uint64_t x = 0;
+	for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+		uint8_t byte = *(*p)++;
+		x |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*v = x;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool add_stack (trace_data *d, const uint8_t **p, const uint8_t *end)
+{
+	uint64_t id, len;
+	if (!get_varint (p, end, &id) || !get_varint (p, end, &len) ||
+	    id == 0 || id > UINT32_MAX || len > (uint64_t)(end - *p)) {
+		return false;
+	}
+	if (id > d->stack_count) {
+		size_t from = d->stacks ? d->stack_count + 1 : 0;
+		d->stacks = realloc (d->stacks, (id + 1) * sizeof (char *));
+		if (!d->stacks) panic ("out of memory");
+		memset (d->stacks + from, 0, (id + 1 - from) * sizeof (char *));
+		d->stack_count = (uint32_t)id;
+	}
+	free (d->stacks[id]);
+	d->stacks[id] = strndup ((const char *)*p, len);
+	if (!d->stacks[id]) panic ("out of memory");
+	*p += len;
+	return true;
+}
+
+static void add_event (trace_data *d, event e)
+{
+	if (d->count == d->cap) {
+		d->cap = d->cap ? d->cap * 2 : 4096;
+		d->events = realloc (d->events, d->cap * sizeof (event));
+		if (!d->events) panic ("out of memory");
+	}
+	e.seq = d->count;
+	d->events[d->count++] = e;
+}
+
+static bool read_block (trace_data *d, uint32_t thread, const uint8_t *p,
+			const uint8_t *end)
+{
+	uint64_t ns = 0, addr = 0;
+	uint32_t stack = 0;
+	while (p < end) {
+		uint8_t tag = *p++;
+		int op = tag & TAG_OP_MASK;
+		uint64_t delta, v, old = 0, size;
+		if (tag == TAG_RESET) {
+			if (!get_varint (&p, end, &delta)) return false;
+			ns += delta;
+			add_event (d, (event){.ns = ns,
+					      .thread = thread,
+					      .op = TAG_RESET});
+			continue;
+		}
+		if (op == TAG_STACK) {
+			if (tag != TAG_STACK || !add_stack (d, &p, end)) {
+				return false;
+			}
+			continue;
+		}
+
+		if (!get_varint (&p, end, &delta)) return false;
+		ns += delta;
+		if (tag & TAG_NEW_STACK) {
+			if (!get_varint (&p, end, &v)) return false;
+			stack = (uint32_t)v;
+		}
+		if (!get_varint (&p, end, &v)) return false;
+		addr += (uint64_t)unzigzag (v);
+		if (op == TAG_REALLOC) {
+			if (!get_varint (&p, end, &v)) return false;
+			old = addr + (uint64_t)unzigzag (v);
+		}
+		if (!get_varint (&p, end, &size)) return false;
+
+		add_event (d, (event){.ns = ns,
+				      .addr = addr,
+				      .old = old,
+				      .size = size,
+				      .stack = stack,
+				      .thread = thread,
+				      .op = (uint8_t)op});
+	}
+	return true;
+}
+
+static int compare_events (const void *a, const void *b)
+{
+	const event *x = a, *y = b;
+	if (x->ns != y->ns) return x->ns < y->ns ? -1 : 1;
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static bool read_trace (const char *path, trace_data *d)
+{
+	mapped_file f;
+	if (!map_file (path, &f)) {
+		log_error ("%s: %s", path, strerror (errno));
+		return false;
+	}
+	struct header h;
+	bool ok = f.len >= sizeof (h);
+	if (ok) memcpy (&h, f.data, sizeof (h));
+	ok = ok && h.magic == MAGIC && h.version >= 1 &&
+	     h.version <= FORMAT_VERSION && h.header_size == sizeof (h);
+
+	const uint8_t *p = f.data + sizeof (h), *end = f.data + f.len;
+	while (ok && p < end) {
+		struct block b;
+		if ((size_t)(end - p) < sizeof (b)) break;
+		memcpy (&b, p, sizeof (b));
+		p += sizeof (b);
+		if (b.len > (size_t)(end - p)) break; /* cut short: stop */
+		ok = read_block (d, b.thread, p, p + b.len);
+		if (b.thread > d->threads) d->threads = b.thread;
+		p += b.len;
+	}
+	unmap_file (&f);
+	if (!ok) {
+		log_error ("%s: not a valid heap trace", path);
+		return false;
+	}
+
+	/* Each thread's records are in order already */
+	qsort (d->events, d->count, sizeof (event), compare_events);
+	return true;
+}
+
+static void free_trace (trace_data *d)
+{
+	for (uint32_t i = 0; i <= d->stack_count && d->stacks; i++) {
+		free (d->stacks[i]);
+	}
+	free (d->stacks);
+	free (d->events);
+}
+
+static inline size_t hash_addr (uint64_t addr, size_t cap)
+{
+	return (size_t)((addr >> 4) * 0x9e3779b97f4a7c15ull) & (cap - 1);
+}
+
+static void live_add (live_table *t, const live *block);
+
+static void live_grow (live_table *t)
+{
+	live *old = t->slots;
+	size_t old_cap = t->cap;
+	t->cap = t->cap ? t->cap * 2 : 1024;
+	t->slots = calloc (t->cap, sizeof (live));
+	if (!t->slots) panic ("out of memory");
+	t->used = t->bytes = t->count = 0;
+	for (size_t i = 0; i < old_cap; i++) {
+		live *l = &old[i];
+		if (l->addr && !l->deleted) live_add (t, l);
+	}
+	free (old);
+}
+
+static live *live_find (live_table *t, uint64_t addr)
+{
+	if (!t->cap) return nullptr;
+	for (size_t i = hash_addr (addr, t->cap);; i = (i + 1) & (t->cap - 1)) {
+		live *l = &t->slots[i];
+		if (!l->addr) return nullptr;
+		if (l->addr == addr && !l->deleted) return l;
+	}
+}
+
+static void live_add (live_table *t, const live *block)
+{
+	if ((t->used + 1) * 2 > t->cap) live_grow (t);
+	live *l = live_find (t, block->addr);
+	if (l) { /* freed untraced, and reused */
+		t->bytes -= l->size;
+		t->count--;
+	} else { /* the first free slot, reusing deleted ones */
+		size_t i = hash_addr (block->addr, t->cap);
+		while (t->slots[i].addr && !t->slots[i].deleted) {
+			i = (i + 1) & (t->cap - 1);
+		}
+		l = &t->slots[i];
+		if (!l->addr) t->used++;
+	}
+	*l = *block;
+	t->bytes += l->size;
+	t->count++;
+}
+
+static void live_remove (live_table *t, uint64_t addr)
+{
+	live *l = live_find (t, addr);
+	if (!l) return; /* allocated before the trace started */
+	l->deleted = true;
+	t->bytes -= l->size;
+	t->count--;
+}
+
+/* Remove every block a thread allocated */
+static void live_reset (live_table *t, uint32_t thread)
+{
+	for (size_t i = 0; i < t->cap; i++) {
+		live *l = &t->slots[i];
+		if (!l->addr || l->deleted || l->thread != thread) continue;
+		l->deleted = true;
+		t->bytes -= l->size;
+		t->count--;
+	}
+}
+
+static void replay (live_table *t, const event *e)
+{
+	live block = {.addr = e->addr,
+		      .size = e->size,
+		      .stack = e->stack,
+		      .thread = e->thread};
+	switch (e->op) {
+	case TAG_ALLOC: live_add (t, &block); break;
+	case TAG_FREE: live_remove (t, e->addr); break;
+	case TAG_REALLOC:
+		live_remove (t, e->old);
+		live_add (t, &block);
+		break;
+	case TAG_RESET: live_reset (t, e->thread); break;
+	}
+}
+
+static int compare_totals (const void *a, const void *b)
+{
+	const stack_total *x = a, *y = b;
+	return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+/* The live blocks by stack, most bytes first; returns the stacks used */
+static size_t totals_by_stack (live_table *t, uint32_t stack_count,
+			       stack_total *totals)
+{
+	for (uint32_t i = 0; i <= stack_count; i++) {
+		totals[i] = (stack_total){.stack = i};
+	}
+	for (size_t i = 0; i < t->cap; i++) {
+		live *l = &t->slots[i];
+		if (!l->addr || l->deleted) continue;
+		uint32_t s = l->stack <= stack_count ? l->stack : 0;
+		totals[s].bytes += l->size;
+		totals[s].count++;
+	}
+	qsort (totals, stack_count + 1, sizeof (stack_total), compare_totals);
+	size_t used = 0;
+	while (used <= stack_count && totals[used].count) used++;
+	return used;
+}
+
+static const char *format_bytes (uint64_t n, char *buf, size_t size)
+{
+	if (n < 1024) {
+		snprintf (buf, size, "%llu B", (unsigned long long)n);
+	} else if (n < 1024 * 1024) {
+		snprintf (buf, size, "%.1f KB", n / 1024.0);
+	} else {
+		snprintf (buf, size, "%.1f MB", n / (1024.0 * 1024.0));
+	}
+	return buf;
+}
+
+/* A stack on one line: innermost < caller < ... */
+static void print_stack (FILE *out, const trace_data *d, uint32_t stack)
+{
+	const char *s = stack && stack <= d->stack_count ? d->stacks[stack]
+							  : nullptr;
+	if (!s || !*s) {
+		fprintf (out, "(no stack)\n");
+		return;
+	}
+	for (; *s; s++) {
+		if (*s != '\n') {
+			fputc (*s, out);
+		} else if (s[1]) {
+			fputs (" < ", out);
+		}
+	}
+	fputc ('\n', out);
+}
+
+static void print_totals (FILE *out, const trace_data *d, stack_total *totals,
+			  size_t count, int top)
+{
+	char buf[32];
+	for (size_t i = 0; i < count && i < (size_t)top; i++) {
+		fprintf (out, "  %10s %8llu  ",
+			 format_bytes (totals[i].bytes, buf, sizeof (buf)),
+			 (unsigned long long)totals[i].count);
+		print_stack (out, d, totals[i].stack);
+	}
+	if (count == 0) fprintf (out, "  (none)\n");
+}
+
+bool heaptrace_analyze (const char *path, FILE *out,
+			const heaptrace_analyze_opts *opts)
+{
+	int buckets = opts && opts->buckets > 0 ? opts->buckets : 20;
+	int top = opts && opts->top > 0 ? opts->top : 10;
+	trace_data d = {0};
+	if (!read_trace (path, &d)) {
+		free_trace (&d);
+		return false;
+	}
+
+	/* Totals, sizes, the timeline, and the peak */
+	enum { SIZE_BINS = 24 }; /* powers of two, 16 B to 64 MB and up */
+	uint64_t bin_count[SIZE_BINS] = {0}, bin_bytes[SIZE_BINS] = {0};
+	uint64_t ops[TAG_RESET + 1] = {0}, allocated = 0;
+	uint64_t duration = d.count ? d.events[d.count - 1].ns : 0;
+	uint64_t *timeline = calloc ((size_t)buckets, sizeof (uint64_t));
+	if (!timeline) panic ("out of memory");
+	uint64_t peak = 0, peak_ns = 0;
+	size_t peak_at = 0;
+	live_table t = {0};
+	int bucket = 0;
+	for (size_t i = 0; i < d.count; i++) {
+		const event *e = &d.events[i];
+		int b = duration ? (int)(e->ns * (uint64_t)buckets / duration)
+				 : 0;
+		if (b >= buckets) b = buckets - 1;
+		while (bucket < b) timeline[++bucket] = t.bytes;
+		replay (&t, e);
+		ops[e->op]++;
+		if (e->op == TAG_ALLOC || e->op == TAG_REALLOC) {
+			int bin = 0;
+			while (bin < SIZE_BINS - 1 &&
+			       (16ull << bin) < e->size) {
+				bin++;
+			}
+			bin_count[bin]++;
+			bin_bytes[bin] += e->size;
+			allocated += e->size;
+		}
+		if (t.bytes > peak) {
+			peak = t.bytes;
+			peak_ns = e->ns;
+			peak_at = i;
+		}
+		if (t.bytes > timeline[b]) timeline[b] = t.bytes;
+	}
+
+	char buf[32], buf2[32];
+	fprintf (out, "heap trace %s\n", path);
+	fprintf (out, "  %.3f s, %u threads, %u stacks\n", duration / 1e9,
+		 d.threads, d.stack_count);
+	fprintf (out,
+		 "  %llu allocations (%s), %llu frees, %llu reallocations\n",
+		 (unsigned long long)ops[TAG_ALLOC],
+		 format_bytes (allocated, buf, sizeof (buf)),
+		 (unsigned long long)ops[TAG_FREE],
+		 (unsigned long long)ops[TAG_REALLOC]);
+	if (ops[TAG_RESET]) {
+		fprintf (out, "  %llu heap resets\n",
+			 (unsigned long long)ops[TAG_RESET]);
+	}
+	fprintf (out, "  peak %s at %.3f s, %s in %llu blocks at the end\n",
+		 format_bytes (peak, buf, sizeof (buf)), peak_ns / 1e9,
+		 format_bytes (t.bytes, buf2, sizeof (buf2)),
+		 (unsigned long long)t.count);
+
+	fprintf (out, "\nlive heap (the most in each interval)\n");
+	for (int b = 0; b < buckets; b++) {
+		int bar = peak ? (int)(timeline[b] * 40 / peak) : 0;
+		fprintf (out, "  %8.3f s %10s  %.*s\n",
+			 (double)duration * (b + 1) / buckets / 1e9,
+			 format_bytes (timeline[b], buf, sizeof (buf)), bar,
+			 "########################################");
+	}
+
+	fprintf (out, "\nallocation sizes\n");
+	for (int bin = 0; bin < SIZE_BINS; bin++) {
+		if (!bin_count[bin]) continue;
+		fprintf (out, "  %s %10s %10llu %10s\n",
+			 bin < SIZE_BINS - 1 ? "<=" : "> ",
+			 format_bytes (16ull << (bin < SIZE_BINS - 1 ? bin
+								     : bin - 1),
+				       buf, sizeof (buf)),
+			 (unsigned long long)bin_count[bin],
+			 format_bytes (bin_bytes[bin], buf2, sizeof (buf2)));
+	}
+
+	stack_total *totals = calloc (d.stack_count + 1, sizeof (stack_total));
+	if (!totals) panic ("out of memory");
+	size_t n = totals_by_stack (&t, d.stack_count, totals);
+	fprintf (out, "\nleak candidates (never freed, by stack)\n");
+	print_totals (out, &d, totals, n, top);
+
+	/* Replay again, up to the peak */
+	free (t.slots);
+	t = (live_table){0};
+	for (size_t i = 0; d.count && i <= peak_at; i++) {
+		replay (&t, &d.events[i]);
+	}
+	n = totals_by_stack (&t, d.stack_count, totals);
+	fprintf (out, "\nlive at the peak (by stack)\n");
+	print_totals (out, &d, totals, n, top);
+
+	free (totals);
+	free (t.slots);
+	free (timeline);
+	free_trace (&d);
+	return true;
+}
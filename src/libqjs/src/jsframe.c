@@ -0,0 +1,101 @@
+/*
+ * Partikle JavaScript stack frames
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "jsframe.h"
+
+/* A number at the end of text, after a colon: "app.js:3" */
+static bool trailing_number (const char *text, size_t *len, int *n)
+{
+	size_t end = *len, i = end;
+	while (i > 0 && text[i - 1] >= '0' && text[i - 1] <= '9') i--;
+	if (i == end || i < 2 || text[i - 1] != ':' || end - i > 9) {
+		return false;
+	}
+	*n = 0;
+	for (size_t j = i; j < end; j++) *n = *n * 10 + (text[j] - '0');
+	*len = i - 1;
+	return true;
+}
+
+bool js_frame_parse (const char *text, size_t len, js_frame *f)
+{
+	if (len == 0) return false;
+	*f = (js_frame){.name = text, .name_len = len, .file = text + len};
+
+	/* "name (location)" */
+	if (text[len - 1] != ')') return true;
+	const char *open = nullptr;
+	for (size_t i = len - 1; i > 0; i--) {
+		if (text[i] == '(' && text[i - 1] == ' ') {
+			open = text + i;
+			break;
+		}
+	}
+	if (!open) return true;
+	f->name_len = (size_t)(open - 1 - text);
+	f->file = open + 1;
+	f->file_len = (size_t)(text + len - 1 - f->file);
+
+	/* "file:line:column" or "file:line" */
+	int a, b;
+	if (trailing_number (f->file, &f->file_len, &a)) {
+		if (trailing_number (f->file, &f->file_len, &b)) {
+			f->line = b;
+			f->column = a;
+		} else {
+			f->line = a;
+		}
+	}
+	return true;
+}
+
+size_t js_frame_line (const char *text, const char **next)
+{
+	const char *end = strchr (text, '\n');
+	if (!end) {
+		*next = nullptr;
+		return strlen (text);
+	}
+	*next = end + 1;
+	return (size_t)(end - text);
+}
+
+void js_frames_fold (FILE *f, const char *frames)
+{
+	/* innermost first: write them from the last line */
+	size_t end = strlen (frames);
+	while (end > 0) {
+		size_t start = end;
+		while (start > 0 && frames[start - 1] != '\n') start--;
+		fwrite (frames + start, 1, end - start, f);
+		if (start > 0) fputc (';', f);
+		end = start > 0 ? start - 1 : 0;
+	}
+}
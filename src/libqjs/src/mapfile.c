@@ -0,0 +1,70 @@
+/*
+ * Partikle read-only file mappings
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapfile.h"
+
+bool map_fd (int fd, mapped_file *f)
+{
+	struct stat st;
+	if (fstat (fd, &st) < 0) return false;
+	*f = (mapped_file){0};
+	if (st.st_size == 0) return true;
+
+	void *p = mmap (nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+			fd, 0);
+	if (p == MAP_FAILED) return false;
+
+	/* Read once, in order: read ahead, and drop pages behind */
+	madvise (p, (size_t)st.st_size, MADV_SEQUENTIAL);
+	f->data = p;
+	f->len = (size_t)st.st_size;
+	return true;
+}
+
+bool map_file (const char *path, mapped_file *f)
+{
+	int fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	bool ok = map_fd (fd, f);
+	int err = errno;
+	close (fd);
+	errno = err;
+	return ok;
+}
+
+void unmap_file (mapped_file *f)
+{
+	if (f->data) munmap ((void *)f->data, f->len);
+	*f = (mapped_file){0};
+}
@@ -0,0 +1,222 @@
+/*
+ * Partikle JavaScript engine pool
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ * Copyright (c) 2017-2021 Charlie Gordon
+ * Copyright (c) 2017-2021 Fabrice Bellard
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "log.h"
+#include "qjs.h"
+#include "quickjs.h"
+
+typedef struct slot {
+	engine *e; /* null if discarded and not yet replaced */
+	uint32_t uses;
+	bool filling; /* a new engine is being created for it */
+} slot;
+
+struct engine_pool {
+	engine_pool_opts opts;
+	pthread_mutex_t lock;
+	pthread_cond_t available;
+
+	slot *slots;  /* opts.size */
+	size_t *idle; /* indexes of idle slots, most recently released last */
+	size_t idle_count;
+	engine_pool_stats stats;
+};
+
+static uint64_t now_ns ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* A new engine, warmed and snapshotted (called without the lock) */
+static engine *warm_engine (engine_pool *pool, uint64_t *ns)
+{
+	uint64_t start = now_ns ();
+	engine *e = engine_new (&pool->opts.engine);
+	if (!e) return nullptr;
+	if (pool->opts.warm && !pool->opts.warm (e, pool->opts.warm_arg)) {
+		log_error ("engine pool: warming a new engine failed");
+		engine_free (e);
+		return nullptr;
+	}
+	if (!engine_snapshot (e)) {
+		engine_free (e);
+		return nullptr;
+	}
+	*ns = now_ns () - start;
+	return e;
+}
+
+engine_pool *engine_pool_new (const engine_pool_opts *opts)
+{
+	engine_pool *pool = calloc (1, sizeof (*pool));
+	if (!pool) panic ("out of memory");
+	pool->opts = *opts;
+	if (pool->opts.size == 0) pool->opts.size = 1;
+	pool->slots = calloc (pool->opts.size, sizeof (slot));
+	pool->idle = calloc (pool->opts.size, sizeof (size_t));
+	if (!pool->slots || !pool->idle) panic ("out of memory");
+	pthread_mutex_init (&pool->lock, nullptr);
+	pthread_cond_init (&pool->available, nullptr);
+
+	for (size_t i = 0; i < pool->opts.size; i++) {
+		engine *e = warm_engine (pool, &pool->stats.warm_ns);
+		if (!e) {
+			engine_pool_free (pool);
+			return nullptr;
+		}
+		pool->slots[i].e = e;
+		pool->idle[pool->idle_count++] = i;
+		pool->stats.created++;
+	}
+	return pool;
+}
+
+void engine_pool_free (engine_pool *pool)
+{
+	if (!pool) return;
+	for (size_t i = 0; i < pool->opts.size; i++) {
+		engine_free (pool->slots[i].e);
+	}
+	pthread_cond_destroy (&pool->available);
+	pthread_mutex_destroy (&pool->lock);
+	free (pool->idle);
+	free (pool->slots);
+	free (pool);
+}
+
+static slot *find_slot (engine_pool *pool, engine *e)
+{
+	for (size_t i = 0; i < pool->opts.size; i++) {
+		slot *s = &pool->slots[i];
+		if (s->e == e && !s->filling) return s;
+	}
+	return nullptr;
+}
+
+/* Fill an empty slot (one whose replacement failed), with the lock held */
+static engine *fill_slot (engine_pool *pool, slot *s)
+{
+	s->filling = true;
+	pthread_mutex_unlock (&pool->lock);
+	uint64_t ns;
+	engine *e = warm_engine (pool, &ns);
+	pthread_mutex_lock (&pool->lock);
+	s->filling = false;
+	s->e = e;
+	s->uses = 0;
+	if (e) {
+		pool->stats.created++;
+		pool->stats.warm_ns = ns;
+	}
+	return e;
+}
+
+engine *engine_pool_acquire (engine_pool *pool)
+{
+	engine *e = nullptr;
+	pthread_mutex_lock (&pool->lock);
+	if (pool->idle_count == 0) pool->stats.waited++;
+	while (pool->idle_count == 0) {
+		slot *empty = find_slot (pool, nullptr);
+		if (empty) {
+			e = fill_slot (pool, empty);
+			if (!e) pthread_cond_signal (&pool->available);
+			goto done;
+		}
+		pthread_cond_wait (&pool->available, &pool->lock);
+	}
+	e = pool->slots[pool->idle[--pool->idle_count]].e;
+
+done:
+	if (e) pool->stats.acquired++;
+	pthread_mutex_unlock (&pool->lock);
+
+	/* The stack overflow check compares against the stack of the thread
+	   the runtime was last used on */
+	if (e) JS_UpdateStackTop (engine_runtime (e));
+	return e;
+}
+
+static bool healthy (engine_pool *pool, slot *s)
+{
+	if (pool->opts.max_uses && s->uses >= pool->opts.max_uses) {
+		return false;
+	}
+	if (pool->opts.max_heap && s->uses % ENGINE_POOL_HEAP_CHECK == 0) {
+		engine_stats stats;
+		engine_get_stats (s->e, &stats);
+		if (stats.memory_used > pool->opts.max_heap) return false;
+	}
+	return true;
+}
+
+void engine_pool_release (engine_pool *pool, engine *e, bool ok)
+{
+	pthread_mutex_lock (&pool->lock);
+	slot *s = find_slot (pool, e);
+	if (!s) panic ("engine pool: releasing an unknown engine");
+	pthread_mutex_unlock (&pool->lock);
+
+	/* The slot is ours until it's idle again */
+	s->uses++;
+	if (ok && engine_scrub (e) && healthy (pool, s)) {
+		pthread_mutex_lock (&pool->lock);
+		pool->idle[pool->idle_count++] = (size_t)(s - pool->slots);
+		pthread_cond_signal (&pool->available);
+		pthread_mutex_unlock (&pool->lock);
+		return;
+	}
+
+	/* Replace it now, so acquire doesn't wait for a new engine */
+	pthread_mutex_lock (&pool->lock);
+	pool->stats.discarded++;
+	s->e = nullptr;
+	s->filling = true;
+	pthread_mutex_unlock (&pool->lock);
+	engine_free (e);
+
+	pthread_mutex_lock (&pool->lock);
+	if (fill_slot (pool, s)) {
+		pool->idle[pool->idle_count++] = (size_t)(s - pool->slots);
+	}
+	pthread_cond_signal (&pool->available);
+	pthread_mutex_unlock (&pool->lock);
+}
+
+void engine_pool_get_stats (engine_pool *pool, engine_pool_stats *stats)
+{
+	pthread_mutex_lock (&pool->lock);
+	*stats = pool->stats;
+	pthread_mutex_unlock (&pool->lock);
+}
@@ -0,0 +1,194 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Benchmarks
+ *
+ * Benchmarks are organized like tests (see test.h): a suite function calls
+ * benchmark() for each benchmark function, and main() passes an array of
+ * suites to run_benches().
+ *
+ * A benchmark function receives a bench and must run the code being measured
+ * b->n times (the harness calibrates n so that each sample runs long enough
+ * to time accurately):
+ *
+ *     static void bench_vector_add (bench *b)
+ *     {
+ *             vector v;
+ *             vector_init (&v);
+ *             for (uint64_t i = 0; i < b->n; i++) vector_add (&v, &v);
+ *             bench_timer_stop (b);
+ *             vector_free (&v);
+ *     }
+ *
+ *     void adt_bench ()
+ *     {
+ *             benchmark (bench_vector_add);
+ *     }
+ *
+ * Each benchmark is calibrated, warmed up, then sampled BENCH_SAMPLES times.
+ * Results report ns/op median, p99, and median absolute deviation (MAD),
+ * and allocs/op if an allocation counter is registered.
+ * With --json FILE, results (including every sample) are also written as
+ * JSON for regression tracking.
+ *
+ * Use bench_keep() on results the compiler could otherwise discard, and
+ * bench_clobber() to force pending writes to memory.
+ */
+
+/* target duration of one sample (calibration goal) */
+#ifndef BENCH_SAMPLE_NS
+#define BENCH_SAMPLE_NS 2000000ULL
+#endif
+
+/* minimum time spent running the benchmark before sampling */
+#ifndef BENCH_WARMUP_NS
+#define BENCH_WARMUP_NS 20000000ULL
+#endif
+
+/* number of samples per benchmark */
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES 30
+#endif
+
+typedef struct bench {
+	const char *name;
+
+	/* number of iterations the benchmark function must run */
+	uint64_t n;
+
+	/* timer state (use bench_timer_start/bench_timer_stop) */
+	uint64_t start;
+	uint64_t elapsed;
+	bool timing;
+} bench;
+
+typedef void (*bench_func) (bench *b);
+
+typedef struct bench_suite {
+	char *name;
+	void (*fn) (void);
+	bool skip;
+} bench_suite;
+
+typedef struct bench_stats {
+	size_t count;
+	double min;
+	double max;
+	double mean;
+	double median;
+	double p99;
+	double mad; /* median absolute deviation */
+} bench_stats;
+
+/**
+ * Monotonic time in nanoseconds. Uses clock_gettime, or rdtsc (calibrated
+ * against clock_gettime) when compiled with BENCH_USE_RDTSC on x86.
+ */
+uint64_t bench_now ();
+
+/**
+ * Name of the timer used by bench_now ("clock_gettime" or "rdtsc").
+ */
+const char *bench_timer_name ();
+
+/**
+ * Pause timing (e.g., to exclude teardown), and resume it.
+ */
+void bench_timer_stop (bench *b);
+void bench_timer_start (bench *b);
+
+/**
+ * Calibrate, warm up, sample, and record a benchmark in the current suite.
+ */
+void bench_run (const char *name, bench_func fn);
+
+#define benchmark(fn) bench_run (#fn, fn)
+
+/**
+ * Count heap allocations made while benchmarks run. A benchmark program can
+ * register a function that returns the number of allocations made so far
+ * (e.g., from a counting malloc wrapper); results then include allocs/op.
+ */
+typedef uint64_t (*bench_alloc_counter) (void);
+
+void bench_set_alloc_counter (bench_alloc_counter fn);
+
+/**
+ * Compute summary statistics over samples (the array is sorted in place).
+ */
+bench_stats bench_compute_stats (double *samples, size_t count);
+
+/**
+ * Two-sided Mann-Whitney U test (normal approximation with tie correction)
+ * of whether samples a and b come from the same distribution. Returns the
+ * p-value; small values (e.g., < 0.05) mean the difference is significant.
+ * Neither array is modified. Returns 1.0 if either array is empty.
+ */
+double bench_mann_whitney (const double *a, size_t na, const double *b,
+			   size_t nb);
+
+/**
+ * Run the suites and print a summary table. Options:
+ *
+ *     --json FILE    also write results (with all samples) as JSON to FILE
+ *     --filter STR   only run benchmarks whose name contains STR
+ *
+ * Returns EXIT_SUCCESS or EXIT_FAILURE (for invalid options).
+ */
+int run_benches (const bench_suite *suites, int argc, char **argv);
+
+/**
+ * Optimization barriers
+ */
+
+/* pretend to read p, so the compiler can't discard whatever it points to */
+static inline void bench_escape (void *p)
+{
+	__asm__ volatile ("" : : "g"(p) : "memory");
+}
+
+/* pretend to read and write all memory */
+static inline void bench_clobber ()
+{
+	__asm__ volatile ("" : : : "memory");
+}
+
+/* keep the value of an expression (like benchmark::DoNotOptimize) */
+#define bench_keep(expr)                                                       \
+	do {                                                                   \
+		__typeof__ (expr) bench_keep_ = (expr);                        \
+		bench_escape (&bench_keep_);                                   \
+	} while (0)
+
+#endif /* BENCH_H */
@@ -28,6 +28,7 @@
 #define LOG_H
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -76,8 +77,9 @@
  *
  *    The LOG macro dynamically checks the value of the environment variable
  *    `LOG_LEVEL` at runtime (the value is case-insensitive and must be one of
- *    "none"|"error"|"info"|"debug"|"trace"; the default is none. The trade-off
- *    for using LOG is convenience over performance and binary size.
+ *    "none"|"error"|"info"|"debug"|"trace"; the default is none. The variable
+ *    is read once, on first use. The trade-off for using LOG is convenience
+ *    over performance and binary size.
  *
  * 1. EXIT_FAILURE regardless of LOG_LEVEL. The only difference
  *    is that PANIC prints a stack trace. Using the macros
@@ -99,6 +101,16 @@
  *    top of main(). This is recommended even if you don't
  *    explicitly invoke panic() in any code.
  *
+ * 6. Every ERROR, WARN, INFO, DEBUG, TRACE, LOG and TODO call
+ *    site is rate limited by a token bucket stored in a static
+ *    log_site struct private to that call site. Messages over
+ *    the limit are dropped and counted; the next message that
+ *    gets through is preceded by a "suppressed N messages"
+ *    line. DEBUG and TRACE sites are additionally sampled
+ *    1-in-N. The bucket is only touched after the level check
+ *    passes, so sites that aren't firing pay nothing. See
+ *    log_set_rate_limit() and log_set_sampling().
+ *
  */
 
 #define LOG_LEVEL_NONE 0
@@ -164,6 +176,88 @@ static inline void trace (const char *fmt, ...)
 	va_end (args);
 }
 
+/**
+ * Default per call site rate limit: a site may burst up to
+ * LOG_RATE_BURST messages, then is refilled at LOG_RATE_PER_SEC
+ * messages per second. Override at compile time or at runtime
+ * with log_set_rate_limit(). A rate of 0 disables rate limiting.
+ */
+#ifndef LOG_RATE_BURST
+#define LOG_RATE_BURST 100
+#endif
+
+#ifndef LOG_RATE_PER_SEC
+#define LOG_RATE_PER_SEC 100
+#endif
+
+/**
+ * Default 1-in-N sampling for DEBUG and TRACE sites (1 means
+ * every message is kept). Override at compile time or at
+ * runtime with log_set_sampling().
+ */
+#ifndef LOG_SAMPLE_EVERY
+#define LOG_SAMPLE_EVERY 1
+#endif
+
+/**
+ * Per call site logging state. The macros below declare one
+ * of these as a zero-initialized static at each call site, so
+ * it costs nothing until the site actually fires.
+ */
+typedef struct log_site {
+	uint64_t last_ns; /* time of last refill, 0 until first use */
+	uint64_t tokens; /* available tokens (fixed point) */
+	uint64_t hits; /* messages seen, for sampling */
+	uint64_t suppressed; /* messages dropped since the last one logged */
+} log_site;
+
+/**
+ * Set the per call site token bucket for all sites. A rate of 0
+ * disables rate limiting.
+ */
+void log_set_rate_limit (unsigned burst, unsigned per_sec);
+
+/**
+ * Keep 1 in every n DEBUG and TRACE messages per call site
+ * (n <= 1 keeps all of them).
+ */
+void log_set_sampling (unsigned n);
+
+/**
+ * Return true if a message from this site should be logged,
+ * otherwise count it as suppressed (sampled messages are not
+ * counted as suppressed).
+ */
+bool log_site_admit (log_site *site, int level);
+
+/**
+ * Print the "LEVEL: {filename}:{line}: {function}(): " prefix
+ * to stderr, preceded by a summary line if messages from this
+ * site were suppressed since the last one was logged.
+ */
+void log_site_prefix (log_site *site, const char *level, const char *file,
+		      int line, const char *func);
+
+/**
+ * Return the log level from the LOG_LEVEL environment variable.
+ * The variable is only read on the first call.
+ */
+int log_env_level ();
+
+/**
+ * Log a message through a rate limited call site (used by the
+ * macros below).
+ */
+#define LOG_SITE(log_level, label, format, ...)                                \
+	do {                                                                   \
+		static log_site log_site_;                                     \
+		if (log_site_admit (&log_site_, log_level)) {                  \
+			log_site_prefix (&log_site_, label, __FILE_NAME__,     \
+					 __LINE__, __func__);                  \
+			trace (format __VA_OPT__ (, ) __VA_ARGS__);            \
+		}                                                              \
+	} while (0)
+
 /**
  * MACROS
  */
@@ -189,9 +283,7 @@ static inline void trace (const char *fmt, ...)
  */
 #if defined(LOG_LEVEL) && LOG_LEVEL >= LOG_LEVEL_ERROR
 #define ERROR(format, ...)                                                     \
-	fprintf (stderr, "ERROR: %s:%d: %s(): ", __FILE_NAME__, __LINE__,      \
-		 __func__);                                                    \
-	trace (format __VA_OPT__ (, ) __VA_ARGS__)
+	LOG_SITE (LOG_LEVEL_ERROR, "ERROR", format __VA_OPT__ (, ) __VA_ARGS__)
 #else
 #define ERROR(format, ...)
 #endif /* LOG_LEVEL >= LOG_LEVEL_ERROR */
@@ -201,9 +293,7 @@ static inline void trace (const char *fmt, ...)
  */
 #if defined(LOG_LEVEL) && LOG_LEVEL >= LOG_LEVEL_WARN
 #define WARN(format, ...)                                                      \
-	fprintf (stderr, "WARN : %s:%d: %s(): ", __FILE_NAME__, __LINE__,      \
-		 __func__);                                                    \
-	trace (format __VA_OPT__ (, ) __VA_ARGS__)
+	LOG_SITE (LOG_LEVEL_WARN, "WARN ", format __VA_OPT__ (, ) __VA_ARGS__)
 #else
 #define WARN(format, ...)
 #endif /* LOG_LEVEL >= LOG_LEVEL_WARN */
@@ -213,9 +303,7 @@ static inline void trace (const char *fmt, ...)
  */
 #if defined(LOG_LEVEL) && LOG_LEVEL >= LOG_LEVEL_INFO
 #define INFO(format, ...)                                                      \
-	fprintf (stderr, "INFO : %s:%d: %s(): ", __FILE_NAME__, __LINE__,      \
-		 __func__);                                                    \
-	trace (format __VA_OPT__ (, ) __VA_ARGS__)
+	LOG_SITE (LOG_LEVEL_INFO, "INFO ", format __VA_OPT__ (, ) __VA_ARGS__)
 #else
 #define INFO(format, ...)
 #endif /* LOG_LEVEL >= LOG_LEVEL_INFO */
@@ -225,9 +313,7 @@ static inline void trace (const char *fmt, ...)
  */
 #if defined(LOG_LEVEL) && LOG_LEVEL >= LOG_LEVEL_DEBUG
 #define DEBUG(format, ...)                                                     \
-	fprintf (stderr, "DEBUG: %s:%d: %s(): ", __FILE_NAME__, __LINE__,      \
-		 __func__);                                                    \
-	trace (format __VA_OPT__ (, ) __VA_ARGS__)
+	LOG_SITE (LOG_LEVEL_DEBUG, "DEBUG", format __VA_OPT__ (, ) __VA_ARGS__)
 #else
 #define DEBUG(format, ...)
 #endif /* LOG_LEVEL >= LOG_LEVEL_DEBUG */
@@ -237,9 +323,7 @@ static inline void trace (const char *fmt, ...)
  */
 #if defined(LOG_LEVEL) && LOG_LEVEL >= LOG_LEVEL_TRACE
 #define TRACE(format, ...)                                                     \
-	fprintf (stderr, "TRACE: %s:%d: %s(): ", __FILE_NAME__, __LINE__,      \
-		 __func__);                                                    \
-	trace (format __VA_OPT__ (, ) __VA_ARGS__)
+	LOG_SITE (LOG_LEVEL_TRACE, "TRACE", format __VA_OPT__ (, ) __VA_ARGS__)
 #else
 #define TRACE(format, ...)
 #endif /* LOG_LEVEL >= LOG_LEVEL_TRACE */
@@ -250,30 +334,10 @@ static inline void trace (const char *fmt, ...)
 #define LOG(log_level, format, ...)                                            \
 	do {                                                                   \
 		int ll = (int)log_level;                                       \
-		char *env_level_str = getenv ("LOG_LEVEL");                    \
-		int env_level = LOG_LEVEL_NONE;                                \
-		if (env_level_str == nullptr) {                                \
-			/* do nothing */                                       \
-		} else if (strncasecmp (env_level_str, "error", 5) == 0) {     \
-			env_level = LOG_LEVEL_ERROR;                           \
-		} else if (strncasecmp (env_level_str, "warn", 4) == 0) {      \
-			env_level = LOG_LEVEL_WARN;                            \
-		} else if (strncasecmp (env_level_str, "info", 4) == 0) {      \
-			env_level = LOG_LEVEL_INFO;                            \
-		} else if (strncasecmp (env_level_str, "debug", 5) == 0) {     \
-			env_level = LOG_LEVEL_DEBUG;                           \
-		} else if (strncasecmp (env_level_str, "trace", 5) == 0) {     \
-			env_level = LOG_LEVEL_TRACE;                           \
-		} else if (strncasecmp (env_level_str, "todo", 4) == 0) {      \
-			env_level = LOG_LEVEL_TODO;                            \
-		} else {                                                       \
-			/* do nothing */                                       \
-		}                                                              \
 		if (ll == LOG_LEVEL_TODO) {                                    \
-			fprintf (stderr, "%s: %s:%d: %s(): ", "TODO ",         \
-				 __FILE_NAME__, __LINE__, __func__);           \
-			trace (format __VA_OPT__ (, ) __VA_ARGS__);            \
-		} else if (env_level >= ll) {                                  \
+			LOG_SITE (ll, "TODO ", format __VA_OPT__ (, )          \
+					  __VA_ARGS__);                        \
+		} else if (log_env_level () >= ll) {                           \
 			char *level = nullptr;                                 \
 			switch (ll) {                                          \
 			case LOG_LEVEL_ERROR: level = "ERROR"; break;          \
@@ -284,9 +348,8 @@ static inline void trace (const char *fmt, ...)
 			default: /* do nothing */                              \
 			}                                                      \
 			if (level != nullptr) {                                \
-				fprintf (stderr, "%s: %s:%d: %s(): ", level,   \
-					 __FILE_NAME__, __LINE__, __func__);   \
-				trace (format __VA_OPT__ (, ) __VA_ARGS__);    \
+				LOG_SITE (ll, level, format __VA_OPT__ (, )    \
+						  __VA_ARGS__);                \
 			}                                                      \
 		}                                                              \
 	} while (0)
@@ -0,0 +1,111 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+
+/**
+ * Sampling CPU profiler for native code.
+ *
+ * While running, each registered thread receives SIGPROF at the configured
+ * rate (per-thread CPU time timers via timer_create on Linux, a process-wide
+ * setitimer(ITIMER_PROF) elsewhere). The signal handler captures the native
+ * stack with backtrace() into a lock-free, single-producer ring buffer owned
+ * by that thread, so the handler never locks or allocates.
+ *
+ * Samples are drained from the rings and aggregated by stack whenever
+ * profiler_drain() or profiler_write_folded() is called. The folded output
+ * (one "frame;frame;frame count" line per unique stack, root first) can be
+ * fed directly to flamegraph.pl or speedscope.
+ *
+ * At the default 99 Hz, the cost is one backtrace() per thread roughly every
+ * 10ms of CPU time; compare a run with and without the profiler to see what
+ * that costs a given workload.
+ *
+ * Usage:
+ *
+ *     profiler_start (PROFILER_DEFAULT_HZ);
+ *     ...
+ *     profiler_stop ();
+ *     profiler_write_folded (f);
+ *     profiler_reset ();
+ *
+ * Threads other than the one that called profiler_start() must call
+ * profiler_register_thread() to be sampled (on Linux). A registered thread's
+ * timer and ring are released when it exits (its samples are kept).
+ */
+
+#define PROFILER_DEFAULT_HZ 99
+
+/**
+ * Start sampling the calling thread (and any threads registered later) at
+ * the given rate. Returns false if already running or if the timer could not
+ * be created.
+ */
+bool profiler_start (unsigned hz);
+
+/**
+ * Stop sampling. Collected samples are kept until profiler_reset().
+ */
+void profiler_stop ();
+
+/**
+ * Return true while the profiler is sampling.
+ */
+bool profiler_running ();
+
+/**
+ * Start sampling the calling thread. Call this at the top of any thread that
+ * should be profiled; it's a no-op if the thread is already registered.
+ */
+bool profiler_register_thread ();
+
+/**
+ * Move samples from the per-thread ring buffers into the aggregate. Call
+ * periodically for long profiling sessions so the rings don't overflow
+ * (overflowing samples are dropped and counted).
+ */
+void profiler_drain ();
+
+/**
+ * Drain, then write aggregated stacks in folded format. Returns the number
+ * of samples written.
+ */
+size_t profiler_write_folded (FILE *f);
+
+/**
+ * Number of samples dropped because a ring buffer was full.
+ */
+size_t profiler_dropped ();
+
+/**
+ * Discard all aggregated samples.
+ */
+void profiler_reset ();
+
+#endif /* PROFILER_H */
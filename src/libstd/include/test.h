@@ -66,6 +66,25 @@ static inline void run_tests (const test_suite *tests)
 	}
 }
 
+/**
+ * Run test suites in parallel, each one isolated in its own child process
+ * (so a failing expect_* or a crash only fails that suite). Output from each
+ * suite is captured and printed as a block when the suite finishes, followed
+ * by a summary with per-suite durations and the slowest suites.
+ *
+ * Options:
+ *
+ *     --jobs N       run up to N suites at once (default: online CPUs)
+ *     --filter STR   only run suites whose name contains STR
+ *     --shard I/N    only run the I-th of N shards (1-based), for CI
+ *     --slowest N    list the N slowest suites (default: 5)
+ *     --serial       run suites in-process, one at a time (for debugging)
+ *
+ * Returns EXIT_SUCCESS if all selected suites passed, otherwise
+ * EXIT_FAILURE.
+ */
+int run_test_suites (const test_suite *tests, int argc, char **argv);
+
 
 /**
  * Test expectations
@@ -40,6 +40,8 @@ bool vector_add (vector *v, void *item);
 void vector_set (const vector *v, size_t index, void *item);
 void *vector_get (const vector *v, size_t index);
 bool vector_delete (vector *v, size_t index);
+/* remove all items, keeping the storage for reuse */
+void vector_clear (vector *v);
 void vector_free (vector *v);
 size_t vector_size (const vector *v);
 
@@ -0,0 +1,411 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(BENCH_USE_RDTSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_RDTSC 1
+#endif
+
+#include "bench.h"
+#include "log.h"
+#include "vector.h"
+
+typedef struct bench_result {
+	const char *suite;
+	const char *name;
+	uint64_t n;
+	double samples[BENCH_SAMPLES]; /* ns/op */
+	double sorted[BENCH_SAMPLES];
+	bench_stats stats;
+	double allocs; /* per op, or -1 if not counted */
+} bench_result;
+
+/* results for all benchmarks run so far */
+static vector results;
+static bool results_ready;
+
+static const char *current_suite;
+static const char *filter;
+static bench_alloc_counter alloc_counter;
+
+
+static uint64_t clock_now ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+#if defined(BENCH_RDTSC)
+/* nanoseconds per tick, measured once against clock_gettime */
+static double ns_per_tick;
+
+static void rdtsc_calibrate ()
+{
+	const uint64_t t0 = clock_now ();
+	const uint64_t c0 = __rdtsc ();
+	while (clock_now () - t0 < 10000000ULL) {}
+	const uint64_t t1 = clock_now ();
+	const uint64_t c1 = __rdtsc ();
+	ns_per_tick = (double)(t1 - t0) / (double)(c1 - c0);
+}
+#endif
+
+
+uint64_t bench_now ()
+{
+#if defined(BENCH_RDTSC)
+	if (ns_per_tick == 0) rdtsc_calibrate ();
+	return (uint64_t)((double)__rdtsc () * ns_per_tick);
+#else
+	return clock_now ();
+#endif
+}
+
+
+const char *bench_timer_name ()
+{
+#if defined(BENCH_RDTSC)
+	return "rdtsc";
+#else
+	return "clock_gettime";
+#endif
+}
+
+
+void bench_timer_stop (bench *b)
+{
+	if (!b->timing) return;
+	b->elapsed += bench_now () - b->start;
+	b->timing = false;
+}
+
+
+void bench_timer_start (bench *b)
+{
+	if (b->timing) return;
+	b->start = bench_now ();
+	b->timing = true;
+}
+
+
+void bench_set_alloc_counter (bench_alloc_counter fn)
+{
+	alloc_counter = fn;
+}
+
+
+/* run fn once with n iterations and return the timed duration in ns */
+static uint64_t bench_once (const char *name, bench_func fn, uint64_t n)
+{
+	bench b = {.name = name, .n = n};
+	bench_timer_start (&b);
+	fn (&b);
+	bench_timer_stop (&b);
+	return b.elapsed > 0 ? b.elapsed : 1;
+}
+
+
+/* find n so that one run takes about BENCH_SAMPLE_NS */
+static uint64_t bench_calibrate (const char *name, bench_func fn)
+{
+	uint64_t n = 1;
+	for (;;) {
+		const uint64_t ns = bench_once (name, fn, n);
+		if (ns >= BENCH_SAMPLE_NS) return n;
+
+		/* predict from the last run, with headroom, but grow at most
+		 * 100x per step in case the first runs were noisy */
+		uint64_t next =
+			(uint64_t)((double)n * BENCH_SAMPLE_NS / ns * 1.2);
+		if (next > n * 100) next = n * 100;
+		if (next <= n) next = n + 1;
+		n = next;
+	}
+}
+
+
+static int compare_doubles (const void *a, const void *b)
+{
+	const double x = *(const double *)a;
+	const double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+
+/* linear interpolation between closest ranks (sorted must be sorted) */
+static double percentile (const double *sorted, size_t count, double p)
+{
+	if (count == 0) return 0;
+	const double rank = p * (double)(count - 1);
+	const size_t lo = (size_t)rank;
+	const size_t hi = lo + 1 < count ? lo + 1 : lo;
+	const double frac = rank - (double)lo;
+	return sorted[lo] + (sorted[hi] - sorted[lo]) * frac;
+}
+
+
+bench_stats bench_compute_stats (double *samples, size_t count)
+{
+	bench_stats stats = {.count = count};
+	if (count == 0) return stats;
+
+	qsort (samples, count, sizeof (double), compare_doubles);
+
+	double sum = 0;
+	for (size_t i = 0; i < count; i++) sum += samples[i];
+
+	stats.min = samples[0];
+	stats.max = samples[count - 1];
+	stats.mean = sum / (double)count;
+	stats.median = percentile (samples, count, 0.5);
+	stats.p99 = percentile (samples, count, 0.99);
+
+	double *deviations = malloc (sizeof (double) * count);
+	if (deviations == nullptr) panic ("out of memory");
+	for (size_t i = 0; i < count; i++) {
+		const double d = samples[i] - stats.median;
+		deviations[i] = d < 0 ? -d : d;
+	}
+	qsort (deviations, count, sizeof (double), compare_doubles);
+	stats.mad = percentile (deviations, count, 0.5);
+	free (deviations);
+
+	return stats;
+}
+
+
+typedef struct ranked {
+	double value;
+	bool first; /* from the first sample */
+} ranked;
+
+static int compare_ranked (const void *a, const void *b)
+{
+	const double x = ((const ranked *)a)->value;
+	const double y = ((const ranked *)b)->value;
+	return (x > y) - (x < y);
+}
+
+double bench_mann_whitney (const double *a, size_t na, const double *b,
+			   size_t nb)
+{
+	if (na == 0 || nb == 0) return 1.0;
+
+	const size_t n = na + nb;
+	ranked *all = malloc (sizeof (ranked) * n);
+	if (all == nullptr) panic ("out of memory");
+	for (size_t i = 0; i < na; i++) all[i] = (ranked){a[i], true};
+	for (size_t i = 0; i < nb; i++) all[na + i] = (ranked){b[i], false};
+	qsort (all, n, sizeof (ranked), compare_ranked);
+
+	/* rank sum of the first sample, averaging ranks over ties */
+	double rank_sum = 0;
+	double ties = 0; /* sum of t^3 - t over tie groups */
+	for (size_t i = 0; i < n;) {
+		size_t j = i;
+		while (j + 1 < n && all[j + 1].value == all[i].value) j++;
+		const double rank = (double)(i + j) / 2.0 + 1.0;
+		const double t = (double)(j - i + 1);
+		ties += t * t * t - t;
+		for (size_t k = i; k <= j; k++) {
+			if (all[k].first) rank_sum += rank;
+		}
+		i = j + 1;
+	}
+	free (all);
+
+	const double n1 = (double)na, n2 = (double)nb, nn = (double)n;
+	const double u = rank_sum - n1 * (n1 + 1) / 2.0;
+	const double mean = n1 * n2 / 2.0;
+	const double var =
+		n1 * n2 / 12.0 * ((nn + 1) - ties / (nn * (nn - 1)));
+	if (var <= 0) return 1.0;
+
+	/* continuity correction */
+	double diff = fabs (u - mean) - 0.5;
+	if (diff < 0) diff = 0;
+	return erfc (diff / sqrt (var) / sqrt (2.0));
+}
+
+
+void bench_run (const char *name, bench_func fn)
+{
+	if (filter != nullptr && strstr (name, filter) == nullptr) return;
+
+	if (!results_ready) {
+		vector_init (&results);
+		results_ready = true;
+	}
+
+	bench_result *r = calloc (1, sizeof (bench_result));
+	if (r == nullptr) panic ("out of memory");
+	r->suite = current_suite;
+	r->name = name;
+
+	printf ("▷ %s ... ", name);
+	fflush (stdout);
+
+	r->n = bench_calibrate (name, fn);
+
+	/* warm up caches, branch predictors, and CPU frequency */
+	const uint64_t warmup_start = bench_now ();
+	while (bench_now () - warmup_start < BENCH_WARMUP_NS) {
+		bench_once (name, fn, r->n);
+	}
+
+	for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+		const uint64_t ns = bench_once (name, fn, r->n);
+		r->samples[i] = (double)ns / (double)r->n;
+	}
+
+	/* count allocations in a separate, untimed run */
+	r->allocs = -1;
+	if (alloc_counter != nullptr) {
+		const uint64_t before = alloc_counter ();
+		bench_once (name, fn, r->n);
+		r->allocs = (double)(alloc_counter () - before) / (double)r->n;
+	}
+
+	memcpy (r->sorted, r->samples, sizeof (r->samples));
+	r->stats = bench_compute_stats (r->sorted, BENCH_SAMPLES);
+
+	printf ("\r\x1b[K  %-36s %12.1f ns/op  (p99 %.1f, mad %.1f, n %llu",
+		name, r->stats.median, r->stats.p99, r->stats.mad,
+		(unsigned long long)r->n);
+	if (r->allocs >= 0) printf (", allocs %.1f", r->allocs);
+	printf (")\n");
+
+	vector_add (&results, r);
+}
+
+
+static void write_json_string (FILE *f, const char *s)
+{
+	fputc ('"', f);
+	for (; s != nullptr && *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') {
+			fprintf (f, "\\%c", *s);
+		} else if ((unsigned char)*s < 0x20) {
+			fprintf (f, "\\u%04x", *s);
+		} else {
+			fputc (*s, f);
+		}
+	}
+	fputc ('"', f);
+}
+
+
+static void write_json (FILE *f)
+{
+	fprintf (f, "{\n  \"version\": 1,\n  \"unit\": \"ns/op\",\n");
+	fprintf (f, "  \"timer\": \"%s\",\n  \"benchmarks\": [",
+		 bench_timer_name ());
+
+	const size_t count = results_ready ? vector_size (&results) : 0;
+	for (size_t i = 0; i < count; i++) {
+		const bench_result *r = vector_get (&results, i);
+		fprintf (f, "%s\n    {\"suite\": ", i > 0 ? "," : "");
+		write_json_string (f, r->suite);
+		fprintf (f, ", \"name\": ");
+		write_json_string (f, r->name);
+		const bench_stats *st = &r->stats;
+		fprintf (f,
+			 ", \"iterations\": %llu, \"median\": %.3f, "
+			 "\"p99\": %.3f, \"mad\": %.3f, \"mean\": %.3f, "
+			 "\"min\": %.3f, \"max\": %.3f",
+			 (unsigned long long)r->n, st->median, st->p99, st->mad,
+			 st->mean, st->min, st->max);
+		if (r->allocs >= 0) {
+			fprintf (f, ", \"allocs\": %.3f", r->allocs);
+		}
+		fprintf (f, ",\n     \"samples\": [");
+		for (size_t j = 0; j < BENCH_SAMPLES; j++) {
+			fprintf (f, "%s%.3f", j > 0 ? ", " : "", r->samples[j]);
+		}
+		fprintf (f, "]}");
+	}
+	fprintf (f, "\n  ]\n}\n");
+}
+
+
+int run_benches (const bench_suite *suites, int argc, char **argv)
+{
+	const char *json_path = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp (argv[i], "--json") == 0 && i + 1 < argc) {
+			json_path = argv[++i];
+		} else if (strcmp (argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else {
+			log_error ("usage: %s [--json FILE] [--filter STR]",
+				   argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf ("Running benchmarks (timer: %s)\n\n", bench_timer_name ());
+
+	for (const bench_suite *s = suites; s != nullptr && s->name; s++) {
+		printf ("▶︎ %s", s->name);
+		if (s->skip) {
+			printf (" ... skipped\n\n");
+			continue;
+		}
+		printf ("\n");
+		current_suite = s->name;
+		s->fn ();
+		printf ("\n");
+	}
+
+	if (json_path != nullptr) {
+		FILE *f = fopen (json_path, "w");
+		if (f == nullptr) {
+			log_error ("unable to write %s", json_path);
+			return EXIT_FAILURE;
+		}
+		write_json (f);
+		fclose (f);
+		printf ("Results written to %s\n", json_path);
+	}
+
+	if (results_ready) {
+		for (size_t i = 0; i < vector_size (&results); i++) {
+			free (vector_get (&results, i));
+		}
+		vector_free (&results);
+		results_ready = false;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -24,16 +24,25 @@
  * THE SOFTWARE.
  */
 
+#include <ctype.h>
 #include <execinfo.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "log.h"
 
 #include <stdarg.h>
 
+/* fixed point scale for token bucket arithmetic (1 token) */
+#define LOG_TOKEN_SCALE 1000000ULL
+
+static unsigned log_rate_burst = LOG_RATE_BURST;
+static unsigned log_rate_per_sec = LOG_RATE_PER_SEC;
+static unsigned log_sample_every = LOG_SAMPLE_EVERY;
+
 
 void log_info (const char *fmt, ...)
 {
@@ -88,6 +97,123 @@ void log_error (const char *fmt, ...)
 }
 
 
+void log_set_rate_limit (unsigned burst, unsigned per_sec)
+{
+	log_rate_burst = burst > 0 ? burst : 1;
+	log_rate_per_sec = per_sec;
+}
+
+
+void log_set_sampling (unsigned n)
+{
+	log_sample_every = n > 0 ? n : 1;
+}
+
+
+static uint64_t log_now_ns ()
+{
+	struct timespec ts;
+#if defined(CLOCK_MONOTONIC_COARSE)
+	clock_gettime (CLOCK_MONOTONIC_COARSE, &ts);
+#else
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+#endif
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+/*
+ * Sites are not locked: if two threads race on the same site, the worst case
+ * is that one extra message is logged or dropped, which is fine for logging.
+ */
+bool log_site_admit (log_site *site, int level)
+{
+	/* 1-in-N sampling for debug and trace (not counted as suppressed) */
+	if (level >= LOG_LEVEL_DEBUG && log_sample_every > 1 &&
+	    site->hits++ % log_sample_every != 0) {
+		return false;
+	}
+
+	if (log_rate_per_sec == 0) return true;
+
+	const uint64_t capacity = log_rate_burst * LOG_TOKEN_SCALE;
+	const uint64_t now = log_now_ns ();
+
+	if (site->last_ns == 0) {
+		/* first use: start with a full bucket */
+		site->tokens = capacity;
+	} else if (now > site->last_ns) {
+		/* refill for elapsed time, capped at the time it takes to fill
+		 * an empty bucket (also keeps the arithmetic from overflowing) */
+		const uint64_t ns_per_unit = 1000000000ULL / LOG_TOKEN_SCALE;
+		const uint64_t fill_ns =
+			capacity * ns_per_unit / log_rate_per_sec;
+		uint64_t elapsed = now - site->last_ns;
+		if (elapsed > fill_ns) elapsed = fill_ns;
+		site->tokens += elapsed * log_rate_per_sec / ns_per_unit;
+		if (site->tokens > capacity) site->tokens = capacity;
+	}
+	site->last_ns = now;
+
+	if (site->tokens < LOG_TOKEN_SCALE) {
+		site->suppressed++;
+		return false;
+	}
+	site->tokens -= LOG_TOKEN_SCALE;
+	return true;
+}
+
+
+void log_site_prefix (log_site *site, const char *level, const char *file,
+		      int line, const char *func)
+{
+	if (site->suppressed > 0) {
+		fprintf (stderr, "%s: %s:%d: %s(): suppressed %llu messages\n",
+			 level, file, line, func,
+			 (unsigned long long)site->suppressed);
+		site->suppressed = 0;
+	}
+	fprintf (stderr, "%s: %s:%d: %s(): ", level, file, line, func);
+}
+
+
+/* Whether s starts with word, ignoring case (libstd's strings.h shadows the
+   system header that declares strncasecmp) */
+static bool starts_with_word (const char *s, const char *word)
+{
+	for (; *word; s++, word++) {
+		if (tolower ((unsigned char)*s) != *word) return false;
+	}
+	return true;
+}
+
+int log_env_level ()
+{
+	static int env_level = -2; /* not yet read */
+	if (env_level != -2) return env_level;
+
+	int level = LOG_LEVEL_NONE;
+	const char *env_level_str = getenv ("LOG_LEVEL");
+	if (env_level_str == nullptr) {
+		/* do nothing */
+	} else if (starts_with_word (env_level_str, "error")) {
+		level = LOG_LEVEL_ERROR;
+	} else if (starts_with_word (env_level_str, "warn")) {
+		level = LOG_LEVEL_WARN;
+	} else if (starts_with_word (env_level_str, "info")) {
+		level = LOG_LEVEL_INFO;
+	} else if (starts_with_word (env_level_str, "debug")) {
+		level = LOG_LEVEL_DEBUG;
+	} else if (starts_with_word (env_level_str, "trace")) {
+		level = LOG_LEVEL_TRACE;
+	} else if (starts_with_word (env_level_str, "todo")) {
+		level = LOG_LEVEL_TODO;
+	}
+	env_level = level;
+	return env_level;
+}
+
+
 void log_stack_trace ()
 {
 	void *buffer[1024];
@@ -0,0 +1,454 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* for dladdr() and Dl_info on glibc */
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "log.h"
+#include "map.h"
+#include "profiler.h"
+#include "strings.h"
+
+/*
+ * Each profiled thread owns a ring of samples. The SIGPROF handler running
+ * on that thread is the only producer and profiler_drain() (serialized by
+ * drain_lock) is the only consumer, so head/tail atomics are all that's
+ * needed: the handler never locks or allocates.
+ *
+ * When a registered thread exits, its ring is drained, its timer deleted,
+ * and its slot freed for the next thread to register. drain_lock also
+ * guards the slots.
+ */
+
+#define PROFILER_MAX_THREADS 64
+#define PROFILER_MAX_FRAMES 48
+#define PROFILER_RING_SIZE 512 /* must be a power of 2 */
+
+/* frames for the signal handler and the signal trampoline */
+#define PROFILER_SKIP_FRAMES 2
+
+#if defined(__linux__) && !defined(sigev_notify_thread_id)
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+typedef struct profiler_sample {
+	int depth;
+	void *frames[PROFILER_MAX_FRAMES];
+} profiler_sample;
+
+typedef struct profiler_ring {
+	_Atomic size_t head; /* next slot the signal handler writes */
+	_Atomic size_t tail; /* next slot the drainer reads */
+	_Atomic size_t dropped;
+#if defined(__linux__)
+	timer_t timer;
+	bool has_timer;
+#endif
+	profiler_sample samples[PROFILER_RING_SIZE];
+} profiler_ring;
+
+static profiler_ring *rings[PROFILER_MAX_THREADS];
+static _Atomic size_t ring_count; /* slots ever used */
+static _Thread_local profiler_ring *thread_ring;
+
+/* its destructor releases an exiting thread's ring */
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/* dropped by threads that have exited */
+static size_t exited_dropped;
+
+static _Atomic bool running;
+static unsigned interval_ns;
+
+/* aggregated stacks: "addr;addr;..." (leaf first) -> count */
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static map stacks;
+static bool stacks_ready;
+
+
+static void profiler_signal_handler (int sig, siginfo_t *info, void *context)
+{
+	const int saved_errno = errno;
+	profiler_ring *ring = thread_ring;
+
+	if (ring == nullptr ||
+	    !atomic_load_explicit (&running, memory_order_relaxed)) {
+		goto done;
+	}
+
+	const size_t head =
+		atomic_load_explicit (&ring->head, memory_order_relaxed);
+	const size_t tail =
+		atomic_load_explicit (&ring->tail, memory_order_acquire);
+	if (head - tail >= PROFILER_RING_SIZE) {
+		atomic_fetch_add_explicit (&ring->dropped, 1,
+					   memory_order_relaxed);
+		goto done;
+	}
+
+	profiler_sample *sample =
+		&ring->samples[head & (PROFILER_RING_SIZE - 1)];
+	sample->depth = backtrace (sample->frames, PROFILER_MAX_FRAMES);
+	atomic_store_explicit (&ring->head, head + 1, memory_order_release);
+
+done:
+	errno = saved_errno;
+}
+
+
+#if defined(__linux__)
+static void profiler_arm (profiler_ring *ring, unsigned ns)
+{
+	if (!ring->has_timer) return;
+	struct itimerspec its = {
+		.it_interval = {.tv_sec = ns / 1000000000,
+				.tv_nsec = ns % 1000000000},
+		.it_value = {.tv_sec = ns / 1000000000,
+			     .tv_nsec = ns % 1000000000},
+	};
+	timer_settime (ring->timer, 0, &its, nullptr);
+}
+#endif
+
+
+static void profiler_release_ring (void *arg);
+
+static void profiler_create_key ()
+{
+	pthread_key_create (&ring_key, profiler_release_ring);
+}
+
+
+bool profiler_register_thread ()
+{
+	if (thread_ring != nullptr) return true;
+	pthread_once (&ring_key_once, profiler_create_key);
+
+	pthread_mutex_lock (&drain_lock);
+	size_t index = 0;
+	while (index < PROFILER_MAX_THREADS && rings[index] != nullptr) index++;
+	if (index == PROFILER_MAX_THREADS) {
+		pthread_mutex_unlock (&drain_lock);
+		LOG_ERROR ("profiler: too many threads (max %d)",
+			   PROFILER_MAX_THREADS);
+		return false;
+	}
+
+	profiler_ring *ring = calloc (1, sizeof (profiler_ring));
+	if (ring == nullptr) panic ("out of memory");
+
+	/* the first call to backtrace() may load libgcc, which isn't safe in
+	 * a signal handler, so make sure that happens here */
+	void *warmup[1];
+	backtrace (warmup, 1);
+
+#if defined(__linux__)
+	/* per-thread CPU time timer that signals this thread only */
+	struct sigevent sev = {};
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+	sev.sigev_notify_thread_id = (pid_t)syscall (SYS_gettid);
+	if (timer_create (CLOCK_THREAD_CPUTIME_ID, &sev, &ring->timer) == 0) {
+		ring->has_timer = true;
+	} else {
+		LOG_ERROR ("profiler: timer_create: %s", strerror (errno));
+	}
+#endif
+
+	thread_ring = ring;
+	rings[index] = ring;
+	if (index >= atomic_load (&ring_count)) {
+		atomic_store (&ring_count, index + 1);
+	}
+	pthread_setspecific (ring_key, ring);
+
+#if defined(__linux__)
+	if (atomic_load (&running)) profiler_arm (ring, interval_ns);
+#endif
+	pthread_mutex_unlock (&drain_lock);
+	return true;
+}
+
+
+bool profiler_start (unsigned hz)
+{
+	if (atomic_load (&running)) return false;
+	if (hz == 0) hz = PROFILER_DEFAULT_HZ;
+	interval_ns = 1000000000 / hz;
+
+	struct sigaction sa = {};
+	sa.sa_sigaction = profiler_signal_handler;
+	sa.sa_flags = SA_RESTART | SA_SIGINFO;
+	sigemptyset (&sa.sa_mask);
+	if (sigaction (SIGPROF, &sa, nullptr) != 0) return false;
+
+	if (!profiler_register_thread ()) return false;
+
+	atomic_store (&running, true);
+
+#if defined(__linux__)
+	pthread_mutex_lock (&drain_lock);
+	const size_t count = atomic_load (&ring_count);
+	for (size_t i = 0; i < count && i < PROFILER_MAX_THREADS; i++) {
+		if (rings[i] != nullptr) profiler_arm (rings[i], interval_ns);
+	}
+	pthread_mutex_unlock (&drain_lock);
+#else
+	/* process-wide: the signal lands on whichever thread is running */
+	struct itimerval itv = {
+		.it_interval = {.tv_sec = 0, .tv_usec = interval_ns / 1000},
+		.it_value = {.tv_sec = 0, .tv_usec = interval_ns / 1000},
+	};
+	if (setitimer (ITIMER_PROF, &itv, nullptr) != 0) {
+		atomic_store (&running, false);
+		return false;
+	}
+#endif
+	return true;
+}
+
+
+void profiler_stop ()
+{
+	if (!atomic_load (&running)) return;
+
+#if defined(__linux__)
+	pthread_mutex_lock (&drain_lock);
+	const size_t count = atomic_load (&ring_count);
+	for (size_t i = 0; i < count && i < PROFILER_MAX_THREADS; i++) {
+		if (rings[i] != nullptr) profiler_arm (rings[i], 0);
+	}
+	pthread_mutex_unlock (&drain_lock);
+#else
+	struct itimerval itv = {};
+	setitimer (ITIMER_PROF, &itv, nullptr);
+#endif
+
+	atomic_store (&running, false);
+}
+
+
+bool profiler_running ()
+{
+	return atomic_load (&running);
+}
+
+
+static void profiler_aggregate (const profiler_sample *sample)
+{
+	char key[PROFILER_MAX_FRAMES * 20];
+	size_t len = 0;
+
+	key[0] = '\0';
+	for (int i = PROFILER_SKIP_FRAMES; i < sample->depth; i++) {
+		len += snprintf (key + len, sizeof (key) - len, "%s%p",
+				 len > 0 ? ";" : "", sample->frames[i]);
+		if (len >= sizeof (key)) break;
+	}
+	if (len == 0) return;
+
+	uintptr_t count = (uintptr_t)map_get (&stacks, key);
+	map_put (&stacks, key, (void *)(count + 1));
+}
+
+
+/* with drain_lock held */
+static void profiler_stacks_init ()
+{
+	if (!stacks_ready) {
+		map_init (&stacks);
+		stacks_ready = true;
+	}
+}
+
+
+/* with drain_lock held */
+static void profiler_drain_ring (profiler_ring *ring)
+{
+	profiler_stacks_init ();
+
+	size_t tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+	const size_t head =
+		atomic_load_explicit (&ring->head, memory_order_acquire);
+	while (tail != head) {
+		profiler_aggregate (
+			&ring->samples[tail & (PROFILER_RING_SIZE - 1)]);
+		tail++;
+	}
+	atomic_store_explicit (&ring->tail, tail, memory_order_release);
+}
+
+
+void profiler_drain ()
+{
+	pthread_mutex_lock (&drain_lock);
+	profiler_stacks_init ();
+
+	const size_t count = atomic_load (&ring_count);
+	for (size_t i = 0; i < count && i < PROFILER_MAX_THREADS; i++) {
+		if (rings[i] != nullptr) profiler_drain_ring (rings[i]);
+	}
+
+	pthread_mutex_unlock (&drain_lock);
+}
+
+
+/* the ring_key destructor, on the exiting thread */
+static void profiler_release_ring (void *arg)
+{
+	profiler_ring *ring = arg;
+
+	/* the signal handler ignores this thread from here on */
+	thread_ring = nullptr;
+	atomic_signal_fence (memory_order_seq_cst);
+#if defined(__linux__)
+	if (ring->has_timer) timer_delete (ring->timer);
+#endif
+
+	pthread_mutex_lock (&drain_lock);
+	profiler_drain_ring (ring);
+	exited_dropped += atomic_load (&ring->dropped);
+	for (size_t i = 0; i < PROFILER_MAX_THREADS; i++) {
+		if (rings[i] == ring) rings[i] = nullptr;
+	}
+	pthread_mutex_unlock (&drain_lock);
+	free (ring);
+}
+
+
+/* append one frame as "symbol", falling back to "module+0xoffset" */
+static string profiler_cat_frame (string s, void *addr)
+{
+	Dl_info info = {};
+	if (dladdr (addr, &info) != 0 && info.dli_sname != nullptr) {
+		return string_cat (s, info.dli_sname);
+	}
+	if (info.dli_fname != nullptr) {
+		const char *name = strrchr (info.dli_fname, '/');
+		return string_cat_fmt (
+			s, "%s+%#lx", name ? name + 1 : info.dli_fname,
+			(unsigned long)((char *)addr - (char *)info.dli_fbase));
+	}
+	return string_cat_fmt (s, "%p", addr);
+}
+
+
+size_t profiler_write_folded (FILE *f)
+{
+	profiler_drain ();
+
+	pthread_mutex_lock (&drain_lock);
+
+	size_t size = map_size (&stacks);
+	char **keys = malloc (sizeof (char *) * (size + 1));
+	void **values = malloc (sizeof (void *) * (size + 1));
+	if (keys == nullptr || values == nullptr) panic ("out of memory");
+	map_items (&stacks, keys, values);
+
+	/* symbolize, then merge stacks that only differ by return address
+	 * within the same functions */
+	map folded;
+	map_init (&folded);
+	string line = string_new ("");
+	for (size_t i = 0; i < size; i++) {
+		/* keys are leaf first; folded format is root first */
+		void *frames[PROFILER_MAX_FRAMES];
+		int depth = 0;
+		char *p = keys[i];
+		while (*p != '\0' && depth < PROFILER_MAX_FRAMES) {
+			frames[depth++] = (void *)strtoull (p, &p, 16);
+			if (*p == ';') p++;
+		}
+		string_clear (line);
+		for (int j = depth - 1; j >= 0; j--) {
+			line = profiler_cat_frame (line, frames[j]);
+			if (j > 0) line = string_cat (line, ";");
+		}
+		uintptr_t count = (uintptr_t)map_get (&folded, line);
+		map_put (&folded, line, (void *)(count + (uintptr_t)values[i]));
+	}
+	string_free (line);
+
+	size = map_size (&folded);
+	map_items (&folded, keys, values);
+
+	size_t written = 0;
+	for (size_t i = 0; i < size; i++) {
+		fprintf (f, "%s %lu\n", keys[i],
+			 (unsigned long)(uintptr_t)values[i]);
+		written += (uintptr_t)values[i];
+	}
+
+	map_free (&folded);
+	free (keys);
+	free (values);
+
+	pthread_mutex_unlock (&drain_lock);
+	return written;
+}
+
+
+size_t profiler_dropped ()
+{
+	pthread_mutex_lock (&drain_lock);
+	size_t dropped = exited_dropped;
+	const size_t count = atomic_load (&ring_count);
+	for (size_t i = 0; i < count && i < PROFILER_MAX_THREADS; i++) {
+		if (rings[i] == nullptr) continue;
+		dropped += atomic_load (&rings[i]->dropped);
+	}
+	pthread_mutex_unlock (&drain_lock);
+	return dropped;
+}
+
+
+void profiler_reset ()
+{
+	profiler_drain ();
+
+	pthread_mutex_lock (&drain_lock);
+	map_free (&stacks);
+	map_init (&stacks);
+	pthread_mutex_unlock (&drain_lock);
+}
@@ -0,0 +1,399 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "strings.h"
+#include "test.h"
+
+#define TEST_SLOWEST 5
+#define TEST_READ_SIZE 4096
+
+typedef enum test_status {
+	TEST_PENDING,
+	TEST_RUNNING,
+	TEST_PASSED,
+	TEST_FAILED,
+	TEST_CRASHED,
+	TEST_SKIPPED,
+} test_status;
+
+typedef struct test_job {
+	const test_suite *suite;
+	pid_t pid;
+	int fd;
+	string output;
+	uint64_t start;
+	uint64_t elapsed;
+	test_status status;
+	int code; /* exit status or signal number */
+} test_job;
+
+typedef struct test_options {
+	int jobs;
+	const char *filter;
+	int shard;  /* 1-based */
+	int shards; /* 0 means no sharding */
+	int slowest;
+	bool serial;
+} test_options;
+
+
+static uint64_t test_now ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static bool parse_int (const char *s, int *out)
+{
+	if (s == nullptr || *s == '\0') return false;
+	char *end;
+	long v = strtol (s, &end, 10);
+	if (*end != '\0' || v < 0 || v > INT32_MAX) return false;
+	*out = (int)v;
+	return true;
+}
+
+static bool parse_options (int argc, char **argv, test_options *opts)
+{
+	long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+	*opts = (test_options){
+		.jobs = cpus > 0 ? (int)cpus : 1,
+		.slowest = TEST_SLOWEST,
+	};
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (strcmp (arg, "--serial") == 0) {
+			opts->serial = true;
+		} else if (strcmp (arg, "--jobs") == 0 ||
+			   strcmp (arg, "-j") == 0) {
+			if (!parse_int (val, &opts->jobs) || opts->jobs < 1) {
+				log_error ("--jobs expects a positive number");
+				return false;
+			}
+			i++;
+		} else if (strcmp (arg, "--filter") == 0) {
+			if (val == nullptr) {
+				log_error ("--filter expects a string");
+				return false;
+			}
+			opts->filter = val;
+			i++;
+		} else if (strcmp (arg, "--slowest") == 0) {
+			if (!parse_int (val, &opts->slowest)) {
+				log_error ("--slowest expects a number");
+				return false;
+			}
+			i++;
+		} else if (strcmp (arg, "--shard") == 0) {
+			int n = 0;
+			if (val != nullptr) {
+				n = sscanf (val, "%d/%d", &opts->shard,
+					    &opts->shards);
+			}
+			if (n != 2 || opts->shards < 1 || opts->shard < 1 ||
+			    opts->shard > opts->shards) {
+				log_error ("--shard expects I/N, 1 <= I <= N");
+				return false;
+			}
+			i++;
+		} else {
+			log_error ("unknown option: %s", arg);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool selected (const test_options *opts, const test_suite *suite,
+		      int index)
+{
+	if (opts->filter && !strstr (suite->name, opts->filter)) return false;
+	if (opts->shards && index % opts->shards != opts->shard - 1) {
+		return false;
+	}
+	return true;
+}
+
+/* runs in the child: never returns */
+static void run_child (const test_suite *suite, int fd)
+{
+	dup2 (fd, STDOUT_FILENO);
+	dup2 (fd, STDERR_FILENO);
+	close (fd);
+	/* unbuffered, so output written before a crash is not lost */
+	setvbuf (stdout, nullptr, _IONBF, 0);
+	run_test (suite);
+	fflush (stdout);
+	/* skip atexit handlers inherited from the parent */
+	_exit (EXIT_SUCCESS);
+}
+
+static bool start_job (test_job *job)
+{
+	int fds[2];
+	if (pipe (fds) == -1) {
+		log_error ("pipe: %s", strerror (errno));
+		return false;
+	}
+
+	/* don't duplicate buffered parent output in the child */
+	fflush (stdout);
+	fflush (stderr);
+
+	job->start = test_now ();
+	pid_t pid = fork ();
+	if (pid == -1) {
+		log_error ("fork: %s", strerror (errno));
+		close (fds[0]);
+		close (fds[1]);
+		return false;
+	}
+	if (pid == 0) {
+		close (fds[0]);
+		run_child (job->suite, fds[1]);
+	}
+
+	close (fds[1]);
+	job->pid = pid;
+	job->fd = fds[0];
+	job->status = TEST_RUNNING;
+	return true;
+}
+
+/* called once the child's output pipe reaches EOF */
+static void finish_job (test_job *job)
+{
+	close (job->fd);
+	job->fd = -1;
+
+	int status;
+	while (waitpid (job->pid, &status, 0) == -1 && errno == EINTR) {}
+	job->elapsed = test_now () - job->start;
+
+	if (WIFEXITED (status)) {
+		job->code = WEXITSTATUS (status);
+		job->status = job->code == 0 ? TEST_PASSED : TEST_FAILED;
+	} else {
+		job->code = WIFSIGNALED (status) ? WTERMSIG (status) : 0;
+		job->status = TEST_CRASHED;
+	}
+
+	fputs (job->output, stdout);
+	size_t len = string_length (job->output);
+	if (len && job->output[len - 1] != '\n') putchar ('\n');
+	if (job->status == TEST_CRASHED) {
+		printf ("✗ %s crashed (%s)\n\n", job->suite->name,
+			strsignal (job->code));
+	}
+	fflush (stdout);
+}
+
+static void read_job (test_job *job)
+{
+	char buf[TEST_READ_SIZE + 1];
+	ssize_t n = read (job->fd, buf, TEST_READ_SIZE);
+	if (n > 0) {
+		buf[n] = '\0';
+		job->output = string_cat (job->output, buf);
+	} else if (n == 0 || errno != EINTR) {
+		finish_job (job);
+	}
+}
+
+static void run_parallel (test_job *jobs, int count, int max_jobs)
+{
+	struct pollfd *fds = calloc ((size_t)max_jobs, sizeof (*fds));
+	test_job **active = calloc ((size_t)max_jobs, sizeof (*active));
+	if (fds == nullptr || active == nullptr) panic ("out of memory");
+
+	int next = 0;
+	for (;;) {
+		/* refill free slots from the pending queue */
+		int nactive = 0;
+		for (int i = 0; i < count; i++) {
+			if (jobs[i].status == TEST_RUNNING) {
+				active[nactive++] = &jobs[i];
+			}
+		}
+		while (nactive < max_jobs && next < count) {
+			test_job *job = &jobs[next++];
+			if (job->status != TEST_PENDING) continue;
+			if (start_job (job)) {
+				active[nactive++] = job;
+			} else {
+				job->status = TEST_FAILED;
+			}
+		}
+		if (nactive <= 0) break;
+
+		for (int i = 0; i < nactive; i++) {
+			fds[i] = (struct pollfd){.fd = active[i]->fd,
+						 .events = POLLIN};
+		}
+		if (poll (fds, (nfds_t)nactive, -1) == -1) {
+			if (errno == EINTR) continue;
+			panic ("poll: %s", strerror (errno));
+		}
+		for (int i = 0; i < nactive; i++) {
+			if (fds[i].revents) read_job (active[i]);
+		}
+	}
+
+	free (fds);
+	free (active);
+}
+
+static void run_serial (test_job *jobs, int count)
+{
+	for (int i = 0; i < count; i++) {
+		test_job *job = &jobs[i];
+		if (job->status != TEST_PENDING) continue;
+		job->start = test_now ();
+		run_test (job->suite);
+		job->elapsed = test_now () - job->start;
+		/* a failed expectation exits the process */
+		job->status = TEST_PASSED;
+	}
+}
+
+static int compare_elapsed (const void *a, const void *b)
+{
+	const test_job *x = *(const test_job **)a;
+	const test_job *y = *(const test_job **)b;
+	return (x->elapsed < y->elapsed) - (x->elapsed > y->elapsed);
+}
+
+static const char *status_label (test_status status)
+{
+	switch (status) {
+	case TEST_PASSED:
+		return "ok";
+	case TEST_FAILED:
+		return "FAILED";
+	case TEST_CRASHED:
+		return "CRASHED";
+	case TEST_SKIPPED:
+		return "skipped";
+	default:
+		return "not run";
+	}
+}
+
+static void report (test_job *jobs, int count, const test_options *opts,
+		    uint64_t wall)
+{
+	int passed = 0, failed = 0, skipped = 0;
+	uint64_t total = 0;
+	test_job **order = calloc ((size_t)count + 1, sizeof (*order));
+	if (order == nullptr) panic ("out of memory");
+
+	printf ("Suite durations:\n");
+	for (int i = 0; i < count; i++) {
+		test_job *job = &jobs[i];
+		order[i] = job;
+		total += job->elapsed;
+		if (job->status == TEST_PASSED) passed++;
+		else if (job->status == TEST_SKIPPED) skipped++;
+		else failed++;
+		printf ("  %-8s %9.2f ms  %s\n", status_label (job->status),
+			(double)job->elapsed / 1e6, job->suite->name);
+	}
+
+	int slowest = opts->slowest < count ? opts->slowest : count;
+	if (slowest > 0) {
+		qsort (order, (size_t)count, sizeof (*order), compare_elapsed);
+		printf ("\nSlowest suites:\n");
+		for (int i = 0; i < slowest; i++) {
+			printf ("  %9.2f ms  %s\n",
+				(double)order[i]->elapsed / 1e6,
+				order[i]->suite->name);
+		}
+	}
+
+	printf ("\n%d passed, %d failed, %d skipped (%d jobs, %.2f ms wall, "
+		"%.2f ms total)\n\n",
+		passed, failed, skipped, opts->serial ? 1 : opts->jobs,
+		(double)wall / 1e6, (double)total / 1e6);
+	free (order);
+}
+
+int run_test_suites (const test_suite *tests, int argc, char **argv)
+{
+	if (tests == nullptr) return EXIT_SUCCESS;
+
+	test_options opts;
+	if (!parse_options (argc, argv, &opts)) return EXIT_FAILURE;
+
+	int total = 0;
+	while (tests[total].name) total++;
+
+	test_job *jobs = calloc ((size_t)total + 1, sizeof (*jobs));
+	if (jobs == nullptr) panic ("out of memory");
+
+	int count = 0;
+	for (int i = 0; i < total; i++) {
+		if (!selected (&opts, &tests[i], i)) continue;
+		test_job *job = &jobs[count++];
+		job->suite = &tests[i];
+		job->fd = -1;
+		job->output = string_new ("");
+		job->status = tests[i].skip ? TEST_SKIPPED : TEST_PENDING;
+		if (job->status == TEST_SKIPPED) {
+			printf ("▶︎ %s ... skipped\n\n", tests[i].name);
+		}
+	}
+
+	uint64_t start = test_now ();
+	if (opts.serial) run_serial (jobs, count);
+	else run_parallel (jobs, count, opts.jobs);
+	uint64_t wall = test_now () - start;
+
+	report (jobs, count, &opts, wall);
+
+	bool ok = true;
+	for (int i = 0; i < count; i++) {
+		test_status status = jobs[i].status;
+		if (status != TEST_PASSED && status != TEST_SKIPPED) ok = false;
+		string_free (jobs[i].output);
+	}
+	free (jobs);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -40,6 +40,7 @@ bool list_add (list *list, void *data)
 		return false;
 	}
 	new_node->data = data;
+	new_node->next = nullptr;
 	listnode *node = list->head;
 	if (node == nullptr) {
 		list->head = new_node;
@@ -52,23 +52,22 @@ unsigned long hash (const char *str)
 }
 
 
+/* buckets are allocated on first put, so empty maps cost nothing */
 void map_init (map *m)
 {
-	m->capacity = INITIAL_CAPACITY;
+	m->capacity = 0;
 	m->size = 0;
-	m->buckets = calloc (m->capacity, sizeof (mapnode *));
-	if (m->buckets == nullptr) {
-		fprintf (stderr,
-			 "Error: map_init: failed to allocate memory for "
-			 "buckets\n");
-		exit (EXIT_FAILURE);
-	}
+	m->buckets = nullptr;
 }
 
 
 bool map_put (map *m, const char *key, void *value)
 {
 	/* check load factor to determine whether resizing is necessary */
+	if (m->capacity == 0 && !map_resize (m, INITIAL_CAPACITY)) {
+		fprintf (stderr, "Error: map_put: unable to allocate map\n");
+		goto fail;
+	}
 	if ((double)m->size / (double)m->capacity >= MAX_LOAD_FACTOR &&
 	    !map_resize (m, m->capacity * 2)) {
 		fprintf (stderr, "Error: map_put: unable to resize map\n");
@@ -117,6 +116,7 @@ fail:
 
 void *map_get (const map *m, const char *key)
 {
+	if (m->size == 0) return nullptr;
 	const unsigned long index = hash (key) % m->capacity;
 	const mapnode *current = m->buckets[index];
 	while (current != nullptr) {
@@ -131,6 +131,7 @@ void *map_get (const map *m, const char *key)
 
 bool map_delete (map *m, const char *key)
 {
+	if (m->size == 0) return false;
 	const unsigned long index = hash (key) % m->capacity;
 	mapnode *current = m->buckets[index];
 	mapnode *previous = nullptr;
@@ -167,6 +168,7 @@ void map_free (map *m)
 	m->size = 0;
 	m->capacity = 0;
 	free (m->buckets);
+	m->buckets = nullptr;
 }
 
 
@@ -26,22 +26,27 @@
 #include "vector.h"
 #include <string.h>
 
+#define INITIAL_CAPACITY 4
+
+/* items are allocated on first add, so empty vectors cost nothing */
 void vector_init (vector *v)
 {
-	v->capacity = 4;
+	v->capacity = 0;
 	v->size = 0;
-	v->items = malloc (sizeof (void *) * v->capacity);
+	v->items = nullptr;
 }
 
 bool vector_add (vector *v, void *item)
 {
 	if (v->size == v->capacity) {
-		v->capacity *= 2;
-		void **buf = realloc (v->items, sizeof (void *) * v->capacity);
+		unsigned capacity =
+			v->capacity > 0 ? v->capacity * 2 : INITIAL_CAPACITY;
+		void **buf = realloc (v->items, sizeof (void *) * capacity);
 		if (buf == nullptr) {
 			return false;
 		}
 		v->items = buf;
+		v->capacity = capacity;
 	}
 	v->items[v->size++] = item;
 	return true;
@@ -73,12 +78,18 @@ bool vector_delete (vector *v, const size_t index)
 	return false;
 }
 
+void vector_clear (vector *v)
+{
+	v->size = 0;
+}
+
 void vector_free (vector *v)
 {
 	if (v == nullptr) return;
 	v->size = 0;
 	v->capacity = 0;
 	free (v->items);
+	v->items = nullptr;
 }
 
 size_t vector_size (const vector *v)
@@ -28,6 +28,8 @@
 #define COMMANDS_H
 
 #include "command.h"
+#include "cpuprof.h"
+#include "heapprof.h"
 
 /* Command groups */
 #define GROUP_BUILTIN "Built-in Commands"
@@ -35,17 +37,42 @@
 #define GROUP_SERVICES "Service Commands"
 #define GROUP_INTERACTIVE "Interactive Commands"
 
-/* Command constructors */
-command compile_new (command parent, const char *group);
-command console_command_new (command parent, const char *group);
-command data_new (command parent, const char *group);
-command help_new (command parent, const char *group);
-command logs_new (command parent, const char *group);
-command repl_new (command parent, const char *group);
-command run_new (command parent, const char *group);
-command serve_new (command parent, const char *group);
-command service_new (command parent, const char *group);
-command storage_new (command parent, const char *group);
-command version_new (command parent, const char *group);
+/*
+ * Command declarations (see command_spec in command.h). Subcommands are
+ * only constructed when they run (or are listed by help), so adding a
+ * command here costs nothing at startup.
+ */
+extern const command_spec main_spec;
+
+extern const command_spec compile_spec;
+extern const command_spec console_spec;
+extern const command_spec data_spec;
+extern const command_spec heap_spec;
+extern const command_spec help_spec;
+extern const command_spec logs_spec;
+extern const command_spec repl_spec;
+extern const command_spec run_spec;
+extern const command_spec serve_spec;
+extern const command_spec service_spec;
+extern const command_spec storage_spec;
+extern const command_spec version_spec;
+
+/* Flags shared by commands */
+extern const flag_spec help_flag_spec;
+extern const flag_spec profile_flag_spec;
+extern const flag_spec version_flag_spec;
+
+/* Profiling (--profile flag and console "profile" command) */
+bool profile_write (const char *path);
+void profile_finish (command cmd);
+
+/* Heap profiles (--heap-profile): folded stacks if path ends in .folded,
+   otherwise pprof */
+bool heap_profile_write (heapprof *p, const char *path);
+
+/* JS CPU profiles (--cpu-profile): a Chrome profile if path ends in
+   .cpuprofile, otherwise folded stacks; then the top functions to stderr */
+bool cpu_profile_write (cpuprof *p, const char *path, int top);
+#define CPU_PROFILE_DEFAULT_TOP 20
 
 #endif /* COMMANDS_H */
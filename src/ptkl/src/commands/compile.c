@@ -24,26 +24,137 @@
  * THE SOFTWARE.
  */
 
+/* for nftw() and FTW_PHYS on glibc */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "command.h"
+#include "commands.h"
 #include "log.h"
-#include "qjsc.h"
+#include "mapfile.h"
+#include "qjs.h"
+
+/*
+ * ptkl compile bundles a program (see bundle.h): its bytecode, the
+ * bytecode of every module it imports, and the files in an assets
+ * directory, for ptkl run to load without touching the filesystem.
+ */
+
+/* nftw has no argument for its callback */
+static bundle_writer *assets_writer;
+
+static int add_asset (const char *path, const struct stat *st, int type,
+		      struct FTW *ftw)
+{
+	if (type != FTW_F) return 0;
+	mapped_file f;
+	if (!map_file (path, &f)) {
+		log_error ("%s: %s", path, strerror (errno));
+		return 1; /* stop */
+	}
+	bundle_writer_add (assets_writer, path, BUNDLE_ASSET, f.data, f.len);
+	unmap_file (&f);
+	return 0;
+}
+
+static bool add_assets (bundle_writer *w, const char *dir)
+{
+	assets_writer = w;
+	int rc = nftw (dir, add_asset, 16, FTW_PHYS);
+	assets_writer = nullptr;
+	if (rc < 0) log_error ("%s: %s", dir, strerror (errno));
+	return rc == 0;
+}
+
+/* app.js -> app.ptkl */
+static void default_output (const char *path, char *out, size_t size)
+{
+	const char *base = strrchr (path, '/');
+	base = base ? base + 1 : path;
+	const char *dot = strrchr (base, '.');
+	int len = dot ? (int)(dot - base) : (int)strlen (base);
+	snprintf (out, size, "%.*s" BUNDLE_SUFFIX, len, base);
+}
 
 static void compile (command cmd)
 {
-	TODO ("migrate from partikle poc");
-	test_compiler ();
-	for (int i = 0; i < vector_size (cmd->args); i++) {
-		char *arg = vector_get (cmd->args, i);
-		printf ("arg[%d]: %s\n", i, arg);
+	if (vector_size (cmd->args) != 1) {
+		command_push_error (cmd, "compile: expected one file");
+		return;
+	}
+	char *path = vector_get (cmd->args, 0);
+	char out[PATH_MAX];
+	string output = command_get (cmd, "output");
+	if (output) {
+		snprintf (out, sizeof (out), "%s", output);
+	} else {
+		default_output (path, out, sizeof (out));
+	}
+
+	engine *js = engine_new (nullptr);
+	if (!js) {
+		command_push_error (cmd, "compile: cannot start the engine");
+		return;
+	}
+	bundle_writer *w = bundle_writer_new ();
+	string assets = command_get (cmd, "assets");
+	bool ok = engine_bundle (js, path, w) &&
+		  (!assets || add_assets (w, assets)) &&
+		  bundle_writer_write (w, out);
+	if (ok) {
+		engine_stats stats;
+		engine_get_stats (js, &stats);
+		log_time ("compile: %s: %llu modules (%.2f ms)", out,
+			  (unsigned long long)stats.compiled,
+			  stats.compile_ns / 1e6);
+	} else {
+		command_push_errorf (cmd, "compile: %s failed", path);
 	}
+	bundle_writer_free (w);
+	engine_free (js);
 }
 
-command compile_new (command parent, const char *group)
+static void output_flag (flag f)
 {
-	command cmd = command_add (parent, "compile",
-				   "compile a JavaScript program", compile);
-	command_expect_args (cmd, COMMAND_ARGS_ANY);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
+	command_set (f->command, "output", f->arg);
 }
+
+static void assets_flag (flag f)
+{
+	command_set (f->command, "assets", f->arg);
+}
+
+static const flag_spec output_flag_spec = {
+	.short_flag = 'o',
+	.long_flag = "output",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "bundle to write (default: the file's name, with .ptkl)",
+	.fn = output_flag,
+};
+
+static const flag_spec assets_flag_spec = {
+	.long_flag = "assets",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "directory of files to embed (see bundleAsset)",
+	.fn = assets_flag,
+};
+
+const command_spec compile_spec = {
+	.name = "compile",
+	.help = "compile a JavaScript program into a bundle",
+	.group = GROUP_DEVELOPMENT,
+	.fn = compile,
+	.expect_args = COMMAND_ARGS_ANY,
+	.flags =
+		(const flag_spec *const[]){
+			&output_flag_spec,
+			&assets_flag_spec,
+			nullptr,
+		},
+};
@@ -24,81 +24,103 @@
  * THE SOFTWARE.
  */
 
+/* for pipe2() on glibc */
+#define _GNU_SOURCE
+
 #include "console.h"
 #include "command.h"
 #include "commands.h"
+#include "completion.h"
+#include "jobs.h"
 #include "log.h"
+#include "metrics.h"
+#include "profiler.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
-/* Available commands */
-static const char *COMMANDS[] = {"clear", "help", "quit", "service", "storage", "data", "logs", NULL};
+extern char **environ;
 
-/* Get matching commands for completion */
-static char **get_matching_commands(const char *prefix, int *count)
-{
-	if (!prefix) {
-		prefix = "";
-	}
+/* Console commands, completed along with the ptkl command tree */
+static const char *BUILTINS[] = {"cancel", "clear", "dashboard", "help",
+				 "jobs", "profile", "quit", NULL};
 
-	/* Count matching commands first */
-	*count = 0;
-	for (const char **cmd = COMMANDS; *cmd; cmd++) {
-		if (strncmp(prefix, *cmd, strlen(prefix)) == 0) {
-			(*count)++;
-		}
-	}
+/* Where the console "profile" command writes folded stacks */
+#define PROFILE_PATH "ptkl-profile.folded"
 
-	if (*count == 0) return NULL;
+/* Words to complete: built once when the console opens */
+static completion_index *completions;
 
-	/* Allocate array for matches */
-	char **matches = malloc(*count * sizeof(char*));
-	if (!matches) {
-		*count = 0;
-		return NULL;
-	}
+/* The ptkl command tree */
+static command root_command;
 
-	/* Fill matches array */
-	int i = 0;
-	for (const char **cmd = COMMANDS; *cmd; cmd++) {
-		if (strncmp(prefix, *cmd, strlen(prefix)) == 0) {
-			matches[i++] = strdup(*cmd);
-		}
+/* The ptkl executable that jobs run (a bare name is searched in PATH) */
+static char exe_path[PATH_MAX] = PTKL;
+
+static void build_completions (command cmd)
+{
+	completions = completion_new();
+	for (const char **b = BUILTINS; *b; b++) {
+		completion_add(completions, COMPLETION_ROOT, *b, strlen(*b),
+			       COMPLETION_COMMAND);
 	}
 
-	return matches;
+	/* The ptkl commands, with their subcommands and flags */
+	root_command = cmd->parent ? cmd->parent : cmd;
+	completion_add_command(completions, COMPLETION_ROOT, root_command);
 }
 
-/* Command completion callback */
-static char **complete_command(console c, const char *prefix, int *count)
+/* Command completion callback (results point into the index) */
+static int complete_command(console c, const char *line, int *start,
+			    console_completion *out, int cap)
 {
-	return get_matching_commands(prefix, count);
+	completion matches[CONSOLE_MAX_COMPLETIONS];
+	if (cap > CONSOLE_MAX_COMPLETIONS) cap = CONSOLE_MAX_COMPLETIONS;
+
+	size_t word = 0;
+	size_t count = completion_line(completions, line, &word, matches, cap);
+	for (size_t i = 0; i < count; i++) {
+		out[i] = (console_completion){matches[i].text, matches[i].len};
+	}
+	*start = (int)word;
+	return (int)count;
 }
 
-/* Check if input matches a command uniquely */
-static const char *match_command(const char *input)
+/* The command named by the first word of input, or a unique prefix of it */
+static bool match_command(const char *input, char *name, size_t size)
 {
-	if (!input || !*input) return NULL;
-
-	const char *match = NULL;
-	size_t input_len = strlen(input);
+	size_t len = strcspn(input, " \t");
+	if (len == 0) return false;
 
-	for (const char **cmd = COMMANDS; *cmd; cmd++) {
-		if (strncmp(input, *cmd, input_len) == 0) {
-			/* If we already found a match, this is ambiguous */
-			if (match) return NULL;
-			match = *cmd;
-		}
-	}
+	/* in byte order, so an exact match comes first */
+	completion m[2];
+	size_t count = completion_prefix(completions, COMPLETION_ROOT, input,
+					 len, m, 2);
+	if (count == 0 || (count > 1 && m[0].len != len)) return false;
+	if (m[0].kind != COMPLETION_COMMAND || m[0].len >= size) return false;
 
-	return match;
+	snprintf(name, size, "%.*s", (int)m[0].len, m[0].text);
+	return true;
 }
 
 static void print_help(console c)
 {
 	/* Print Console Commands */
 	console_print(c, "\nConsole Commands:\n");
+	console_print(c, "  cancel     Cancel a job (newest or ID; Ctrl-X)\n");
 	console_print(c, "  clear      Clear the screen\n");
+	console_print(c, "  dashboard  Show/hide live service metrics\n");
 	console_print(c, "  help       Show help for commands\n");
+	console_print(c, "  jobs       List running and recent jobs\n");
+	console_print(c, "  profile    Start/stop the native CPU profiler\n");
 	console_print(c, "  quit       Exit the console\n\n");
 
 	/* Print Service Commands */
@@ -109,10 +131,396 @@ static void print_help(console c)
 	console_print(c, "  logs       View logs\n\n");
 }
 
+static void toggle_profiler (console c)
+{
+	if (!profiler_running()) {
+		if (profiler_start(PROFILER_DEFAULT_HZ)) {
+			console_print(c, "profiler started (%d Hz)\n", PROFILER_DEFAULT_HZ);
+		} else {
+			console_error(c, "Failed to start profiler");
+		}
+		return;
+	}
+
+	if (profile_write(PROFILE_PATH)) {
+		console_print(c, "profiler stopped, folded stacks written to %s\n", PROFILE_PATH);
+	} else {
+		console_error(c, "Failed to write %s", PROFILE_PATH);
+	}
+}
+
+/*
+ * Dashboard: live metrics of the running services, read from the shared
+ * metrics segment (see metrics.h). Reading only loads from a read-only
+ * mapping, so refreshing never blocks or slows the services. Rates and
+ * latency percentiles are for the interval since the previous refresh.
+ */
+#define DASHBOARD_INTERVAL_MS 500
+
+typedef struct dashboard {
+	bool open;
+	int timer;
+	metrics_reader *reader;
+	metrics_snapshot readings[2][METRICS_SLOTS];
+	int count[2];
+	uint64_t read_ns[2];
+	int current; /* readings[current] is the latest */
+} dashboard;
+
+static dashboard board;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static const char *format_bytes(char *buf, size_t size, uint64_t n)
+{
+	if (n >= 1ull << 30) {
+		snprintf(buf, size, "%.1fG", n / (double)(1ull << 30));
+	} else if (n >= 1ull << 20) {
+		snprintf(buf, size, "%.1fM", n / (double)(1ull << 20));
+	} else if (n >= 1ull << 10) {
+		snprintf(buf, size, "%.1fK", n / (double)(1ull << 10));
+	} else {
+		snprintf(buf, size, "%lluB", (unsigned long long)n);
+	}
+	return buf;
+}
+
+static const char *format_us(char *buf, size_t size, uint64_t us, bool any)
+{
+	if (!any) {
+		snprintf(buf, size, "-");
+	} else if (us >= 1000000) {
+		snprintf(buf, size, "%.2fs", us / 1e6);
+	} else if (us >= 1000) {
+		snprintf(buf, size, "%.1fms", us / 1e3);
+	} else {
+		snprintf(buf, size, "%lluus", (unsigned long long)us);
+	}
+	return buf;
+}
+
+/* the previous reading of the same service process, if any */
+static const metrics_snapshot *previous_reading(const metrics_snapshot *s)
+{
+	int prev = !board.current;
+	for (int i = 0; i < board.count[prev]; i++) {
+		const metrics_snapshot *p = &board.readings[prev][i];
+		if (p->pid == s->pid && strcmp(p->service, s->service) == 0) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static void draw_dashboard(console c, WINDOW *win, void *data)
+{
+	int cur = board.current;
+	double secs = (board.read_ns[cur] - board.read_ns[!cur]) / 1e9;
+	int row = 0;
+
+	wattron(win, A_BOLD);
+	mvwprintw(win, row++, 1, "Dashboard  (%.1f s refresh, "
+		  "\"dashboard\" to close)", DASHBOARD_INTERVAL_MS / 1000.0);
+	wattroff(win, A_BOLD);
+	row++;
+
+	if (board.reader == NULL || board.count[cur] == 0) {
+		mvwprintw(win, row, 1, "No services are publishing metrics "
+			  "(%s)", METRICS_SEGMENT);
+		return;
+	}
+
+	wattron(win, A_UNDERLINE);
+	mvwprintw(win, row++, 1, "%-16s %7s %9s %7s %8s %8s %8s %15s %8s "
+		  "%6s", "SERVICE", "PID", "REQ/S", "ERR/S", "P50", "P90",
+		  "P99", "HEAP", "RSS", "QUEUE");
+	wattroff(win, A_UNDERLINE);
+
+	for (int i = 0; i < board.count[cur]; i++) {
+		const metrics_snapshot *s = &board.readings[cur][i];
+		const metrics_snapshot *p = previous_reading(s);
+
+		/* counters over the interval since the previous reading */
+		uint64_t latency[METRICS_BUCKETS];
+		uint64_t requests = s->requests, errors = s->errors;
+		for (int b = 0; b < METRICS_BUCKETS; b++) {
+			latency[b] = s->latency[b] - (p ? p->latency[b] : 0);
+		}
+		if (p) {
+			requests -= p->requests;
+			errors -= p->errors;
+		}
+		bool rates = p != NULL && secs > 0;
+
+		char p50[16], p90[16], p99[16], used[16], limit[16], rss[16];
+		char heap[40];
+		format_bytes(used, sizeof(used), s->gauges[METRIC_HEAP_USED]);
+		if (s->gauges[METRIC_HEAP_LIMIT]) {
+			snprintf(heap, sizeof(heap), "%s/%s", used,
+				 format_bytes(limit, sizeof(limit),
+					      s->gauges[METRIC_HEAP_LIMIT]));
+		} else {
+			snprintf(heap, sizeof(heap), "%s", used);
+		}
+
+		mvwprintw(win, row++, 1,
+			  "%-16.16s %7d %9.1f %7.1f %8s %8s %8s %15s %8s "
+			  "%6llu",
+			  s->service, s->pid, rates ? requests / secs : 0.0,
+			  rates ? errors / secs : 0.0,
+			  format_us(p50, sizeof(p50),
+				    metrics_percentile(latency, 0.50),
+				    requests > 0),
+			  format_us(p90, sizeof(p90),
+				    metrics_percentile(latency, 0.90),
+				    requests > 0),
+			  format_us(p99, sizeof(p99),
+				    metrics_percentile(latency, 0.99),
+				    requests > 0),
+			  heap,
+			  format_bytes(rss, sizeof(rss), s->gauges[METRIC_RSS]),
+			  (unsigned long long)s->gauges[METRIC_QUEUE_DEPTH]);
+	}
+}
+
+static bool refresh_dashboard(console c, void *data)
+{
+	/* services may start after the dashboard is opened */
+	if (board.reader == NULL) board.reader = metrics_open(NULL);
+
+	board.current = !board.current;
+	int cur = board.current;
+	board.count[cur] = metrics_read(board.reader, board.readings[cur],
+					METRICS_SLOTS);
+	board.read_ns[cur] = now_ns();
+	console_redraw_pane(c);
+	return true;
+}
+
+static void close_dashboard(console c)
+{
+	if (!board.open) return;
+	console_remove_timer(c, board.timer);
+	console_set_pane(c, NULL, NULL);
+	metrics_close(board.reader);
+	board = (dashboard){0};
+}
+
+static void toggle_dashboard(console c)
+{
+	if (board.open) {
+		close_dashboard(c);
+		return;
+	}
+
+	board.open = true;
+	board.timer = console_add_timer(c, DASHBOARD_INTERVAL_MS,
+					refresh_dashboard, NULL);
+	refresh_dashboard(c, NULL);
+	console_set_pane(c, draw_dashboard, NULL);
+}
+
+/*
+ * Jobs: ptkl commands typed in the console run in a child ptkl process on a
+ * job worker (see jobs.h), so they never block input or rendering, and
+ * their output streams into the content window as it arrives. Cancelling a
+ * job sends the process SIGTERM, then SIGKILL if it hasn't exited after
+ * KILL_GRACE_NS.
+ */
+#define CANCEL_KEY 24 /* Ctrl-X */
+#define KILL_GRACE_NS 2000000000L
+
+static console_jobs *jobs;
+
+static void free_words(char **words)
+{
+	for (char **w = words; *w; w++) free(*w);
+	free(words);
+}
+
+/* Split input at whitespace into a NULL-terminated array */
+static char **split_words(const char *input)
+{
+	size_t cap = strlen(input) / 2 + 2;
+	char **words = calloc(cap, sizeof(char *));
+	if (!words) return NULL;
+	size_t n = 0;
+	for (const char *p = input; *p;) {
+		p += strspn(p, " \t");
+		size_t len = strcspn(p, " \t");
+		if (len == 0) break;
+		words[n] = strndup(p, len);
+		if (!words[n++]) {
+			free_words(words);
+			return NULL;
+		}
+		p += len;
+	}
+	return words;
+}
+
+/* If the job was cancelled: SIGTERM, then SIGKILL after the grace time */
+static void stop_if_cancelled(console_job *job, pid_t pid, long *term_ns)
+{
+	if (!console_job_cancelled(job)) return;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	long now = ts.tv_sec * 1000000000L + ts.tv_nsec;
+	if (*term_ns == 0) {
+		kill(pid, SIGTERM);
+		*term_ns = now;
+	} else if (now - *term_ns > KILL_GRACE_NS) {
+		kill(pid, SIGKILL);
+	}
+}
+
+static void run_process(console_job *job, void *arg)
+{
+	char **argv = arg;
+	int out[2];
+
+	/* Both ends close-on-exec, so other jobs' processes don't hold this
+	   one's pipe open (dup2 clears it on the child's stdout and stderr) */
+	if (console_job_cancelled(job) || pipe2(out, O_CLOEXEC) < 0) {
+		free_words(argv);
+		return;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+					 O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDERR_FILENO);
+	posix_spawn_file_actions_addclose(&actions, out[1]);
+	pid_t pid;
+	int err = posix_spawnp(&pid, exe_path, &actions, NULL, argv,
+			       environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(out[1]);
+	if (err != 0) {
+		console_job_print(job, "can't run %s: %s\n", argv[0],
+				  strerror(err));
+		close(out[0]);
+		free_words(argv);
+		return;
+	}
+
+	/* Stream output until the process closes it, checking for cancel */
+	long term_ns = 0;
+	char buf[4096];
+	for (;;) {
+		stop_if_cancelled(job, pid, &term_ns);
+		struct pollfd p = {.fd = out[0], .events = POLLIN};
+		if (poll(&p, 1, 100) <= 0) continue;
+		ssize_t n = read(out[0], buf, sizeof(buf));
+		if (n <= 0) break;
+		console_job_print(job, "%.*s", (int)n, buf);
+	}
+	close(out[0]);
+
+	/* It may outlive its output (and ignore SIGTERM) */
+	int status = 0;
+	for (;;) {
+		pid_t done = waitpid(pid, &status, WNOHANG);
+		if (done == pid || (done < 0 && errno != EINTR)) break;
+		stop_if_cancelled(job, pid, &term_ns);
+		usleep(10000);
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		console_job_print(job, "exit status %d\n", WEXITSTATUS(status));
+	} else if (WIFSIGNALED(status) && term_ns == 0) {
+		console_job_print(job, "killed by signal %d\n",
+				  WTERMSIG(status));
+	}
+	free_words(argv);
+}
+
+static void start_job(console c, const char *cmd, const char *input)
+{
+	command target = command_find(root_command, cmd);
+	if (target && target->group &&
+	    strcmp(target->group, GROUP_INTERACTIVE) == 0) {
+		console_error(c, "%s: interactive, can't run in the console",
+			      cmd);
+		return;
+	}
+
+	/* argv: ptkl, the command's full name, then the rest of the input */
+	char **argv = split_words(input);
+	if (!argv || !argv[0]) {
+		free(argv);
+		return;
+	}
+	size_t n = 0;
+	while (argv[n]) n++;
+	char **args = calloc(n + 2, sizeof(char *));
+	if (!args) {
+		free_words(argv);
+		return;
+	}
+	args[0] = strdup(PTKL);
+	args[1] = strdup(cmd);
+	for (size_t i = 1; i < n; i++) args[i + 1] = argv[i];
+	free(argv[0]);
+	free(argv);
+
+	int id = console_job_start(jobs, input, run_process, args);
+	if (id < 0) {
+		free_words(args);
+		console_error(c, "Failed to start job: %s", input);
+		return;
+	}
+	console_print(c, "[%d] started: %s\n", id, input);
+}
+
+static const char *job_states[] = {"queued", "running", "done", "cancelled"};
+
+static void list_jobs(console c)
+{
+	console_job_info list[64];
+	int n = console_job_list(jobs, list, 64);
+	if (n == 0) {
+		console_print(c, "no jobs\n");
+		return;
+	}
+	console_print(c, "%4s  %-10s %9s %8s  %s\n", "ID", "STATE", "TIME",
+		      "LINES", "COMMAND");
+	for (int i = 0; i < n; i++) {
+		console_print(c, "%4d  %-10s %8.2fs %8llu  %s\n", list[i].id,
+			      job_states[list[i].state], list[i].seconds,
+			      (unsigned long long)list[i].lines, list[i].name);
+	}
+}
+
+static void cancel_job(console c, const char *input)
+{
+	/* "cancel" or "cancel <id>" */
+	const char *arg = input + strcspn(input, " \t");
+	arg += strspn(arg, " \t");
+	int id = *arg ? atoi(arg) : -1;
+	if (!console_job_cancel(jobs, id)) {
+		console_error(c, id < 0 ? "No running jobs"
+					: "No running job %d", id);
+	}
+}
+
+static bool handle_key(console c, int ch, void *data)
+{
+	if (ch != CANCEL_KEY) return false;
+	if (!console_job_cancel(jobs, -1)) console_error(c, "No running jobs");
+	return true;
+}
+
 static void handle_command (console c, const char *input)
 {
-	const char *cmd = match_command(input);
-	if (!cmd) {
+	char cmd[64];
+	if (!match_command(input, cmd, sizeof(cmd))) {
 		console_error(c, "Unknown or ambiguous command: %s", input);
 		return;
 	}
@@ -121,8 +529,48 @@ static void handle_command (console c, const char *input)
 		console_stop(c);
 	} else if (strcmp(cmd, "clear") == 0) {
 		console_clear(c);
+	} else if (strcmp(cmd, "dashboard") == 0) {
+		toggle_dashboard(c);
 	} else if (strcmp(cmd, "help") == 0) {
+		close_dashboard(c);
 		print_help(c);
+	} else if (strcmp(cmd, "profile") == 0) {
+		toggle_profiler(c);
+	} else if (strcmp(cmd, "jobs") == 0) {
+		list_jobs(c);
+	} else if (strcmp(cmd, "cancel") == 0) {
+		cancel_job(c, input);
+	} else {
+		start_job(c, cmd, input);
+	}
+}
+
+/* Header with how long the console has been up (updated by a timer) */
+typedef struct uptime {
+	char title[128];
+	time_t start;
+} uptime;
+
+static bool show_uptime (console c, void *data)
+{
+	uptime *u = data;
+	long secs = (long)(time(NULL) - u->start);
+	char title[256];
+	snprintf(title, sizeof(title), "%s  up %02ld:%02ld:%02ld", u->title,
+		 secs / 3600, secs / 60 % 60, secs % 60);
+	console_set_title(c, title);
+	return true;
+}
+
+/* Resolve the executable from the ptkl command line once, at startup */
+static void resolve_exe_path(void)
+{
+	const char *arg0 = root_command->argv ? root_command->argv[0] : NULL;
+	if (!arg0 || !*arg0) return;
+	if (!strchr(arg0, '/')) {
+		snprintf(exe_path, sizeof(exe_path), "%s", arg0);
+	} else if (!realpath(arg0, exe_path)) {
+		snprintf(exe_path, sizeof(exe_path), "%s", arg0);
 	}
 }
 
@@ -138,9 +586,9 @@ static void console_command (command cmd)
 	}
 
 	/* Set title with version */
-	char title[256];
-	snprintf(title, sizeof(title), "Partikle Runtime %s", version);
-	console_set_title(c, title);
+	uptime up = {.start = time(NULL)};
+	snprintf(up.title, sizeof(up.title), "Partikle Runtime %s", version);
+	console_set_title(c, up.title);
 
 	if (!console_init (c)) {
 		LOG_ERROR ("Failed to initialize console");
@@ -149,9 +597,14 @@ static void console_command (command cmd)
 	}
 
 	/* Set up command handlers */
+	build_completions(cmd);
+	resolve_exe_path();
+	jobs = console_jobs_new(c, JOBS_DEFAULT_WORKERS);
 	console_set_command_handler(c, handle_command);
+	console_set_key_handler(c, handle_key, NULL);
 	console_set_completion_handler(c, complete_command);
 	console_show_command_bar(c, ">");
+	console_add_timer(c, 1000, show_uptime, &up);
 
 	/* Print welcome message and help */
 	console_print(c, "\n\n");
@@ -161,14 +614,18 @@ static void console_command (command cmd)
 	console_run (c);
 
 	/* Clean up */
+	close_dashboard(c);
+	console_jobs_free(jobs);
+	jobs = NULL;
 	console_cleanup (c);
 	console_free (c);
+	completion_free(completions);
+	completions = NULL;
 }
 
-command console_command_new (command parent, const char *group)
-{
-	command cmd = command_add (parent, "console", "open the admin console",
-				   console_command);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
-}
+const command_spec console_spec = {
+	.name = "console",
+	.help = "open the admin console",
+	.group = GROUP_INTERACTIVE,
+	.fn = console_command,
+};
@@ -25,6 +25,7 @@
  */
 
 #include "command.h"
+#include "commands.h"
 #include "log.h"
 
 static void data (command cmd)
@@ -32,10 +33,9 @@ static void data (command cmd)
 	TODO ("implement");
 }
 
-command data_new (command parent, const char *group)
-{
-	command cmd = command_add (parent, "data", "manage data (kv, doc, sql)",
-				   data);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
-}
+const command_spec data_spec = {
+	.name = "data",
+	.help = "manage data (kv, doc, sql)",
+	.group = GROUP_SERVICES,
+	.fn = data,
+};
@@ -0,0 +1,152 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permissio  n notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "command.h"
+#include "commands.h"
+#include "heapprof.h"
+#include "heaptrace.h"
+#include "log.h"
+
+/*
+ * ptkl heap works with heap traces (see heaptrace.h), which ptkl run
+ * --heap-trace records. Heap profiles (see heapprof.h) are read with
+ * pprof or a flame graph tool instead.
+ */
+
+extern void help (command cmd);
+
+bool heap_profile_write (heapprof *p, const char *path)
+{
+	FILE *f = fopen (path, "w");
+	if (f == nullptr) {
+		log_error ("unable to write heap profile: %s", path);
+		return false;
+	}
+	size_t len = strlen (path), suffix = strlen (".folded");
+	bool ok;
+	if (len > suffix && strcmp (path + len - suffix, ".folded") == 0) {
+		heapprof_write_folded (p, f);
+		ok = !ferror (f);
+	} else {
+		ok = heapprof_write_pprof (p, f);
+	}
+	ok = fclose (f) == 0 && ok;
+	if (!ok) {
+		log_error ("unable to write heap profile: %s", path);
+		return false;
+	}
+
+	heapprof_stats stats;
+	heapprof_get_stats (p, &stats);
+	log_time ("heap profile: %llu live samples (~%.1f MB) written to %s",
+		  (unsigned long long)stats.live,
+		  stats.live_bytes / (1024.0 * 1024.0), path);
+	return true;
+}
+
+static bool int_setting (command cmd, const char *name, int *n)
+{
+	string value = command_get (cmd, name);
+	if (value == nullptr) return true;
+	char *end;
+	long v = strtol (value, &end, 10);
+	if (end == value || *end != '\0' || v <= 0 || v > 1000) {
+		command_push_errorf (cmd, "invalid --%s: %s", name, value);
+		return false;
+	}
+	*n = (int)v;
+	return true;
+}
+
+static void analyze (command cmd)
+{
+	if (vector_size (cmd->args) != 1) {
+		command_push_error (cmd, "heap analyze: expected a trace file");
+		return;
+	}
+	heaptrace_analyze_opts opts = {0};
+	if (!int_setting (cmd, "buckets", &opts.buckets) ||
+	    !int_setting (cmd, "top", &opts.top)) {
+		return;
+	}
+	const char *path = vector_get (cmd->args, 0);
+	if (!heaptrace_analyze (path, stdout, &opts)) {
+		command_push_errorf (cmd, "heap analyze: cannot read %s", path);
+	}
+}
+
+static void buckets_flag (flag f)
+{
+	command_set (f->command, "buckets", f->arg);
+}
+
+static void top_flag (flag f)
+{
+	command_set (f->command, "top", f->arg);
+}
+
+static const flag_spec buckets_flag_spec = {
+	.long_flag = "buckets",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "intervals in the live heap timeline (default 20)",
+	.fn = buckets_flag,
+};
+
+static const flag_spec top_flag_spec = {
+	.long_flag = "top",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "stacks listed for the peak and leak candidates (default 10)",
+	.fn = top_flag,
+};
+
+static const command_spec analyze_spec = {
+	.name = "analyze",
+	.help = "report the live heap, allocation sizes, peak, and leaks",
+	.fn = analyze,
+	.expect_args = COMMAND_ARGS_ANY,
+	.flags =
+		(const flag_spec *const[]){
+			&buckets_flag_spec,
+			&top_flag_spec,
+			nullptr,
+		},
+};
+
+const command_spec heap_spec = {
+	.name = "heap",
+	.help = "analyze JavaScript heap traces",
+	.group = GROUP_DEVELOPMENT,
+	.fn = help,
+	.commands =
+		(const command_spec *const[]){
+			&analyze_spec,
+			nullptr,
+		},
+};
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "command.h"
+#include "commands.h"
 #include "map.h"
 #include "vector.h"
 
@@ -27,8 +28,9 @@ static size_t get_max_width (command cmd)
 	}
 
 	/* Check command widths */
-	for (size_t i = 0; i < vector_size (cmd->ordered_commands); i++) {
-		command subcmd = vector_get (cmd->ordered_commands, i);
+	vector *commands = command_subcommands (cmd);
+	for (size_t i = 0; i < vector_size (commands); i++) {
+		command subcmd = vector_get (commands, i);
 		size_t width = strlen (subcmd->name) + 2; /* name + 2 spaces */
 		if (width > max_width) max_width = width;
 	}
@@ -50,6 +52,7 @@ static void print_aligned (const char *name, const char *help, size_t width)
 void help (command cmd)
 {
 	size_t width = get_max_width (cmd);
+	vector *commands = command_subcommands (cmd);
 
 	printf ("Usage: %s [options] [command] [args]\n\n", cmd->name);
 	printf ("Options:\n");
@@ -68,8 +71,8 @@ void help (command cmd)
 
 	/* First check if there are any ungrouped commands */
 	bool has_ungrouped = false;
-	for (size_t i = 0; i < vector_size (cmd->ordered_commands); i++) {
-		command subcmd = vector_get (cmd->ordered_commands, i);
+	for (size_t i = 0; i < vector_size (commands); i++) {
+		command subcmd = vector_get (commands, i);
 		if (subcmd->group == nullptr) {
 			has_ungrouped = true;
 			break;
@@ -79,9 +82,9 @@ void help (command cmd)
 	/* Then show ungrouped commands if any */
 	if (has_ungrouped) {
 		printf ("\nCommands:\n");
-		for (size_t i = 0; i < vector_size (cmd->ordered_commands);
+		for (size_t i = 0; i < vector_size (commands);
 		     i++) {
-			command subcmd = vector_get (cmd->ordered_commands, i);
+			command subcmd = vector_get (commands, i);
 			if (subcmd->group == nullptr) {
 				print_aligned (subcmd->name, subcmd->help,
 					       width);
@@ -94,17 +97,15 @@ void help (command cmd)
 	map_init (shown_groups);
 
 	/* Then show commands by group */
-	for (size_t i = 0; i < vector_size (cmd->ordered_commands); i++) {
-		command subcmd = vector_get (cmd->ordered_commands, i);
+	for (size_t i = 0; i < vector_size (commands); i++) {
+		command subcmd = vector_get (commands, i);
 		if (subcmd->group && !map_get (shown_groups, subcmd->group)) {
 			printf ("\n%s:\n", subcmd->group);
 			map_put (shown_groups, subcmd->group, (void *)1);
 
 			/* Show all commands in this group */
-			for (size_t j = 0;
-			     j < vector_size (cmd->ordered_commands); j++) {
-				command cmd2 =
-					vector_get (cmd->ordered_commands, j);
+			for (size_t j = 0; j < vector_size (commands); j++) {
+				command cmd2 = vector_get (commands, j);
 				if (cmd2->group &&
 				    strcmp (cmd2->group, subcmd->group) == 0) {
 					print_aligned (cmd2->name, cmd2->help,
@@ -123,17 +124,25 @@ static void help_flag (flag f)
 	help (f->command);
 }
 
-command help_new (command parent, const char *group)
+/* "help" prints help for the command it's a subcommand of */
+static void help_command (command cmd)
 {
-	auto help_cmd = command_add (parent, "help", "print help", help);
-	command_expect_args (help_cmd, COMMAND_ARGS_ANY);
-	if (group != nullptr) command_set_group (help_cmd, group);
-	return help_cmd;
+	help (cmd->parent != nullptr ? cmd->parent : cmd);
 }
 
-command help_flag_new (command parent)
-{
-	flag hf = command_flag (parent, 'h', "help", NO_ARGUMENT, "print help");
-	flag_add_callback (hf, help_flag, true);
-	return parent;
-}
+const command_spec help_spec = {
+	.name = "help",
+	.help = "print help",
+	.group = GROUP_BUILTIN,
+	.fn = help_command,
+	.expect_args = COMMAND_ARGS_ANY,
+};
+
+const flag_spec help_flag_spec = {
+	.short_flag = 'h',
+	.long_flag = "help",
+	.has_arg = NO_ARGUMENT,
+	.help = "print help",
+	.fn = help_flag,
+	.should_exit = true,
+};
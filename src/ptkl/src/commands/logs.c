@@ -25,6 +25,7 @@
  */
 
 #include "command.h"
+#include "commands.h"
 #include "log.h"
 
 static void logs (command cmd)
@@ -32,10 +33,9 @@ static void logs (command cmd)
 	TODO ("implement");
 }
 
-command logs_new (command parent, const char *group)
-{
-	command cmd =
-		command_add (parent, "logs", "monitor and query logs", logs);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
-}
+const command_spec logs_spec = {
+	.name = "logs",
+	.help = "monitor and query logs",
+	.group = GROUP_SERVICES,
+	.fn = logs,
+};
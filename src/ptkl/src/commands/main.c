@@ -7,12 +7,9 @@
  */
 
 #include "command.h"
+#include "commands.h"
 #include "ptkl.h"
 
-extern command help_new (command parent, const char *group);
-extern command version_new (command parent, const char *group);
-extern command help_flag_new (command parent);
-extern command version_flag_new (command parent);
 extern void help (command cmd);
 
 static void default_command (command cmd)
@@ -20,16 +17,39 @@ static void default_command (command cmd)
 	help (cmd);
 }
 
-command main_command_new (const char *name, const char *group)
-{
-	auto description = "Partikle is a lightweight runtime for the web";
-	command cmd = command_new (name, description, default_command);
-	command_set (cmd, "version", CONFIG_VERSION);
+const command_spec main_spec = {
+	.name = PTKL,
+	.help = "Partikle is a lightweight runtime for the web",
+	.fn = default_command,
+	.settings = (const char *const[]){"version", CONFIG_VERSION, nullptr},
+	.flags =
+		(const flag_spec *const[]){
+			&version_flag_spec,
+			&help_flag_spec,
+			&profile_flag_spec,
+			nullptr,
+		},
+	.commands =
+		(const command_spec *const[]){
+			/* Built-in commands */
+			&help_spec,
+			&version_spec,
 
-	/* Configure flags */
-	version_flag_new (cmd);
-	help_flag_new (cmd);
+			/* Development commands */
+			&run_spec,
+			&serve_spec,
+			&compile_spec,
+			&heap_spec,
 
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
-}
+			/* Service commands */
+			&service_spec,
+			&storage_spec,
+			&data_spec,
+			&logs_spec,
+
+			/* Interactive commands */
+			&console_spec,
+			&repl_spec,
+			nullptr,
+		},
+};
@@ -0,0 +1,95 @@
+/*
+ * ptkl - Partikle Runtime
+ *
+ * MIT License
+ * Copyright (c) 2025 Tony Pujals
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "command.h"
+#include "commands.h"
+#include "cpuprof.h"
+#include "log.h"
+#include "profiler.h"
+
+/*
+ * --profile FILE samples native stacks at PROFILER_DEFAULT_HZ for the whole
+ * run and writes folded stacks (for flamegraph.pl, speedscope, etc.) to FILE
+ * when the command finishes.
+ */
+
+static void profile_flag (flag f)
+{
+	if (!profiler_start (PROFILER_DEFAULT_HZ)) {
+		LOG_ERROR ("unable to start profiler");
+		return;
+	}
+	command_set (f->command, "profile", f->arg);
+}
+
+const flag_spec profile_flag_spec = {
+	.short_flag = 'p',
+	.long_flag = "profile",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "write a native CPU profile (folded stacks)",
+	.fn = profile_flag,
+	.should_exit = false,
+};
+
+bool profile_write (const char *path)
+{
+	profiler_stop ();
+
+	FILE *f = fopen (path, "w");
+	if (f == nullptr) {
+		log_error ("unable to write profile: %s", path);
+		return false;
+	}
+	size_t samples = profiler_write_folded (f);
+	fclose (f);
+
+	log_time ("profile: %zu samples (%zu dropped) written to %s", samples,
+		  profiler_dropped (), path);
+	profiler_reset ();
+	return true;
+}
+
+void profile_finish (command cmd)
+{
+	string path = command_get (cmd, "profile");
+	if (path == nullptr || !profiler_running ()) return;
+	profile_write (path);
+}
+
+/*
+ * --cpu-profile FILE (run and serve) samples JavaScript stacks instead,
+ * with the engine's CPU profiler (see cpuprof.h).
+ */
+
+bool cpu_profile_write (cpuprof *p, const char *path, int top)
+{
+	FILE *f = fopen (path, "w");
+	if (f == nullptr) {
+		log_error ("unable to write cpu profile: %s", path);
+		return false;
+	}
+	size_t len = strlen (path), suffix = strlen (".cpuprofile");
+	bool ok = true;
+	if (len > suffix && strcmp (path + len - suffix, ".cpuprofile") == 0) {
+		ok = cpuprof_write_cpuprofile (p, f);
+	} else {
+		cpuprof_write_folded (p, f);
+	}
+	ok = fclose (f) == 0 && ok;
+	if (!ok) {
+		log_error ("unable to write cpu profile: %s", path);
+		return false;
+	}
+
+	log_time ("cpu profile: %zu samples written to %s",
+		  cpuprof_samples (p), path);
+	cpuprof_write_top (p, stderr, top);
+	return true;
+}
@@ -25,17 +25,19 @@
  */
 
 #include "command.h"
+#include "commands.h"
 #include "log.h"
 
+/* The poc's shell made its own runtime; here it gets an engine (qjs.h),
+   as run does, so both set up JavaScript the same way */
 static void repl (command cmd)
 {
 	TODO ("migrate from partikle poc");
 }
 
-command repl_new (command parent, const char *group)
-{
-	command cmd =
-		command_add (parent, "repl", "start a JavaScript shell", repl);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
-}
+const command_spec repl_spec = {
+	.name = "repl",
+	.help = "start a JavaScript shell",
+	.group = GROUP_INTERACTIVE,
+	.fn = repl,
+};
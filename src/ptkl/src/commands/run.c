@@ -24,26 +24,372 @@
  * THE SOFTWARE.
  */
 
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "command.h"
+#include "commands.h"
 #include "log.h"
+#include "ptkl.h"
 #include "qjs.h"
+#include "subsystem.h"
+
+/* the engine's options, set by run before the engine subsystem is used */
+static engine_opts opts;
+static bool use_cache;
+static const char *bundle_path;
+static const char *heap_trace_path;
+static const char *heap_profile_path;
+static size_t heap_sample_interval;
+static const char *cpu_profile_path;
+static size_t cpu_profile_hz;
+static size_t cpu_profile_top;
+static engine *js;
+
+static void engine_teardown ();
+
+static bool engine_init ()
+{
+	/* A bundle is already compiled, and without a cache directory, run
+	   compiles every time */
+	char dir[PATH_MAX];
+	if (bundle_path) {
+		opts.bundle = bundle_open (bundle_path);
+		if (!opts.bundle) return false;
+	} else if (use_cache && codecache_default_dir (dir, sizeof (dir))) {
+		opts.cache = codecache_open (dir, CODECACHE_DEFAULT_MAX);
+	}
+	if (heap_trace_path) {
+		opts.heap_trace = heaptrace_open (heap_trace_path);
+		if (!opts.heap_trace) {
+			engine_teardown ();
+			return false;
+		}
+	}
+	if (heap_profile_path) {
+		opts.heap_profile = heapprof_new (heap_sample_interval);
+	}
+	if (cpu_profile_path) {
+		opts.cpu_profile = cpuprof_new ((unsigned)cpu_profile_hz);
+	}
+	js = engine_new (&opts);
+	if (!js) {
+		engine_teardown ();
+		return false;
+	}
+	if (opts.cpu_profile && !cpuprof_start (opts.cpu_profile)) {
+		log_error ("cannot start the cpu profiler");
+	}
+	return true;
+}
+
+static void engine_teardown ()
+{
+	engine_free (js);
+	js = nullptr;
+	codecache_close (opts.cache);
+	opts.cache = nullptr;
+	bundle_close (opts.bundle);
+	opts.bundle = nullptr;
+	if (opts.heap_trace) {
+		if (heaptrace_close (opts.heap_trace)) {
+			log_time ("heap trace written to %s "
+				  "(see ptkl heap analyze)",
+				  heap_trace_path);
+		} else {
+			log_error ("cannot write heap trace: %s",
+				   heap_trace_path);
+		}
+		opts.heap_trace = nullptr;
+	}
+	if (opts.heap_profile) {
+		heap_profile_write (opts.heap_profile, heap_profile_path);
+		heapprof_free (opts.heap_profile);
+		opts.heap_profile = nullptr;
+	}
+	if (opts.cpu_profile) {
+		cpuprof_stop (opts.cpu_profile);
+		cpu_profile_write (opts.cpu_profile, cpu_profile_path,
+				   (int)cpu_profile_top);
+		cpuprof_free (opts.cpu_profile);
+		opts.cpu_profile = nullptr;
+	}
+}
+
+static subsystem engine_subsystem =
+	SUBSYSTEM ("engine", engine_init, engine_teardown);
+
+/* A byte count, optionally with a k, m, or g suffix */
+static bool parse_size (const char *s, size_t *size)
+{
+	/* (strtoull would take "-1" as a huge count) */
+	if (!isdigit ((unsigned char)*s)) return false;
+	char *end;
+	errno = 0;
+	unsigned long long n = strtoull (s, &end, 10);
+	if (end == s || errno == ERANGE) return false;
+	int shift = 0;
+	switch (*end) {
+	case 'k':
+	case 'K': shift = 10; break;
+	case 'm':
+	case 'M': shift = 20; break;
+	case 'g':
+	case 'G': shift = 30; break;
+	}
+	if (shift) end++;
+	if (*end != '\0' || n > SIZE_MAX >> shift) return false;
+	*size = (size_t)(n << shift);
+	return true;
+}
+
+static bool size_setting (command cmd, const char *name, size_t *size)
+{
+	string value = command_get (cmd, name);
+	if (value == nullptr) return true;
+	if (parse_size (value, size)) return true;
+	command_push_errorf (cmd, "invalid --%s: %s", name, value);
+	return false;
+}
+
+static bool count_setting (command cmd, const char *name, size_t *count)
+{
+	string value = command_get (cmd, name);
+	if (value == nullptr) return true;
+	char *end;
+	unsigned long n = strtoul (value, &end, 10);
+	if (end != value && *end == '\0' && n > 0 && n <= 100000) {
+		*count = n;
+		return true;
+	}
+	command_push_errorf (cmd, "invalid --%s: %s", name, value);
+	return false;
+}
+
+static bool is_bundle (const char *path)
+{
+	size_t len = strlen (path), suffix = strlen (BUNDLE_SUFFIX);
+	return len > suffix && strcmp (path + len - suffix, BUNDLE_SUFFIX) == 0;
+}
+
+static void cache_report (engine *e)
+{
+	engine_stats stats;
+	engine_get_stats (e, &stats);
+	log_time ("cache: %llu hits, %llu compiled (%.2f ms), "
+		  "loaded in %.2f ms, saved %.2f ms",
+		  (unsigned long long)stats.cache_hits,
+		  (unsigned long long)stats.compiled, stats.compile_ns / 1e6,
+		  stats.cache_load_ns / 1e6, stats.cache_saved_ns / 1e6);
+}
 
 static void run (command cmd)
 {
-	TODO ("migrate from partikle poc");
-	test_engine ();
-	for (int i = 0; i < vector_size (cmd->args); i++) {
-		char *arg = vector_get (cmd->args, i);
-		printf ("arg[%d]: %s\n", i, arg);
+	ptkl_startup_mark ("dispatch");
+	size_t argc = vector_size (cmd->args);
+	if (argc == 0) {
+		command_push_error (cmd, "run: missing file");
+		return;
+	}
+	char *argv0 = vector_get (cmd->args, 0);
+
+	opts = ENGINE_OPTS_DEFAULT;
+	heap_sample_interval = 0;
+	cpu_profile_hz = CPUPROF_DEFAULT_HZ;
+	cpu_profile_top = CPU_PROFILE_DEFAULT_TOP;
+	if (!size_setting (cmd, "memory-limit", &opts.memory_limit) ||
+	    !size_setting (cmd, "stack-size", &opts.stack_size) ||
+	    !size_setting (cmd, "heap-sample-interval",
+			   &heap_sample_interval) ||
+	    !count_setting (cmd, "cpu-profile-hz", &cpu_profile_hz) ||
+	    !count_setting (cmd, "cpu-profile-top", &cpu_profile_top)) {
+		return;
 	}
+	opts.arena = command_get (cmd, "arena") != nullptr;
+	use_cache = command_get (cmd, "no-cache") == nullptr;
+	bundle_path = is_bundle (argv0) ? argv0 : nullptr;
+	heap_trace_path = command_get (cmd, "heap-trace");
+	heap_profile_path = command_get (cmd, "heap-profile");
+	cpu_profile_path = command_get (cmd, "cpu-profile");
+
+	/* scriptArgs: the file and its arguments */
+	char **argv = calloc (argc + 1, sizeof (char *));
+	if (!argv) panic ("out of memory");
+	for (size_t i = 0; i < argc; i++) argv[i] = vector_get (cmd->args, i);
+	opts.argc = (int)argc;
+	opts.argv = argv;
+
+	if (subsystem_use (&engine_subsystem)) {
+		ptkl_startup_mark ("engine");
+		bool ok = bundle_path ? engine_eval_bundle (js)
+				      : engine_eval_file (js, argv[0]);
+		if (command_get (cmd, "cache-report")) cache_report (js);
+		if (ok) {
+			engine_run_loop (js);
+		} else {
+			command_push_errorf (cmd, "run: %s failed", argv[0]);
+		}
+	} else {
+		command_push_error (cmd, "run: cannot start the engine");
+	}
+	free (argv);
+}
+
+static void memory_limit_flag (flag f)
+{
+	command_set (f->command, "memory-limit", f->arg);
+}
+
+static void stack_size_flag (flag f)
+{
+	command_set (f->command, "stack-size", f->arg);
+}
+
+static void no_cache_flag (flag f)
+{
+	command_set (f->command, "no-cache", "true");
+}
+
+static void arena_flag (flag f)
+{
+	command_set (f->command, "arena", "true");
 }
 
-command run_new (command parent, const char *group)
+static void heap_trace_flag (flag f)
 {
-	command cmd =
-		command_add (parent, "run", "run a JavaScript program", run);
-	command_expect_args (cmd, COMMAND_ARGS_ANY);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
+	command_set (f->command, "heap-trace", f->arg);
 }
+
+static void heap_profile_flag (flag f)
+{
+	command_set (f->command, "heap-profile", f->arg);
+}
+
+static void heap_sample_interval_flag (flag f)
+{
+	command_set (f->command, "heap-sample-interval", f->arg);
+}
+
+static void cpu_profile_flag (flag f)
+{
+	command_set (f->command, "cpu-profile", f->arg);
+}
+
+static void cpu_profile_hz_flag (flag f)
+{
+	command_set (f->command, "cpu-profile-hz", f->arg);
+}
+
+static void cpu_profile_top_flag (flag f)
+{
+	command_set (f->command, "cpu-profile-top", f->arg);
+}
+
+static void cache_report_flag (flag f)
+{
+	command_set (f->command, "cache-report", "true");
+}
+
+static const flag_spec memory_limit_flag_spec = {
+	.long_flag = "memory-limit",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "limit the JavaScript heap (bytes, or with k, m, g)",
+	.fn = memory_limit_flag,
+};
+
+static const flag_spec stack_size_flag_spec = {
+	.long_flag = "stack-size",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "limit the JavaScript stack (bytes, or with k, m, g)",
+	.fn = stack_size_flag,
+};
+
+static const flag_spec no_cache_flag_spec = {
+	.long_flag = "no-cache",
+	.has_arg = NO_ARGUMENT,
+	.help = "compile every file instead of using the bytecode cache",
+	.fn = no_cache_flag,
+};
+
+static const flag_spec arena_flag_spec = {
+	.long_flag = "arena",
+	.has_arg = NO_ARGUMENT,
+	.help = "allocate the JavaScript heap from an arena, freed whole",
+	.fn = arena_flag,
+};
+
+static const flag_spec heap_trace_flag_spec = {
+	.long_flag = "heap-trace",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "record every JavaScript heap allocation to a file",
+	.fn = heap_trace_flag,
+};
+
+static const flag_spec heap_profile_flag_spec = {
+	.long_flag = "heap-profile",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "sample the JavaScript heap to a pprof (or .folded) file",
+	.fn = heap_profile_flag,
+};
+
+static const flag_spec heap_sample_interval_flag_spec = {
+	.long_flag = "heap-sample-interval",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "average bytes between heap samples (default 512k)",
+	.fn = heap_sample_interval_flag,
+};
+
+static const flag_spec cpu_profile_flag_spec = {
+	.long_flag = "cpu-profile",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "sample JavaScript stacks to a .cpuprofile (or folded) file",
+	.fn = cpu_profile_flag,
+};
+
+static const flag_spec cpu_profile_hz_flag_spec = {
+	.long_flag = "cpu-profile-hz",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "cpu profile samples a second (default 1000)",
+	.fn = cpu_profile_hz_flag,
+};
+
+static const flag_spec cpu_profile_top_flag_spec = {
+	.long_flag = "cpu-profile-top",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "functions to list after a cpu profile (default 20)",
+	.fn = cpu_profile_top_flag,
+};
+
+static const flag_spec cache_report_flag_spec = {
+	.long_flag = "cache-report",
+	.has_arg = NO_ARGUMENT,
+	.help = "report bytecode cache hits and compile time",
+	.fn = cache_report_flag,
+};
+
+const command_spec run_spec = {
+	.name = "run",
+	.help = "run a JavaScript program",
+	.group = GROUP_DEVELOPMENT,
+	.fn = run,
+	.expect_args = COMMAND_ARGS_ANY,
+	.flags =
+		(const flag_spec *const[]){
+			&memory_limit_flag_spec,
+			&stack_size_flag_spec,
+			&arena_flag_spec,
+			&no_cache_flag_spec,
+			&cache_report_flag_spec,
+			&heap_trace_flag_spec,
+			&heap_profile_flag_spec,
+			&heap_sample_interval_flag_spec,
+			&cpu_profile_flag_spec,
+			&cpu_profile_hz_flag_spec,
+			&cpu_profile_top_flag_spec,
+			nullptr,
+		},
+};
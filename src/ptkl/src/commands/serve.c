@@ -24,18 +24,380 @@
  * THE SOFTWARE.
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
 #include "command.h"
+#include "commands.h"
 #include "log.h"
+#include "metrics.h"
+#include "ptkl.h"
+#include "qjs.h"
+#include "zygote.h"
+
+/*
+ * ptkl serve runs as a zygote (see zygote.h): the app's top-level code is
+ * evaluated once, here, and each worker is forked from the initialized
+ * engine and runs its event loop. Workers are managed with the zygote's
+ * control protocol on stdin.
+ *
+ * There's no engine pool (see qjs.h) here: a worker's one engine runs the
+ * app's event loop, and the app's own server code handles every request
+ * in it, so there's no per-request engine to borrow. A pool is for a host
+ * that calls a handler in a fresh-looking engine for each request.
+ *
+ * With --heap-profile, the heap profiler samples from the start (so the
+ * workers inherit the app's samples), and a worker writes its profile
+ * when it gets SIGUSR2 and when its loop ends, to the path with its pid
+ * before the extension (heap.pb -> heap.1234.pb).
+ *
+ * --cpu-profile works the same way, except that sampling starts in each
+ * worker: the profiler's timer thread doesn't survive fork, and the
+ * zygote's time is spent on the app's top level, not on requests.
+ *
+ * Each worker publishes its metrics (see metrics.h) under the app's name,
+ * for the console's dashboard: the requests the app reports with
+ * reportRequest(ms[, ok]), and its RSS and JS heap size, read every
+ * METRICS_INTERVAL_MS. QuickJS doesn't report its collections, so there
+ * is no GC count.
+ */
+
+#define METRICS_INTERVAL_MS 1000
+
+static metrics_publisher *metrics;
+static char service[METRICS_NAME_MAX];
+
+/* stops the metrics thread */
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t metrics_stop = PTHREAD_COND_INITIALIZER;
+static bool metrics_stopping;
+
+static heapprof *heap_profile;
+static const char *heap_profile_path;
+static cpuprof *cpu_profile;
+static const char *cpu_profile_path;
+
+/* posted by the SIGUSR2 handler (sem_post is async-signal-safe) */
+static sem_t dump_requested;
+
+/* path with the worker's pid before the extension */
+static void worker_path (const char *path, char *out, size_t size)
+{
+	const char *dot = strrchr (path, '.');
+	const char *slash = strrchr (path, '/');
+	if (!dot || (slash && dot < slash)) dot = path + strlen (path);
+	snprintf (out, size, "%.*s.%d%s", (int)(dot - path), path,
+		  (int)getpid (), dot);
+}
+
+static void write_profiles ()
+{
+	char path[PATH_MAX];
+	if (heap_profile) {
+		worker_path (heap_profile_path, path, sizeof (path));
+		heap_profile_write (heap_profile, path);
+	}
+	if (cpu_profile) {
+		worker_path (cpu_profile_path, path, sizeof (path));
+		cpu_profile_write (cpu_profile, path,
+				   CPU_PROFILE_DEFAULT_TOP);
+	}
+}
+
+static void free_profiles ()
+{
+	heapprof_free (heap_profile);
+	heap_profile = nullptr;
+	cpuprof_free (cpu_profile);
+	cpu_profile = nullptr;
+}
+
+static void request_dump (int sig)
+{
+	sem_post (&dump_requested);
+}
+
+/* The profilers are thread safe, so they're written from here while the
+   worker's loop runs */
+static void *dump_profiles (void *arg)
+{
+	for (;;) {
+		if (sem_wait (&dump_requested) < 0) {
+			if (errno == EINTR) continue;
+			return nullptr;
+		}
+		write_profiles ();
+	}
+}
+
+static void start_dumps ()
+{
+	pthread_t thread;
+	sem_init (&dump_requested, 0, 0);
+	if (pthread_create (&thread, nullptr, dump_profiles, nullptr)) {
+		log_error ("serve: cannot start the profile thread");
+		return;
+	}
+	pthread_detach (thread);
+	struct sigaction sa = {.sa_handler = request_dump,
+			       .sa_flags = SA_RESTART};
+	sigemptyset (&sa.sa_mask);
+	sigaction (SIGUSR2, &sa, nullptr);
+}
+
+static void report_request (void *arg, uint64_t latency_ns, bool ok)
+{
+	metrics_request (metrics, latency_ns, ok);
+}
+
+/* a first reading of the engine, for the metrics thread to publish */
+static engine_stats first_reading;
+
+/* The gauges are set here (only), requests on the engine's thread */
+static void *publish_metrics (void *arg)
+{
+	engine *js = arg;
+	metrics_set (metrics, METRIC_HEAP_USED, first_reading.memory_used);
+	metrics_set (metrics, METRIC_HEAP_LIMIT, first_reading.memory_limit);
+	pthread_mutex_lock (&metrics_lock);
+	while (!metrics_stopping) {
+		metrics_sample_rss (metrics);
+		/* (0 until the engine has taken a reading) */
+		size_t used = engine_sample_memory (js);
+		if (used) metrics_set (metrics, METRIC_HEAP_USED, used);
+		struct timespec ts;
+		clock_gettime (CLOCK_REALTIME, &ts);
+		ts.tv_sec += METRICS_INTERVAL_MS / 1000;
+		ts.tv_nsec += (METRICS_INTERVAL_MS % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait (&metrics_stop, &metrics_lock, &ts);
+	}
+	pthread_mutex_unlock (&metrics_lock);
+	return nullptr;
+}
+
+static bool start_metrics (engine *js, pthread_t *thread)
+{
+	metrics = metrics_publish (nullptr, service);
+	if (!metrics) return false;
+
+	/* a first reading, from this thread (engine_get_stats can't be called
+	   while the engine runs), in case the app is idle */
+	engine_get_stats (js, &first_reading);
+	if (pthread_create (thread, nullptr, publish_metrics, js)) {
+		log_error ("serve: cannot start the metrics thread");
+		metrics_unpublish (metrics);
+		metrics = nullptr;
+		return false;
+	}
+	return true;
+}
+
+static void stop_metrics (pthread_t thread)
+{
+	pthread_mutex_lock (&metrics_lock);
+	metrics_stopping = true;
+	pthread_cond_signal (&metrics_stop);
+	pthread_mutex_unlock (&metrics_lock);
+	pthread_join (thread, nullptr);
+	metrics_unpublish (metrics);
+	metrics = nullptr;
+}
+
+/* app.js -> app */
+static void service_name (const char *path)
+{
+	const char *base = strrchr (path, '/');
+	base = base ? base + 1 : path;
+	const char *dot = strrchr (base, '.');
+	int len = dot && dot > base ? (int)(dot - base) : (int)strlen (base);
+	snprintf (service, sizeof (service), "%.*s", len, base);
+}
+
+static void collect_garbage (void *arg)
+{
+	engine_gc (arg);
+}
+
+static int run_worker (int index, void *arg)
+{
+	if (cpu_profile && !cpuprof_start (cpu_profile)) {
+		log_error ("serve: cannot start the cpu profiler");
+	}
+	if (heap_profile || cpu_profile) start_dumps ();
+	pthread_t metrics_thread;
+	bool publishing = start_metrics (arg, &metrics_thread);
+	engine_run_loop (arg);
+	if (publishing) stop_metrics (metrics_thread);
+	if (cpu_profile) cpuprof_stop (cpu_profile);
+	if (heap_profile || cpu_profile) write_profiles ();
+	return EXIT_SUCCESS;
+}
 
 static void serve (command cmd)
 {
-	TODO ("implement");
+	ptkl_startup_mark ("dispatch");
+	size_t argc = vector_size (cmd->args);
+	if (argc == 0) {
+		command_push_error (cmd, "serve: missing file");
+		return;
+	}
+	int workers = 1;
+	string value = command_get (cmd, "workers");
+	if (value != nullptr && (workers = atoi (value)) <= 0) {
+		command_push_errorf (cmd, "invalid --workers: %s", value);
+		return;
+	}
+	int hz = CPUPROF_DEFAULT_HZ;
+	value = command_get (cmd, "cpu-profile-hz");
+	if (value != nullptr && (hz = atoi (value)) <= 0) {
+		command_push_errorf (cmd, "invalid --cpu-profile-hz: %s",
+				     value);
+		return;
+	}
+
+	/* scriptArgs: the file and its arguments */
+	char **argv = calloc (argc + 1, sizeof (char *));
+	if (!argv) panic ("out of memory");
+	for (size_t i = 0; i < argc; i++) argv[i] = vector_get (cmd->args, i);
+	engine_opts opts = ENGINE_OPTS_DEFAULT;
+	opts.argc = (int)argc;
+	opts.argv = argv;
+	opts.on_request = report_request;
+	opts.sample_memory = true;
+	service_name (argv[0]);
+	heap_profile_path = command_get (cmd, "heap-profile");
+	if (heap_profile_path) {
+		heap_profile = heapprof_new (HEAPPROF_DEFAULT_INTERVAL);
+		opts.heap_profile = heap_profile;
+	}
+	cpu_profile_path = command_get (cmd, "cpu-profile");
+	if (cpu_profile_path) {
+		cpu_profile = cpuprof_new ((unsigned)hz);
+		opts.cpu_profile = cpu_profile;
+	}
+
+	engine *js = engine_new (&opts);
+	if (!js) {
+		command_push_error (cmd, "serve: cannot start the engine");
+		free_profiles ();
+		free (argv);
+		return;
+	}
+	ptkl_startup_mark ("engine");
+	if (!engine_eval_file (js, argv[0])) {
+		command_push_errorf (cmd, "serve: %s failed", argv[0]);
+		engine_free (js);
+		free_profiles ();
+		free (argv);
+		return;
+	}
+	ptkl_startup_mark ("app");
+
+	zygote_opts zopts = {
+		.worker = run_worker,
+		.prefork = collect_garbage,
+		.arg = js,
+	};
+	zygote *z = zygote_new (&zopts);
+	for (int i = 0; i < workers; i++) {
+		uint64_t ns;
+		pid_t pid = zygote_spawn (z, &ns);
+		if (pid < 0) break;
+		log_time ("serve: worker %d spawned in %llu us", (int)pid,
+			  (unsigned long long)(ns / 1000));
+	}
+	zygote_memory m;
+	if (zygote_read_memory (getpid (), &m)) {
+		log_time ("serve: zygote %d rss %zu KB (%zu KB private)",
+			  (int)getpid (), m.rss / 1024, m.private / 1024);
+	}
+	log_time ("serve: commands: spawn [N], reap, list, kill PID, quit");
+	if (heap_profile || cpu_profile) {
+		log_time ("serve: kill -USR2 PID writes the worker's profiles");
+	}
+
+	if (!zygote_serve (z, STDIN_FILENO, STDOUT_FILENO)) {
+		command_push_error (cmd, "serve: control connection failed");
+	}
+	zygote_free (z);
+	engine_free (js);
+	free_profiles ();
+	free (argv);
+}
+
+static void workers_flag (flag f)
+{
+	command_set (f->command, "workers", f->arg);
+}
+
+static void heap_profile_flag (flag f)
+{
+	command_set (f->command, "heap-profile", f->arg);
 }
 
-command serve_new (command parent, const char *group)
+static void cpu_profile_flag (flag f)
 {
-	command cmd = command_add (parent, "serve", "serve the current program",
-				   serve);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
+	command_set (f->command, "cpu-profile", f->arg);
 }
+
+static void cpu_profile_hz_flag (flag f)
+{
+	command_set (f->command, "cpu-profile-hz", f->arg);
+}
+
+static const flag_spec workers_flag_spec = {
+	.short_flag = 'w',
+	.long_flag = "workers",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "workers to start (default 1)",
+	.fn = workers_flag,
+};
+
+static const flag_spec heap_profile_flag_spec = {
+	.long_flag = "heap-profile",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "sample the JavaScript heap (workers write it on SIGUSR2)",
+	.fn = heap_profile_flag,
+};
+
+static const flag_spec cpu_profile_flag_spec = {
+	.long_flag = "cpu-profile",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "sample JavaScript stacks (workers write them on SIGUSR2)",
+	.fn = cpu_profile_flag,
+};
+
+static const flag_spec cpu_profile_hz_flag_spec = {
+	.long_flag = "cpu-profile-hz",
+	.has_arg = REQUIRED_ARGUMENT,
+	.help = "cpu profile samples a second (default 1000)",
+	.fn = cpu_profile_hz_flag,
+};
+
+const command_spec serve_spec = {
+	.name = "serve",
+	.help = "serve the current program",
+	.group = GROUP_DEVELOPMENT,
+	.fn = serve,
+	.expect_args = COMMAND_ARGS_ANY,
+	.flags =
+		(const flag_spec *const[]){
+			&workers_flag_spec,
+			&heap_profile_flag_spec,
+			&cpu_profile_flag_spec,
+			&cpu_profile_hz_flag_spec,
+			nullptr,
+		},
+};
@@ -25,6 +25,7 @@
  */
 
 #include "command.h"
+#include "commands.h"
 #include "log.h"
 
 static void service (command cmd)
@@ -32,11 +33,9 @@ static void service (command cmd)
 	TODO ("implement");
 }
 
-command service_new (command parent, const char *group)
-{
-	command cmd =
-		command_add (parent, "service",
-			     "manage services (web, job, agent)", service);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
-}
+const command_spec service_spec = {
+	.name = "service",
+	.help = "manage services (web, job, agent)",
+	.group = GROUP_SERVICES,
+	.fn = service,
+};
@@ -25,6 +25,7 @@
  */
 
 #include "command.h"
+#include "commands.h"
 #include "log.h"
 
 static void storage (command cmd)
@@ -32,10 +33,9 @@ static void storage (command cmd)
 	TODO ("implement");
 }
 
-command storage_new (command parent, const char *group)
-{
-	command cmd = command_add (parent, "storage", "manage storage (file)",
-				   storage);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
-}
+const command_spec storage_spec = {
+	.name = "storage",
+	.help = "manage storage (file)",
+	.group = GROUP_SERVICES,
+	.fn = storage,
+};
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include "command.h"
+#include "commands.h"
 
 static void version (command cmd)
 {
@@ -18,17 +19,18 @@ static void version_flag (flag f)
 	version (f->command);
 }
 
-command version_new (command parent, const char *group)
-{
-	auto cmd = command_add (parent, "version", "print version", version);
-	if (group != nullptr) command_set_group (cmd, group);
-	return cmd;
-}
+const flag_spec version_flag_spec = {
+	.short_flag = 'v',
+	.long_flag = "version",
+	.has_arg = NO_ARGUMENT,
+	.help = "print version",
+	.fn = version_flag,
+	.should_exit = true,
+};
 
-command version_flag_new (command parent)
-{
-	flag vf = command_flag (parent, 'v', "version", NO_ARGUMENT,
-				"print version");
-	flag_add_callback (vf, version_flag, true);
-	return parent;
-}
+const command_spec version_spec = {
+	.name = "version",
+	.help = "print version",
+	.group = GROUP_BUILTIN,
+	.fn = version,
+};
@@ -34,57 +34,31 @@
 
 /*
  * To add a new command:
- *   1. Create a file under ./commands and add a callback function
- *      of type command_fn (defined in libcli/include/command.h)
+ *   1. Create a file under ./commands with a callback function of type
+ *      command_fn and a command_spec for it (see libcli/include/command.h)
  *   2. Add it to ./CMakeLists.txt
- *   3. Add the extern declaration below (sorted)
- *   4. Add the command in main()
+ *   3. Add the extern declaration to ../include/commands.h (sorted)
+ *   4. Add it to main_spec's commands in ./commands/main.c
  */
 
-/* Main command configuration */
-extern command main_command_new (const char *name, const char *group);
-
-/* Subcommand configuration functions */
-extern command compile_new (command parent, const char *group);
-extern command console_command_new (command parent, const char *group);
-extern command data_new (command parent, const char *group);
-extern command help_new (command parent, const char *group);
-extern command logs_new (command parent, const char *group);
-extern command repl_new (command parent, const char *group);
-extern command run_new (command parent, const char *group);
-extern command serve_new (command parent, const char *group);
-extern command service_new (command parent, const char *group);
-extern command storage_new (command parent, const char *group);
-extern command version_new (command parent, const char *group);
-
 int main (const int argc, char **argv)
 {
 
 
+	ptkl_startup_mark ("load");
 	ptkl_init ();
+	ptkl_startup_mark ("init");
 
-	auto cmd = main_command_new (argv[0], NULL);
-
-	/* Built-in commands */
-	help_new (cmd, GROUP_BUILTIN);
-	version_new (cmd, GROUP_BUILTIN);
-
-	/* Development commands */
-	run_new (cmd, GROUP_DEVELOPMENT);
-	serve_new (cmd, GROUP_DEVELOPMENT);
-	compile_new (cmd, GROUP_DEVELOPMENT);
-
-	service_new (cmd, GROUP_SERVICES);
-	storage_new (cmd, GROUP_SERVICES);
-	data_new (cmd, GROUP_SERVICES);
-	logs_new (cmd, GROUP_SERVICES);
-
-	console_command_new (cmd, GROUP_INTERACTIVE);
-	repl_new (cmd, GROUP_INTERACTIVE);
+	/* only the commands that run are constructed */
+	command cmd = command_from_spec (&main_spec);
+	ptkl_startup_mark ("commands");
 
 	bool ok = command_run (cmd, argc, argv);
 	if (!ok) command_print_errors (cmd);
 
+	/* write the profile if --profile was given */
+	profile_finish (cmd);
+
 	/* TODO: handle atexit for cleanup if normal flow is short-circuited */
 	command_free (cmd);
 	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
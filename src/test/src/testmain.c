@@ -30,12 +30,27 @@
 #include "test.h"
 
 extern void adt_test ();
+extern void arena_test ();
+extern void bench_test ();
+extern void bundle_test ();
 extern void cli_test ();
+extern void codecache_test ();
+extern void completion_test ();
+extern void cpuprof_test ();
+extern void heapprof_test ();
+extern void heaptrace_test ();
 extern void expect_test ();
+extern void jobs_test ();
 extern void log_test ();
+extern void profiler_test ();
+extern void scrollback_test ();
 extern void string_test ();
+extern void metrics_test ();
+extern void pool_test ();
+extern void zygote_test ();
+extern void subsystem_test ();
 
-int main ()
+int main (int argc, char **argv)
 {
 	register_signal_panic_handlers ();
 	printf ("Running tests\n\n");
@@ -43,13 +58,31 @@ int main ()
 	test_suite tests[] = {
 		{.name = "libstd: test framework tests", .fn = expect_test},
 		{.name = "libstd: adt tests", .fn = adt_test},
+		{.name = "libstd: bench tests", .fn = bench_test},
 		{.name = "libstd: errors tests", .fn = log_test},
+		{.name = "libstd: profiler tests", .fn = profiler_test},
 		{.name = "libstd: string tests", .fn = string_test},
 		{.name = "libcli: CLI tests", .fn = cli_test},
+		{.name = "libcli: completion tests", .fn = completion_test},
+		{.name = "libconsole: jobs tests", .fn = jobs_test},
+		{.name = "libconsole: scrollback tests", .fn = scrollback_test},
+		{.name = "libqjs: arena tests", .fn = arena_test},
+		{.name = "libqjs: bundle tests", .fn = bundle_test},
+		{.name = "libqjs: codecache tests", .fn = codecache_test},
+		{.name = "libqjs: cpuprof tests", .fn = cpuprof_test},
+		{.name = "libqjs: heapprof tests", .fn = heapprof_test},
+		{.name = "libqjs: heaptrace tests", .fn = heaptrace_test},
+		{.name = "libqjs: engine pool tests", .fn = pool_test},
+		{.name = "libptkl: metrics tests", .fn = metrics_test},
+		{.name = "libptkl: zygote tests", .fn = zygote_test},
+		{.name = "libptkl: subsystem tests", .fn = subsystem_test},
 		{},
 	};
 
-	run_tests (tests);
+	if (run_test_suites (tests, argc, argv) != EXIT_SUCCESS) {
+		printf ("Tests failed.\n");
+		return EXIT_FAILURE;
+	}
 
 	printf ("All tests passed.\n");
 	return EXIT_SUCCESS;
@@ -107,6 +107,13 @@ void test_vector ()
 	expect_eq_str ("foo", (char *)vector_get (&v, 0));
 	expect_eq_str ("baz", (char *)vector_get (&v, 1));
 
+	/* Test vector_clear */
+	vector_clear (&v);
+	expect_eq_int (0, vector_size (&v));
+	expect_null (vector_get (&v, 0));
+	expect (vector_add (&v, "qux"));
+	expect_eq_str ("qux", (char *)vector_get (&v, 0));
+
 	/* Test vector_free */
 	vector_free (&v);
 	expect_eq_int (0, vector_size (&v));
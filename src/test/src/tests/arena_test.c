@@ -0,0 +1,129 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "test.h"
+
+static void test_arena_classes ()
+{
+	arena *a = arena_new (0);
+	/* {size, usable size} */
+	size_t sizes[][2] = {
+		{1, 16},    {16, 16},   {17, 32},    {128, 128},
+		{129, 160}, {160, 160}, {161, 192},  {256, 256},
+		{257, 320}, {4095, 4096}, {4096, 4096},
+	};
+	for (size_t i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		void *p = arena_alloc (a, sizes[i][0]);
+		expect_not_null (p);
+		expect_eq_int (0, (int)((uintptr_t)p % 16));
+		expect_eq_int ((int)sizes[i][1], (int)arena_usable_size (p));
+		memset (p, 0xab, sizes[i][0]);
+	}
+	void *big = arena_alloc (a, 5000);
+	expect_eq_int (0, (int)((uintptr_t)big % 16));
+	expect (arena_usable_size (big) >= 5000);
+	arena_free (a);
+}
+
+static void test_arena_release_reuse ()
+{
+	arena *a = arena_new (0);
+	void *p = arena_alloc (a, 100);
+	arena_release (a, p);
+	expect (arena_alloc (a, 110) == p); /* same class */
+
+	arena_stats stats;
+	arena_get_stats (a, &stats);
+	expect_eq_int (1, (int)stats.malloc_count);
+	expect_eq_int (112, (int)stats.malloc_size);
+	arena_release (a, p);
+	arena_release (a, nullptr);
+	arena_get_stats (a, &stats);
+	expect_eq_int (0, (int)stats.malloc_count);
+	expect_eq_int (0, (int)stats.malloc_size);
+	arena_free (a);
+}
+
+static void test_arena_resize ()
+{
+	arena *a = arena_new (0);
+	char *p = arena_alloc (a, 20);
+	memcpy (p, "0123456789", 10);
+	expect (arena_resize (a, p, 30) == p); /* still 32 bytes */
+
+	p = arena_resize (a, p, 1000);
+	expect_eq_int (0, memcmp (p, "0123456789", 10));
+	p = arena_resize (a, p, 100000);
+	expect_eq_int (0, memcmp (p, "0123456789", 10));
+	p = arena_resize (a, p, 200000);
+	expect_eq_int (0, memcmp (p, "0123456789", 10));
+	p = arena_resize (a, p, 10);
+	expect_eq_int (0, memcmp (p, "0123456789", 10));
+	expect_null (arena_resize (a, p, 0));
+
+	arena_stats stats;
+	arena_get_stats (a, &stats);
+	expect_eq_int (0, (int)stats.malloc_count);
+	arena_free (a);
+}
+
+static void test_arena_reset ()
+{
+	arena *a = arena_new (64 << 10);
+	void *first = arena_alloc (a, 64);
+	for (int i = 0; i < 10000; i++) expect_not_null (arena_alloc (a, 64));
+	expect_not_null (arena_alloc (a, 1 << 20));
+
+	arena_stats before, after;
+	arena_get_stats (a, &before);
+	expect_eq_int (10002, (int)before.malloc_count);
+	arena_reset (a);
+	arena_get_stats (a, &after);
+	expect_eq_int (0, (int)after.malloc_count);
+	expect_eq_int (0, (int)after.malloc_size);
+	expect_eq_int (1, (int)after.resets);
+
+	/* the chunks are kept, the large block isn't */
+	expect (after.footprint < before.footprint);
+	expect (after.footprint > (size_t)10000 * 64);
+	expect (arena_alloc (a, 64) == first);
+	for (int i = 0; i < 10000; i++) arena_alloc (a, 64);
+	arena_get_stats (a, &before);
+	expect_eq_int ((int)after.footprint, (int)before.footprint);
+	arena_free (a);
+}
+
+void arena_test ()
+{
+	test (test_arena_classes);
+	test (test_arena_release_reuse);
+	test (test_arena_resize);
+	test (test_arena_reset);
+}
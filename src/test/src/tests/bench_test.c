@@ -0,0 +1,72 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "bench.h"
+#include "test.h"
+
+void test_bench_compute_stats ()
+{
+	double samples[] = {5, 1, 4, 2, 3};
+	bench_stats stats = bench_compute_stats (samples, 5);
+	expect_eq_int (5, (int)stats.count);
+	expect_true (stats.min == 1 && stats.max == 5);
+	expect_true (stats.median == 3 && stats.mean == 3);
+	expect_true (stats.mad == 1);
+	/* sorted in place */
+	expect_true (samples[0] == 1 && samples[4] == 5);
+}
+
+void test_bench_mann_whitney ()
+{
+	double a[10], b[10];
+	for (int i = 0; i < 10; i++) {
+		a[i] = i + 1;
+		b[i] = i + 11;
+	}
+
+	/* no overlap: U = 0, z = 3.74 */
+	double p = bench_mann_whitney (a, 10, b, 10);
+	expect_true (p > 0.000182 && p < 0.000183);
+	expect_true (bench_mann_whitney (b, 10, a, 10) == p);
+
+	/* same samples (all ties across groups) */
+	expect_true (bench_mann_whitney (a, 10, a, 10) == 1.0);
+
+	/* interleaved samples are not significant */
+	for (int i = 0; i < 10; i++) b[i] = i + 1.5;
+	expect_true (bench_mann_whitney (a, 10, b, 10) > 0.5);
+
+	/* inputs are not modified */
+	expect_true (a[0] == 1 && a[9] == 10);
+
+	expect_true (bench_mann_whitney (a, 0, b, 10) == 1.0);
+}
+
+void bench_test ()
+{
+	test (test_bench_compute_stats);
+	test (test_bench_mann_whitney);
+}
@@ -0,0 +1,137 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bundle.h"
+#include "test.h"
+
+static const char *bundle_path ()
+{
+	static char path[64];
+	snprintf (path, sizeof (path), "/tmp/ptkltest-bundle-%d.ptkl",
+		  (int)getpid ());
+	return path;
+}
+
+static void test_bundle_write_open ()
+{
+	bundle_writer *w = bundle_writer_new ();
+	expect (bundle_writer_add (w, "app/main.js", BUNDLE_MODULE, "main", 4));
+	expect (bundle_writer_add (w, "app/lib.js", BUNDLE_MODULE, "lib!", 4));
+	expect (bundle_writer_add (w, "app/logo.svg", BUNDLE_ASSET, "", 0));
+	expect (!bundle_writer_add (w, "app/lib.js", BUNDLE_MODULE, "x", 1));
+	expect (bundle_writer_has (w, "app/lib.js"));
+	expect (!bundle_writer_set_main (w, "app/logo.svg"));
+	expect (!bundle_writer_set_main (w, "app/none.js"));
+	expect (bundle_writer_set_main (w, "app/main.js"));
+	expect (bundle_writer_write (w, bundle_path ()));
+	bundle_writer_free (w);
+
+	bundle *b = bundle_open (bundle_path ());
+	expect_not_null (b);
+	expect_eq_int (3, (int)bundle_count (b));
+
+	bundle_item item;
+	expect (bundle_main (b, &item));
+	expect_eq_str ("app/main.js", item.name);
+	expect (bundle_find (b, "app/lib.js", &item));
+	expect_eq_int (BUNDLE_MODULE, item.kind);
+	expect_eq_int (4, (int)item.len);
+	expect_eq_int (0, memcmp ("lib!", item.data, item.len));
+	expect (bundle_find (b, "app/logo.svg", &item));
+	expect_eq_int (BUNDLE_ASSET, item.kind);
+	expect_eq_int (0, (int)item.len);
+	expect (!bundle_find (b, "app/lib", &item));
+	expect (!bundle_find (b, "lib.js", &item));
+
+	expect (bundle_item_at (b, 1, &item));
+	expect_eq_str ("app/lib.js", item.name);
+	expect (!bundle_item_at (b, 3, &item));
+	bundle_close (b);
+	unlink (bundle_path ());
+}
+
+/* enough items to grow the index and make probes collide */
+static void test_bundle_many ()
+{
+	bundle_writer *w = bundle_writer_new ();
+	char name[32];
+	for (int i = 0; i < 500; i++) {
+		snprintf (name, sizeof (name), "lib/m%d.js", i);
+		expect (bundle_writer_add (w, name, BUNDLE_MODULE, &i,
+					   sizeof (i)));
+	}
+	expect (bundle_writer_write (w, bundle_path ()));
+	bundle_writer_free (w);
+
+	bundle *b = bundle_open (bundle_path ());
+	expect_not_null (b);
+	bundle_item item;
+	expect (!bundle_main (b, &item));
+	int found = 0;
+	for (int i = 0; i < 500; i++) {
+		snprintf (name, sizeof (name), "lib/m%d.js", i);
+		int n;
+		if (!bundle_find (b, name, &item)) continue;
+		memcpy (&n, item.data, sizeof (n));
+		found += n == i;
+	}
+	expect_eq_int (500, found);
+	bundle_close (b);
+	unlink (bundle_path ());
+}
+
+static void test_bundle_damaged ()
+{
+	bundle_writer *w = bundle_writer_new ();
+	expect (bundle_writer_add (w, "main.js", BUNDLE_SCRIPT, "main", 4));
+	expect (bundle_writer_write (w, bundle_path ()));
+	bundle_writer_free (w);
+
+	/* truncated */
+	expect (truncate (bundle_path (), 40) == 0);
+	expect_null (bundle_open (bundle_path ()));
+
+	/* not a bundle */
+	int fd = open (bundle_path (), O_WRONLY | O_TRUNC);
+	expect (write (fd, "console.log (1);\n", 17) == 17);
+	close (fd);
+	expect_null (bundle_open (bundle_path ()));
+	unlink (bundle_path ());
+
+	expect_null (bundle_open (bundle_path ()));
+}
+
+void bundle_test ()
+{
+	test (test_bundle_write_open);
+	test (test_bundle_many);
+	test (test_bundle_damaged);
+}
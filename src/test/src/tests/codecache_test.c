@@ -0,0 +1,214 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "codecache.h"
+#include "test.h"
+
+static const char *cache_dir ()
+{
+	static char dir[64];
+	snprintf (dir, sizeof (dir), "/tmp/ptkltest-codecache-%d/bytecode",
+		  (int)getpid ());
+	return dir;
+}
+
+/* remove the cache directory and its parent */
+static void remove_cache (codecache *c)
+{
+	codecache_evict (c, 0);
+	codecache_close (c);
+	char parent[64];
+	snprintf (parent, sizeof (parent), "%s", cache_dir ());
+	rmdir (parent);
+	*strrchr (parent, '/') = '\0';
+	rmdir (parent);
+}
+
+static void entry_file (codecache_key key, char *path, size_t size)
+{
+	snprintf (path, size, "%s/%016llx%016llx.qbc", cache_dir (),
+		  (unsigned long long)key.hash[0],
+		  (unsigned long long)key.hash[1]);
+}
+
+/* set an entry's last use, in seconds ago */
+static void set_age (codecache_key key, int seconds)
+{
+	char path[128];
+	entry_file (key, path, sizeof (path));
+	struct timespec now;
+	clock_gettime (CLOCK_REALTIME, &now);
+	struct timespec times[2] = {now, now};
+	times[1].tv_sec -= seconds;
+	utimensat (AT_FDCWD, path, times, 0);
+}
+
+static void test_codecache_key ()
+{
+	const char *src = "export const x = 1;";
+	codecache_key a = codecache_key_for (src, strlen (src), "v1 module");
+	codecache_key b = codecache_key_for (src, strlen (src), "v1 module");
+	codecache_key c = codecache_key_for (src, strlen (src), "v2 module");
+	codecache_key d = codecache_key_for (src, strlen (src) - 1,
+					     "v1 module");
+	expect (a.hash[0] == b.hash[0] && a.hash[1] == b.hash[1]);
+	expect (a.hash[0] != c.hash[0] || a.hash[1] != c.hash[1]);
+	expect (a.hash[0] != d.hash[0] || a.hash[1] != d.hash[1]);
+}
+
+static void test_codecache_put_get ()
+{
+	codecache *c = codecache_open (cache_dir (), 0);
+	expect_not_null (c);
+
+	codecache_key key = codecache_key_for ("source", 6, "salt");
+	codecache_entry entry;
+	expect (!codecache_get (c, key, &entry));
+
+	const char bytecode[] = "\x01\x02\x03 compiled";
+	expect (codecache_put (c, key, bytecode, sizeof (bytecode), 12345));
+	expect (codecache_get (c, key, &entry));
+	expect_eq_int ((int)sizeof (bytecode), (int)entry.len);
+	expect_eq_int (0, memcmp (bytecode, entry.data, entry.len));
+	expect_eq_int (12345, (int)entry.cost_ns);
+	codecache_release (&entry);
+
+	/* damage the data: the entry is removed */
+	char path[128];
+	entry_file (key, path, sizeof (path));
+	int fd = open (path, O_WRONLY);
+	off_t end = lseek (fd, 0, SEEK_END);
+	expect (pwrite (fd, "X", 1, end - 1) == 1);
+	close (fd);
+	expect (!codecache_get (c, key, &entry));
+	expect (access (path, F_OK) != 0);
+
+	codecache_stats stats;
+	codecache_get_stats (c, &stats);
+	expect_eq_int (1, (int)stats.hits);
+	expect_eq_int (2, (int)stats.misses);
+	expect_eq_int (1, (int)stats.invalid);
+	expect_eq_int (1, (int)stats.writes);
+	remove_cache (c);
+}
+
+static void test_codecache_replaced ()
+{
+	codecache *c = codecache_open (cache_dir (), 0);
+	codecache_key key = codecache_key_for ("source", 6, "salt");
+	expect (codecache_put (c, key, "old", 3, 0));
+
+	/* a mapped entry outlives its file being replaced */
+	codecache_entry old, new;
+	expect (codecache_get (c, key, &old));
+	expect (codecache_put (c, key, "new!", 4, 0));
+	expect (codecache_get (c, key, &new));
+	expect_eq_int (3, (int)old.len);
+	expect_eq_int (0, memcmp ("old", old.data, old.len));
+	expect_eq_int (4, (int)new.len);
+	expect_eq_int (0, memcmp ("new!", new.data, new.len));
+	codecache_release (&old);
+	codecache_release (&new);
+	expect_null (old.data);
+	remove_cache (c);
+}
+
+static void test_codecache_evict_lru ()
+{
+	codecache *c = codecache_open (cache_dir (), 0);
+	char data[1000] = {0};
+	codecache_key keys[5];
+	for (int i = 0; i < 5; i++) {
+		char source[8];
+		snprintf (source, sizeof (source), "src%d", i);
+		keys[i] = codecache_key_for (source, strlen (source), "salt");
+		expect (codecache_put (c, keys[i], data, sizeof (data), 0));
+		set_age (keys[i], 100 - i); /* 0 is the oldest */
+	}
+
+	/* using the oldest makes it the newest */
+	codecache_entry entry;
+	expect (codecache_get (c, keys[0], &entry));
+	codecache_release (&entry);
+
+	/* room for 3 entries: 1 and 2 go */
+	expect_eq_int (2, (int)codecache_evict (c, 3 * (sizeof (data) + 64)));
+	int present = 0;
+	for (int i = 0; i < 5; i++) {
+		bool hit = codecache_get (c, keys[i], &entry);
+		if (hit) codecache_release (&entry);
+		expect (hit == (i == 0 || i >= 3));
+		present += hit;
+	}
+	expect_eq_int (3, present);
+	remove_cache (c);
+}
+
+static void test_codecache_put_evicts ()
+{
+	char data[1000] = {0};
+	size_t entry_size = sizeof (data) + 64;
+	codecache *c = codecache_open (cache_dir (), 3 * entry_size);
+	codecache_key keys[5];
+	for (int i = 0; i < 5; i++) {
+		char source[8];
+		snprintf (source, sizeof (source), "src%d", i);
+		keys[i] = codecache_key_for (source, strlen (source), "salt");
+		expect (codecache_put (c, keys[i], data, sizeof (data), 0));
+		set_age (keys[i], 100 - i);
+	}
+
+	/* the first put scans; later ones only once over the limit */
+	codecache_stats stats;
+	codecache_get_stats (c, &stats);
+	expect_eq_int (2, (int)stats.evictions);
+	int present = 0;
+	for (int i = 0; i < 5; i++) {
+		codecache_entry entry;
+		bool hit = codecache_get (c, keys[i], &entry);
+		if (hit) codecache_release (&entry);
+		present += hit;
+	}
+	expect_eq_int (3, present);
+	remove_cache (c);
+}
+
+void codecache_test ()
+{
+	test (test_codecache_key);
+	test (test_codecache_put_get);
+	test (test_codecache_replaced);
+	test (test_codecache_evict_lru);
+	test (test_codecache_put_evicts);
+}
@@ -0,0 +1,201 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "command.h"
+#include "completion.h"
+#include "test.h"
+
+/* expect completion c to be text */
+static void expect_text (const char *text, completion c)
+{
+	char buf[COMPLETION_MAX_WORD + 1];
+	snprintf (buf, sizeof (buf), "%.*s", (int)c.len, c.text);
+	expect_eq_str (text, buf);
+}
+
+static completion_scope add (completion_index *idx, completion_scope scope,
+			     const char *word)
+{
+	return completion_add (idx, scope, word, strlen (word),
+			       COMPLETION_WORD);
+}
+
+static void test_completion_prefix ()
+{
+	completion_index *idx = completion_new ();
+	const char *words[] = {"storage", "service", "quit", "status", "st"};
+	for (int i = 0; i < 5; i++) add (idx, COMPLETION_ROOT, words[i]);
+
+	/* adding a word again returns the same scope */
+	completion_scope quit = add (idx, COMPLETION_ROOT, "quit");
+	expect_eq_int ((int)quit, (int)completion_find (idx, COMPLETION_ROOT,
+							   "quit", 4));
+	expect_eq_int ((int)COMPLETION_NONE,
+		       (int)completion_find (idx, COMPLETION_ROOT, "qui", 3));
+
+	/* in byte order, and the count includes matches that didn't fit */
+	completion out[8];
+	expect_eq_int (3, (int)completion_prefix (idx, COMPLETION_ROOT, "st",
+						  2, out, 8));
+	expect_text ("st", out[0]);
+	expect_text ("status", out[1]);
+	expect_text ("storage", out[2]);
+	expect_eq_int (5, (int)completion_prefix (idx, COMPLETION_ROOT, "", 0,
+						  out, 2));
+	expect_text ("quit", out[0]);
+	expect_text ("service", out[1]);
+	expect_eq_int (0, (int)completion_prefix (idx, COMPLETION_ROOT, "x", 1,
+						  out, 8));
+
+	/* words in another scope */
+	add (idx, quit, "now");
+	expect_eq_int (1, (int)completion_prefix (idx, quit, "", 0, out, 8));
+	expect_text ("now", out[0]);
+	expect_eq_int (0, (int)completion_prefix (idx, COMPLETION_ROOT, "n", 1,
+						  out, 8));
+	completion_free (idx);
+}
+
+static void test_completion_fuzzy ()
+{
+	completion_index *idx = completion_new ();
+	char word[64];
+	for (int i = 0; i < 5000; i++) {
+		snprintf (word, sizeof (word),
+			  "bucket-%d/objects/item-%04d.json", i % 7, i);
+		add (idx, COMPLETION_ROOT, word);
+	}
+	const char *words[] = {"service", "storage", "session-vectors",
+			       "sharedVolumeCache", "logs"};
+	for (int i = 0; i < 5; i++) add (idx, COMPLETION_ROOT, words[i]);
+
+	completion out[4];
+	size_t n = completion_fuzzy (idx, COMPLETION_ROOT, "svc", 3, out, 4);
+	expect_eq_int (3, (int)n);
+	/* matches at the start of parts, then tighter matches, rank higher */
+	expect_text ("sharedVolumeCache", out[0]);
+	expect_text ("service", out[1]);
+	expect_text ("session-vectors", out[2]);
+	expect (out[0].score > out[1].score);
+
+	n = completion_fuzzy (idx, COMPLETION_ROOT, "item4999", 8, out, 4);
+	expect_eq_int (1, (int)n);
+	expect_text ("bucket-1/objects/item-4999.json", out[0]);
+
+	n = completion_fuzzy (idx, COMPLETION_ROOT, "OBJ", 3, out, 4);
+	expect_eq_int (4, (int)n);
+	expect (strncmp (out[0].text, "bucket-", 7) == 0);
+
+	expect_eq_int (0, (int)completion_fuzzy (idx, COMPLETION_ROOT, "zz", 2,
+						 out, 4));
+	completion_free (idx);
+}
+
+static void noop (command cmd) {}
+
+static const flag_spec verbose_flag_spec = {
+	.short_flag = 'v',
+	.long_flag = "verbose",
+};
+
+static const flag_spec short_flag_spec = {
+	.short_flag = 'x',
+};
+
+static const command_spec list_spec = {
+	.name = "list",
+	.fn = noop,
+	.flags = (const flag_spec *const[]){&short_flag_spec, nullptr},
+};
+
+static const command_spec logs_spec = {
+	.name = "logs",
+	.fn = noop,
+};
+
+static const command_spec service_spec = {
+	.name = "service",
+	.fn = noop,
+	.flags = (const flag_spec *const[]){&verbose_flag_spec, nullptr},
+	.commands = (const command_spec *const[]){&list_spec, &logs_spec,
+						  nullptr},
+};
+
+static const command_spec root_spec = {
+	.name = "ptkl",
+	.commands = (const command_spec *const[]){&service_spec, nullptr},
+};
+
+static void test_completion_line ()
+{
+	command root = command_from_spec (&root_spec);
+	completion_index *idx = completion_new ();
+	completion_add_command (idx, COMPLETION_ROOT, root);
+
+	completion out[8];
+	size_t start;
+	expect_eq_int (1, (int)completion_line (idx, "se", &start, out, 8));
+	expect_eq_int (0, (int)start);
+	expect_text ("service", out[0]);
+	expect_eq_int (COMPLETION_COMMAND, out[0].kind);
+
+	/* subcommands and flags of the command before the last word */
+	expect_eq_int (3, (int)completion_line (idx, "service ", &start, out,
+						8));
+	expect_eq_int (8, (int)start);
+	expect_text ("--verbose", out[0]);
+	expect_eq_int (COMPLETION_FLAG, out[0].kind);
+	expect_text ("list", out[1]);
+	expect_text ("logs", out[2]);
+
+	/* flags and other words don't change the scope */
+	expect_eq_int (1, (int)completion_line (idx, "service --verbose li",
+						&start, out, 8));
+	expect_eq_int (18, (int)start);
+	expect_text ("list", out[0]);
+	expect_eq_int (1, (int)completion_line (idx, "service list -", &start,
+						out, 8));
+	expect_text ("-x", out[0]);
+
+	/* no prefix matches: fuzzy */
+	expect_eq_int (1, (int)completion_line (idx, "service lst", &start,
+						out, 8));
+	expect_text ("list", out[0]);
+	expect (out[0].score > 0);
+
+	completion_free (idx);
+	command_free (root);
+}
+
+void completion_test ()
+{
+	test (test_completion_prefix);
+	test (test_completion_fuzzy);
+	test (test_completion_line);
+}
@@ -0,0 +1,162 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpuprof.h"
+#include "test.h"
+
+/* What was written to f, in a buffer the caller frees */
+static char *read_all (FILE *f)
+{
+	long len = ftell (f);
+	char *data = calloc (1, (size_t)len + 1);
+	rewind (f);
+	expect_eq_int ((int)len, (int)fread (data, 1, (size_t)len, f));
+	fclose (f);
+	return data;
+}
+
+static double now_ms ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void test_cpuprof_timer ()
+{
+	cpuprof *p = cpuprof_new (1000);
+	expect (!cpuprof_due (p));
+	expect (cpuprof_start (p));
+	expect (!cpuprof_start (p));
+
+	/* what the engine does at its interrupt checks, until there are a
+	   few samples (however slowly the timer thread gets to run) */
+	double end = now_ms () + 5000;
+	while (cpuprof_samples (p) < 5 && now_ms () < end) {
+		if (cpuprof_due (p)) cpuprof_sample (p, "spin (test.js:1:1)");
+	}
+	cpuprof_stop (p);
+	expect (cpuprof_samples (p) >= 5);
+	expect (!cpuprof_due (p));
+	cpuprof_free (p);
+}
+
+static void test_cpuprof_output ()
+{
+	cpuprof *p = cpuprof_new (0);
+	const char *deep = "fib (fib.js:3:12)\nfib (fib.js:8:16)\n"
+			   "<eval> (fib.js:12:1)";
+	const char *shallow = "fib (fib.js:8:16)\n<eval> (fib.js:12:1)";
+	for (int i = 0; i < 6; i++) cpuprof_sample (p, deep);
+	for (int i = 0; i < 3; i++) cpuprof_sample (p, shallow);
+	cpuprof_sample (p, "print (native)\n<eval> (fib.js:12:1)");
+	expect_eq_int (10, (int)cpuprof_samples (p));
+
+	FILE *f = tmpfile ();
+	expect_eq_int (3, (int)cpuprof_write_folded (p, f));
+	char *folded = read_all (f);
+	expect_not_null (strstr (folded, "<eval> (fib.js:12:1);"
+					 "fib (fib.js:8:16);"
+					 "fib (fib.js:3:12) 6\n"));
+	expect_not_null (strstr (folded, "<eval> (fib.js:12:1);"
+					 "fib (fib.js:8:16) 3\n"));
+	free (folded);
+
+	/* fib is on top of 9 samples, and counted once in each stack */
+	f = tmpfile ();
+	cpuprof_write_top (p, f, 10);
+	char *top = read_all (f);
+	expect_not_null (strstr (top, "10 samples at 1000 Hz"));
+	expect_not_null (strstr (top, "       9  90.0%        9  90.0%  "
+				      "fib (fib.js)\n"));
+	expect_not_null (strstr (top, "       1  10.0%        1  10.0%  "
+				      "print (native)\n"));
+	expect_not_null (strstr (top, "       0   0.0%       10 100.0%  "
+				      "<eval> (fib.js)\n"));
+	expect (strstr (top, "fib") < strstr (top, "print"));
+	free (top);
+
+	/* root, <eval>, fib, fib, print */
+	f = tmpfile ();
+	expect (cpuprof_write_cpuprofile (p, f));
+	char *json = read_all (f);
+	expect_eq_int (0, strncmp (json, "{\"nodes\":[{\"id\":1,", 18));
+	expect_not_null (strstr (json, "\"functionName\":\"(root)\""));
+	const char *fib = "{\"id\":3,\"callFrame\":{\"functionName\":\"fib\","
+			  "\"scriptId\":\"1\",\"url\":\"fib.js\","
+			  "\"lineNumber\":2,\"columnNumber\":11},"
+			  "\"hitCount\":3,\"children\":[4]}";
+	expect_not_null (strstr (json, fib));
+	expect_not_null (strstr (json, "\"hitCount\":6,\"children\":[]"));
+	expect_null (strstr (json, "{\"id\":6,"));
+	expect_not_null (strstr (json, "\"samples\":[4,4,4,4,4,4,3,3,3,5]"));
+	expect_not_null (strstr (json, "\"timeDeltas\":["));
+	free (json);
+	cpuprof_free (p);
+}
+
+static void test_cpuprof_outside_js ()
+{
+	/* 10 Hz: a 100 ms interval */
+	cpuprof *p = cpuprof_new (10);
+	expect (cpuprof_start (p));
+	cpuprof_stop (p);
+	struct timespec wait = {.tv_nsec = 300 * 1000000};
+	nanosleep (&wait, nullptr);
+	cpuprof_sample (p, "handle (app.js:5:3)");
+	cpuprof_sample (p, "handle (app.js:5:3)");
+
+	/* the wait is outside JS, not in handle */
+	expect_eq_int (3, (int)cpuprof_samples (p));
+	FILE *f = tmpfile ();
+	expect_eq_int (2, (int)cpuprof_write_folded (p, f));
+	char *folded = read_all (f);
+	expect_not_null (strstr (folded, "handle (app.js:5:3) 2\n"));
+	char *outside = strstr (folded, CPUPROF_OUTSIDE_JS " ");
+	expect_not_null (outside);
+	expect (outside && atoi (outside + strlen (CPUPROF_OUTSIDE_JS)) >= 2);
+	free (folded);
+
+	f = tmpfile ();
+	expect (cpuprof_write_cpuprofile (p, f));
+	char *json = read_all (f);
+	expect_not_null (strstr (json, "\"functionName\":\"(program)\""));
+	expect_not_null (strstr (json, ",100000,"));
+	free (json);
+	cpuprof_free (p);
+}
+
+void cpuprof_test ()
+{
+	test (test_cpuprof_timer);
+	test (test_cpuprof_outside_js);
+	test (test_cpuprof_output);
+}
@@ -0,0 +1,209 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heapprof.h"
+#include "jsframe.h"
+#include "test.h"
+
+/* The profiler only keeps addresses, so they needn't be real */
+static const void *address (int i)
+{
+	return (const void *)(uintptr_t)(0x100000 + (uintptr_t)i * 64);
+}
+
+static void test_js_frame_parse ()
+{
+	js_frame f;
+	const char *text = "parse (app/main.js:3:15)";
+	expect (js_frame_parse (text, strlen (text), &f));
+	expect_eq_int (5, (int)f.name_len);
+	expect_eq_int (0, strncmp ("parse", f.name, f.name_len));
+	expect_eq_int (11, (int)f.file_len);
+	expect_eq_int (0, strncmp ("app/main.js", f.file, f.file_len));
+	expect_eq_int (3, f.line);
+	expect_eq_int (15, f.column);
+
+	text = "<anonymous> (lib.js:42)";
+	expect (js_frame_parse (text, strlen (text), &f));
+	expect_eq_int (11, (int)f.name_len);
+	expect_eq_int (42, f.line);
+	expect_eq_int (0, f.column);
+
+	text = "JSON.parse (native)";
+	expect (js_frame_parse (text, strlen (text), &f));
+	expect_eq_int (10, (int)f.name_len);
+	expect_eq_int (0, strncmp ("native", f.file, f.file_len));
+	expect_eq_int (0, f.line);
+
+	text = "<eval>";
+	expect (js_frame_parse (text, strlen (text), &f));
+	expect_eq_int (6, (int)f.name_len);
+	expect_eq_int (0, (int)f.file_len);
+	expect (!js_frame_parse (text, 0, &f));
+
+	const char *next;
+	expect_eq_int (4, (int)js_frame_line ("f ()\ng ()", &next));
+	expect_eq_str ("g ()", next);
+	expect_eq_int (4, (int)js_frame_line (next, &next));
+	expect_null (next);
+}
+
+static void test_heapprof_estimate ()
+{
+	/* 640 KB in 64-byte blocks, sampled every 4 KB or so */
+	heapprof *p = heapprof_new (4096);
+	for (int i = 0; i < 10000; i++) {
+		heapprof_alloc (p, nullptr, address (i), 64);
+	}
+	expect (heapprof_pending (p));
+	heapprof_set_stack (p, "alloc (app.js:1)");
+	expect (!heapprof_pending (p));
+
+	heapprof_stats stats;
+	heapprof_get_stats (p, &stats);
+	expect (stats.samples > 50 && stats.samples < 400);
+	expect_eq_int ((int)stats.samples, (int)stats.live);
+	expect_eq_int (0, (int)stats.pending);
+	/* within the error of a few hundred samples */
+	expect (stats.live_bytes > 640000 * 6 / 10);
+	expect (stats.live_bytes < 640000 * 14 / 10);
+
+	for (int i = 0; i < 10000; i++) heapprof_release (p, address (i));
+	heapprof_get_stats (p, &stats);
+	expect_eq_int (0, (int)stats.live);
+	expect_eq_int (0, (int)stats.live_bytes);
+	heapprof_free (p);
+}
+
+static void test_heapprof_release_heap ()
+{
+	heapprof *p = heapprof_new (1);
+	int a, b; /* two heaps */
+	for (int i = 0; i < 10; i++) {
+		heapprof_alloc (p, i < 5 ? &a : &b, address (i), 100);
+	}
+	heapprof_release (p, address (0)); /* while pending */
+	heapprof_set_stack (p, "f (app.js:1:1)");
+
+	heapprof_stats stats;
+	heapprof_get_stats (p, &stats);
+	expect_eq_int (9, (int)stats.live);
+	heapprof_release_heap (p, &a);
+	heapprof_get_stats (p, &stats);
+	expect_eq_int (5, (int)stats.live);
+	expect_eq_int (500, (int)stats.live_bytes);
+
+	/* a heap dropped with samples still pending */
+	heapprof_alloc (p, &a, address (20), 100);
+	heapprof_release_heap (p, &a);
+	heapprof_get_stats (p, &stats);
+	expect_eq_int (5, (int)stats.live);
+	expect_eq_int (0, (int)stats.pending);
+	expect (heapprof_pending (p));
+	heapprof_set_stack (p, nullptr);
+	expect (!heapprof_pending (p));
+
+	/* the heap's samples are gone from its addresses */
+	heapprof_release (p, address (1));
+	heapprof_release (p, address (5));
+	heapprof_get_stats (p, &stats);
+	expect_eq_int (4, (int)stats.live);
+	heapprof_free (p);
+}
+
+/* The profile as text, in a buffer the caller frees */
+static char *read_all (FILE *f, size_t *len)
+{
+	*len = (size_t)ftell (f);
+	char *data = calloc (1, *len + 1);
+	rewind (f);
+	expect_eq_int ((int)*len, (int)fread (data, 1, *len, f));
+	fclose (f);
+	return data;
+}
+
+static bool contains (const char *data, size_t len, const char *s)
+{
+	size_t n = strlen (s);
+	for (size_t i = 0; i + n <= len; i++) {
+		if (memcmp (data + i, s, n) == 0) return true;
+	}
+	return false;
+}
+
+static void test_heapprof_output ()
+{
+	/* a 1-byte interval samples every allocation, at its own size */
+	heapprof *p = heapprof_new (1);
+	for (int i = 0; i < 10; i++) {
+		heapprof_alloc (p, nullptr, address (i), 100);
+	}
+	heapprof_set_stack (p, "parse (app.js:3:5)\nmain (app.js:9:1)");
+	for (int i = 10; i < 15; i++) {
+		heapprof_alloc (p, nullptr, address (i), 1000);
+	}
+	heapprof_set_stack (p, "load (lib.js:1:1)");
+	heapprof_alloc (p, nullptr, address (15), 7);
+	heapprof_set_stack (p, nullptr);
+	heapprof_release (p, address (0));
+	heapprof_release (p, address (10));
+	heapprof_release (p, address (99)); /* not sampled */
+
+	FILE *f = tmpfile ();
+	expect_eq_int (3, (int)heapprof_write_folded (p, f));
+	size_t len;
+	char *folded = read_all (f, &len);
+	expect_not_null (strstr (folded, "main (app.js:9:1);parse (app.js:3:5) "
+					 "900\n"));
+	expect_not_null (strstr (folded, "load (lib.js:1:1) 4000\n"));
+	expect_not_null (strstr (folded, "(no stack) 7\n"));
+	free (folded);
+
+	f = tmpfile ();
+	expect (heapprof_write_pprof (p, f));
+	char *pprof = read_all (f, &len);
+	expect (len > 0);
+	expect_eq_int (0x0a, (uint8_t)pprof[0]); /* sample_type */
+	expect (contains (pprof, len, "inuse_space"));
+	expect (contains (pprof, len, "parse"));
+	expect (contains (pprof, len, "app.js"));
+	expect (contains (pprof, len, "(no stack)"));
+	free (pprof);
+	heapprof_free (p);
+}
+
+void heapprof_test ()
+{
+	test (test_js_frame_parse);
+	test (test_heapprof_estimate);
+	test (test_heapprof_release_heap);
+	test (test_heapprof_output);
+}
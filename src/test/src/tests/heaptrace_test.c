@@ -0,0 +1,188 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "heaptrace.h"
+#include "test.h"
+
+static const char *trace_path ()
+{
+	static char path[64];
+	snprintf (path, sizeof (path), "/tmp/ptkltest-heap-%d.htrace",
+		  (int)getpid ());
+	return path;
+}
+
+/* The report for the trace, in a buffer the caller frees */
+static char *analyze (const heaptrace_analyze_opts *opts)
+{
+	FILE *f = tmpfile ();
+	expect_not_null (f);
+	expect (heaptrace_analyze (trace_path (), f, opts));
+	long len = ftell (f);
+	char *report = calloc (1, (size_t)len + 1);
+	rewind (f);
+	expect_eq_int ((int)len, (int)fread (report, 1, (size_t)len, f));
+	fclose (f);
+	return report;
+}
+
+static void test_heaptrace_report ()
+{
+	heaptrace *t = heaptrace_open (trace_path ());
+	expect_not_null (t);
+
+	/* 100 blocks of 100 bytes from one stack, half of them freed, and
+	   one block from another stack that grows, and is freed */
+	const char *frames = "parse (app.js:3)\nmain (app.js:9)";
+	uint32_t parse = heaptrace_stack (t, frames);
+	uint32_t load = heaptrace_stack (t, "load (lib.js:1)");
+	char copy[64];
+	strcpy (copy, frames);
+	expect_eq_int ((int)parse, (int)heaptrace_stack (t, copy));
+	expect_eq_int ((int)parse, (int)heaptrace_stack (t, frames));
+	expect (parse != load);
+
+	/* the recorder only keeps addresses, so they needn't be real */
+	static char heap[16 << 10];
+	heaptrace_set_stack (t, parse);
+	for (int i = 0; i < 100; i++) heaptrace_alloc (t, heap + i * 112, 100);
+	for (int i = 0; i < 50; i++) heaptrace_free (t, heap + i * 112, 100);
+	heaptrace_set_stack (t, load);
+	heaptrace_alloc (t, heap + 12000, 5000);
+	heaptrace_realloc (t, heap + 12000, heap, 20000);
+	heaptrace_free (t, heap, 20000);
+	heaptrace_set_stack (t, 0);
+	expect (heaptrace_close (t));
+
+	char *report = analyze (nullptr);
+	expect_not_null (strstr (report, "101 allocations"));
+	expect_not_null (strstr (report, "51 frees, 1 reallocations"));
+	expect_not_null (strstr (report, "peak 24.4 KB"));
+	expect_not_null (strstr (report, "4.9 KB in 50 blocks at the end"));
+
+	/* never freed: the second half of the parse blocks */
+	char *leaks = strstr (report, "leak candidates");
+	expect_not_null (leaks);
+	expect_not_null (strstr (leaks, "4.9 KB       50  parse (app.js:3) < "
+					"main (app.js:9)"));
+	/* at the peak: the grown block, then the parse blocks */
+	char *peak = strstr (report, "live at the peak");
+	expect_not_null (peak);
+	expect_not_null (strstr (peak, "19.5 KB        1  load (lib.js:1)"));
+	expect (strstr (peak, "load") < strstr (peak, "parse"));
+	free (report);
+}
+
+static void *record_thread (void *arg)
+{
+	heaptrace *t = arg;
+	/* enough to fill the thread's buffer a few times */
+	for (int i = 0; i < 20000; i++) {
+		void *p = malloc (32);
+		heaptrace_alloc (t, p, 32);
+		heaptrace_free (t, p, 32);
+		free (p);
+	}
+	return nullptr;
+}
+
+static void test_heaptrace_threads ()
+{
+	heaptrace *t = heaptrace_open (trace_path ());
+	expect_not_null (t);
+	pthread_t threads[4];
+	for (int i = 0; i < 4; i++) {
+		pthread_create (&threads[i], nullptr, record_thread, t);
+	}
+	for (int i = 0; i < 4; i++) pthread_join (threads[i], nullptr);
+	expect (heaptrace_close (t));
+
+	char *report = analyze (&(heaptrace_analyze_opts){.buckets = 5});
+	expect_not_null (strstr (report, "4 threads"));
+	expect_not_null (strstr (report, "80000 allocations"));
+	expect_not_null (strstr (report, "80000 frees"));
+	expect_not_null (strstr (report, "0 B in 0 blocks at the end"));
+	expect_not_null (strstr (report, "(none)"));
+	free (report);
+}
+
+static char reset_heap[4096];
+
+static void *record_other_heap (void *arg)
+{
+	heaptrace_alloc (arg, reset_heap + 2048, 300);
+	return nullptr;
+}
+
+static void test_heaptrace_reset ()
+{
+	heaptrace *t = heaptrace_open (trace_path ());
+	expect_not_null (t);
+	for (int i = 0; i < 10; i++) {
+		heaptrace_alloc (t, reset_heap + i * 64, 50);
+	}
+	heaptrace_free (t, reset_heap, 50);
+
+	/* the other thread's block outlives this thread's reset */
+	pthread_t other;
+	pthread_create (&other, nullptr, record_other_heap, t);
+	pthread_join (other, nullptr);
+	heaptrace_reset (t);
+	heaptrace_alloc (t, reset_heap + 1024, 200);
+	expect (heaptrace_close (t));
+
+	char *report = analyze (nullptr);
+	expect_not_null (strstr (report, "1 heap resets"));
+	expect_not_null (strstr (report, "500 B in 2 blocks at the end"));
+	free (report);
+}
+
+static void test_heaptrace_invalid ()
+{
+	FILE *f = fopen (trace_path (), "w");
+	expect_not_null (f);
+	fputs ("not a heap trace", f);
+	fclose (f);
+	FILE *out = tmpfile ();
+	expect (!heaptrace_analyze (trace_path (), out, nullptr));
+	expect (!heaptrace_analyze ("/nonexistent/app.htrace", out, nullptr));
+	fclose (out);
+	unlink (trace_path ());
+}
+
+void heaptrace_test ()
+{
+	test (test_heaptrace_report);
+	test (test_heaptrace_threads);
+	test (test_heaptrace_reset);
+	test (test_heaptrace_invalid);
+}
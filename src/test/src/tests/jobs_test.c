@@ -0,0 +1,213 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "test.h"
+
+/* poll until job id reaches state (or a few seconds pass) */
+static bool wait_for (console_jobs *jobs, int id, console_job_state state)
+{
+	for (int i = 0; i < 5000; i++) {
+		console_job_info info[64];
+		int n = console_job_list (jobs, info, 64);
+		for (int j = 0; j < n; j++) {
+			if (info[j].id == id && info[j].state == state) {
+				return true;
+			}
+		}
+		usleep (1000);
+	}
+	return false;
+}
+
+static console_job_info job_info (console_jobs *jobs)
+{
+	console_job_info info = {0};
+	console_job_list (jobs, &info, 1);
+	return info;
+}
+
+/* all the output taken so far, appended to *out (the caller frees it) */
+static size_t take_all (console_jobs *jobs, char **out, size_t len)
+{
+	size_t n;
+	char *text = console_jobs_take_output (jobs, &n);
+	if (text == nullptr) return len;
+	*out = realloc (*out, len + n + 1);
+	memcpy (*out + len, text, n);
+	(*out)[len + n] = '\0';
+	free (text);
+	return len + n;
+}
+
+static void print_lines (console_job *job, void *arg)
+{
+	console_job_print (job, "one\ntw");
+	console_job_print (job, "o\n");
+	console_job_print (job, "three");
+}
+
+static void test_jobs_output ()
+{
+	console c = console_new ();
+	console_jobs *jobs = console_jobs_new (c, 2);
+	expect_not_null (jobs);
+
+	int id = console_job_start (jobs, "lines", print_lines, nullptr);
+	expect_eq_int (1, id);
+	expect (wait_for (jobs, id, JOB_DONE));
+
+	/* lines are prefixed with the job id, and the unterminated end is
+	   printed when the job returns */
+	char *out = nullptr;
+	take_all (jobs, &out, 0);
+	expect_not_null (out);
+	const char *expected = "[1] one\n[1] two\n[1] three\n[1] lines: done (";
+	expect_eq_int (0, strncmp (out, expected, strlen (expected)));
+
+	console_job_info info;
+	expect_eq_int (1, console_job_list (jobs, &info, 1));
+	expect_eq_str ("lines", info.name);
+	expect_eq_int (3, (int)info.lines);
+
+	/* nothing more until another job prints */
+	size_t len;
+	expect_null (console_jobs_take_output (jobs, &len));
+	expect_eq_int (0, (int)len);
+	free (out);
+	console_jobs_free (jobs);
+	console_free (c);
+}
+
+static void run_until_cancelled (console_job *job, void *arg)
+{
+	while (!console_job_cancelled (job)) usleep (1000);
+}
+
+static void test_jobs_cancel ()
+{
+	console c = console_new ();
+	console_jobs *jobs = console_jobs_new (c, 1);
+
+	/* one worker: the second job waits for the first */
+	int first = console_job_start (jobs, "first", run_until_cancelled,
+				       nullptr);
+	int second = console_job_start (jobs, "second", run_until_cancelled,
+					nullptr);
+	expect (wait_for (jobs, first, JOB_RUNNING));
+	expect (wait_for (jobs, second, JOB_QUEUED));
+
+	/* -1 is the newest unfinished job: a queued job is cancelled
+	   before it runs */
+	expect (console_job_cancel (jobs, -1));
+	expect (console_job_cancel (jobs, first));
+	expect (wait_for (jobs, first, JOB_CANCELLED));
+	expect (wait_for (jobs, second, JOB_CANCELLED));
+	expect (!console_job_cancel (jobs, first));
+	expect (!console_job_cancel (jobs, 99));
+
+	char *out = nullptr;
+	take_all (jobs, &out, 0);
+	expect_not_null (strstr (out, "[1] first: cancelled"));
+	expect_not_null (strstr (out, "[2] second: cancelled"));
+	free (out);
+	console_jobs_free (jobs);
+	console_free (c);
+}
+
+#define FLOOD_LINES 40000 /* about 1.5 MB, over JOBS_MAX_PENDING */
+
+static void flood (console_job *job, void *arg)
+{
+	for (int i = 0; i < FLOOD_LINES; i++) {
+		console_job_print (job, "line %08d of the flood\n", i);
+	}
+}
+
+static void test_jobs_backpressure ()
+{
+	console c = console_new ();
+	console_jobs *jobs = console_jobs_new (c, 1);
+	expect_eq_int (1, console_job_start (jobs, "flood", flood, nullptr));
+
+	/* until the output is taken, the job waits for it: wait until it
+	   has printed more than that (however slowly it gets to run),
+	   counting the "[1] " each line is prefixed with */
+	size_t line_len = strlen ("[1] line 00000000 of the flood\n");
+	for (int i = 0; i < 5000; i++) {
+		if (job_info (jobs).lines * line_len > JOBS_MAX_PENDING) break;
+		usleep (1000);
+	}
+	expect_eq_int (JOB_RUNNING, job_info (jobs).state);
+	expect (job_info (jobs).lines < FLOOD_LINES);
+
+	char *out = nullptr;
+	size_t len = take_all (jobs, &out, 0);
+	expect (len > JOBS_MAX_PENDING);
+	expect (len < JOBS_MAX_PENDING + 64 * 1024);
+	for (int i = 0; i < 5000 && job_info (jobs).state != JOB_DONE; i++) {
+		len = take_all (jobs, &out, len);
+		usleep (1000);
+	}
+	expect_eq_int (JOB_DONE, job_info (jobs).state);
+	len = take_all (jobs, &out, len);
+
+	/* nothing was dropped */
+	int lines = 0;
+	for (size_t i = 0; i < len; i++) lines += out[i] == '\n';
+	expect_eq_int (FLOOD_LINES + 1, lines);
+	expect_not_null (strstr (out, "line 00039999 of the flood\n"));
+	free (out);
+	console_jobs_free (jobs);
+	console_free (c);
+}
+
+/* freeing the pool cancels the running jobs and waits for them */
+static void test_jobs_free_cancels ()
+{
+	console c = console_new ();
+	console_jobs *jobs = console_jobs_new (c, 2);
+	int a = console_job_start (jobs, "a", run_until_cancelled, nullptr);
+	int b = console_job_start (jobs, "b", run_until_cancelled, nullptr);
+	expect (wait_for (jobs, a, JOB_RUNNING));
+	expect (wait_for (jobs, b, JOB_RUNNING));
+	console_jobs_free (jobs);
+	console_free (c);
+}
+
+void jobs_test ()
+{
+	test (test_jobs_output);
+	test (test_jobs_cancel);
+	test (test_jobs_backpressure);
+	test (test_jobs_free_cancels);
+}
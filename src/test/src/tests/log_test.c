@@ -34,7 +34,55 @@ void test_log ()
 	// panic ("test");
 }
 
+void test_log_rate_limit ()
+{
+	log_site site = {};
+	log_set_rate_limit (3, 1);
+
+	/* a fresh site starts with a full bucket */
+	expect (log_site_admit (&site, LOG_LEVEL_ERROR));
+	expect (log_site_admit (&site, LOG_LEVEL_ERROR));
+	expect (log_site_admit (&site, LOG_LEVEL_ERROR));
+
+	/* then drops and counts messages until the bucket refills */
+	expect_false (log_site_admit (&site, LOG_LEVEL_ERROR));
+	expect_false (log_site_admit (&site, LOG_LEVEL_ERROR));
+	expect_eq_int (2, site.suppressed);
+
+	/* a rate of 0 disables rate limiting */
+	log_set_rate_limit (3, 0);
+	expect (log_site_admit (&site, LOG_LEVEL_ERROR));
+
+	log_set_rate_limit (LOG_RATE_BURST, LOG_RATE_PER_SEC);
+}
+
+void test_log_sampling ()
+{
+	log_site debug_site = {};
+	log_site error_site = {};
+	log_set_sampling (4);
+
+	/* debug and trace sites keep 1 in every 4 messages */
+	int admitted = 0;
+	for (int i = 0; i < 8; i++) {
+		if (log_site_admit (&debug_site, LOG_LEVEL_DEBUG)) admitted++;
+	}
+	expect_eq_int (2, admitted);
+	expect_eq_int (0, debug_site.suppressed);
+
+	/* other levels are not sampled */
+	admitted = 0;
+	for (int i = 0; i < 8; i++) {
+		if (log_site_admit (&error_site, LOG_LEVEL_ERROR)) admitted++;
+	}
+	expect_eq_int (8, admitted);
+
+	log_set_sampling (LOG_SAMPLE_EVERY);
+}
+
 void log_test ()
 {
 	test (test_log);
+	test (test_log_rate_limit);
+	test (test_log_sampling);
 }
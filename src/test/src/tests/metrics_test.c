@@ -0,0 +1,144 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "test.h"
+
+/* a segment of the test's own */
+static const char *segment_name ()
+{
+	static char name[64];
+	snprintf (name, sizeof (name), "/ptkltest-metrics-%d", (int)getpid ());
+	return name;
+}
+
+static void test_metrics_buckets ()
+{
+	for (uint64_t us = 0; us < 100000; us += 7) {
+		int b = metrics_bucket (us);
+		expect (metrics_bucket_floor (b) <= us);
+		expect (us < metrics_bucket_floor (b + 1));
+	}
+	expect_eq_int (3, metrics_bucket (3));
+	expect_eq_int (4, metrics_bucket (4));
+	expect_eq_int (8, metrics_bucket (8));
+	expect_eq_int (METRICS_BUCKETS - 1, metrics_bucket (UINT64_MAX));
+
+	uint64_t latency[METRICS_BUCKETS] = {0};
+	expect_eq_int (0, (int)metrics_percentile (latency, 0.5));
+	for (uint64_t us = 1; us <= 100; us++) latency[metrics_bucket (us)]++;
+	uint64_t p50 = metrics_percentile (latency, 0.5);
+	uint64_t p99 = metrics_percentile (latency, 0.99);
+	expect (p50 >= 50 && p50 < 64);
+	expect (p99 >= 99 && p99 < 112);
+	uint64_t max = metrics_percentile (latency, 1.0);
+	expect (max >= 100 && max < 112);
+}
+
+static void test_metrics_publish ()
+{
+	const char *name = segment_name ();
+	shm_unlink (name);
+	expect_null (metrics_open (name));
+
+	metrics_publisher *api = metrics_publish (name, "api");
+	metrics_publisher *jobs = metrics_publish (name, "jobs");
+	expect_not_null (api);
+	expect_not_null (jobs);
+
+	for (int i = 0; i < 1000; i++) metrics_request (api, 1000 * i, i % 10);
+	metrics_set (api, METRIC_QUEUE_DEPTH, 7);
+	metrics_sample_rss (jobs);
+
+	metrics_reader *r = metrics_open (name);
+	expect_not_null (r);
+	metrics_snapshot snaps[4];
+	expect_eq_int (2, metrics_read (r, snaps, 4));
+	expect_eq_str ("api", snaps[0].service);
+	expect_eq_int ((int)getpid (), snaps[0].pid);
+	expect_eq_int (1000, (int)snaps[0].requests);
+	expect_eq_int (100, (int)snaps[0].errors);
+	expect_eq_int (7, (int)snaps[0].gauges[METRIC_QUEUE_DEPTH]);
+	uint64_t p50 = metrics_percentile (snaps[0].latency, 0.5);
+	expect (p50 >= 499 && p50 < 640);
+	expect_eq_str ("jobs", snaps[1].service);
+	expect (snaps[1].gauges[METRIC_RSS] > 0);
+
+	/* an unpublished slot disappears, and is reused */
+	metrics_unpublish (api);
+	expect_eq_int (1, metrics_read (r, snaps, 4));
+	expect_eq_str ("jobs", snaps[0].service);
+	api = metrics_publish (name, "api2");
+	expect_eq_int (2, metrics_read (r, snaps, 4));
+	expect_eq_str ("api2", snaps[0].service);
+	expect_eq_int (0, (int)snaps[0].requests);
+
+	metrics_close (r);
+	metrics_unpublish (api);
+	metrics_unpublish (jobs);
+	shm_unlink (name);
+}
+
+/* a process that exits without unpublishing doesn't keep its slot */
+static void test_metrics_reclaim ()
+{
+	const char *name = segment_name ();
+	shm_unlink (name);
+	pid_t child = fork ();
+	if (child == 0) {
+		metrics_publish (name, "crashed");
+		_exit (0);
+	}
+	expect_eq_int (child, waitpid (child, nullptr, 0));
+
+	metrics_reader *r = metrics_open (name);
+	expect_not_null (r);
+	metrics_snapshot snaps[METRICS_SLOTS];
+	expect_eq_int (0, metrics_read (r, snaps, METRICS_SLOTS));
+
+	metrics_publisher *m[METRICS_SLOTS];
+	for (int i = 0; i < METRICS_SLOTS; i++) {
+		m[i] = metrics_publish (name, "api");
+		expect_not_null (m[i]);
+	}
+	expect_eq_int (METRICS_SLOTS, metrics_read (r, snaps, METRICS_SLOTS));
+	for (int i = 0; i < METRICS_SLOTS; i++) metrics_unpublish (m[i]);
+	metrics_close (r);
+	shm_unlink (name);
+}
+
+void metrics_test ()
+{
+	test (test_metrics_buckets);
+	test (test_metrics_publish);
+	test (test_metrics_reclaim);
+}
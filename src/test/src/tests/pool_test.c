@@ -0,0 +1,155 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "qjs.h"
+#include "test.h"
+
+/* The app's top level: globals a request must leave as they are */
+static const char app[] = "globalThis.count = 1;\n"
+			  "globalThis.nan = NaN;\n"
+			  "globalThis.zero = -0;\n"
+			  "globalThis.big = 1n << 40n;\n";
+
+static bool warm (engine *e, void *arg)
+{
+	const char *src = arg;
+	return engine_eval_buf (e, src, strlen (src), "app.js", false);
+}
+
+static bool run (engine *e, const char *src)
+{
+	return engine_eval_buf (e, src, strlen (src), "request.js", false);
+}
+
+static engine_pool *new_pool (size_t size)
+{
+	engine_pool_opts opts = {
+		.engine = ENGINE_OPTS_DEFAULT,
+		.size = size,
+		.warm = warm,
+		.warm_arg = (void *)app,
+	};
+	opts.engine.std_modules = false;
+	return engine_pool_new (&opts);
+}
+
+static void test_pool_acquire_release ()
+{
+	engine_pool *pool = new_pool (2);
+	expect_not_null (pool);
+	engine *a = engine_pool_acquire (pool);
+	engine *b = engine_pool_acquire (pool);
+	expect_not_null (a);
+	expect_not_null (b);
+	expect (a != b);
+	engine_pool_release (pool, a, true);
+	engine_pool_release (pool, b, true);
+
+	/* most recently released first */
+	engine *c = engine_pool_acquire (pool);
+	expect (c == b);
+	engine_pool_release (pool, c, true);
+
+	engine_pool_stats stats;
+	engine_pool_get_stats (pool, &stats);
+	expect_eq_int (3, (int)stats.acquired);
+	expect_eq_int (2, (int)stats.created);
+	expect_eq_int (0, (int)stats.discarded);
+	expect_eq_int (0, (int)stats.waited);
+
+	/* a failed run's engine is replaced */
+	c = engine_pool_acquire (pool);
+	engine_pool_release (pool, c, false);
+	engine_pool_get_stats (pool, &stats);
+	expect_eq_int (1, (int)stats.discarded);
+	expect_eq_int (3, (int)stats.created);
+	engine_pool_free (pool);
+}
+
+static void test_pool_scrub ()
+{
+	engine_pool *pool = new_pool (1);
+	expect_not_null (pool);
+	engine *e = engine_pool_acquire (pool);
+	expect (run (e, "globalThis.leaked = count + 1;"));
+	engine_pool_release (pool, e, true);
+
+	e = engine_pool_acquire (pool);
+	expect (run (e, "if (typeof leaked !== 'undefined') throw 1;"));
+	expect (run (e, "if (count !== 1) throw 1;"));
+
+	/* assigning a snapshot global its own value isn't a change */
+	expect (run (e, "nan = NaN; zero = -0; big = 1n << 40n;"));
+	engine_pool_release (pool, e, true);
+
+	engine_pool_stats stats;
+	engine_pool_get_stats (pool, &stats);
+	expect_eq_int (0, (int)stats.discarded);
+	expect_eq_int (1, (int)stats.created);
+	engine_pool_free (pool);
+}
+
+static void test_pool_scrub_refuses_changed_globals ()
+{
+	/* 0 isn't -0, and a short bigint differing above bit 31 is new */
+	const char *changes[] = {
+		"count = 2;",
+		"zero = 0;",
+		"big = 1n << 41n;",
+		"nan = 0;",
+		"delete globalThis.count;",
+	};
+	for (size_t i = 0; i < sizeof (changes) / sizeof (*changes); i++) {
+		engine_pool *pool = new_pool (1);
+		expect_not_null (pool);
+		engine *e = engine_pool_acquire (pool);
+		expect (run (e, changes[i]));
+		engine_pool_release (pool, e, true);
+
+		engine_pool_stats stats;
+		engine_pool_get_stats (pool, &stats);
+		expect_eq_int (1, (int)stats.discarded);
+		expect_eq_int (2, (int)stats.created);
+
+		/* the replacement has the app's values */
+		e = engine_pool_acquire (pool);
+		expect_not_null (e);
+		expect (run (e, "if (count !== 1 || !Object.is (zero, -0)) "
+				"throw 1;"));
+		engine_pool_release (pool, e, true);
+		engine_pool_free (pool);
+	}
+}
+
+void pool_test ()
+{
+	test (test_pool_acquire_release);
+	test (test_pool_scrub);
+	test (test_pool_scrub_refuses_changed_globals);
+}
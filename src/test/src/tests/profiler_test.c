@@ -0,0 +1,93 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "profiler.h"
+#include "test.h"
+
+static volatile double sink;
+
+static void busy_loop ()
+{
+	for (long i = 0; i < 50000000; i++) sink += (double)i * 0.5;
+}
+
+void test_profiler_samples ()
+{
+	expect (profiler_start (PROFILER_DEFAULT_HZ));
+	expect (profiler_running ());
+	expect_false (profiler_start (PROFILER_DEFAULT_HZ));
+
+	busy_loop ();
+
+	profiler_stop ();
+	expect_false (profiler_running ());
+
+	FILE *f = tmpfile ();
+	expect_not_null (f);
+	size_t samples = profiler_write_folded (f);
+	expect (samples > 0);
+
+	/* folded format: "frame;frame;... count" */
+	char line[4096];
+	rewind (f);
+	expect_not_null (fgets (line, sizeof (line), f));
+	expect_not_null (strrchr (line, ' '));
+	fclose (f);
+
+	/* reset discards aggregated samples */
+	profiler_reset ();
+	f = tmpfile ();
+	expect_eq_int (0, profiler_write_folded (f));
+	fclose (f);
+}
+
+static void *register_thread (void *arg)
+{
+	*(bool *)arg = profiler_register_thread ();
+	return nullptr;
+}
+
+/* an exiting thread frees its slot (there are 64) */
+void test_profiler_thread_exit ()
+{
+	for (int i = 0; i < 200; i++) {
+		pthread_t thread;
+		bool registered = false;
+		expect_eq_int (0, pthread_create (&thread, nullptr,
+						  register_thread, &registered));
+		pthread_join (thread, nullptr);
+		expect (registered);
+	}
+}
+
+void profiler_test ()
+{
+	test (test_profiler_samples);
+	test (test_profiler_thread_exit);
+}
@@ -0,0 +1,131 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "scrollback.h"
+#include "test.h"
+
+/* expect line n to be text */
+static void expect_line (scrollback *sb, uint64_t n, const char *text)
+{
+	size_t len = 0;
+	const char *line = scrollback_line (sb, n, &len);
+	expect_not_null (line);
+	if (line == nullptr) return;
+	char buf[256];
+	snprintf (buf, sizeof (buf), "%.*s", (int)len, line);
+	expect_eq_str (text, buf);
+}
+
+static void test_scrollback_lines ()
+{
+	scrollback *sb = scrollback_new (1024, 16);
+	expect_eq_int (0, (int)scrollback_end (sb));
+
+	scrollback_append (sb, "one\ntwo\r\nth", 11);
+	expect_eq_int (0, (int)scrollback_first (sb));
+	expect_eq_int (3, (int)scrollback_end (sb));
+	expect_line (sb, 0, "one");
+	expect_line (sb, 1, "two");
+
+	/* an unterminated line is the last line until it's ended */
+	expect_line (sb, 2, "th");
+	scrollback_append (sb, "ree\n\n", 5);
+	expect_eq_int (4, (int)scrollback_end (sb));
+	expect_line (sb, 2, "three");
+	expect_line (sb, 3, "");
+
+	size_t len;
+	expect_null (scrollback_line (sb, 4, &len));
+
+	/* line numbers keep counting after a clear */
+	scrollback_clear (sb);
+	expect_eq_int (4, (int)scrollback_first (sb));
+	expect_eq_int (4, (int)scrollback_end (sb));
+	expect_null (scrollback_line (sb, 0, &len));
+	scrollback_append (sb, "four\n", 5);
+	expect_line (sb, 4, "four");
+	scrollback_free (sb);
+}
+
+static void test_scrollback_bounded ()
+{
+	/* at most 8 lines, and 64 bytes of text */
+	scrollback *sb = scrollback_new (64, 8);
+	char line[32];
+	for (int i = 0; i < 100; i++) {
+		int len = snprintf (line, sizeof (line), "line %d\n", i);
+		scrollback_append (sb, line, len);
+	}
+	expect_eq_int (100, (int)scrollback_end (sb));
+	expect_eq_int (92, (int)scrollback_first (sb));
+	expect_line (sb, 92, "line 92");
+	expect_line (sb, 99, "line 99");
+
+	/* long lines drop more of the oldest to make room */
+	scrollback_append (sb, "0123456789012345678901234567890123456789\n",
+			   41);
+	expect_line (sb, 100, "0123456789012345678901234567890123456789");
+	expect_line (sb, 99, "line 99");
+	expect (scrollback_first (sb) > 93);
+	size_t len;
+	expect_null (scrollback_line (sb, 92, &len));
+
+	/* lines longer than the arena are truncated */
+	char big[100];
+	memset (big, 'x', sizeof (big));
+	scrollback_append (sb, big, sizeof (big));
+	scrollback_append (sb, "\n", 1);
+	scrollback_line (sb, 101, &len);
+	expect_eq_int (64, (int)len);
+	expect_eq_int (101, (int)scrollback_first (sb));
+	scrollback_free (sb);
+}
+
+static void test_scrollback_find ()
+{
+	scrollback *sb = scrollback_new (1024, 16);
+	const char *text = "alpha\nbeta\ngamma\nalphabet\ndelta";
+	scrollback_append (sb, text, strlen (text));
+
+	expect_eq_int (3, (int)scrollback_find (sb, "alpha", 4, true));
+	expect_eq_int (0, (int)scrollback_find (sb, "alpha", 2, true));
+	expect_eq_int (3, (int)scrollback_find (sb, "alpha", 1, false));
+	expect_eq_int (4, (int)scrollback_find (sb, "elt", 0, false));
+	expect_eq_int (1, (int)scrollback_find (sb, "bet", 2, true));
+	expect_eq_int (-1, (int)scrollback_find (sb, "omega", 4, true));
+	expect_eq_int (-1, (int)scrollback_find (sb, "delta", 3, true));
+	scrollback_free (sb);
+}
+
+void scrollback_test ()
+{
+	test (test_scrollback_lines);
+	test (test_scrollback_bounded);
+	test (test_scrollback_find);
+}
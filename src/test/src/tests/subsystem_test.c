@@ -0,0 +1,192 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "subsystem.h"
+#include "test.h"
+
+static int init_calls;
+static int teardown_calls;
+static char teardown_order[8];
+
+static bool count_init ()
+{
+	init_calls++;
+	return true;
+}
+
+static bool fail_init ()
+{
+	init_calls++;
+	return false;
+}
+
+static void test_subsystem_once ()
+{
+	static subsystem s = SUBSYSTEM ("once", count_init, nullptr);
+	init_calls = 0;
+
+	expect_false (subsystem_ready (&s));
+	expect (subsystem_use (&s));
+	expect (subsystem_use (&s));
+	expect (subsystem_ready (&s));
+	expect_eq_int (1, init_calls);
+
+	/* torn down subsystems initialize again on next use */
+	subsystem_teardown_all ();
+	expect_false (subsystem_ready (&s));
+	expect (subsystem_use (&s));
+	expect_eq_int (2, init_calls);
+	subsystem_teardown_all ();
+}
+
+static void test_subsystem_failed ()
+{
+	static subsystem s = SUBSYSTEM ("failing", fail_init, nullptr);
+	init_calls = 0;
+
+	/* a failed init isn't retried */
+	expect_false (subsystem_use (&s));
+	expect_false (subsystem_use (&s));
+	expect_eq_int (1, init_calls);
+	expect_false (subsystem_ready (&s));
+}
+
+/* a uses b, and b uses c */
+
+static void teardown_a ()
+{
+	teardown_order[teardown_calls++] = 'a';
+}
+
+static void teardown_b ()
+{
+	teardown_order[teardown_calls++] = 'b';
+}
+
+static void teardown_c ()
+{
+	teardown_order[teardown_calls++] = 'c';
+}
+
+static subsystem c = SUBSYSTEM ("c", count_init, teardown_c);
+
+static bool init_b ()
+{
+	return subsystem_use (&c);
+}
+
+static subsystem b = SUBSYSTEM ("b", init_b, teardown_b);
+
+static bool init_a ()
+{
+	usleep (1000);
+	return subsystem_use (&b);
+}
+
+static subsystem a = SUBSYSTEM ("a", init_a, teardown_a);
+
+static void test_subsystem_dependencies ()
+{
+	init_calls = 0;
+	teardown_calls = 0;
+	subsystem_reset_trace ();
+
+	expect (subsystem_use (&a));
+	expect (subsystem_ready (&b));
+	expect (subsystem_ready (&c));
+	expect_eq_int (1, init_calls);
+
+	/* the trace is in the order inits started, nested by dependency */
+	expect_eq_int (3, (int)subsystem_trace_count ());
+	subsystem_trace_entry ta, tb, tc, none;
+	expect (subsystem_trace_get (0, &ta));
+	expect (subsystem_trace_get (1, &tb));
+	expect (subsystem_trace_get (2, &tc));
+	expect_eq_str ("a", ta.name);
+	expect_eq_str ("b", tb.name);
+	expect_eq_str ("c", tc.name);
+	expect_eq_int (0, ta.depth);
+	expect_eq_int (2, tc.depth);
+	expect (ta.duration_ns >= 1000000);
+	expect (ta.self_ns >= 1000000);
+	expect (ta.duration_ns == ta.self_ns + tb.duration_ns);
+	expect_false (subsystem_trace_get (3, &none));
+
+	/* dependents are torn down before their dependencies */
+	subsystem_teardown_all ();
+	expect_eq_int (3, teardown_calls);
+	expect (memcmp ("abc", teardown_order, 3) == 0);
+	subsystem_reset_trace ();
+}
+
+/* threads race to use a subsystem with a slow init */
+
+#define THREADS 8
+
+static atomic_int slow_init_calls;
+
+static bool slow_init ()
+{
+	atomic_fetch_add (&slow_init_calls, 1);
+	usleep (10000);
+	return true;
+}
+
+static subsystem slow = SUBSYSTEM ("slow", slow_init, nullptr);
+
+static void *use_slow (void *arg)
+{
+	*(bool *)arg = subsystem_use (&slow);
+	return nullptr;
+}
+
+static void test_subsystem_threads ()
+{
+	pthread_t threads[THREADS];
+	bool results[THREADS] = {};
+	for (int i = 0; i < THREADS; i++) {
+		pthread_create (&threads[i], nullptr, use_slow, &results[i]);
+	}
+	for (int i = 0; i < THREADS; i++) {
+		pthread_join (threads[i], nullptr);
+		expect (results[i]);
+	}
+	expect_eq_int (1, atomic_load (&slow_init_calls));
+	subsystem_teardown_all ();
+	subsystem_reset_trace ();
+}
+
+void subsystem_test ()
+{
+	test (test_subsystem_once);
+	test (test_subsystem_failed);
+	test (test_subsystem_dependencies);
+	test (test_subsystem_threads);
+}
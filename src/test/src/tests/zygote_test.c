@@ -0,0 +1,201 @@
+/*
+ * Unit tests for Partikle Runtime
+ *
+ * MIT License
+ *
+ * Copyright (c) 2025 Tony Pujals
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "zygote.h"
+
+static int exit_with_index (int index, void *arg)
+{
+	return 3 + index;
+}
+
+static int wait_for_signal (int index, void *arg)
+{
+	pause ();
+	return 0;
+}
+
+/* a worker that stops the zygote after a while, then waits */
+static int stop_zygote (int index, void *arg)
+{
+	usleep (200000);
+	kill (getppid (), SIGTERM);
+	pause ();
+	return 0;
+}
+
+static void count_prefork (void *arg)
+{
+	(*(int *)arg)++;
+}
+
+/* reap until count workers exited (or a few seconds passed) */
+static size_t reap_all (zygote *z, zygote_worker *out, size_t count)
+{
+	size_t n = 0;
+	for (int i = 0; i < 300 && n < count; i++) {
+		n += zygote_reap (z, out + n, count - n);
+		if (n < count) usleep (10000);
+	}
+	return n;
+}
+
+static void test_zygote_spawn_reap ()
+{
+	int preforks = 0;
+	zygote_opts opts = {
+		.worker = exit_with_index,
+		.prefork = count_prefork,
+		.arg = &preforks,
+	};
+	zygote *z = zygote_new (&opts);
+
+	for (int i = 0; i < 3; i++) {
+		uint64_t ns = 0;
+		expect (zygote_spawn (z, &ns) > 0);
+		expect (ns > 0);
+	}
+	expect_eq_int (3, preforks);
+
+	zygote_worker exited[3];
+	expect_eq_int (3, (int)reap_all (z, exited, 3));
+	for (int i = 0; i < 3; i++) {
+		expect (WIFEXITED (exited[i].status));
+		expect_eq_int (3 + exited[i].index,
+			       WEXITSTATUS (exited[i].status));
+	}
+	zygote_worker running[1];
+	expect_eq_int (0, (int)zygote_workers (z, running, 1));
+	zygote_free (z);
+}
+
+static void test_zygote_kill ()
+{
+	zygote_opts opts = {.worker = wait_for_signal, .max_workers = 1};
+	zygote *z = zygote_new (&opts);
+
+	pid_t pid = zygote_spawn (z, nullptr);
+	expect (pid > 0);
+	expect_eq_int (-1, (int)zygote_spawn (z, nullptr));
+	expect (!zygote_kill (z, pid + 100000));
+	expect (zygote_kill (z, pid));
+
+	zygote_worker w;
+	expect_eq_int (1, (int)reap_all (z, &w, 1));
+	expect_eq_int ((int)pid, (int)w.pid);
+	expect (WIFSIGNALED (w.status));
+	expect_eq_int (SIGTERM, WTERMSIG (w.status));
+	zygote_free (z);
+}
+
+static void test_zygote_memory ()
+{
+	zygote_memory m;
+	expect (zygote_read_memory (getpid (), &m));
+	expect (m.rss > 0);
+	expect (m.shared + m.private <= m.rss);
+	expect (!zygote_read_memory (-1, &m));
+}
+
+static void test_zygote_serve ()
+{
+	zygote_opts opts = {.worker = wait_for_signal};
+	zygote *z = zygote_new (&opts);
+
+	int in[2], out[2];
+	expect_eq_int (0, pipe (in));
+	expect_eq_int (0, pipe (out));
+	const char *commands = "spawn 2\nlist\nkill 0\nbogus\nquit\n";
+	expect_eq_int ((int)strlen (commands),
+		       (int)write (in[1], commands, strlen (commands)));
+	close (in[1]);
+
+	expect (zygote_serve (z, in[0], out[1]));
+	close (out[1]);
+	char buf[4096];
+	ssize_t n = read (out[0], buf, sizeof (buf) - 1);
+	expect (n > 0);
+	buf[n > 0 ? n : 0] = '\0';
+
+	expect_not_null (strstr (buf, "spawned "));
+	expect_not_null (strstr (buf, "worker "));
+	expect_not_null (strstr (buf, "error: no worker 0\n"));
+	expect_not_null (strstr (buf, "error: unknown command: bogus\n"));
+	expect_not_null (strstr (buf, "bye\n"));
+
+	/* quit terminated the workers */
+	zygote_worker running[2];
+	expect_eq_int (0, (int)zygote_workers (z, running, 2));
+	close (in[0]);
+	close (out[0]);
+	zygote_free (z);
+}
+
+static void test_zygote_serve_eof ()
+{
+	zygote_opts opts = {.worker = stop_zygote};
+	zygote *z = zygote_new (&opts);
+
+	int in[2], out[2];
+	expect_eq_int (0, pipe (in));
+	expect_eq_int (0, pipe (out));
+	const char *commands = "spawn\n";
+	expect_eq_int ((int)strlen (commands),
+		       (int)write (in[1], commands, strlen (commands)));
+	close (in[1]);
+
+	/* The end of input doesn't stop serving: the worker's SIGTERM does */
+	struct timespec start, end;
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	expect (zygote_serve (z, in[0], out[1]));
+	clock_gettime (CLOCK_MONOTONIC, &end);
+	long ms = (end.tv_sec - start.tv_sec) * 1000 +
+		  (end.tv_nsec - start.tv_nsec) / 1000000;
+	expect (ms >= 150);
+
+	/* and the worker is still running until the zygote is freed */
+	zygote_worker running[1];
+	expect_eq_int (1, (int)zygote_workers (z, running, 1));
+	close (in[0]);
+	close (out[0]);
+	close (out[1]);
+	zygote_free (z);
+}
+
+void zygote_test ()
+{
+	test (test_zygote_spawn_reap);
+	test (test_zygote_kill);
+	test (test_zygote_memory);
+	test (test_zygote_serve);
+	test (test_zygote_serve_eof);
+}